@@ -3,7 +3,14 @@ import toml
 from pathlib import Path
 from typing import Optional, Mapping, List, Dict
 from camera_zwo_asi import bindings
-from camera_zwo_asi.bindings import Controllable, Camera, get_nb_cameras
+from camera_zwo_asi.bindings import (
+    Controllable,
+    Camera,
+    get_nb_cameras,
+    find_camera_by_serial,
+    find_camera_by_id,
+    find_camera_by_name,
+)
 from .roi import ROI
 from .image import Image
 
@@ -20,12 +27,61 @@ class Camera(bindings.Camera):
     """
 
     def __init__(self, index: int) -> None:
-
-        # no idea why, camera may not be detected if this is not
-        # called first
-        nb_detected_cams = get_nb_cameras()
+        # cameras are enumerated once (and cached) by the
+        # native side, no need to call get_nb_cameras first
         super().__init__(index)
 
+    @classmethod
+    def _from_index(cls, index: int, description: str) -> "Camera":
+        if index < 0:
+            raise ValueError(f"failed to find a camera with {description}")
+        return cls(index)
+
+    @classmethod
+    def _from_identity(
+        cls,
+        find: typing.Callable[[str], int],
+        get: typing.Callable[["Camera"], str],
+        value: str,
+        description: str,
+    ) -> "Camera":
+        # the camera is found from the cached identities, which are checked
+        # against the identity read once the camera is opened: if cameras
+        # swapped their indexes, the cache has been dropped and the camera
+        # is looked up again
+        for _ in range(2):
+            camera = cls._from_index(find(value), description)
+            if get(camera) == value:
+                return camera
+            del camera
+        raise ValueError(f"failed to find a camera with {description}")
+
+    @classmethod
+    def from_serial(cls, serial: str) -> "Camera":
+        """
+        Open the camera with the given serial number (as returned by
+        Camera.get_serial), independently of its index.
+        """
+        return cls._from_identity(
+            find_camera_by_serial, cls.get_serial, serial, f"serial {serial}"
+        )
+
+    @classmethod
+    def from_id(cls, id_: str) -> "Camera":
+        """
+        Open the camera with the given id (up to 8 characters, as
+        set by Camera.set_id and stored in the camera), independently
+        of its index.
+        """
+        return cls._from_identity(find_camera_by_id, cls.get_id, id_, f"id {id_}")
+
+    @classmethod
+    def from_name(cls, name: str) -> "Camera":
+        """
+        Open the first camera with the given name (e.g. "ZWO ASI294MC Pro").
+        """
+        return cls._from_index(find_camera_by_name(name), f"name {name}")
+
     def set_control(self, controllable: str, value: typing.Union[int, str]) -> None:
         """
         Set the value of the controllable.
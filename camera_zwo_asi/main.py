@@ -3,10 +3,24 @@ console scripts
 """
 
 import os
+import time
 import argparse
 from pathlib import Path
 from .camera import Camera
-from camera_zwo_asi.bindings import get_nb_cameras, create_udev_file
+from camera_zwo_asi.bindings import (
+    get_nb_cameras,
+    create_udev_file,
+    get_system_diagnostics,
+    BenchmarkOptions,
+    calibrate as calibrate_camera,
+    AllSky,
+    AllSkyOptions,
+    KeogramOptions,
+    KeogramStage,
+    StartrailOptions,
+    StartrailStage,
+)
+from .image import get_image
 
 _CONFIG_FILE = "zwo_asi.toml"
 
@@ -36,6 +50,18 @@ def print_():
         print(camera)
 
 
+def diagnostics():
+    """
+    print to the console the usbfs memory limit and, for each
+    connected camera, the usb speed and the maximum frame rate,
+    with warnings about host misconfigurations
+    """
+    d = get_system_diagnostics()
+    print(d)
+    if not d.ok():
+        print("issues detected, frames may be dropped")
+
+
 def _shot():
     parser = argparse.ArgumentParser("take pictures with a ZWO-ASI camera")
 
@@ -150,3 +176,192 @@ def dump():
     camera.to_toml(path)
 
     print(f"configuration saved to {path}")
+
+
+def calibrate():
+    """
+    Sweep the HighSpeedMode and BandWidth controls and the image types
+    in video mode, and save the best settings for this camera model and
+    host (used by camera_zwo_asi.apply_cached_profile)
+    """
+
+    parser = argparse.ArgumentParser()
+
+    # if several cameras are plugged, which to use ?
+    parser.add_argument(
+        "--index",
+        type=int,
+        required=False,
+        help="index of the camera to use (0 if not specified)",
+    )
+
+    # duration of the measurement, for each setting
+    parser.add_argument(
+        "--duration",
+        type=int,
+        required=False,
+        default=2000,
+        help="duration (ms) of the measurement for each setting (default: 2000)",
+    )
+
+    args = parser.parse_args()
+
+    # opening the camera
+    if args.index:
+        index = args.index
+    else:
+        index = 0
+    camera = Camera(index)
+
+    # configuring from the toml file of the current directory, if any,
+    # as the results depend on the roi and exposure
+    path = Path(os.getcwd()) / _CONFIG_FILE
+    if path.is_file():
+        camera.configure_from_toml(path)
+
+    options = BenchmarkOptions()
+    options.duration_ms = args.duration
+    for profile in calibrate_camera(camera, options):
+        print(profile)
+
+
+def _save_sky_products(
+    folder: Path, night: str, keogram: KeogramStage, startrails: StartrailStage
+) -> None:
+    """
+    Saves the keogram and the startrails (if they have frames) as
+    keogram_<night>.png and startrails_<night>.png
+    """
+    for name, stage in (("keogram", keogram), ("startrails", startrails)):
+        if stage.get_nb_frames() == 0:
+            continue
+        frame = stage.get_image()
+        image = get_image(frame.type, frame.width, frame.height)
+        image.get_data()[:] = frame.get_data()
+        path = folder / f"{name}_{night}.png"
+        image.save(path)
+        print(f"saved {path}")
+
+
+def allsky():
+    """
+    All-sky monitoring: takes pictures until interrupted, with exposure
+    and gain depending on the altitude of the sun, and saves them as
+    timelapse frames (the latest one also as latest.pgm). The keogram and
+    the startrails of each night are saved at dawn (and on exit)
+    """
+
+    parser = argparse.ArgumentParser()
+
+    # if several cameras are plugged, which to use ?
+    parser.add_argument(
+        "--index",
+        type=int,
+        required=False,
+        help="index of the camera to use (0 if not specified)",
+    )
+
+    # location, for the altitude of the sun
+    parser.add_argument(
+        "--latitude", type=float, required=True, help="latitude (degrees)"
+    )
+    parser.add_argument(
+        "--longitude",
+        type=float,
+        required=True,
+        help="longitude (degrees, positive east)",
+    )
+
+    # where the timelapse frames are saved
+    parser.add_argument(
+        "--folder",
+        type=str,
+        required=False,
+        default=os.getcwd(),
+        help=(
+            "folder of the timelapse frames, keograms and startrails "
+            "(default: current directory)"
+        ),
+    )
+
+    parser.add_argument(
+        "--scale",
+        type=int,
+        required=False,
+        default=1,
+        help="the timelapse frames are downscaled by this factor (default: 1)",
+    )
+
+    args = parser.parse_args()
+
+    # opening the camera
+    if args.index:
+        index = args.index
+    else:
+        index = 0
+    camera = Camera(index)
+
+    # configuring from the toml file of the current directory, if any
+    # (e.g. roi and image type)
+    path = Path(os.getcwd()) / _CONFIG_FILE
+    if path.is_file():
+        camera.configure_from_toml(path)
+
+    folder = Path(args.folder)
+    options = AllSkyOptions()
+    options.latitude_deg = args.latitude
+    options.longitude_deg = args.longitude
+    options.folder = folder
+    options.timelapse_scale = args.scale
+    allsky_ = AllSky(camera, options)
+
+    # keogram and startrails, checkpointed in the folder so that they
+    # resume after a restart
+    roi = camera.get_roi()
+    keogram_options = KeogramOptions()
+    keogram_options.checkpoint = folder / "keogram.checkpoint"
+    keogram_options.checkpoint_interval = 10
+    keogram = KeogramStage(roi.width, roi.height, roi.type, keogram_options)
+    startrail_options = StartrailOptions()
+    startrail_options.checkpoint = folder / "startrails.checkpoint"
+    startrail_options.checkpoint_interval = 10
+    startrails = StartrailStage(
+        roi.width, roi.height, roi.type, startrail_options
+    )
+    # the first phase is the day: the startrails are of the other
+    # phases, and the products of the night are saved when the day
+    # starts again (dawn)
+    day = options.phases[0].name
+    allsky_.add_stage(keogram)
+    allsky_.add_stage(
+        startrails, phases=[phase.name for phase in options.phases[1:]]
+    )
+    last_phase = None
+
+    def _night(unix_s: float) -> str:
+        # date of the evening the night started
+        return time.strftime("%Y-%m-%d", time.localtime(unix_s - 12 * 3600))
+
+    def _on_frame(info) -> None:
+        nonlocal last_phase
+        print(info)
+        if info.phase == day and last_phase not in (None, day):
+            _save_sky_products(folder, _night(info.unix_s), keogram, startrails)
+            for stage, checkpoint in (
+                (keogram, keogram_options.checkpoint),
+                (startrails, startrail_options.checkpoint),
+            ):
+                stage.reset()
+                checkpoint.unlink(missing_ok=True)
+        last_phase = info.phase
+
+    allsky_.set_callback(_on_frame)
+    print(f"saving frames to {args.folder}, ctrl-c to exit")
+    try:
+        # failed frames are retried by run (e.g. the camera may be
+        # reconnected). ctrl-c stops it.
+        allsky_.run()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        _save_sky_products(folder, _night(time.time()), keogram, startrails)
@@ -0,0 +1,164 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "zwo_asi/camera.hpp"
+#include "zwo_asi/pipeline.hpp"
+
+namespace zwo_asi
+{
+// Altitude of the center of the sun above the horizon (degrees), at the
+// location (degrees, longitude positive east), ignoring the refraction.
+// Accurate to about 0.5 degree.
+double get_solar_altitude(double latitude_deg,
+                          double longitude_deg,
+                          std::chrono::system_clock::time_point time);
+
+// Acquisition settings while the sun is above min_sun_altitude_deg (and
+// below the min_sun_altitude_deg of the next phase)
+class AllSkyPhase
+{
+public:
+    AllSkyPhase(std::string name,
+                double min_sun_altitude_deg,
+                long gain,
+                long min_exposure_us,
+                long max_exposure_us,
+                double interval_s);
+
+public:
+    std::string name;
+    double min_sun_altitude_deg;
+    long gain;
+    // range of the auto exposure
+    long min_exposure_us;
+    long max_exposure_us;
+    // between the starts of two frames (frames are captured back to back
+    // if the exposure is longer)
+    double interval_s;
+};
+
+class AllSkyOptions
+{
+public:
+    AllSkyOptions();
+
+public:
+    double latitude_deg;
+    double longitude_deg;
+    // default: day (sun above -6 degrees), twilight (above -12 degrees)
+    // and night
+    std::vector<AllSkyPhase> phases;
+    // auto exposure: the exposure of the next frame is adjusted so that
+    // the mean of the frame is target_mean (fraction of the maximum pixel
+    // value), by a factor of at most max_exposure_step
+    double target_mean;
+    double max_exposure_step;
+    // folder of the timelapse frames (8 bits PGM, or PPM for rgb24
+    // frames): <prefix><index>.pgm, and latest.pgm (replaced by each
+    // frame). The indices continue from the highest one already in the
+    // folder, so that a restart does not overwrite the timelapse.
+    // Empty: no timelapse.
+    std::filesystem::path folder;
+    std::string prefix;
+    // the timelapse frames are downscaled by this (integer) factor
+    int timelapse_scale;
+    // run: after a failed frame (e.g. camera disconnected), the next one
+    // is attempted after retry_s, doubled after each consecutive failure
+    // up to max_retry_s
+    double retry_s;
+    double max_retry_s;
+};
+
+class AllSkyFrameInfo
+{
+public:
+    // -1 if the frame could not be captured
+    long index;
+    std::chrono::system_clock::time_point time;
+    double sun_altitude_deg;
+    std::string phase;
+    long exposure_us;
+    long gain;
+    // fraction of the maximum pixel value
+    double mean;
+    // of the timelapse frame, empty if none
+    std::filesystem::path path;
+    // empty if the frame was captured and processed
+    std::string error;
+
+public:
+    std::string to_string() const;
+};
+
+// Long running all-sky acquisition: snapshots at the interval of the
+// phase for the current solar altitude, with the exposure adjusted
+// between frames (auto exposure), written as timelapse frames and passed
+// to the stages (e.g. keogram, startrails). Memory use is bounded: a
+// single frame is kept.
+class AllSky
+{
+public:
+    AllSky(Camera& camera, AllSkyOptions options = AllSkyOptions());
+    // stages called (in order, from the acquisition thread) with each
+    // frame of the phases (of all phases if empty, e.g. startrails may
+    // be restricted to the night)
+    void add_stage(std::shared_ptr<Stage> stage,
+                   std::vector<std::string> phases = {});
+    // captures and processes a single frame, the phase being selected
+    // for the solar altitude at time. On failure, the error is recorded
+    // (see get_last) and the exception rethrown.
+    AllSkyFrameInfo step(std::chrono::system_clock::time_point time);
+    AllSkyFrameInfo step();
+    // called by run, from its thread, after each frame (failed or
+    // not), e.g. to report progress or to save the products of a night.
+    // An exception thrown by the callback stops run, which rethrows it.
+    void set_callback(std::function<void(const AllSkyFrameInfo&)> callback);
+    // runs until stop is called, or for duration_s (if positive). Failed
+    // frames do not stop the acquisition (see AllSkyOptions::retry_s).
+    void run(double duration_s = -1);
+    // thread safe
+    void stop();
+    // frames captured and processed
+    long get_nb_frames() const;
+    long get_nb_errors() const;
+    // of the last frame, failed or not
+    AllSkyFrameInfo get_last() const;
+    const AllSkyOptions& get_options() const;
+
+private:
+    struct PhaseStage
+    {
+        std::shared_ptr<Stage> stage;
+        // all if empty
+        std::vector<std::string> phases;
+    };
+    const AllSkyPhase& get_phase(double sun_altitude_deg) const;
+    void write_timelapse(const Frame& frame, AllSkyFrameInfo& info);
+
+private:
+    Camera& camera_;
+    AllSkyOptions options_;
+    std::vector<PhaseStage> stages_;
+    std::function<void(const AllSkyFrameInfo&)> callback_;
+    const AllSkyPhase* phase_;
+    long exposure_us_;
+    Frame frame_;
+    std::vector<unsigned char> timelapse_;
+    // of the next captured frame
+    long next_index_;
+    long nb_frames_;
+    long nb_errors_;
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_;
+    AllSkyFrameInfo last_;
+};
+
+}  // namespace zwo_asi
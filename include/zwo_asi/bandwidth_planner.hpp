@@ -0,0 +1,112 @@
+#pragma once
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+#include "zwo_asi/camera_info.hpp"
+#include "zwo_asi/frame.hpp"
+#include "zwo_asi/roi.hpp"
+
+namespace zwo_asi
+{
+class Camera;
+
+class PlannerTarget
+{
+public:
+    PlannerTarget();
+
+public:
+    // frame rate to reach. If 0, 1/exposure is used.
+    double fps;
+    // exposure that will be used, limits the frame rate if not 0
+    long exposure_us;
+    // image types the plan may use, all supported types if empty
+    std::set<ImageType> types;
+    // if true, cropping is preferred to binning (keeps the pixel
+    // resolution), otherwise binning is preferred (keeps the field
+    // of view)
+    bool prefer_resolution;
+    // BandWidth (percent) the plan assumes
+    int bandwidth_percent;
+};
+
+class BandwidthPlan
+{
+public:
+    ROI roi;
+    int bandwidth_percent;
+    // throughput available at bandwidth_percent (MB/s)
+    double throughput_mb_s;
+    // throughput needed to transfer the frames at the target fps (MB/s)
+    double required_mb_s;
+    double predicted_fps;
+    // fraction of the sensor area covered by the roi
+    double field_of_view;
+    bool meets_target;
+
+public:
+    std::string to_string() const;
+};
+
+// All (valid) roi candidates for the target, one per supported
+// bin and image type: the full (binned) frame if it reaches the target
+// frame rate, otherwise the largest centered crop that does.
+// Sorted from the best candidate to the worst. Throws if the exposure
+// alone limits the frame rate below the target.
+std::vector<BandwidthPlan> get_bandwidth_plans(const CameraInfo& info,
+                                               const PlannerTarget& target);
+
+// The best candidate of get_bandwidth_plans. If no candidate reaches
+// the target, the one with the highest frame rate (meets_target is
+// then false).
+BandwidthPlan plan_bandwidth(const CameraInfo& info,
+                             const PlannerTarget& target);
+
+// sets the roi and the BandWidth of the camera
+void apply_plan(Camera& camera, const BandwidthPlan& plan);
+
+class BandwidthTrial
+{
+public:
+    int bandwidth_percent;
+    long frames;
+    long dropped;
+    long timeouts;
+    double fps;
+};
+
+class BandwidthTuning
+{
+public:
+    // selected BandWidth (percent), also set on the camera
+    int bandwidth_percent;
+    std::vector<BandwidthTrial> trials;
+
+public:
+    std::string to_string() const;
+};
+
+// Gets video frames (video capture must be started) for duration,
+// and counts frames, dropped frames and timeouts.
+BandwidthTrial measure_video(Camera& camera,
+                             Frame& frame,
+                             int wait_ms,
+                             std::chrono::milliseconds duration);
+
+// timeout (ms) for getting a video frame with the current exposure
+int get_video_wait_ms(const Camera& camera);
+
+// Streams video for trial_duration at decreasing BandWidth values
+// (from the control maximum down to min_percent, by step) and selects
+// the highest value for which no frame was dropped. If frames are
+// dropped at all values, the value with the least dropped frames
+// is selected. The BandWidth is restored if the tuning fails.
+BandwidthTuning tune_bandwidth(
+    Camera& camera,
+    std::chrono::milliseconds trial_duration =
+        std::chrono::milliseconds(2000),
+    int min_percent = 40,
+    int step = 10);
+
+}  // namespace zwo_asi
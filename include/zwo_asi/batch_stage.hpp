@@ -0,0 +1,79 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include "zwo_asi/pipeline.hpp"
+
+namespace zwo_asi
+{
+class BatchMetrics
+{
+public:
+    long batches;
+    long frames;
+    long failed;
+    int pending;
+    double mean_batch_size;
+    double mean_batch_latency_us;
+    std::string last_error;
+};
+
+// Stage collecting frames into batches, which are handed to process_batch
+// from a dedicated thread. A batch is dispatched once it contains
+// batch_size frames, or when its oldest frame has been waiting for
+// max_latency. Frames are shared, not copied. When max_pending frames are
+// waiting, submitting more blocks until a batch is dispatched.
+// As batches are processed asynchronously, a BatchStage should be a leaf of
+// the pipeline (stages declared after it may run before the batch is
+// processed).
+// Subclasses must call stop in their destructor, so that the pending
+// frames are processed while process_batch can still be called.
+class BatchStage : public Stage
+{
+public:
+    BatchStage(int batch_size,
+               std::chrono::microseconds max_latency,
+               int max_pending = -1);
+    ~BatchStage();
+    void submit(std::shared_ptr<Frame> frame);
+    void process(Frame& frame);
+    void flush();
+    void stop();
+    BatchMetrics get_metrics() const;
+
+protected:
+    virtual void process_batch(
+        const std::vector<std::shared_ptr<Frame>>& frames) = 0;
+
+private:
+    struct Pending
+    {
+        std::shared_ptr<Frame> frame;
+        std::chrono::steady_clock::time_point submitted;
+    };
+    void run();
+    void dispatch(std::vector<std::shared_ptr<Frame>>& batch);
+
+private:
+    int batch_size_;
+    std::chrono::microseconds max_latency_;
+    int max_pending_;
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::condition_variable space_;
+    std::condition_variable flushed_;
+    // oldest first
+    std::deque<Pending> pending_;
+    bool flush_requested_;
+    bool dispatching_;
+    bool stop_;
+    long batches_;
+    long frames_;
+    long failed_;
+    long total_latency_ns_;
+    std::string last_error_;
+    std::thread thread_;
+};
+
+}  // namespace zwo_asi
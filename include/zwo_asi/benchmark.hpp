@@ -0,0 +1,120 @@
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "zwo_asi/bandwidth_planner.hpp"
+
+namespace zwo_asi
+{
+class BenchmarkOptions
+{
+public:
+    BenchmarkOptions();
+
+public:
+    // duration of the measurement for each setting
+    std::chrono::milliseconds duration;
+    // BandWidth values (percent) to sweep
+    std::vector<int> bandwidths;
+    // image types to sweep, all supported types if empty
+    std::set<ImageType> types;
+    // if false, only the current HighSpeedMode is used
+    bool sweep_high_speed;
+};
+
+class BenchmarkResult
+{
+public:
+    ImageType type;
+    bool high_speed;
+    int bandwidth_percent;
+    long frames;
+    long dropped;
+    long timeouts;
+    double fps;
+    // frame bytes transferred per second (MB/s)
+    double throughput_mb_s;
+};
+
+// best known settings for a camera model, connected to a host,
+// and an image type
+class ThroughputProfile
+{
+public:
+    std::string camera_model;
+    std::string host;
+    ImageType type;
+    bool high_speed;
+    int bandwidth_percent;
+    int width;
+    int height;
+    int bins;
+    double fps;
+    long dropped;
+
+public:
+    std::string to_string() const;
+};
+
+// Streams video with the current roi (and exposure), for each image type,
+// HighSpeedMode and BandWidth value of the options. The roi, HighSpeedMode
+// and BandWidth of the camera, and the video streaming, are restored
+// afterwards, also if the benchmark fails.
+std::vector<BenchmarkResult> run_benchmark(
+    Camera& camera, const BenchmarkOptions& options = BenchmarkOptions());
+
+// Best settings for each image type: fewest dropped frames (and
+// timeouts), then highest frame rate, then lowest BandWidth.
+std::vector<ThroughputProfile> select_profiles(
+    const CameraInfo& info,
+    const ROI& roi,
+    const std::vector<BenchmarkResult>& results);
+
+// host name, used to identify the host in the profiles
+std::string get_host_name();
+
+// default: $XDG_CACHE_HOME/camera_zwo_asi/throughput_profiles
+// (or ~/.cache/...)
+std::filesystem::path get_default_profile_cache();
+
+// Profiles saved in a (text) file, one line per camera model, host and
+// image type.
+class ProfileCache
+{
+public:
+    ProfileCache(std::filesystem::path path = get_default_profile_cache());
+    // false if the file does not exist
+    bool load();
+    void save() const;
+    // nullptr if no profile
+    const ThroughputProfile* get(std::string camera_model,
+                                 std::string host,
+                                 ImageType type) const;
+    void set(const ThroughputProfile& profile);
+    std::vector<ThroughputProfile> get_profiles() const;
+    const std::filesystem::path& get_path() const;
+
+private:
+    typedef std::tuple<std::string, std::string, ImageType> Key;
+    std::filesystem::path path_;
+    std::map<Key, ThroughputProfile> profiles_;
+};
+
+// runs the benchmark, and saves the selected profiles in the cache
+// (the best profile for the current image type is applied)
+std::vector<ThroughputProfile> calibrate(
+    Camera& camera,
+    const BenchmarkOptions& options = BenchmarkOptions(),
+    std::filesystem::path cache = get_default_profile_cache());
+
+// Sets HighSpeedMode and BandWidth from the cached profile of the
+// camera model, host and current image type. Returns false (camera
+// unchanged) if there is no such profile.
+bool apply_cached_profile(
+    Camera& camera, std::filesystem::path cache = get_default_profile_cache());
+
+}  // namespace zwo_asi
@@ -1,27 +1,80 @@
 #pragma once
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
 #include "zwo_asi/camera_exception.hpp"
 #include "zwo_asi/camera_info.hpp"
 #include "zwo_asi/camera_mode.hpp"
+#include "zwo_asi/camera_registry.hpp"
+#include "zwo_asi/camera_snapshot.hpp"
 #include "zwo_asi/controllable.hpp"
+#include "zwo_asi/frame.hpp"
 #include "zwo_asi/guide_direction.hpp"
 #include "zwo_asi/camera_attributes.hpp"
+#include "zwo_asi/result.hpp"
 #include "zwo_asi/roi.hpp"
+#include "zwo_asi/sdk.hpp"
 
 namespace zwo_asi
 {
 std::string get_sdk_version();
 void close_camera(int camera_index);
+// closes all the cameras opened by this process (e.g. before replacing
+// the sdk, see set_sdk). Errors are ignored.
+void close_cameras();
 
+// Acquisition state of a camera. The roi, camera mode and dark
+// substraction can be changed only when idle.
+enum class CameraState
+{
+    idle,
+    exposing,
+    streaming,
+    reconfiguring
+};
+
+std::string to_string(CameraState state);
+
+// Recommended offsets and gain, as provided by the SDK
+class GainOffset
+{
+public:
+    int offset_highest_dr;
+    int offset_unity_gain;
+    int gain_lowest_rn;
+    int offset_lowest_rn;
+};
+
+// Cameras can be used from several threads. Frame acquisition does not
+// lock: it is coordinated with configuration changes by the camera
+// state (e.g. changing the roi while streaming throws rather than
+// blocking). Control writes are serialized, and can be done while
+// capturing or streaming, concurrently with control reads.
 class Camera
 {
 public:
     Camera(int camera_index);
     ~Camera();
+    static std::unique_ptr<Camera> open_by_serial(std::string serial);
+    static std::unique_ptr<Camera> open_by_id(std::string id);
+    static std::unique_ptr<Camera> open_by_name(std::string name);
+    std::string get_serial() const;
+    std::string get_id() const;
+    void set_id(std::string id);
+    int get_index() const;
     std::map<std::string, Controllable> get_controls() const;
     ROI get_roi() const;
     void set_control(std::string control, long value);
     void set_auto(std::string control);
+    // writes both controls as a single change of the frame settings
+    // (see Frame::settings), e.g. for auto exposure loops running
+    // while the video is streaming
+    void set_exposure_and_gain(long exposure_us, long gain);
+    // last written exposure and gain (not necessarily yet applied to
+    // the video frames)
+    FrameSettings get_settings() const;
     void set_camera_mode(CameraMode mode);
     void set_pulse_guide_on(GuideDirection guide);
     void set_pulse_guide_off(GuideDirection guide);
@@ -29,24 +82,126 @@ public:
     void disable_dark_substract();
     std::string to_string() const;
     void capture(unsigned char* buffer, int image_size);
+    void capture(Frame& frame);
+    void start_video();
+    void stop_video();
+    bool is_video_active() const;
+    CameraState get_state() const;
+    void get_video_frame(unsigned char* buffer, int image_size, int wait_ms);
+    void get_video_frame(Frame& frame, int wait_ms);
+    int get_dropped_frames() const;
+    CameraMode get_camera_mode() const;
+    GainOffset get_gain_offset() const;
     const CameraInfo& get_info() const;
     void configure(ROI roi, std::map<std::string, Controllable>);
     void set_roi(const ROI& roi);
 
+    // Named hardware presets (e.g. binned raw8 preview and full
+    // resolution raw16 science frames). A preset is validated once when
+    // added (throws std::runtime_error listing the issues), and holds its
+    // native SDK parameters and a pool of frames of its geometry.
+    // Switching to a preset writes only what differs from the active
+    // preset (all values if no preset is active, or if the configuration
+    // was changed since by another method). Controls not in the preset
+    // are left unchanged. If the roi or camera mode changes, the video
+    // is stopped and restarted. Returns the number of values written.
+    void add_preset(std::string name,
+                    const CameraSnapshot& config,
+                    int nb_frames = 2);
+    int apply_preset(std::string name);
+    std::shared_ptr<FramePool> get_preset_pool(std::string name) const;
+    std::vector<std::string> get_presets() const;
+    // empty string if none
+    std::string get_active_preset() const;
+
+    // variants of capture, get_video_frame, set_control and of the
+    // exposure status reading that do not throw, for hot paths
+    Result try_capture(unsigned char* buffer, int image_size) noexcept;
+    Result try_capture(Frame& frame) noexcept;
+    Result try_get_video_frame(unsigned char* buffer,
+                               int image_size,
+                               int wait_ms) noexcept;
+    Result try_get_video_frame(Frame& frame, int wait_ms) noexcept;
+    Result try_get_exposure_status(
+        ASI_EXPOSURE_STATUS& status) const noexcept;
+    Result try_set_control(const std::string& control, long value) noexcept;
+
 private:
+    static std::unique_ptr<Camera> open_by_identity(
+        std::function<bool(const CameraIdentity&)> match,
+        std::string description);
     const ASI_CONTROL_CAPS& get_control_caps(std::string control) const;
     Controllable get_controllable(const ASI_CONTROL_CAPS& cap) const;
     ASI_EXPOSURE_STATUS get_exposition_status() const;
-    void check_camera_ready() const;
-    ASI_EXPOSURE_STATUS wait_for_status_change(
-        ASI_EXPOSURE_STATUS status) const;
+    Result wait_for_status_change(ASI_EXPOSURE_STATUS current_status,
+                                  ASI_EXPOSURE_STATUS& status) const noexcept;
+    void throw_on_error(const Result& result) const;
     void read_control_caps(
         std::map<std::string, std::shared_ptr<ASI_CONTROL_CAPS>>& controls);
+    template <typename F>
+    void reconfigure(const std::string& operation, F function);
+    ASI_ERROR_CODE write_control(ASI_CONTROL_TYPE type,
+                                 long value,
+                                 bool is_auto) noexcept;
+    void record_settings(FrameSettings settings) noexcept;
+    void read_settings();
+    void tag_settings(Frame& frame) noexcept;
+
+    struct SettingsChange
+    {
+        std::chrono::steady_clock::time_point time;
+        FrameSettings settings;
+    };
+
+    struct NativeControl
+    {
+        ASI_CONTROL_TYPE type;
+        long value;
+        bool is_auto;
+    };
+
+    struct Preset
+    {
+        std::string name;
+        int width;
+        int height;
+        int bins;
+        ASI_IMG_TYPE type;
+        int start_x;
+        int start_y;
+        bool has_mode;
+        ASI_CAMERA_MODE mode;
+        std::vector<NativeControl> controls;
+        std::shared_ptr<FramePool> pool;
+    };
+    const Preset& get_preset(const std::string& name) const;
+    static bool same_geometry(const Preset& a, const Preset& b);
+    int write_preset(const Preset& preset, const Preset* active);
 
 private:
+    // the sdk in use when the camera has been opened
+    std::shared_ptr<Sdk> sdk_;
     CameraInfo camera_info_;
     int camera_index_;
+    int camera_id_;
+    // not modified after construction
     std::map<std::string, std::shared_ptr<ASI_CONTROL_CAPS>> controls_;
+    std::atomic<long> nb_captured_;
+    std::atomic<CameraState> state_;
+    // exclusive: control writes, shared: control reads
+    mutable std::shared_mutex control_mutex_;
+    // frame settings: settings_ is the last written (modified only with
+    // the control lock held), video_settings_ the one of the last video
+    // frame, changes are pending until a frame is acquired with them
+    mutable std::mutex settings_mutex_;
+    FrameSettings settings_;
+    FrameSettings video_settings_;
+    std::deque<SettingsChange> settings_changes_;
+    std::chrono::steady_clock::time_point last_video_frame_;
+    // presets (with the control lock), active_preset_ is reset by the
+    // methods changing the configuration
+    std::map<std::string, std::unique_ptr<Preset>> presets_;
+    const Preset* active_preset_;
 };
 
 }  // namespace zwo_asi
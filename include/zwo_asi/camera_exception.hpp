@@ -2,6 +2,7 @@
 #include <exception>
 #include <string>
 #include "ASICamera2.h"
+#include "zwo_asi/result.hpp"
 #include "zwo_asi/utils.hpp"
 
 namespace zwo_asi
@@ -14,9 +15,13 @@ public:
                     ASI_ERROR_CODE error_code,
                     bool udev = false);
     const char* what() const throw();
+    ASI_ERROR_CODE get_error_code() const;
+    int get_camera_index() const;
 
 private:
     std::string error_message_;
+    ASI_ERROR_CODE error_code_;
+    int camera_index_;
 };
 
 }  // namespace zwo_asi
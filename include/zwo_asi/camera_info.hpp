@@ -35,5 +35,6 @@ public:
 int get_nb_cameras();
 void check_system_udev();
 CameraInfo get_camera_info(int camera_index);
+CameraInfo get_camera_info(const ASI_CAMERA_INFO& cam_info);
 
 }  // namespace zwo_asi
@@ -15,5 +15,9 @@ enum CameraMode
     low_level
 };
 ASI_CAMERA_MODE get_native(CameraMode mode);
+CameraMode get_camera_mode(ASI_CAMERA_MODE mode);
+std::string to_string(CameraMode mode);
+// throws std::runtime_error for unknown modes
+CameraMode get_camera_mode(std::string mode);
 
 }  // namespace zwo_asi
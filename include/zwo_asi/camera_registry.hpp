@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "zwo_asi/camera_info.hpp"
+#include "zwo_asi/sdk.hpp"
+
+namespace zwo_asi
+{
+std::string to_string(const ASI_ID& id);
+std::string id_to_string(const ASI_ID& id);
+ASI_ID string_to_id(std::string id);
+
+// serial number (set by the manufacturer) and id (up to 8 characters,
+// set by the user via Camera::set_id and stored in the camera). Empty
+// if not supported by the camera (older cameras have no serial number,
+// USB2 cameras no id).
+class CameraIdentity
+{
+public:
+    std::string serial;
+    std::string id;
+};
+
+// reads the identity of an opened camera
+CameraIdentity read_identity(Sdk& sdk, int camera_id);
+
+// Process wide cache of the connected cameras. The information of all
+// cameras is read once, and read again on refresh (e.g. by the hot-plug
+// monitoring) or when an index beyond the cached cameras is requested.
+// Listeners are notified when the names or ids of the cameras change
+// (a camera has been plugged, unplugged or replaced).
+// Identities (which can be read only from an opened camera) are
+// cached as well, for as long as the cameras stay the same (same
+// camera ids and names across enumerations), so that cameras do not
+// have to be opened each time they are looked up. Cameras of the same
+// model may still swap their camera ids (USB re-enumeration): the
+// identity read from an opened camera is given to update_identity, which
+// drops the cache if it differs from the cached one.
+class CameraRegistry
+{
+public:
+    typedef std::function<void(const std::vector<CameraInfo>&)> Listener;
+
+public:
+    static CameraRegistry& instance();
+    ~CameraRegistry();
+    // returns true if the cameras changed
+    bool refresh();
+    void invalidate();
+    int get_nb_cameras();
+    std::vector<CameraInfo> get_cameras();
+    CameraInfo get_camera_info(int camera_index);
+    CameraIdentity get_identity(int camera_index);
+    std::string get_serial(int camera_index);
+    void set_id(int camera_index, std::string id);
+    // returns false if the identity differs from the cached one (the
+    // cached identities are then all dropped)
+    bool update_identity(int camera_index, const CameraIdentity& identity);
+    int find_by_name(std::string name);
+    int find_by_serial(std::string serial);
+    int find_by_id(std::string id);
+    int find_by_identity(std::function<bool(const CameraIdentity&)> match);
+    // open and close the camera, keeping track of the cameras opened by
+    // this process. Serialized with the identity probes of get_identity,
+    // which could otherwise close a camera being opened.
+    ASI_ERROR_CODE open(Sdk& sdk, int camera_id);
+    ASI_ERROR_CODE close(Sdk& sdk, int camera_id);
+    // camera ids of the cameras opened by this process
+    std::vector<int> get_opened();
+    int add_listener(Listener listener);
+    void remove_listener(int listener_id);
+    void clear_listeners();
+    void start_monitoring(std::chrono::milliseconds period);
+    void stop_monitoring();
+
+private:
+    typedef std::pair<int, std::string> IdentityKey;
+
+private:
+    CameraRegistry();
+    static IdentityKey get_key(const CameraInfo& info);
+    void enumerate();
+    void ensure_enumerated();
+    void notify(const std::vector<CameraInfo>& cameras);
+    void monitor(std::chrono::milliseconds period);
+
+private:
+    std::recursive_mutex mutex_;
+    bool enumerated_;
+    std::vector<CameraInfo> cameras_;
+    // by camera id and name
+    std::map<IdentityKey, CameraIdentity> identities_;
+    std::set<int> opened_;
+    std::mutex listeners_mutex_;
+    std::map<int, Listener> listeners_;
+    int next_listener_;
+    std::mutex monitor_mutex_;
+    std::condition_variable monitor_condition_;
+    bool monitoring_;
+    std::thread monitor_thread_;
+};
+
+}  // namespace zwo_asi
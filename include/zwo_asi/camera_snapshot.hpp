@@ -0,0 +1,86 @@
+#pragma once
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+#include "zwo_asi/camera_mode.hpp"
+#include "zwo_asi/roi.hpp"
+
+namespace zwo_asi
+{
+class Camera;
+
+class ControlSetting
+{
+public:
+    long value;
+    bool is_auto;
+
+public:
+    bool operator==(const ControlSetting& other) const;
+    bool operator!=(const ControlSetting& other) const;
+};
+
+// Complete (writable) configuration of a camera: roi, controls and,
+// for trigger cameras, camera mode.
+class CameraSnapshot
+{
+public:
+    CameraSnapshot();
+
+public:
+    ROI roi;
+    std::map<std::string, ControlSetting> controls;
+    bool has_mode;
+    CameraMode mode;
+
+public:
+    // compact binary encoding (little endian)
+    std::vector<unsigned char> to_binary() const;
+    static CameraSnapshot from_binary(const std::vector<unsigned char>& data);
+    // same schema as zwo_asi.toml (see Camera.to_toml)
+    std::string to_toml() const;
+};
+
+CameraSnapshot take_snapshot(const Camera& camera);
+
+// Applies the snapshot, writing only the values that differ from
+// current (video capture is stopped and restarted if the roi changes).
+// Returns the number of values written.
+int restore_snapshot(Camera& camera,
+                     const CameraSnapshot& snapshot,
+                     const CameraSnapshot& current);
+
+// as above, current being read from the camera
+int restore_snapshot(Camera& camera, const CameraSnapshot& snapshot);
+
+// Named snapshots (e.g. "planetary", "deep-sky") that can be switched to.
+// The last applied snapshot is kept, so that switching does not need
+// to read the camera state (unless the camera has been configured by
+// other means: see invalidate).
+class ConfigurationProfiles
+{
+public:
+    ConfigurationProfiles();
+    void set(std::string name, const CameraSnapshot& snapshot);
+    // stores the current configuration of the camera
+    void save(std::string name, const Camera& camera);
+    const CameraSnapshot& get(std::string name) const;
+    bool has(std::string name) const;
+    void remove(std::string name);
+    std::vector<std::string> get_names() const;
+    // returns the number of values written
+    int apply(std::string name, Camera& camera);
+    // to call if the camera has been configured other than via apply
+    void invalidate();
+    void save_file(const std::filesystem::path& path) const;
+    void load_file(const std::filesystem::path& path);
+
+private:
+    std::map<std::string, CameraSnapshot> snapshots_;
+    bool has_current_;
+    int current_camera_;
+    CameraSnapshot current_;
+};
+
+}  // namespace zwo_asi
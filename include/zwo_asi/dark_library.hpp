@@ -0,0 +1,125 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include "zwo_asi/camera.hpp"
+
+namespace zwo_asi
+{
+// Acquisition conditions of a frame. Master darks with an exposure of 0
+// are bias frames.
+class DarkKey
+{
+public:
+    DarkKey();
+
+public:
+    long exposure_us;
+    long gain;
+    long offset;
+    double temperature_c;
+    int width;
+    int height;
+    int bins;
+    ImageType type;
+
+public:
+    std::string to_string() const;
+};
+
+// Key of the frame, for the current roi, offset and sensor temperature
+// of the camera (read from the controls, not the disk).
+DarkKey get_dark_key(const Camera& camera, const Frame& frame);
+
+class DarkMatch
+{
+public:
+    // of the master dark used
+    DarkKey key;
+    // the dark current (dark minus bias) is scaled by the ratio of the
+    // exposures, if a bias frame of the same gain and offset exists
+    double scale;
+    bool exact;
+};
+
+// Library of master darks, stored in a folder (one file per master
+// dark, memory mapped). A frame is calibrated with the dark of the same
+// geometry, gain and offset, with the closest temperature (in buckets
+// of temperature_step_c), then the closest exposure. Darks prepared for
+// a key (scaled if needed) are kept in memory (the cache_size most
+// recently used), so that calibrating frames does not access the disk
+// once the dark of their key has been used.
+// Darks are stored with the byte order of the host. Thread safe.
+class DarkLibrary
+{
+public:
+    DarkLibrary(std::filesystem::path folder,
+                int cache_size = 8,
+                double temperature_step_c = 2.);
+    ~DarkLibrary();
+    DarkLibrary(const DarkLibrary&) = delete;
+    DarkLibrary& operator=(const DarkLibrary&) = delete;
+
+    // averages the frames (of the same geometry) into a master dark
+    // and stores it, replacing the one with the same key
+    void add(const DarkKey& key,
+             const std::vector<std::shared_ptr<Frame>>& frames);
+    std::vector<DarkKey> get_keys() const;
+    // throws std::runtime_error if there is no dark for the geometry,
+    // gain and offset of the key
+    DarkMatch find(const DarkKey& key) const;
+    // subtracts the matching dark from the frame (values are clamped
+    // to 0)
+    DarkMatch calibrate(Frame& frame, const DarkKey& key);
+    int get_nb_cached() const;
+    // keys of the frames the cached darks were prepared for, most
+    // recently used first
+    std::vector<DarkKey> get_cached_keys() const;
+    void clear_cache();
+    const std::filesystem::path& get_folder() const;
+
+private:
+    // exposure, gain, offset, temperature bucket, width, height, bins,
+    // type
+    typedef std::tuple<long, long, long, long, int, int, int, int> Index;
+    struct Dark
+    {
+        DarkKey key;
+        std::filesystem::path path;
+        void* mapping;
+        size_t mapping_size;
+        const float* data;
+    };
+    struct Prepared
+    {
+        // of the frame
+        DarkKey key;
+        DarkMatch match;
+        std::shared_ptr<const std::vector<float>> data;
+    };
+    Index get_index(const DarkKey& key) const;
+    void load(const std::filesystem::path& path);
+    void unmap(Dark& dark);
+    const Dark* match(const DarkKey& key,
+                      const Dark*& bias,
+                      DarkMatch& match) const;
+    Prepared prepare(const DarkKey& key);
+
+private:
+    std::filesystem::path folder_;
+    int cache_size_;
+    double temperature_step_c_;
+    mutable std::mutex mutex_;
+    std::map<Index, Dark> darks_;
+    // most recently used first
+    std::list<std::pair<Index, Prepared>> cache_;
+    std::map<Index, std::list<std::pair<Index, Prepared>>::iterator>
+        cached_;
+};
+
+}  // namespace zwo_asi
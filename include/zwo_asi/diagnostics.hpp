@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "zwo_asi/camera_info.hpp"
+#include "zwo_asi/roi.hpp"
+
+namespace zwo_asi
+{
+class Camera;
+
+// usb throughput at 100% bandwidth, in bytes per microsecond (MB/s)
+double get_usb_throughput(bool usb3);
+
+// bytes transferred per frame
+long get_frame_size(const ROI& roi);
+
+// maximum frame rate for the roi: limited by the usb transfer,
+// and by the exposure (if not 0)
+double get_max_frame_rate(const CameraInfo& info,
+                          const ROI& roi,
+                          int bandwidth_percent = 100,
+                          long exposure_us = 0);
+
+class CameraDiagnostics
+{
+public:
+    int camera_index;
+    std::string name;
+    bool is_usb3;
+    bool is_usb3_host;
+    ROI roi;
+    int bandwidth_percent;
+    long exposure_us;
+    long frame_size;
+    double throughput_mb_s;
+    double max_fps;
+    std::vector<std::string> warnings;
+
+public:
+    std::string to_string() const;
+};
+
+class Diagnostics
+{
+public:
+    // 0: no limit, -1: could not be read
+    int usbfs_memory_mb;
+    std::vector<CameraDiagnostics> cameras;
+    // host level warnings, camera warnings are in cameras
+    std::vector<std::string> warnings;
+
+public:
+    bool ok() const;
+    std::string to_string() const;
+};
+
+// diagnostics of an opened camera, for its current roi, bandwidth
+// and exposure
+CameraDiagnostics get_camera_diagnostics(const Camera& camera);
+
+// diagnostics of the host and of all connected cameras (which are not
+// opened: full frame roi, raw16 when supported).
+// If refresh is true, the usbfs memory limit and the cameras are
+// read again.
+Diagnostics get_system_diagnostics(bool refresh = false);
+
+}  // namespace zwo_asi
@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "zwo_asi/image_type.hpp"
+
+namespace zwo_asi
+{
+// Exposure and gain a frame was acquired with. The generation is
+// incremented by the camera on each change of these settings. Values
+// are -1 when unknown (e.g. control in auto mode).
+class FrameSettings
+{
+public:
+    FrameSettings();
+
+public:
+    long exposure_us;
+    long gain;
+    long generation;
+};
+
+class Frame
+{
+public:
+    Frame(int width, int height, ImageType type);
+    int size() const;
+
+public:
+    int width;
+    int height;
+    ImageType type;
+    long index;
+    std::chrono::steady_clock::time_point timestamp;
+    FrameSettings settings;
+    // true for the first video frame acquired with new settings
+    bool settings_changed;
+    std::vector<unsigned char> data;
+};
+
+// Fixed set of preallocated frames. Frames acquired from the pool
+// are returned to it (without reallocation) when their last
+// shared_ptr is released.
+class FramePool
+{
+public:
+    FramePool(int width, int height, ImageType type, int nb_frames);
+    std::shared_ptr<Frame> acquire();
+    std::shared_ptr<Frame> try_acquire();
+    int available() const;
+    int capacity() const;
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::vector<std::unique_ptr<Frame>> free;
+    };
+    std::shared_ptr<Frame> wrap(std::unique_ptr<Frame> frame);
+
+private:
+    std::shared_ptr<State> state_;
+    int capacity_;
+};
+
+}  // namespace zwo_asi
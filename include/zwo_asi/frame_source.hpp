@@ -0,0 +1,213 @@
+#pragma once
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "zwo_asi/camera.hpp"
+#include "zwo_asi/pipeline.hpp"
+#include "zwo_asi/thread_pool.hpp"
+
+namespace zwo_asi
+{
+// Sequence of frames of the same geometry, from a live camera or from
+// recorded files, so that the same processing code can run on both.
+class FrameSource
+{
+public:
+    virtual ~FrameSource();
+    virtual int get_width() const = 0;
+    virtual int get_height() const = 0;
+    virtual ImageType get_type() const = 0;
+    // -1 if unbounded (live camera)
+    virtual long get_nb_frames() const = 0;
+    // writes the next frame into frame (which must have the geometry of
+    // the source). Returns false once all frames have been read.
+    virtual bool read(Frame& frame) = 0;
+};
+
+// Frames of a camera, for the roi at construction: video frames if the
+// camera is streaming, snapshots otherwise.
+class CameraSource : public FrameSource
+{
+public:
+    CameraSource(Camera& camera, int wait_ms = -1);
+    int get_width() const;
+    int get_height() const;
+    ImageType get_type() const;
+    long get_nb_frames() const;
+    bool read(Frame& frame);
+
+private:
+    Camera& camera_;
+    ROI roi_;
+    int wait_ms_;
+};
+
+// Recorded frames, which can be decoded in any order (and concurrently)
+class FileSource : public FrameSource
+{
+public:
+    FileSource();
+    // a frame that fails to decode is skipped: its exception is thrown,
+    // and the next read returns the next frame
+    bool read(Frame& frame);
+    void seek(long index);
+    long get_position() const;
+    // thread safe
+    virtual void decode(long index, Frame& frame) const = 0;
+
+protected:
+    // checks the geometry of the frame, and sets its index
+    void prepare(long index, Frame& frame) const;
+
+private:
+    long position_;
+};
+
+// SER video file (e.g. FireCapture, SharpCap): mono, bayer (raw8 or
+// raw16) and 8 bits color (rgb24) videos. 16 bits values are read as
+// little endian whatever the endianness field of the header, as most
+// writers do not set it as specified. The file is memory mapped.
+class SerSource : public FileSource
+{
+public:
+    SerSource(std::filesystem::path path);
+    ~SerSource();
+    SerSource(const SerSource&) = delete;
+    SerSource& operator=(const SerSource&) = delete;
+    int get_width() const;
+    int get_height() const;
+    ImageType get_type() const;
+    long get_nb_frames() const;
+    void decode(long index, Frame& frame) const;
+
+private:
+    std::filesystem::path path_;
+    int width_;
+    int height_;
+    ImageType type_;
+    long nb_frames_;
+    // red and blue swapped (frames are stored as bgr)
+    bool rgb_;
+    void* mapping_;
+    size_t mapping_size_;
+};
+
+// FITS files, one (2D, 8 or 16 bits) frame per file, in the order of
+// the list. All files must have the same geometry (checked when
+// decoded).
+class FitsSource : public FileSource
+{
+public:
+    FitsSource(std::vector<std::filesystem::path> paths);
+    // the .fits, .fit and .fts files of the folder, in alphabetical order
+    static std::vector<std::filesystem::path> list(
+        const std::filesystem::path& folder);
+    int get_width() const;
+    int get_height() const;
+    ImageType get_type() const;
+    long get_nb_frames() const;
+    void decode(long index, Frame& frame) const;
+
+private:
+    std::vector<std::filesystem::path> paths_;
+    int width_;
+    int height_;
+    ImageType type_;
+};
+
+// Raw dumps written by RawWriterStage (<folder>/<prefix><index>.raw),
+// in increasing order of index. The geometry is not stored in the
+// files and must be given.
+class RawSource : public FileSource
+{
+public:
+    RawSource(std::filesystem::path folder,
+              int width,
+              int height,
+              ImageType type,
+              std::string prefix = "frame_");
+    int get_width() const;
+    int get_height() const;
+    ImageType get_type() const;
+    long get_nb_frames() const;
+    void decode(long index, Frame& frame) const;
+
+private:
+    std::vector<std::pair<long, std::filesystem::path>> files_;
+    int width_;
+    int height_;
+    ImageType type_;
+};
+
+// Decodes the next nb_frames frames of a file source in advance, on a
+// thread pool, so that reading is not limited by the latency of a
+// single decode.
+class ReadaheadSource : public FrameSource
+{
+public:
+    ReadaheadSource(std::shared_ptr<FileSource> source,
+                    int nb_frames = 8,
+                    int nb_threads = 0);
+    ~ReadaheadSource();
+    int get_width() const;
+    int get_height() const;
+    ImageType get_type() const;
+    long get_nb_frames() const;
+    // rethrows the exception of the decode of the frame, if any (the
+    // frame is skipped, see FileSource::read)
+    bool read(Frame& frame);
+
+private:
+    struct Slot
+    {
+        Slot(int width, int height, ImageType type);
+        Frame frame;
+        bool ready;
+        std::exception_ptr error;
+    };
+    void schedule(long index);
+
+private:
+    std::shared_ptr<FileSource> source_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+    long next_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    // declared last: destroyed (and its threads joined) first
+    ThreadPool pool_;
+};
+
+// Frames of a source that failed to be read (e.g. truncated files)
+class ReadErrors
+{
+public:
+    ReadErrors();
+    long failed;
+    std::string last_error;
+};
+
+// Reads the next frame of the source. Frames of recorded sources that
+// fail to decode are skipped, and counted in errors (if not null);
+// errors of live sources (get_nb_frames() < 0, e.g. a disconnected
+// camera) are thrown.
+bool read_skipping_errors(FrameSource& source,
+                          Frame& frame,
+                          ReadErrors* errors = nullptr);
+
+// Reads the frames of the source (all of them, or at most nb_frames)
+// into frames of a pool of nb_buffers frames, and pushes them into the
+// pipeline (waiting for a frame to be released when all are in use),
+// then waits for the pipeline. Frames failing to decode are skipped
+// (see read_skipping_errors). The pipeline is waited for also if an
+// error is thrown. Returns the number of frames pushed.
+long replay(FrameSource& source,
+            Pipeline& pipeline,
+            long nb_frames = -1,
+            int nb_buffers = 8,
+            ReadErrors* errors = nullptr);
+
+}  // namespace zwo_asi
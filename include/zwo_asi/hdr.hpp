@@ -0,0 +1,94 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "zwo_asi/camera.hpp"
+
+namespace zwo_asi
+{
+class BracketStep
+{
+public:
+    long exposure_us;
+    // in 0.1 dB
+    long gain;
+};
+
+class HdrOptions
+{
+public:
+    HdrOptions();
+
+public:
+    // values above saturation * maximum value (255 or 65535) are ignored
+    double saturation;
+    // the weight of values decreases linearly to 0 over this fraction
+    // of the maximum value below the saturation level
+    double rolloff;
+    // black level, in pixel values
+    double black_level;
+};
+
+// High dynamic range image merged from bracketed frames: one float
+// per pixel value (three per pixel for rgb24), in pixel values per
+// second of exposure at gain 0.
+class HdrFrame
+{
+public:
+    HdrFrame(int width, int height, ImageType type);
+    int size() const;
+
+public:
+    int width;
+    int height;
+    // of the merged frames
+    ImageType type;
+    long index;
+    std::chrono::steady_clock::time_point timestamp;
+    std::vector<float> data;
+    // sum of the weights of the merged values, 0 when saturated in all
+    // frames (data is then estimated from the shortest exposure)
+    std::vector<float> weights;
+};
+
+// Merges frames of the same roi acquired with different exposures or
+// gains (read from Frame::settings) into hdr. Each value is the
+// average of the values of the frames, scaled to the same exposure and
+// gain, weighted by the exposure time and by their distance to
+// saturation. Throws std::runtime_error if the frames do not match or
+// if their settings are unknown.
+void merge_hdr(const std::vector<std::shared_ptr<Frame>>& frames,
+               HdrFrame& hdr,
+               const HdrOptions& options = HdrOptions());
+
+// Captures one frame per step, back to back. If the camera is
+// streaming, the video is not interrupted: the settings of the next
+// step are written as soon as a frame of the current step is received,
+// and the frames acquired before the new settings apply are skipped
+// (see Frame::settings). Otherwise, a frame is captured per step.
+// Frames are allocated once, for the roi of the camera at construction.
+class BracketSequencer
+{
+public:
+    BracketSequencer(Camera& camera,
+                     std::vector<BracketStep> steps,
+                     HdrOptions options = HdrOptions());
+    const std::vector<std::shared_ptr<Frame>>& capture();
+    void capture(HdrFrame& hdr);
+    const std::vector<BracketStep>& get_steps() const;
+    // time between the reception of the first and of the last frame
+    // of the last capture
+    double get_last_duration_ms() const;
+
+private:
+    void capture_video_frame(int step);
+
+private:
+    Camera& camera_;
+    std::vector<BracketStep> steps_;
+    HdrOptions options_;
+    std::vector<std::shared_ptr<Frame>> frames_;
+    double last_duration_ms_;
+};
+
+}  // namespace zwo_asi
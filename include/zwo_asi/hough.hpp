@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "zwo_asi/frame.hpp"
+
+namespace zwo_asi
+{
+class LineSegment
+{
+public:
+    double length() const;
+    std::string to_string() const;
+
+public:
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+    // votes of the line of the segment when it was found
+    int votes;
+};
+
+class HoughOptions
+{
+public:
+    HoughOptions();
+
+public:
+    // minimal number of votes of a line
+    int threshold;
+    // minimal length of a segment, in pixels
+    int min_length;
+    // maximal gap between two pixels of a segment, in pixels
+    int max_gap;
+    // angular resolution: pi / nb_angles
+    int nb_angles;
+    // of the segments returned by a call to detect
+    int max_segments;
+};
+
+// Progressive probabilistic Hough transform (Matas et al.): the pixels of
+// the mask vote in a random order, and as soon as a line gets enough
+// votes, its segment is walked along the mask, and its pixels are
+// removed (including their votes). Much faster than the standard
+// transform when the mask is sparse (e.g. thresholded frame
+// differences). The buffers are kept between calls.
+class LineDetector
+{
+public:
+    LineDetector(int width, int height, HoughOptions options = HoughOptions());
+    // mask: width x height, non zero for the pixels to consider. The mask
+    // is used as working memory: the pixels of the segments found are
+    // cleared, the others are set to non zero values.
+    std::vector<LineSegment> detect(std::vector<uint8_t>& mask);
+    int get_width() const;
+    int get_height() const;
+    const HoughOptions& get_options() const;
+
+private:
+    void vote(int x, int y, int increment, int* max_votes, int* max_angle);
+
+private:
+    int width_;
+    int height_;
+    HoughOptions options_;
+    int nb_rho_;
+    std::vector<float> cos_;
+    std::vector<float> sin_;
+    // nb_angles x nb_rho
+    std::vector<int> accumulator_;
+    std::vector<int> points_;
+    std::mt19937 random_;
+};
+
+// Lines are searched in the difference of binned frames (see
+// MeteorDetector, VideoIntegrator), thresholded at a multiple of its
+// noise.
+
+// sums of binning x binning pixels of the frame (all channels), the
+// pixels of the incomplete bins of the right and bottom borders are
+// ignored
+void bin_frame(const Frame& frame,
+               int binning,
+               int binned_width,
+               int binned_height,
+               int32_t* binned);
+
+// standard deviation of the difference between the values and the
+// reference, estimated from its mean absolute value (sigma sqrt(2/pi)
+// for a gaussian noise)
+double estimate_difference_noise(const int32_t* values,
+                                 const int32_t* reference,
+                                 int size);
+double estimate_difference_noise(const int32_t* values,
+                                 const float* reference,
+                                 int size);
+
+}  // namespace zwo_asi
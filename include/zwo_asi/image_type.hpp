@@ -12,5 +12,8 @@ enum ImageType
     y8
 };
 std::string to_string(ImageType type);
+// throws std::runtime_error for unknown types
+ImageType get_image_type(std::string type);
 ASI_IMG_TYPE get_native(ImageType type);
+int get_bytes_per_pixel(ImageType type);
 }  // namespace zwo_asi
@@ -0,0 +1,125 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "zwo_asi/camera.hpp"
+#include "zwo_asi/hough.hpp"
+
+namespace zwo_asi
+{
+class IntegratorOptions
+{
+public:
+    IntegratorOptions();
+
+public:
+    // number of video frames integrated (K)
+    int nb_frames;
+    // the highest value of each pixel over the K frames is rejected
+    // (replaced by the mean of the other values) if it exceeds this mean
+    // by more than this threshold, in pixel values (e.g. satellite
+    // trails, cosmic rays). Negative: no rejection.
+    double rejection_threshold;
+    // satellite trails: from the second frame of an integration, lines
+    // are searched (see LineDetector, in binned pixels) in the
+    // difference between the frame (binned by trail_binning) and the
+    // mean of the frames already integrated, thresholded at trail_sigma
+    // times its noise. The pixels closer than trail_width pixels to a
+    // line are not integrated: their sum is scaled to the K frames.
+    // Trails of the first frame of an integration are not masked (but
+    // may be rejected, see rejection_threshold). Negative trail_sigma:
+    // no masking.
+    double trail_sigma;
+    int trail_binning;
+    int trail_width;
+    HoughOptions trail_hough;
+};
+
+// Sum of K video frames: synthetic exposure of K times the exposure of
+// the frames.
+class IntegratedFrame
+{
+public:
+    IntegratedFrame(int width, int height, ImageType type);
+    int size() const;
+
+public:
+    int width;
+    int height;
+    // of the integrated frames
+    ImageType type;
+    long index;
+    // of the last integrated frame
+    std::chrono::steady_clock::time_point timestamp;
+    int nb_frames;
+    // total exposure time, -1 if unknown
+    long exposure_us;
+    long nb_rejected;
+    // number of trails found, and of values masked (see
+    // IntegratorOptions::trail_sigma)
+    int nb_trails;
+    long nb_masked;
+    // one value per pixel (three per pixel for rgb24)
+    std::vector<uint32_t> data;
+};
+
+// Integrates consecutive video frames into 32 bits accumulators. Frames
+// are not kept: the sum and the highest value of each pixel are updated
+// as frames are added, and the outliers are rejected when the K-th
+// frame is added. Frames acquired with different settings (see
+// Frame::settings) are not integrated together: a change of the
+// settings restarts the integration.
+// Satellite trails can be masked as the frames are added (see
+// IntegratorOptions::trail_sigma), without keeping the frames.
+class VideoIntegrator
+{
+public:
+    VideoIntegrator(int width,
+                    int height,
+                    ImageType type,
+                    IntegratorOptions options = IntegratorOptions());
+    // returns true if the frame completed an integration, which is then
+    // available (get_frame) until the next one is completed
+    bool add(const Frame& frame);
+    const IntegratedFrame& get_frame() const;
+    // reads video frames from the camera (which must be streaming) until
+    // an integration is complete
+    const IntegratedFrame& capture(Camera& camera, int wait_ms);
+    // number of frames of the current integration
+    int get_nb_added() const;
+    void reset();
+    const IntegratorOptions& get_options() const;
+
+private:
+    void complete();
+    bool mask_trails(const Frame& frame);
+
+private:
+    IntegratorOptions options_;
+    int nb_added_;
+    long nb_integrated_;
+    FrameSettings settings_;
+    std::vector<uint32_t> sum_;
+    std::vector<uint32_t> max_;
+    IntegratedFrame integrated_;
+    Frame frame_;
+    // trail masking only
+    std::unique_ptr<LineDetector> trail_detector_;
+    int binned_width_;
+    int binned_height_;
+    std::vector<int32_t> binned_;
+    // of the (not masked) binned frames of the integration, and their
+    // number for each bin
+    std::vector<float> binned_mean_;
+    std::vector<uint32_t> binned_count_;
+    std::vector<uint8_t> binned_mask_;
+    // one value per value of the frames, non zero for masked values
+    std::vector<uint8_t> mask_;
+    // number of frames integrated, for each value
+    std::vector<uint32_t> count_;
+    int nb_trails_;
+    long nb_masked_;
+};
+
+}  // namespace zwo_asi
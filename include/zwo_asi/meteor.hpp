@@ -0,0 +1,134 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "zwo_asi/hough.hpp"
+#include "zwo_asi/pipeline.hpp"
+
+namespace zwo_asi
+{
+class MeteorOptions
+{
+public:
+    MeteorOptions();
+
+public:
+    // the frames are binned (binning x binning pixels, channels summed)
+    // before differencing
+    int binning;
+    // a binned pixel is "changed" if it got brighter than the previous
+    // frame by more than sigma_threshold times the noise of the
+    // difference (estimated from its mean absolute value)
+    double sigma_threshold;
+    // frames with a larger fraction of changed pixels are not searched
+    // (e.g. clouds, lights, exposure changes)
+    double max_changed_fraction;
+    // in binned pixels
+    HoughOptions hough;
+    // frames kept before the detection, and recorded after it. Frames
+    // of the events are written to
+    // <folder>/<prefix><trigger frame index>/frame_<index>.raw (see
+    // RawSource) along with event.txt. Empty folder: events are only
+    // recorded in memory.
+    int pre_trigger_frames;
+    int post_trigger_frames;
+    std::filesystem::path folder;
+    std::string prefix;
+};
+
+class MeteorEvent
+{
+public:
+    std::string to_string() const;
+
+public:
+    long trigger_index;
+    long first_index;
+    long last_index;
+    // in pixels of the frames
+    std::vector<LineSegment> segments;
+    // empty if not written
+    std::filesystem::path folder;
+};
+
+// Detects meteors (and other transients drawing lines, e.g. satellites
+// or planes) in a stream of frames: each frame is binned and compared to
+// the previous one, and lines are searched in the thresholded difference
+// (LineDetector). The last pre_trigger_frames frames are kept in a
+// ring of preallocated frames (2 x (pre + post + 1) frames are
+// allocated, so that an event can be written while the next one is
+// recorded). Events are written by a background thread; if it cannot
+// keep up, frames are dropped from the ring.
+// Frames must be processed in order: add the stage to a pipeline as
+// serialized.
+class MeteorDetector : public Stage
+{
+public:
+    MeteorDetector(int width,
+                   int height,
+                   ImageType type,
+                   MeteorOptions options = MeteorOptions());
+    // writes the events already complete
+    ~MeteorDetector();
+    void process(Frame& frame);
+    // completes the event being recorded (if any) with the frames
+    // received so far, and waits until all events are written
+    void flush();
+    // completed events, in order
+    std::vector<MeteorEvent> get_events() const;
+    long get_nb_frames() const;
+    // frames too different from the previous one to be searched
+    long get_nb_skipped() const;
+    // frames not kept because no frame of the ring was available
+    long get_nb_dropped() const;
+    // of the writing of the events
+    std::string get_last_error() const;
+
+private:
+    struct Event
+    {
+        MeteorEvent info;
+        std::vector<std::shared_ptr<Frame>> frames;
+    };
+    std::vector<LineSegment> detect(const Frame& frame);
+    void complete_event();
+    void write(Event& event);
+    void run();
+
+private:
+    int width_;
+    int height_;
+    ImageType type_;
+    MeteorOptions options_;
+    int binned_width_;
+    int binned_height_;
+    LineDetector detector_;
+    std::vector<int32_t> current_;
+    std::vector<int32_t> previous_;
+    bool has_previous_;
+    std::vector<uint8_t> mask_;
+    FramePool pool_;
+    std::deque<std::shared_ptr<Frame>> ring_;
+    std::unique_ptr<Event> event_;
+    int remaining_;
+    long nb_frames_;
+    long nb_skipped_;
+    long nb_dropped_;
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::condition_variable written_;
+    std::deque<std::unique_ptr<Event>> queue_;
+    bool writing_;
+    bool stop_;
+    std::vector<MeteorEvent> events_;
+    std::string last_error_;
+    std::thread thread_;
+};
+
+}  // namespace zwo_asi
@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "zwo_asi/frame.hpp"
+#include "zwo_asi/thread_pool.hpp"
+
+namespace zwo_asi
+{
+// A processing step of a pipeline. process is called from the worker
+// threads, possibly concurrently on different frames (unless the stage
+// has been added to the pipeline as serialized).
+// The pipeline calls submit, which calls process by default. Stages that
+// need to keep a reference on the frame (e.g. BatchStage) override submit.
+class Stage
+{
+public:
+    virtual ~Stage();
+    virtual void submit(std::shared_ptr<Frame> frame);
+    virtual void process(Frame& frame) = 0;
+};
+
+class FunctionStage : public Stage
+{
+public:
+    FunctionStage(std::function<void(Frame&)> function);
+    void process(Frame& frame);
+
+private:
+    std::function<void(Frame&)> function_;
+};
+
+class StageMetrics
+{
+public:
+    std::string name;
+    long processed;
+    long failed;
+    long queued;
+    long max_queued;
+    double mean_latency_us;
+    double max_latency_us;
+    double mean_wait_us;
+    std::string last_error;
+};
+
+class PipelineMetrics
+{
+public:
+    long pushed;
+    long completed;
+    long rejected;
+    int in_flight;
+    int max_in_flight;
+    std::vector<StageMetrics> stages;
+
+public:
+    std::string to_string() const;
+};
+
+// Directed acyclic graph of stages, executed on a work-stealing thread
+// pool. Each pushed frame goes through all the stages; a stage starts
+// once all the stages it has been declared to run after are done with
+// the frame. The number of frames being processed at the same time
+// is bounded by max_in_flight. If a stage throws, the stages downstream
+// of it are skipped for this frame.
+class Pipeline
+{
+public:
+    Pipeline(int nb_threads = 0, int max_in_flight = 4);
+    ~Pipeline();
+    void add_stage(std::string name,
+                   std::shared_ptr<Stage> stage,
+                   std::vector<std::string> after = {},
+                   bool serialized = false);
+    void push(std::shared_ptr<Frame> frame);
+    bool try_push(std::shared_ptr<Frame> frame);
+    void wait();
+    PipelineMetrics get_metrics() const;
+    std::vector<std::string> get_stages() const;
+
+private:
+    struct Node
+    {
+        std::string name;
+        std::shared_ptr<Stage> stage;
+        std::vector<int> successors;
+        int nb_predecessors;
+        bool serialized;
+        std::mutex mutex;
+        std::atomic<long> processed;
+        std::atomic<long> failed;
+        std::atomic<long> queued;
+        std::atomic<long> max_queued;
+        std::atomic<long> total_latency_ns;
+        std::atomic<long> max_latency_ns;
+        std::atomic<long> total_wait_ns;
+        std::string last_error;
+    };
+    struct Job;
+    void start(std::shared_ptr<Frame> frame);
+    void schedule(std::shared_ptr<Job> job, int node);
+    void execute(std::shared_ptr<Job> job, int node);
+    void fail(Node& node, std::string error);
+    void complete();
+
+private:
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::map<std::string, int> indexes_;
+    std::vector<int> roots_;
+    int max_in_flight_;
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    int in_flight_;
+    long pushed_;
+    long completed_;
+    long rejected_;
+    bool started_;
+    // declared last: destroyed (and its threads joined) first
+    ThreadPool pool_;
+};
+
+}  // namespace zwo_asi
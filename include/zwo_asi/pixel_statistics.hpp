@@ -0,0 +1,94 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "zwo_asi/camera.hpp"
+#include "zwo_asi/frame_source.hpp"
+#include "zwo_asi/thread_pool.hpp"
+
+namespace zwo_asi
+{
+enum class StatisticsPrecision
+{
+    float32,
+    float64
+};
+
+class PixelStatisticsOptions
+{
+public:
+    PixelStatisticsOptions();
+
+public:
+    // of the per pixel accumulators (float32: half the memory, enough
+    // for sequences of tens of thousands of frames)
+    StatisticsPrecision precision;
+    // 0: one per core
+    int nb_threads;
+    // the frames are processed in bands of rows, the accumulators of a
+    // band (about band_bytes) staying in cache while the frames of a
+    // batch are added
+    int band_bytes;
+    // number of frames read from the camera before being added
+    // (see PixelStatistics::capture)
+    int batch_size;
+};
+
+// Per pixel mean and variance over a sequence of frames, updated as the
+// frames are added (Welford's algorithm), so that the sequence does not
+// need to be stored (e.g. read noise maps from bias frames, random
+// telegraph noise maps). Not thread safe.
+class PixelStatistics
+{
+public:
+    PixelStatistics(int width,
+                    int height,
+                    ImageType type,
+                    PixelStatisticsOptions options = PixelStatisticsOptions());
+    void add(const Frame& frame);
+    void add(const std::vector<std::shared_ptr<Frame>>& frames);
+    // reads the frames of the source (all of them, or at most
+    // nb_frames), batch_size at a time: a batch is added while the next
+    // one is read. Frames failing to decode are skipped (see
+    // read_skipping_errors). Returns the number of frames added.
+    long add(FrameSource& source,
+             long nb_frames = -1,
+             ReadErrors* errors = nullptr);
+    // reads nb_frames video frames from the camera (which must be
+    // streaming), see add(FrameSource&)
+    void capture(Camera& camera, long nb_frames, int wait_ms);
+    long get_nb_frames() const;
+    // one value per pixel (three per pixel for rgb24)
+    std::vector<double> get_mean() const;
+    // sample variance (0 if less than two frames)
+    std::vector<double> get_variance() const;
+    void reset();
+    int get_width() const;
+    int get_height() const;
+    ImageType get_type() const;
+    const PixelStatisticsOptions& get_options() const;
+
+private:
+    void check(const Frame& frame) const;
+    // submits the update of the accumulators to the pool (returns before
+    // completion)
+    void submit(const std::vector<const Frame*>& frames);
+    template <typename P>
+    void submit(const std::vector<const Frame*>& frames,
+                std::vector<P>& mean,
+                std::vector<P>& m2);
+
+private:
+    int width_;
+    int height_;
+    ImageType type_;
+    PixelStatisticsOptions options_;
+    int row_size_;
+    long nb_frames_;
+    std::vector<float> mean32_;
+    std::vector<float> m2_32_;
+    std::vector<double> mean64_;
+    std::vector<double> m2_64_;
+    ThreadPool pool_;
+};
+
+}  // namespace zwo_asi
@@ -0,0 +1,116 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#include "zwo_asi/camera.hpp"
+
+namespace zwo_asi
+{
+// Statistics of a pair of frames acquired with the same settings
+// (in pixel values of the frames)
+class PairStatistics
+{
+public:
+    // of the two frames
+    double mean;
+    // of the difference of the frames, i.e. twice the temporal noise
+    // variance of a frame (fixed pattern noise cancels out)
+    double difference_variance;
+    long nb_values;
+};
+
+// Statistics of the centered region of the frames covering the fraction
+// region of their width and height (e.g. 0.5: central quarter of the
+// frames). Throws std::runtime_error if the frames do not match.
+PairStatistics compute_pair_statistics(const Frame& a,
+                                       const Frame& b,
+                                       double region = 1.);
+
+class PtcOptions
+{
+public:
+    PtcOptions();
+
+public:
+    // gains to characterize (empty: current gain)
+    std::vector<long> gains;
+    // exposures of the flat pairs, which should span from low signal to
+    // above saturation
+    std::vector<long> exposures_us;
+    // see compute_pair_statistics
+    double region;
+};
+
+// Point of a photon transfer curve, in ADU (of the sensor bit depth)
+class PtcPoint
+{
+public:
+    long exposure_us;
+    // mean signal above bias
+    double signal;
+    // temporal noise variance of a frame, minus the read noise variance
+    double shot_variance;
+};
+
+class GainCharacterization
+{
+public:
+    long gain;
+    long offset;
+    double elec_per_adu;
+    double bias_adu;
+    double read_noise_adu;
+    double read_noise_e;
+    double full_well_e;
+    // false if no flat pair reached saturation: full_well_e is then a
+    // lower bound
+    bool saturated;
+    std::vector<PtcPoint> points;
+
+public:
+    std::string to_string() const;
+};
+
+// Measured characteristics of a camera, per gain. Saved in a (text)
+// file, one line per gain.
+class PtcProfile
+{
+public:
+    std::string camera_model;
+    std::string serial;
+    std::vector<GainCharacterization> gains;
+
+public:
+    // nullptr if the gain was not characterized
+    const GainCharacterization* get(long gain) const;
+    std::string to_string() const;
+    void save(const std::filesystem::path& path) const;
+    static PtcProfile load(const std::filesystem::path& path);
+};
+
+// ~/.cache/camera_zwo_asi/ptc/<camera model>_<serial>
+std::filesystem::path get_default_ptc_profile(const Camera& camera);
+
+// Fits the photon transfer curve of a gain: the shot noise variance is
+// proportional to the signal (1 / elec_per_adu) up to the full well,
+// beyond which the variance decreases.
+GainCharacterization fit_ptc(long gain,
+                             double bias_adu,
+                             double read_noise_adu,
+                             std::vector<PtcPoint> points);
+
+// For each gain, captures a bias pair (shortest exposure, the sensor
+// must be covered) and flat pairs (the sensor must be evenly
+// illuminated) for each exposure, and fits the photon transfer curve.
+// Frames are captured in raw16 if supported (the roi is restored).
+// Values are in ADU of the sensor bit depth (as CameraInfo::elec_per_adu).
+// As the bias and flat frames need different illuminations, the bias
+// pairs of all gains are captured first, then on_flats is called (e.g. to
+// ask for the light to be turned on) before the flat pairs.
+PtcProfile characterize(
+    Camera& camera,
+    const PtcOptions& options = PtcOptions(),
+    std::function<void()> on_flats = std::function<void()>());
+
+}  // namespace zwo_asi
@@ -0,0 +1,48 @@
+#pragma once
+#include "ASICamera2.h"
+
+namespace zwo_asi
+{
+// name of the error code (e.g. "ASI_ERROR_TIMEOUT")
+const char* get_error_name(ASI_ERROR_CODE error_code) noexcept;
+
+enum class ResultCode
+{
+    ok,
+    // no frame / status change before the deadline
+    timeout,
+    // camera removed or closed
+    disconnected,
+    // exposure or video capture in progress
+    busy,
+    // invalid control, value, size or roi
+    invalid,
+    failed
+};
+
+ResultCode get_result_code(ASI_ERROR_CODE error_code) noexcept;
+
+// Lightweight outcome of the noexcept (try_*) methods of Camera, for
+// hot paths (e.g. video capture loops) where building and catching a
+// CameraException on each timeout would be too costly.
+class Result
+{
+public:
+    Result() noexcept;
+    Result(ASI_ERROR_CODE error_code, const char* message) noexcept;
+    Result(ResultCode code,
+           ASI_ERROR_CODE error_code,
+           const char* message) noexcept;
+    bool ok() const noexcept;
+    explicit operator bool() const noexcept;
+
+public:
+    ResultCode code;
+    // ASI_SUCCESS for failures not reported by the SDK
+    // (e.g. camera busy)
+    ASI_ERROR_CODE error_code;
+    // static string describing the failing operation, nullptr if ok
+    const char* message;
+};
+
+}  // namespace zwo_asi
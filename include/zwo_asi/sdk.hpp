@@ -0,0 +1,154 @@
+#pragma once
+#include <memory>
+#include "ASICamera2.h"
+
+namespace zwo_asi
+{
+// Interface over the functions of the ZWO SDK (same names, without the
+// ASI prefix, and same arguments). All calls to the SDK go through the
+// instance returned by get_sdk, which allows to replace the cameras by
+// simulated ones (see SimulatedSdk), e.g. for testing.
+class Sdk
+{
+public:
+    virtual ~Sdk();
+    virtual int GetNumOfConnectedCameras() = 0;
+    virtual ASI_ERROR_CODE GetCameraProperty(ASI_CAMERA_INFO* info,
+                                             int camera_index) = 0;
+    virtual ASI_ERROR_CODE OpenCamera(int camera_id) = 0;
+    virtual ASI_ERROR_CODE InitCamera(int camera_id) = 0;
+    virtual ASI_ERROR_CODE CloseCamera(int camera_id) = 0;
+    virtual ASI_ERROR_CODE GetNumOfControls(int camera_id,
+                                            int* nb_controls) = 0;
+    virtual ASI_ERROR_CODE GetControlCaps(int camera_id,
+                                          int control_index,
+                                          ASI_CONTROL_CAPS* caps) = 0;
+    virtual ASI_ERROR_CODE GetControlValue(int camera_id,
+                                           ASI_CONTROL_TYPE control,
+                                           long* value,
+                                           ASI_BOOL* is_auto) = 0;
+    virtual ASI_ERROR_CODE SetControlValue(int camera_id,
+                                           ASI_CONTROL_TYPE control,
+                                           long value,
+                                           ASI_BOOL is_auto) = 0;
+    virtual ASI_ERROR_CODE SetROIFormat(
+        int camera_id, int width, int height, int bin, ASI_IMG_TYPE type) = 0;
+    virtual ASI_ERROR_CODE GetROIFormat(int camera_id,
+                                        int* width,
+                                        int* height,
+                                        int* bin,
+                                        ASI_IMG_TYPE* type) = 0;
+    virtual ASI_ERROR_CODE SetStartPos(int camera_id,
+                                       int start_x,
+                                       int start_y) = 0;
+    virtual ASI_ERROR_CODE GetStartPos(int camera_id,
+                                       int* start_x,
+                                       int* start_y) = 0;
+    virtual ASI_ERROR_CODE GetDroppedFrames(int camera_id,
+                                            int* dropped_frames) = 0;
+    virtual ASI_ERROR_CODE EnableDarkSubtract(int camera_id,
+                                              char* bmp_path) = 0;
+    virtual ASI_ERROR_CODE DisableDarkSubtract(int camera_id) = 0;
+    virtual ASI_ERROR_CODE StartVideoCapture(int camera_id) = 0;
+    virtual ASI_ERROR_CODE StopVideoCapture(int camera_id) = 0;
+    virtual ASI_ERROR_CODE GetVideoData(int camera_id,
+                                        unsigned char* buffer,
+                                        long buffer_size,
+                                        int wait_ms) = 0;
+    virtual ASI_ERROR_CODE PulseGuideOn(int camera_id,
+                                        ASI_GUIDE_DIRECTION direction) = 0;
+    virtual ASI_ERROR_CODE PulseGuideOff(int camera_id,
+                                         ASI_GUIDE_DIRECTION direction) = 0;
+    virtual ASI_ERROR_CODE StartExposure(int camera_id, ASI_BOOL is_dark) = 0;
+    virtual ASI_ERROR_CODE StopExposure(int camera_id) = 0;
+    virtual ASI_ERROR_CODE GetExpStatus(int camera_id,
+                                        ASI_EXPOSURE_STATUS* status) = 0;
+    virtual ASI_ERROR_CODE GetDataAfterExp(int camera_id,
+                                           unsigned char* buffer,
+                                           long buffer_size) = 0;
+    virtual ASI_ERROR_CODE GetID(int camera_id, ASI_ID* id) = 0;
+    virtual ASI_ERROR_CODE SetID(int camera_id, ASI_ID id) = 0;
+    virtual ASI_ERROR_CODE GetGainOffset(int camera_id,
+                                         int* offset_highest_dr,
+                                         int* offset_unity_gain,
+                                         int* gain_lowest_rn,
+                                         int* offset_lowest_rn) = 0;
+    virtual const char* GetSDKVersion() = 0;
+    virtual ASI_ERROR_CODE GetCameraMode(int camera_id,
+                                         ASI_CAMERA_MODE* mode) = 0;
+    virtual ASI_ERROR_CODE SetCameraMode(int camera_id,
+                                         ASI_CAMERA_MODE mode) = 0;
+    virtual ASI_ERROR_CODE SendSoftTrigger(int camera_id, ASI_BOOL start) = 0;
+    virtual ASI_ERROR_CODE GetSerialNumber(int camera_id, ASI_SN* sn) = 0;
+};
+
+// Calls the functions of the ZWO SDK library
+class NativeSdk : public Sdk
+{
+public:
+    int GetNumOfConnectedCameras();
+    ASI_ERROR_CODE GetCameraProperty(ASI_CAMERA_INFO* info, int camera_index);
+    ASI_ERROR_CODE OpenCamera(int camera_id);
+    ASI_ERROR_CODE InitCamera(int camera_id);
+    ASI_ERROR_CODE CloseCamera(int camera_id);
+    ASI_ERROR_CODE GetNumOfControls(int camera_id, int* nb_controls);
+    ASI_ERROR_CODE GetControlCaps(int camera_id,
+                                  int control_index,
+                                  ASI_CONTROL_CAPS* caps);
+    ASI_ERROR_CODE GetControlValue(int camera_id,
+                                   ASI_CONTROL_TYPE control,
+                                   long* value,
+                                   ASI_BOOL* is_auto);
+    ASI_ERROR_CODE SetControlValue(int camera_id,
+                                   ASI_CONTROL_TYPE control,
+                                   long value,
+                                   ASI_BOOL is_auto);
+    ASI_ERROR_CODE SetROIFormat(
+        int camera_id, int width, int height, int bin, ASI_IMG_TYPE type);
+    ASI_ERROR_CODE GetROIFormat(
+        int camera_id, int* width, int* height, int* bin, ASI_IMG_TYPE* type);
+    ASI_ERROR_CODE SetStartPos(int camera_id, int start_x, int start_y);
+    ASI_ERROR_CODE GetStartPos(int camera_id, int* start_x, int* start_y);
+    ASI_ERROR_CODE GetDroppedFrames(int camera_id, int* dropped_frames);
+    ASI_ERROR_CODE EnableDarkSubtract(int camera_id, char* bmp_path);
+    ASI_ERROR_CODE DisableDarkSubtract(int camera_id);
+    ASI_ERROR_CODE StartVideoCapture(int camera_id);
+    ASI_ERROR_CODE StopVideoCapture(int camera_id);
+    ASI_ERROR_CODE GetVideoData(int camera_id,
+                                unsigned char* buffer,
+                                long buffer_size,
+                                int wait_ms);
+    ASI_ERROR_CODE PulseGuideOn(int camera_id, ASI_GUIDE_DIRECTION direction);
+    ASI_ERROR_CODE PulseGuideOff(int camera_id,
+                                 ASI_GUIDE_DIRECTION direction);
+    ASI_ERROR_CODE StartExposure(int camera_id, ASI_BOOL is_dark);
+    ASI_ERROR_CODE StopExposure(int camera_id);
+    ASI_ERROR_CODE GetExpStatus(int camera_id, ASI_EXPOSURE_STATUS* status);
+    ASI_ERROR_CODE GetDataAfterExp(int camera_id,
+                                   unsigned char* buffer,
+                                   long buffer_size);
+    ASI_ERROR_CODE GetID(int camera_id, ASI_ID* id);
+    ASI_ERROR_CODE SetID(int camera_id, ASI_ID id);
+    ASI_ERROR_CODE GetGainOffset(int camera_id,
+                                 int* offset_highest_dr,
+                                 int* offset_unity_gain,
+                                 int* gain_lowest_rn,
+                                 int* offset_lowest_rn);
+    const char* GetSDKVersion();
+    ASI_ERROR_CODE GetCameraMode(int camera_id, ASI_CAMERA_MODE* mode);
+    ASI_ERROR_CODE SetCameraMode(int camera_id, ASI_CAMERA_MODE mode);
+    ASI_ERROR_CODE SendSoftTrigger(int camera_id, ASI_BOOL start);
+    ASI_ERROR_CODE GetSerialNumber(int camera_id, ASI_SN* sn);
+};
+
+// Returns the SDK in use (NativeSdk unless set_sdk has been called).
+// The SDK is shared: it stays alive as long as it is used, even if
+// replaced meanwhile (e.g. cameras keep the SDK they were opened with).
+std::shared_ptr<Sdk> get_sdk();
+
+// Replaces the SDK in use (nullptr: back to the native SDK), for the
+// cameras opened from now on. The enumeration of the cameras is
+// invalidated.
+void set_sdk(std::shared_ptr<Sdk> sdk);
+
+}  // namespace zwo_asi
@@ -0,0 +1,91 @@
+#pragma once
+#include <chrono>
+#include <map>
+#include <memory>
+#include "zwo_asi/camera.hpp"
+
+namespace zwo_asi
+{
+class RecoveryMetrics
+{
+public:
+    long recoveries;
+    long failed_recoveries;
+    long timeouts;
+    double last_recovery_ms;
+    double max_recovery_ms;
+    double total_recovery_ms;
+    double last_gap_ms;
+    double total_gap_ms;
+    long lost_frames;
+};
+
+// Wrapper over a camera recovering from USB faults. When the camera is
+// removed from the bus (or no video frame has been received for
+// max_consecutive_timeouts frame intervals: the exposure, or the
+// measured frame period if longer, plus a margin), the camera is
+// closed, searched again (by serial number, or by name if it has none,
+// as its index may have changed), opened, and its configuration (ROI,
+// controls and camera mode, as read at construction and updated by the
+// setters of the session) is replayed. Video capture is restarted if it
+// was active. Recovery is attempted for up to recovery_timeout, after
+// which a CameraException is thrown.
+// Not thread safe.
+class Session
+{
+public:
+    Session(int camera_index,
+            std::chrono::milliseconds recovery_timeout =
+                std::chrono::milliseconds(10000),
+            int max_consecutive_timeouts = 3);
+    Camera& get_camera();
+    void set_roi(const ROI& roi);
+    void set_control(std::string control, long value);
+    void set_auto(std::string control);
+    void set_exposure_and_gain(long exposure_us, long gain);
+    void set_camera_mode(CameraMode mode);
+    void capture(Frame& frame);
+    void start_video();
+    void stop_video();
+    bool get_video_frame(Frame& frame, int wait_ms);
+    void recover();
+    RecoveryMetrics get_metrics() const;
+
+private:
+    struct ControlState
+    {
+        long value;
+        bool is_auto;
+    };
+    static bool is_fault(ASI_ERROR_CODE error_code);
+    template <typename F>
+    auto run(F function) -> decltype(function());
+    void read_state();
+    void replay();
+    void frame_received();
+    // after which a video frame is late
+    double get_frame_interval_ms() const;
+
+private:
+    std::unique_ptr<Camera> camera_;
+    std::string serial_;
+    std::string name_;
+    int camera_index_;
+    std::chrono::milliseconds recovery_timeout_;
+    int max_consecutive_timeouts_;
+    int consecutive_timeouts_;
+    ROI roi_;
+    std::map<std::string, ControlState> controls_;
+    CameraMode mode_;
+    bool video_;
+    long nb_frames_;
+    std::chrono::steady_clock::time_point last_frame_;
+    double frame_period_ms_;
+    // last frame, start of the video or late frame counted as a timeout
+    std::chrono::steady_clock::time_point waiting_since_;
+    // set by recover, until the next frame
+    bool in_gap_;
+    RecoveryMetrics metrics_;
+};
+
+}  // namespace zwo_asi
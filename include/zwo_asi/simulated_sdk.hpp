@@ -0,0 +1,146 @@
+#pragma once
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "zwo_asi/sdk.hpp"
+
+namespace zwo_asi
+{
+// Implementation of the SDK with simulated cameras, for testing without
+// hardware (see set_sdk). Frames are generated from a noise model
+// (photon and read noise, gain in 0.1dB, offset, full well), and the
+// video mode delivers frames at the rate allowed by the exposure and
+// the BandWidth control. Faults can be injected: a disconnected camera
+// returns ASI_ERROR_CAMERA_REMOVED until reconnected, and has then to
+// be opened again.
+class SimulatedSdk : public Sdk
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+public:
+    SimulatedSdk(int nb_cameras = 1,
+                 std::string name = "ZWO ASI Simulator",
+                 int max_width = 1280,
+                 int max_height = 960,
+                 bool usb3 = true,
+                 bool color = true);
+
+    // fault injection
+    void disconnect(int camera_id,
+                    std::chrono::milliseconds duration =
+                        std::chrono::milliseconds(0));
+    void reconnect(int camera_id);
+    void inject_timeouts(int camera_id, int nb_calls);
+    // the cameras (closed) take each other's camera id, as cameras of the
+    // same model may do when the USB devices are enumerated again
+    void swap(int camera_id_a, int camera_id_b);
+
+    // sensor model
+    void set_flux(double electrons_per_second);
+    void set_read_noise(double electrons);
+    void set_full_well(double electrons);
+
+    int GetNumOfConnectedCameras();
+    ASI_ERROR_CODE GetCameraProperty(ASI_CAMERA_INFO* info, int camera_index);
+    ASI_ERROR_CODE OpenCamera(int camera_id);
+    ASI_ERROR_CODE InitCamera(int camera_id);
+    ASI_ERROR_CODE CloseCamera(int camera_id);
+    ASI_ERROR_CODE GetNumOfControls(int camera_id, int* nb_controls);
+    ASI_ERROR_CODE GetControlCaps(int camera_id,
+                                  int control_index,
+                                  ASI_CONTROL_CAPS* caps);
+    ASI_ERROR_CODE GetControlValue(int camera_id,
+                                   ASI_CONTROL_TYPE control,
+                                   long* value,
+                                   ASI_BOOL* is_auto);
+    ASI_ERROR_CODE SetControlValue(int camera_id,
+                                   ASI_CONTROL_TYPE control,
+                                   long value,
+                                   ASI_BOOL is_auto);
+    ASI_ERROR_CODE SetROIFormat(
+        int camera_id, int width, int height, int bin, ASI_IMG_TYPE type);
+    ASI_ERROR_CODE GetROIFormat(
+        int camera_id, int* width, int* height, int* bin, ASI_IMG_TYPE* type);
+    ASI_ERROR_CODE SetStartPos(int camera_id, int start_x, int start_y);
+    ASI_ERROR_CODE GetStartPos(int camera_id, int* start_x, int* start_y);
+    ASI_ERROR_CODE GetDroppedFrames(int camera_id, int* dropped_frames);
+    ASI_ERROR_CODE EnableDarkSubtract(int camera_id, char* bmp_path);
+    ASI_ERROR_CODE DisableDarkSubtract(int camera_id);
+    ASI_ERROR_CODE StartVideoCapture(int camera_id);
+    ASI_ERROR_CODE StopVideoCapture(int camera_id);
+    ASI_ERROR_CODE GetVideoData(int camera_id,
+                                unsigned char* buffer,
+                                long buffer_size,
+                                int wait_ms);
+    ASI_ERROR_CODE PulseGuideOn(int camera_id, ASI_GUIDE_DIRECTION direction);
+    ASI_ERROR_CODE PulseGuideOff(int camera_id,
+                                 ASI_GUIDE_DIRECTION direction);
+    ASI_ERROR_CODE StartExposure(int camera_id, ASI_BOOL is_dark);
+    ASI_ERROR_CODE StopExposure(int camera_id);
+    ASI_ERROR_CODE GetExpStatus(int camera_id, ASI_EXPOSURE_STATUS* status);
+    ASI_ERROR_CODE GetDataAfterExp(int camera_id,
+                                   unsigned char* buffer,
+                                   long buffer_size);
+    ASI_ERROR_CODE GetID(int camera_id, ASI_ID* id);
+    ASI_ERROR_CODE SetID(int camera_id, ASI_ID id);
+    ASI_ERROR_CODE GetGainOffset(int camera_id,
+                                 int* offset_highest_dr,
+                                 int* offset_unity_gain,
+                                 int* gain_lowest_rn,
+                                 int* offset_lowest_rn);
+    const char* GetSDKVersion();
+    ASI_ERROR_CODE GetCameraMode(int camera_id, ASI_CAMERA_MODE* mode);
+    ASI_ERROR_CODE SetCameraMode(int camera_id, ASI_CAMERA_MODE mode);
+    ASI_ERROR_CODE SendSoftTrigger(int camera_id, ASI_BOOL start);
+    ASI_ERROR_CODE GetSerialNumber(int camera_id, ASI_SN* sn);
+
+private:
+    struct SimulatedCamera
+    {
+        ASI_CAMERA_INFO info;
+        ASI_SN serial;
+        ASI_ID id;
+        std::vector<ASI_CONTROL_CAPS> caps;
+        std::map<int, long> values;
+        std::map<int, bool> is_auto;
+        bool connected;
+        clock::time_point reconnect_at;
+        bool opened;
+        bool initialized;
+        int width;
+        int height;
+        int bin;
+        ASI_IMG_TYPE type;
+        int start_x;
+        int start_y;
+        ASI_CAMERA_MODE mode;
+        ASI_EXPOSURE_STATUS status;
+        clock::time_point exposure_end;
+        bool dark;
+        bool video;
+        clock::time_point next_frame_at;
+        int buffered;
+        int dropped;
+        int timeouts;
+        unsigned long long seed;
+    };
+    SimulatedCamera* find(int camera_id,
+                          ASI_ERROR_CODE& error,
+                          bool must_be_opened = true);
+    void produce(SimulatedCamera& camera);
+    long frame_size(const SimulatedCamera& camera) const;
+    double frame_period_us(const SimulatedCamera& camera) const;
+    void generate(SimulatedCamera& camera, unsigned char* buffer, bool dark);
+
+private:
+    std::mutex mutex_;
+    std::vector<SimulatedCamera> cameras_;
+    double flux_;
+    double read_noise_;
+    double full_well_;
+};
+
+}  // namespace zwo_asi
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+#include "zwo_asi/pipeline.hpp"
+
+namespace zwo_asi
+{
+class KeogramOptions
+{
+public:
+    KeogramOptions();
+
+public:
+    // column of the frames (-1: center), averaged over strip_width
+    // columns
+    int column;
+    int strip_width;
+    // once the keogram has max_columns columns, pairs of columns are
+    // averaged (the time resolution is halved, the memory use bounded)
+    int max_columns;
+    // saved every checkpoint_interval frames (if not empty and the
+    // interval is positive). If the file exists (and matches the
+    // geometry), the keogram resumes from it.
+    std::filesystem::path checkpoint;
+    int checkpoint_interval;
+};
+
+// Keogram: one column per frame (a strip along the meridian, if the
+// frames are oriented north up), in the type of the frames.
+class KeogramStage : public Stage
+{
+public:
+    KeogramStage(int width,
+                 int height,
+                 ImageType type,
+                 KeogramOptions options = KeogramOptions());
+    void process(Frame& frame);
+    // width: number of columns, height: height of the frames
+    Frame get_image() const;
+    long get_nb_frames() const;
+    int get_nb_columns() const;
+    // number of frames averaged into each column
+    int get_frames_per_column() const;
+    void save(const std::filesystem::path& path) const;
+    // throws std::runtime_error if the file does not match the geometry
+    void load(const std::filesystem::path& path);
+    void reset();
+
+private:
+    void save_locked(const std::filesystem::path& path) const;
+
+private:
+    int width_;
+    int height_;
+    ImageType type_;
+    KeogramOptions options_;
+    int channels_;
+    int column_size_;
+    mutable std::mutex mutex_;
+    // sums of the frames of each column (column major: column_size_
+    // values per column)
+    std::vector<uint32_t> sums_;
+    // number of frames of each column (the last one may be incomplete)
+    std::vector<int> counts_;
+    int frames_per_column_;
+    long nb_frames_;
+};
+
+class StartrailOptions
+{
+public:
+    StartrailOptions();
+
+public:
+    // frames whose mean (fraction of the maximum pixel value) is not in
+    // [min_mean, max_mean] are skipped (e.g. daylight, clouds lit by
+    // the moon or the city)
+    double min_mean;
+    double max_mean;
+    // see KeogramOptions
+    std::filesystem::path checkpoint;
+    int checkpoint_interval;
+};
+
+// Startrails: maximum of each pixel over the frames.
+class StartrailStage : public Stage
+{
+public:
+    StartrailStage(int width,
+                   int height,
+                   ImageType type,
+                   StartrailOptions options = StartrailOptions());
+    void process(Frame& frame);
+    Frame get_image() const;
+    long get_nb_frames() const;
+    long get_nb_skipped() const;
+    void save(const std::filesystem::path& path) const;
+    void load(const std::filesystem::path& path);
+    void reset();
+
+private:
+    void save_locked(const std::filesystem::path& path) const;
+
+private:
+    int width_;
+    int height_;
+    ImageType type_;
+    StartrailOptions options_;
+    mutable std::mutex mutex_;
+    Frame max_;
+    long nb_frames_;
+    long nb_skipped_;
+};
+
+}  // namespace zwo_asi
@@ -0,0 +1,48 @@
+#pragma once
+#include <filesystem>
+#include <mutex>
+#include "zwo_asi/pipeline.hpp"
+#include "zwo_asi/utils.hpp"
+
+namespace zwo_asi
+{
+class FrameStatistics
+{
+public:
+    long index;
+    double min_value;
+    double max_value;
+    double mean;
+};
+
+FrameStatistics compute_statistics(const Frame& frame);
+
+// Computes min, max and mean pixel values of each frame,
+// keeping the values of the most recent one.
+class StatisticsStage : public Stage
+{
+public:
+    StatisticsStage();
+    void process(Frame& frame);
+    FrameStatistics get_last() const;
+
+private:
+    mutable std::mutex mutex_;
+    FrameStatistics last_;
+};
+
+// Writes the raw content of each frame to
+// <folder>/<prefix><frame index>.raw
+class RawWriterStage : public Stage
+{
+public:
+    RawWriterStage(std::filesystem::path folder,
+                   std::string prefix = "frame_");
+    void process(Frame& frame);
+
+private:
+    std::filesystem::path folder_;
+    std::string prefix_;
+};
+
+}  // namespace zwo_asi
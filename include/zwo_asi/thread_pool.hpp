@@ -0,0 +1,49 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zwo_asi
+{
+// Work-stealing thread pool: each worker owns a task queue.
+// Tasks submitted from a worker go to the back of its own queue (and are
+// popped from the back, for cache locality), while idle workers steal
+// from the front of the others' queues.
+class ThreadPool
+{
+public:
+    ThreadPool(int nb_threads = 0);
+    ~ThreadPool();
+    void submit(std::function<void()> task);
+    void wait_idle();
+    int size() const;
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    void run(int index);
+    bool pop(int index, std::function<void()>& task);
+    bool steal(int index, std::function<void()>& task);
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::atomic<long> queued_;
+    std::atomic<long> pending_;
+    std::atomic<unsigned int> next_;
+    bool stop_;
+};
+
+}  // namespace zwo_asi
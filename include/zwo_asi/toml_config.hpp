@@ -0,0 +1,51 @@
+#pragma once
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+#include "zwo_asi/camera_info.hpp"
+#include "zwo_asi/camera_snapshot.hpp"
+#include "zwo_asi/controllable.hpp"
+
+namespace zwo_asi
+{
+// Parses a configuration in the zwo_asi.toml schema (see Camera.to_toml):
+//
+//   camera_mode = "normal"   # optional
+//
+//   [controllables]
+//   Exposure = 10000
+//   Gain = "auto"
+//
+//   [roi]
+//   start_x = 0
+//   start_y = 0
+//   width = 1280
+//   height = 960
+//   bins = 1
+//   type = "raw16"
+//
+// Only the subset of TOML used by this schema is supported (tables,
+// integer, string and boolean values, comments). Other keys and tables
+// are ignored, but must use this subset as well. Throws
+// std::runtime_error (with the line number) on error.
+CameraSnapshot parse_toml_config(const std::string& content,
+                                 std::string source = "toml configuration");
+
+CameraSnapshot load_toml_config(const std::filesystem::path& path);
+
+// Checks the configuration can be applied to the camera: roi supported
+// by the camera, controls existing, writable, within range and
+// supporting auto mode (if requested). Returns the list of issues
+// (empty if the configuration is valid).
+std::vector<std::string> validate_config(
+    const CameraSnapshot& config,
+    const CameraInfo& info,
+    const std::map<std::string, Controllable>& controls);
+
+// Loads and validates the configuration (throws std::runtime_error
+// listing all issues, the camera being then unchanged), then applies
+// it with restore_snapshot. Returns the number of values written.
+int configure_from_toml(Camera& camera, const std::filesystem::path& path);
+
+}  // namespace zwo_asi
@@ -0,0 +1,262 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "zwo_asi/sdk.hpp"
+
+namespace zwo_asi
+{
+enum class TraceFunction : uint8_t
+{
+    GetNumOfConnectedCameras,
+    GetCameraProperty,
+    OpenCamera,
+    InitCamera,
+    CloseCamera,
+    GetNumOfControls,
+    GetControlCaps,
+    GetControlValue,
+    SetControlValue,
+    SetROIFormat,
+    GetROIFormat,
+    SetStartPos,
+    GetStartPos,
+    GetDroppedFrames,
+    EnableDarkSubtract,
+    DisableDarkSubtract,
+    StartVideoCapture,
+    StopVideoCapture,
+    GetVideoData,
+    PulseGuideOn,
+    PulseGuideOff,
+    StartExposure,
+    StopExposure,
+    GetExpStatus,
+    GetDataAfterExp,
+    GetID,
+    SetID,
+    GetGainOffset,
+    GetSDKVersion,
+    GetCameraMode,
+    SetCameraMode,
+    SendSoftTrigger,
+    GetSerialNumber
+};
+std::string to_string(TraceFunction function);
+
+// What is recorded of the frames returned by the SDK
+enum class TraceData
+{
+    // size and hash (FNV-1a) only
+    hash,
+    // content
+    full
+};
+
+// A call to the SDK
+class TraceRecord
+{
+public:
+    TraceFunction function;
+    // camera id (camera index for GetCameraProperty, -1 if none)
+    int camera_id;
+    // arguments (other than the camera id and the outputs)
+    std::vector<int64_t> args;
+    // return code (return value for GetNumOfConnectedCameras)
+    int result;
+    // since the start of the recording
+    int64_t start_ns;
+    int64_t duration_ns;
+    // values written by the SDK to the pointer arguments (in the memory
+    // layout of the host)
+    std::vector<unsigned char> output;
+    // frame (GetVideoData and GetDataAfterExp): hash and size, and
+    // content if recorded
+    uint64_t data_hash;
+    int64_t data_size;
+    std::vector<unsigned char> data;
+
+public:
+    std::string to_string() const;
+};
+
+// reads all the records of a trace file (throws std::runtime_error
+// if the file is invalid)
+std::vector<TraceRecord> read_trace(const std::filesystem::path& path);
+
+// Forwards the calls to another SDK (e.g. NativeSdk), and records them
+// (arguments, return codes, outputs, timing, and frames) into a trace
+// file, which can be replayed by ReplaySdk. Thread safe.
+class RecordingSdk : public Sdk
+{
+public:
+    RecordingSdk(std::shared_ptr<Sdk> sdk,
+                 std::filesystem::path path,
+                 TraceData data = TraceData::hash);
+    ~RecordingSdk();
+    long get_nb_records() const;
+    void flush();
+
+    int GetNumOfConnectedCameras();
+    ASI_ERROR_CODE GetCameraProperty(ASI_CAMERA_INFO* info, int camera_index);
+    ASI_ERROR_CODE OpenCamera(int camera_id);
+    ASI_ERROR_CODE InitCamera(int camera_id);
+    ASI_ERROR_CODE CloseCamera(int camera_id);
+    ASI_ERROR_CODE GetNumOfControls(int camera_id, int* nb_controls);
+    ASI_ERROR_CODE GetControlCaps(int camera_id,
+                                  int control_index,
+                                  ASI_CONTROL_CAPS* caps);
+    ASI_ERROR_CODE GetControlValue(int camera_id,
+                                   ASI_CONTROL_TYPE control,
+                                   long* value,
+                                   ASI_BOOL* is_auto);
+    ASI_ERROR_CODE SetControlValue(int camera_id,
+                                   ASI_CONTROL_TYPE control,
+                                   long value,
+                                   ASI_BOOL is_auto);
+    ASI_ERROR_CODE SetROIFormat(
+        int camera_id, int width, int height, int bin, ASI_IMG_TYPE type);
+    ASI_ERROR_CODE GetROIFormat(
+        int camera_id, int* width, int* height, int* bin, ASI_IMG_TYPE* type);
+    ASI_ERROR_CODE SetStartPos(int camera_id, int start_x, int start_y);
+    ASI_ERROR_CODE GetStartPos(int camera_id, int* start_x, int* start_y);
+    ASI_ERROR_CODE GetDroppedFrames(int camera_id, int* dropped_frames);
+    ASI_ERROR_CODE EnableDarkSubtract(int camera_id, char* bmp_path);
+    ASI_ERROR_CODE DisableDarkSubtract(int camera_id);
+    ASI_ERROR_CODE StartVideoCapture(int camera_id);
+    ASI_ERROR_CODE StopVideoCapture(int camera_id);
+    ASI_ERROR_CODE GetVideoData(int camera_id,
+                                unsigned char* buffer,
+                                long buffer_size,
+                                int wait_ms);
+    ASI_ERROR_CODE PulseGuideOn(int camera_id, ASI_GUIDE_DIRECTION direction);
+    ASI_ERROR_CODE PulseGuideOff(int camera_id,
+                                 ASI_GUIDE_DIRECTION direction);
+    ASI_ERROR_CODE StartExposure(int camera_id, ASI_BOOL is_dark);
+    ASI_ERROR_CODE StopExposure(int camera_id);
+    ASI_ERROR_CODE GetExpStatus(int camera_id, ASI_EXPOSURE_STATUS* status);
+    ASI_ERROR_CODE GetDataAfterExp(int camera_id,
+                                   unsigned char* buffer,
+                                   long buffer_size);
+    ASI_ERROR_CODE GetID(int camera_id, ASI_ID* id);
+    ASI_ERROR_CODE SetID(int camera_id, ASI_ID id);
+    ASI_ERROR_CODE GetGainOffset(int camera_id,
+                                 int* offset_highest_dr,
+                                 int* offset_unity_gain,
+                                 int* gain_lowest_rn,
+                                 int* offset_lowest_rn);
+    const char* GetSDKVersion();
+    ASI_ERROR_CODE GetCameraMode(int camera_id, ASI_CAMERA_MODE* mode);
+    ASI_ERROR_CODE SetCameraMode(int camera_id, ASI_CAMERA_MODE mode);
+    ASI_ERROR_CODE SendSoftTrigger(int camera_id, ASI_BOOL start);
+    ASI_ERROR_CODE GetSerialNumber(int camera_id, ASI_SN* sn);
+
+private:
+    friend class RecordedCall;
+    void write(const TraceRecord& record);
+
+private:
+    std::shared_ptr<Sdk> sdk_;
+    TraceData data_;
+    std::chrono::steady_clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::ofstream file_;
+    long nb_records_;
+};
+
+// Serves the calls recorded by RecordingSdk: a call gets the outputs and
+// return code of the next recorded call of the same function, with the
+// same camera and arguments (ASI_ERROR_GENERAL_ERROR if there is none
+// left). Each call lasts as long as the recorded one divided by speed
+// (0: no delay). Frames recorded as hashes are replayed as zeros.
+// Traces should be replayed on the platform they were recorded on.
+// Thread safe.
+class ReplaySdk : public Sdk
+{
+public:
+    ReplaySdk(std::filesystem::path path, double speed = 1.);
+    long get_nb_records() const;
+    long get_nb_replayed() const;
+    // calls with no matching record
+    long get_nb_unmatched() const;
+
+    int GetNumOfConnectedCameras();
+    ASI_ERROR_CODE GetCameraProperty(ASI_CAMERA_INFO* info, int camera_index);
+    ASI_ERROR_CODE OpenCamera(int camera_id);
+    ASI_ERROR_CODE InitCamera(int camera_id);
+    ASI_ERROR_CODE CloseCamera(int camera_id);
+    ASI_ERROR_CODE GetNumOfControls(int camera_id, int* nb_controls);
+    ASI_ERROR_CODE GetControlCaps(int camera_id,
+                                  int control_index,
+                                  ASI_CONTROL_CAPS* caps);
+    ASI_ERROR_CODE GetControlValue(int camera_id,
+                                   ASI_CONTROL_TYPE control,
+                                   long* value,
+                                   ASI_BOOL* is_auto);
+    ASI_ERROR_CODE SetControlValue(int camera_id,
+                                   ASI_CONTROL_TYPE control,
+                                   long value,
+                                   ASI_BOOL is_auto);
+    ASI_ERROR_CODE SetROIFormat(
+        int camera_id, int width, int height, int bin, ASI_IMG_TYPE type);
+    ASI_ERROR_CODE GetROIFormat(
+        int camera_id, int* width, int* height, int* bin, ASI_IMG_TYPE* type);
+    ASI_ERROR_CODE SetStartPos(int camera_id, int start_x, int start_y);
+    ASI_ERROR_CODE GetStartPos(int camera_id, int* start_x, int* start_y);
+    ASI_ERROR_CODE GetDroppedFrames(int camera_id, int* dropped_frames);
+    ASI_ERROR_CODE EnableDarkSubtract(int camera_id, char* bmp_path);
+    ASI_ERROR_CODE DisableDarkSubtract(int camera_id);
+    ASI_ERROR_CODE StartVideoCapture(int camera_id);
+    ASI_ERROR_CODE StopVideoCapture(int camera_id);
+    ASI_ERROR_CODE GetVideoData(int camera_id,
+                                unsigned char* buffer,
+                                long buffer_size,
+                                int wait_ms);
+    ASI_ERROR_CODE PulseGuideOn(int camera_id, ASI_GUIDE_DIRECTION direction);
+    ASI_ERROR_CODE PulseGuideOff(int camera_id,
+                                 ASI_GUIDE_DIRECTION direction);
+    ASI_ERROR_CODE StartExposure(int camera_id, ASI_BOOL is_dark);
+    ASI_ERROR_CODE StopExposure(int camera_id);
+    ASI_ERROR_CODE GetExpStatus(int camera_id, ASI_EXPOSURE_STATUS* status);
+    ASI_ERROR_CODE GetDataAfterExp(int camera_id,
+                                   unsigned char* buffer,
+                                   long buffer_size);
+    ASI_ERROR_CODE GetID(int camera_id, ASI_ID* id);
+    ASI_ERROR_CODE SetID(int camera_id, ASI_ID id);
+    ASI_ERROR_CODE GetGainOffset(int camera_id,
+                                 int* offset_highest_dr,
+                                 int* offset_unity_gain,
+                                 int* gain_lowest_rn,
+                                 int* offset_lowest_rn);
+    const char* GetSDKVersion();
+    ASI_ERROR_CODE GetCameraMode(int camera_id, ASI_CAMERA_MODE* mode);
+    ASI_ERROR_CODE SetCameraMode(int camera_id, ASI_CAMERA_MODE mode);
+    ASI_ERROR_CODE SendSoftTrigger(int camera_id, ASI_BOOL start);
+    ASI_ERROR_CODE GetSerialNumber(int camera_id, ASI_SN* sn);
+
+private:
+    friend class ReplayedCall;
+    typedef std::tuple<TraceFunction, int, std::vector<int64_t>> Key;
+    // next record matching the call, nullptr if none
+    const TraceRecord* next(TraceFunction function,
+                            int camera_id,
+                            const std::vector<int64_t>& args);
+
+private:
+    double speed_;
+    std::vector<TraceRecord> records_;
+    mutable std::mutex mutex_;
+    std::map<Key, std::deque<const TraceRecord*>> pending_;
+    long nb_replayed_;
+    long nb_unmatched_;
+};
+
+}  // namespace zwo_asi
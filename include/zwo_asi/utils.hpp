@@ -7,12 +7,15 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
-#define UDEV_CHECK "cat /sys/module/usbcore/parameters/usbfs_memory_mb"
+#define USBFS_MEMORY_MB "/sys/module/usbcore/parameters/usbfs_memory_mb"
+// minimal usbfs memory (MB) recommended by ZWO
+#define USBFS_MEMORY_MB_MIN 200
 
 namespace zwo_asi
 {
@@ -24,7 +27,9 @@ void fix_length(std::string& v, int target_size);
 void fix_lengths(std::vector<std::string>& values, int target_size);
 std::vector<std::string> long_to_str(const std::vector<long>& values);
 bool create_udev_file();
-std::string run_system_command(std::string command);
+// value of USBFS_MEMORY_MB (0: no limit), -1 if it could not be read.
+// The file is read only once, unless refresh is true.
+int read_usbfs_memory_mb(bool refresh = false);
 
 }  // namespace internal
 
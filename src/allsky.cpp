@@ -0,0 +1,451 @@
+#include "zwo_asi/allsky.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "zwo_asi/stages.hpp"
+
+namespace zwo_asi
+{
+static const double DEG = M_PI / 180.;
+
+// low precision formulas of the astronomical almanac
+double get_solar_altitude(double latitude_deg,
+                          double longitude_deg,
+                          std::chrono::system_clock::time_point time)
+{
+    double unix_s =
+        std::chrono::duration<double>(time.time_since_epoch()).count();
+    // days since J2000
+    double n = unix_s / 86400. + 2440587.5 - 2451545.;
+    double mean_longitude = 280.460 + 0.9856474 * n;
+    double mean_anomaly = (357.528 + 0.9856003 * n) * DEG;
+    double ecliptic_longitude =
+        (mean_longitude + 1.915 * std::sin(mean_anomaly) +
+         0.020 * std::sin(2. * mean_anomaly)) *
+        DEG;
+    double obliquity = (23.439 - 0.0000004 * n) * DEG;
+    double right_ascension =
+        std::atan2(std::cos(obliquity) * std::sin(ecliptic_longitude),
+                   std::cos(ecliptic_longitude));
+    double declination =
+        std::asin(std::sin(obliquity) * std::sin(ecliptic_longitude));
+    double sidereal_hours =
+        std::fmod(18.697374558 + 24.06570982441908 * n, 24.);
+    double hour_angle =
+        (sidereal_hours * 15. + longitude_deg) * DEG - right_ascension;
+    double latitude = latitude_deg * DEG;
+    double sin_altitude =
+        std::sin(latitude) * std::sin(declination) +
+        std::cos(latitude) * std::cos(declination) * std::cos(hour_angle);
+    return std::asin(std::max(-1., std::min(1., sin_altitude))) / DEG;
+}
+
+AllSkyPhase::AllSkyPhase(std::string name_,
+                         double min_sun_altitude_deg_,
+                         long gain_,
+                         long min_exposure_us_,
+                         long max_exposure_us_,
+                         double interval_s_)
+    : name{name_},
+      min_sun_altitude_deg{min_sun_altitude_deg_},
+      gain{gain_},
+      min_exposure_us{min_exposure_us_},
+      max_exposure_us{max_exposure_us_},
+      interval_s{interval_s_}
+{
+}
+
+AllSkyOptions::AllSkyOptions()
+    : latitude_deg{0.},
+      longitude_deg{0.},
+      phases{AllSkyPhase("day", -6., 0, 32, 10000, 60.),
+             AllSkyPhase("twilight", -12., 100, 1000, 10000000, 30.),
+             AllSkyPhase("night", -90., 300, 100000, 30000000, 30.)},
+      target_mean{0.25},
+      max_exposure_step{4.},
+      prefix{"allsky_"},
+      timelapse_scale{1},
+      retry_s{10.},
+      max_retry_s{300.}
+{
+}
+
+std::string AllSkyFrameInfo::to_string() const
+{
+    std::ostringstream s;
+    s << "frame " << index << " (" << phase << ", sun at "
+      << sun_altitude_deg << " deg): exposure " << exposure_us
+      << " us | gain " << gain << " | mean " << mean;
+    if (!path.empty()) s << " | " << path.string();
+    if (!error.empty()) s << " | error: " << error;
+    return s.str();
+}
+
+// after the highest index of the timelapse frames of the folder
+static long find_next_index(const std::filesystem::path& folder,
+                            const std::string& prefix)
+{
+    long next = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(folder))
+    {
+        std::string extension = entry.path().extension().string();
+        std::string stem = entry.path().stem().string();
+        if ((extension != ".pgm" && extension != ".ppm") ||
+            stem.compare(0, prefix.size(), prefix) != 0)
+        {
+            continue;
+        }
+        std::string index = stem.substr(prefix.size());
+        if (index.empty() || index.size() > 18 ||
+            index.find_first_not_of("0123456789") != std::string::npos)
+        {
+            continue;
+        }
+        next = std::max(next, std::stol(index) + 1);
+    }
+    return next;
+}
+
+AllSky::AllSky(Camera& camera, AllSkyOptions options)
+    : camera_(camera),
+      options_{options},
+      phase_{nullptr},
+      exposure_us_{0},
+      frame_(camera.get_roi().width,
+             camera.get_roi().height,
+             camera.get_roi().type),
+      next_index_{0},
+      nb_frames_{0},
+      nb_errors_{0},
+      stop_{false}
+{
+    if (options_.phases.empty())
+    {
+        throw std::runtime_error("all-sky: at least one phase required");
+    }
+    if (options_.timelapse_scale < 1 || options_.max_exposure_step <= 1. ||
+        options_.target_mean <= 0. || options_.target_mean >= 1.)
+    {
+        throw std::runtime_error(
+            "all-sky: invalid timelapse scale, exposure step or target mean");
+    }
+    if (options_.retry_s <= 0. || options_.max_retry_s < options_.retry_s)
+    {
+        throw std::runtime_error("all-sky: invalid retry delays");
+    }
+    // highest phase first
+    std::sort(options_.phases.begin(),
+              options_.phases.end(),
+              [](const AllSkyPhase& a, const AllSkyPhase& b) {
+                  return a.min_sun_altitude_deg > b.min_sun_altitude_deg;
+              });
+    if (!options_.folder.empty())
+    {
+        std::filesystem::create_directories(options_.folder);
+        next_index_ = find_next_index(options_.folder, options_.prefix);
+    }
+    last_.index = -1;
+}
+
+void AllSky::add_stage(std::shared_ptr<Stage> stage,
+                       std::vector<std::string> phases)
+{
+    for (const std::string& name : phases)
+    {
+        if (std::none_of(options_.phases.begin(),
+                         options_.phases.end(),
+                         [&name](const AllSkyPhase& phase) {
+                             return phase.name == name;
+                         }))
+        {
+            throw std::runtime_error("all-sky: no phase named " + name);
+        }
+    }
+    stages_.push_back(PhaseStage{stage, phases});
+}
+
+const AllSkyPhase& AllSky::get_phase(double sun_altitude_deg) const
+{
+    for (const AllSkyPhase& phase : options_.phases)
+    {
+        if (sun_altitude_deg >= phase.min_sun_altitude_deg) return phase;
+    }
+    return options_.phases.back();
+}
+
+AllSkyFrameInfo AllSky::step()
+{
+    return step(std::chrono::system_clock::now());
+}
+
+AllSkyFrameInfo AllSky::step(std::chrono::system_clock::time_point time)
+{
+    double altitude = get_solar_altitude(
+        options_.latitude_deg, options_.longitude_deg, time);
+    const AllSkyPhase& phase = get_phase(altitude);
+    if (phase_ == nullptr)
+    {
+        exposure_us_ = std::lround(
+            std::sqrt(double(phase.min_exposure_us) * phase.max_exposure_us));
+    }
+    else if (phase_ != &phase)
+    {
+        // same brightness with the gain of the new phase (0.1 dB units)
+        exposure_us_ = std::lround(
+            exposure_us_ * std::pow(10., (phase_->gain - phase.gain) / 200.));
+    }
+    phase_ = &phase;
+    exposure_us_ = std::max(phase.min_exposure_us,
+                            std::min(phase.max_exposure_us, exposure_us_));
+
+    AllSkyFrameInfo info;
+    info.index = -1;
+    info.time = time;
+    info.sun_altitude_deg = altitude;
+    info.phase = phase.name;
+    info.exposure_us = exposure_us_;
+    info.gain = phase.gain;
+    info.mean = 0.;
+    try
+    {
+        camera_.set_exposure_and_gain(exposure_us_, phase.gain);
+        camera_.capture(frame_);
+        // not reused, even if the processing of the frame fails
+        info.index = next_index_++;
+        frame_.index = info.index;
+        double max_value = frame_.type == ImageType::raw16 ? 65535. : 255.;
+        info.mean = compute_statistics(frame_).mean / max_value;
+        write_timelapse(frame_, info);
+        for (PhaseStage& stage : stages_)
+        {
+            if (stage.phases.empty() ||
+                std::find(stage.phases.begin(),
+                          stage.phases.end(),
+                          phase.name) != stage.phases.end())
+            {
+                stage.stage->process(frame_);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        info.error = e.what();
+        std::lock_guard<std::mutex> lock(mutex_);
+        nb_errors_++;
+        last_ = info;
+        throw;
+    }
+
+    // exposure of the next frame
+    double factor = options_.target_mean / std::max(info.mean, 1e-4);
+    factor = std::max(1. / options_.max_exposure_step,
+                      std::min(options_.max_exposure_step, factor));
+    exposure_us_ = std::lround(exposure_us_ * factor);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    nb_frames_++;
+    last_ = info;
+    return info;
+}
+
+// writes to a temporary file first, so that a partial frame is never
+// read (e.g. by a web server serving latest.pgm)
+static void write_file(const std::filesystem::path& path,
+                       const std::string& header,
+                       const std::vector<unsigned char>& data)
+{
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        if (!f.is_open())
+        {
+            throw std::runtime_error("all-sky: failed to write " +
+                                     tmp.string());
+        }
+        f << header;
+        f.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+// average of the scale x scale blocks, to 8 bits
+template <typename T>
+static void downscale(const T* values,
+                      int width,
+                      int channels,
+                      int scale,
+                      int shift,
+                      int output_width,
+                      int output_height,
+                      unsigned char* output)
+{
+    int nb_values = scale * scale;
+    for (int y = 0; y < output_height; y++)
+    {
+        for (int x = 0; x < output_width; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                uint32_t sum = 0;
+                for (int dy = 0; dy < scale; dy++)
+                {
+                    const T* row =
+                        values +
+                        (static_cast<long>(y * scale + dy) * width) * channels;
+                    for (int dx = 0; dx < scale; dx++)
+                    {
+                        sum += row[(x * scale + dx) * channels + c];
+                    }
+                }
+                output[(y * output_width + x) * channels + c] =
+                    (sum / nb_values) >> shift;
+            }
+        }
+    }
+}
+
+void AllSky::write_timelapse(const Frame& frame, AllSkyFrameInfo& info)
+{
+    if (options_.folder.empty()) return;
+    int scale = options_.timelapse_scale;
+    int width = frame.width / scale;
+    int height = frame.height / scale;
+    bool color = frame.type == ImageType::rgb24;
+    int channels = color ? 3 : 1;
+    timelapse_.resize(static_cast<size_t>(width) * height * channels);
+    if (frame.type == ImageType::raw16)
+        downscale(reinterpret_cast<const uint16_t*>(frame.data.data()),
+                  frame.width,
+                  1,
+                  scale,
+                  8,
+                  width,
+                  height,
+                  timelapse_.data());
+    else
+        downscale(frame.data.data(),
+                  frame.width,
+                  channels,
+                  scale,
+                  0,
+                  width,
+                  height,
+                  timelapse_.data());
+    if (color)
+    {
+        // bgr to rgb
+        for (size_t i = 0; i < timelapse_.size(); i += 3)
+        {
+            std::swap(timelapse_[i], timelapse_[i + 2]);
+        }
+    }
+    std::ostringstream header;
+    header << (color ? "P6" : "P5") << "\n"
+           << width << " " << height << "\n255\n";
+    std::string extension = color ? ".ppm" : ".pgm";
+    std::ostringstream name;
+    name << options_.prefix << std::setw(6) << std::setfill('0') << info.index
+         << extension;
+    info.path = options_.folder / name.str();
+    write_file(info.path, header.str(), timelapse_);
+    write_file(options_.folder / ("latest" + extension),
+               header.str(),
+               timelapse_);
+}
+
+void AllSky::set_callback(
+    std::function<void(const AllSkyFrameInfo&)> callback)
+{
+    callback_ = callback;
+}
+
+void AllSky::run(double duration_s)
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point end = clock::time_point::max();
+    if (duration_s > 0)
+    {
+        end = clock::now() + std::chrono::duration_cast<clock::duration>(
+                                 std::chrono::duration<double>(duration_s));
+    }
+    int nb_failures = 0;
+    while (true)
+    {
+        clock::time_point start = clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stop_ || start >= end) break;
+        }
+        double wait_s;
+        try
+        {
+            step();
+            nb_failures = 0;
+            wait_s = phase_->interval_s;
+        }
+        catch (const std::exception&)
+        {
+            // recorded by step: the acquisition goes on (e.g. the camera
+            // may be reconnected)
+            wait_s = std::min(options_.max_retry_s,
+                              options_.retry_s * std::pow(2., nb_failures));
+            nb_failures = std::min(nb_failures + 1, 30);
+        }
+        try
+        {
+            if (callback_) callback_(get_last());
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = false;
+            throw;
+        }
+        clock::time_point next =
+            start + std::chrono::duration_cast<clock::duration>(
+                        std::chrono::duration<double>(wait_s));
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait_until(
+            lock, std::min(next, end), [this] { return stop_; });
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = false;
+}
+
+void AllSky::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+}
+
+long AllSky::get_nb_frames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_frames_;
+}
+
+long AllSky::get_nb_errors() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_errors_;
+}
+
+AllSkyFrameInfo AllSky::get_last() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_;
+}
+
+const AllSkyOptions& AllSky::get_options() const
+{
+    return options_;
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,362 @@
+#include "zwo_asi/bandwidth_planner.hpp"
+#include <algorithm>
+#include <cmath>
+#include "zwo_asi/camera.hpp"
+#include "zwo_asi/diagnostics.hpp"
+
+namespace zwo_asi
+{
+PlannerTarget::PlannerTarget()
+    : fps{0.}, exposure_us{0}, prefer_resolution{false}, bandwidth_percent{100}
+{
+}
+
+static int floor_to(int value, int modulo)
+{
+    return value - value % modulo;
+}
+
+// adapts the size of the roi to the rules of ROI::valid
+static void align(ROI& roi, const CameraInfo& info)
+{
+    roi.width = floor_to(roi.width, 8);
+    roi.height = floor_to(roi.height, 2);
+    if (info.name == std::string("ASI120") && !info.is_usb3)
+    {
+        while (roi.height > 0 && roi.width * roi.height % 1024 != 0)
+        {
+            roi.height -= 2;
+        }
+    }
+}
+
+static bool get_plan(const CameraInfo& info,
+                     const PlannerTarget& target,
+                     double fps,
+                     int bins,
+                     ImageType type,
+                     BandwidthPlan& plan)
+{
+    ROI full;
+    full.bins = bins;
+    full.type = type;
+    full.width = info.max_width / bins;
+    full.height = info.max_height / bins;
+    align(full, info);
+
+    plan.bandwidth_percent = target.bandwidth_percent;
+    plan.throughput_mb_s = get_usb_throughput(info.is_usb3 &&
+                                              info.is_usb3_host) *
+                           target.bandwidth_percent / 100.;
+
+    // largest number of pixels per frame the usb link can transfer
+    // at the target frame rate
+    double max_pixels =
+        plan.throughput_mb_s * 1e6 / fps / get_bytes_per_pixel(type);
+
+    plan.roi = full;
+    if ((double)full.width * full.height > max_pixels)
+    {
+        // centered crop, same aspect ratio as the full frame
+        double scale =
+            std::sqrt(max_pixels / ((double)full.width * full.height));
+        plan.roi.width = (int)(full.width * scale);
+        plan.roi.height = (int)(full.height * scale);
+        align(plan.roi, info);
+        plan.roi.start_x = (full.width - plan.roi.width) / 2;
+        plan.roi.start_y = (full.height - plan.roi.height) / 2;
+    }
+    if (plan.roi.width <= 0 || plan.roi.height <= 0) return false;
+    plan.roi.valid(info);
+
+    plan.required_mb_s = get_frame_size(plan.roi) * fps / 1e6;
+    plan.predicted_fps = get_max_frame_rate(
+        info, plan.roi, target.bandwidth_percent, target.exposure_us);
+    plan.field_of_view = (double)plan.roi.width * plan.roi.height * bins *
+                         bins / ((double)info.max_width * info.max_height);
+    plan.meets_target = plan.predicted_fps >= fps * (1. - 1e-9);
+    return true;
+}
+
+std::vector<BandwidthPlan> get_bandwidth_plans(const CameraInfo& info,
+                                               const PlannerTarget& target)
+{
+    double fps = target.fps;
+    if (fps <= 0. && target.exposure_us > 0) fps = 1e6 / target.exposure_us;
+    if (fps <= 0.)
+    {
+        throw std::runtime_error(
+            "bandwidth planner: a target fps or exposure is required");
+    }
+    if (target.bandwidth_percent <= 0 || target.bandwidth_percent > 100)
+    {
+        throw std::runtime_error(
+            "bandwidth planner: bandwidth must be in ]0,100]");
+    }
+    // no roi or bandwidth makes frames shorter than their exposure
+    if (target.exposure_us > 0 && fps * target.exposure_us > 1e6 * (1. + 1e-9))
+    {
+        std::ostringstream s;
+        s << "bandwidth planner: the exposure (" << target.exposure_us
+          << "us) limits the frame rate to " << 1e6 / target.exposure_us
+          << "fps, below the target of " << fps << "fps";
+        throw std::runtime_error(s.str());
+    }
+
+    std::set<ImageType> types = target.types;
+    if (types.empty()) types = info.supported_image_types;
+
+    std::vector<BandwidthPlan> plans;
+    for (int bins : info.supported_bins)
+    {
+        for (ImageType type : types)
+        {
+            if (info.supported_image_types.count(type) == 0) continue;
+            BandwidthPlan plan;
+            if (get_plan(info, target, fps, bins, type, plan))
+            {
+                plans.push_back(plan);
+            }
+        }
+    }
+
+    bool prefer_resolution = target.prefer_resolution;
+    std::sort(plans.begin(),
+              plans.end(),
+              [prefer_resolution](const BandwidthPlan& a,
+                                  const BandwidthPlan& b) {
+                  if (a.meets_target != b.meets_target) return a.meets_target;
+                  if (prefer_resolution && a.roi.bins != b.roi.bins)
+                      return a.roi.bins < b.roi.bins;
+                  if (a.field_of_view != b.field_of_view)
+                      return a.field_of_view > b.field_of_view;
+                  if (a.roi.bins != b.roi.bins) return a.roi.bins < b.roi.bins;
+                  int a_bytes = get_bytes_per_pixel(a.roi.type);
+                  int b_bytes = get_bytes_per_pixel(b.roi.type);
+                  if (a_bytes != b_bytes) return a_bytes > b_bytes;
+                  return a.predicted_fps > b.predicted_fps;
+              });
+    return plans;
+}
+
+BandwidthPlan plan_bandwidth(const CameraInfo& info,
+                             const PlannerTarget& target)
+{
+    std::vector<BandwidthPlan> plans = get_bandwidth_plans(info, target);
+    if (plans.empty())
+    {
+        throw std::runtime_error(
+            "bandwidth planner: no valid roi for the camera");
+    }
+    if (plans.front().meets_target) return plans.front();
+    return *std::max_element(
+        plans.begin(),
+        plans.end(),
+        [](const BandwidthPlan& a, const BandwidthPlan& b) {
+            return a.predicted_fps < b.predicted_fps;
+        });
+}
+
+void apply_plan(Camera& camera, const BandwidthPlan& plan)
+{
+    camera.set_roi(plan.roi);
+    camera.set_control("BandWidth", plan.bandwidth_percent);
+}
+
+std::string BandwidthPlan::to_string() const
+{
+    std::ostringstream s;
+    s << "roi: " << roi.width << "x" << roi.height << " (start: "
+      << roi.start_x << "," << roi.start_y << ") bin " << roi.bins << " "
+      << zwo_asi::to_string(roi.type) << " | field of view: "
+      << field_of_view * 100. << "%" << std::endl;
+    s << "bandwidth: " << bandwidth_percent << "% (" << throughput_mb_s
+      << "MB/s) | required: " << required_mb_s << "MB/s | predicted fps: "
+      << predicted_fps << " | target met: " << (meets_target ? "*" : "-")
+      << std::endl;
+    return s.str();
+}
+
+BandwidthTrial measure_video(Camera& camera,
+                             Frame& frame,
+                             int wait_ms,
+                             std::chrono::milliseconds duration)
+{
+    typedef std::chrono::steady_clock clock;
+    BandwidthTrial trial;
+    trial.bandwidth_percent = -1;
+    trial.frames = 0;
+    trial.timeouts = 0;
+    int dropped = camera.get_dropped_frames();
+    clock::time_point start = clock::now();
+    while (clock::now() - start < duration)
+    {
+        Result result = camera.try_get_video_frame(frame, wait_ms);
+        if (result)
+        {
+            trial.frames++;
+        }
+        else if (result.code == ResultCode::timeout)
+        {
+            trial.timeouts++;
+        }
+        else
+        {
+            throw CameraException(result.message,
+                                  camera.get_index(),
+                                  result.error_code);
+        }
+    }
+    double elapsed_s =
+        std::chrono::duration<double>(clock::now() - start).count();
+    trial.dropped = camera.get_dropped_frames() - dropped;
+    trial.fps = trial.frames / elapsed_s;
+    return trial;
+}
+
+static BandwidthTrial run_trial(Camera& camera,
+                                Frame& frame,
+                                int bandwidth_percent,
+                                int wait_ms,
+                                std::chrono::milliseconds duration)
+{
+    camera.set_control("BandWidth", bandwidth_percent);
+    BandwidthTrial trial = measure_video(camera, frame, wait_ms, duration);
+    trial.bandwidth_percent = bandwidth_percent;
+    return trial;
+}
+
+namespace
+{
+// restores the BandWidth of the camera if the tuning fails, and stops
+// the video if it was started for the tuning. Errors are ignored, so
+// that the exception that ended the tuning (if any) is not replaced.
+class Restore
+{
+public:
+    Restore(Camera& camera, const Controllable& bandwidth, bool stop_video)
+        : camera_(camera),
+          bandwidth_{bandwidth},
+          stop_video_{stop_video},
+          tuned_{false}
+    {
+    }
+
+    ~Restore()
+    {
+        if (!tuned_) attempt([this] { restore(bandwidth_); });
+        if (stop_video_) attempt([this] { camera_.stop_video(); });
+    }
+
+    // the tuned BandWidth is kept
+    void set_tuned()
+    {
+        tuned_ = true;
+    }
+
+private:
+    template <typename F>
+    static void attempt(F function)
+    {
+        try
+        {
+            function();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void restore(const Controllable& control)
+    {
+        if (control.is_auto)
+            camera_.set_auto(control.name);
+        else
+            camera_.set_control(control.name, control.value);
+    }
+
+private:
+    Camera& camera_;
+    Controllable bandwidth_;
+    bool stop_video_;
+    bool tuned_;
+};
+}  // namespace
+
+int get_video_wait_ms(const Camera& camera)
+{
+    // waiting for at least two exposures before reporting a timeout
+    std::map<std::string, Controllable> controls = camera.get_controls();
+    auto exposure = controls.find("Exposure");
+    if (exposure == controls.end()) return 500;
+    return 500 + 2 * exposure->second.value / 1000;
+}
+
+BandwidthTuning tune_bandwidth(Camera& camera,
+                               std::chrono::milliseconds trial_duration,
+                               int min_percent,
+                               int step)
+{
+    if (step <= 0)
+    {
+        throw std::runtime_error("bandwidth tuning: step must be positive");
+    }
+    std::map<std::string, Controllable> controls = camera.get_controls();
+    auto bandwidth = controls.find("BandWidth");
+    if (bandwidth == controls.end())
+    {
+        throw std::runtime_error(
+            "bandwidth tuning: the camera has no BandWidth control");
+    }
+    int max_percent = bandwidth->second.max_value;
+    min_percent = std::max(min_percent, (int)bandwidth->second.min_value);
+    min_percent = std::min(min_percent, max_percent);
+
+    int wait_ms = get_video_wait_ms(camera);
+
+    ROI roi = camera.get_roi();
+    Frame frame(roi.width, roi.height, roi.type);
+    bool started = !camera.is_video_active();
+    if (started) camera.start_video();
+    Restore restore(camera, bandwidth->second, started);
+
+    BandwidthTuning tuning;
+    for (int percent = max_percent; percent >= min_percent; percent -= step)
+    {
+        tuning.trials.push_back(
+            run_trial(camera, frame, percent, wait_ms, trial_duration));
+        const BandwidthTrial& trial = tuning.trials.back();
+        if (trial.dropped == 0 && trial.timeouts == 0) break;
+    }
+
+    // trials are sorted by decreasing bandwidth: the first trial
+    // with the least dropped frames
+    const BandwidthTrial* best = &tuning.trials.front();
+    for (const BandwidthTrial& trial : tuning.trials)
+    {
+        if (trial.dropped + trial.timeouts < best->dropped + best->timeouts)
+        {
+            best = &trial;
+        }
+    }
+    tuning.bandwidth_percent = best->bandwidth_percent;
+    camera.set_control("BandWidth", tuning.bandwidth_percent);
+    restore.set_tuned();
+    return tuning;
+}
+
+std::string BandwidthTuning::to_string() const
+{
+    std::ostringstream s;
+    for (const BandwidthTrial& trial : trials)
+    {
+        s << "bandwidth: " << trial.bandwidth_percent
+          << "% | frames: " << trial.frames << " | dropped: " << trial.dropped
+          << " | timeouts: " << trial.timeouts << " | fps: " << trial.fps
+          << std::endl;
+    }
+    s << "selected bandwidth: " << bandwidth_percent << "%" << std::endl;
+    return s.str();
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,173 @@
+#include "zwo_asi/batch_stage.hpp"
+
+namespace zwo_asi
+{
+BatchStage::BatchStage(int batch_size,
+                       std::chrono::microseconds max_latency,
+                       int max_pending)
+    : batch_size_{std::max(1, batch_size)},
+      max_latency_{max_latency},
+      max_pending_{max_pending > 0 ? std::max(max_pending, batch_size_)
+                                   : 4 * batch_size_},
+      flush_requested_{false},
+      dispatching_{false},
+      stop_{false},
+      batches_{0},
+      frames_{0},
+      failed_{0},
+      total_latency_ns_{0}
+{
+    thread_ = std::thread(&BatchStage::run, this);
+}
+
+BatchStage::~BatchStage()
+{
+    stop();
+}
+
+void BatchStage::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_) return;
+        stop_ = true;
+    }
+    condition_.notify_all();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void BatchStage::submit(std::shared_ptr<Frame> frame)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t max_pending = max_pending_;
+    space_.wait(lock,
+                [&] { return stop_ || pending_.size() < max_pending; });
+    if (stop_)
+    {
+        throw std::runtime_error("batch stage: stopped");
+    }
+    pending_.push_back(Pending{frame, std::chrono::steady_clock::now()});
+    // waking up the dispatch thread when the batch is full, or when
+    // it has to start the latency timer of a new batch
+    if (pending_.size() >= static_cast<size_t>(batch_size_) ||
+        pending_.size() == 1)
+    {
+        lock.unlock();
+        condition_.notify_all();
+    }
+}
+
+void BatchStage::process(Frame& frame)
+{
+    // synchronous batch of a single, non owned, frame
+    std::vector<std::shared_ptr<Frame>> batch;
+    batch.push_back(std::shared_ptr<Frame>(&frame, [](Frame*) {}));
+    process_batch(batch);
+}
+
+void BatchStage::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    flush_requested_ = true;
+    condition_.notify_all();
+    flushed_.wait(lock, [this] {
+        return stop_ || (pending_.empty() && !dispatching_);
+    });
+    flush_requested_ = false;
+}
+
+void BatchStage::dispatch(std::vector<std::shared_ptr<Frame>>& batch)
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::string error;
+    bool failed = false;
+    try
+    {
+        process_batch(batch);
+    }
+    catch (const std::exception& e)
+    {
+        failed = true;
+        error = e.what();
+    }
+    catch (...)
+    {
+        // (not letting it end the dispatch thread)
+        failed = true;
+        error = "unknown exception";
+    }
+    long latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    std::lock_guard<std::mutex> lock(mutex_);
+    batches_++;
+    frames_ += batch.size();
+    total_latency_ns_ += latency;
+    if (failed)
+    {
+        failed_++;
+        last_error_ = error;
+    }
+}
+
+void BatchStage::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        if (pending_.empty())
+        {
+            flushed_.notify_all();
+            if (stop_) return;
+            condition_.wait(lock);
+            continue;
+        }
+        size_t batch_size = batch_size_;
+        bool full = pending_.size() >= batch_size;
+        // frames left over by the previous batch keep the time they
+        // were submitted at, so that none waits more than max_latency
+        std::chrono::steady_clock::time_point deadline =
+            pending_.front().submitted + max_latency_;
+        bool expired = std::chrono::steady_clock::now() >= deadline;
+        if (!(full || expired || flush_requested_ || stop_))
+        {
+            condition_.wait_until(lock, deadline);
+            continue;
+        }
+        std::vector<std::shared_ptr<Frame>> batch;
+        while (!pending_.empty() && batch.size() < batch_size)
+        {
+            batch.push_back(pending_.front().frame);
+            pending_.pop_front();
+        }
+        dispatching_ = true;
+        lock.unlock();
+        space_.notify_all();
+        dispatch(batch);
+        batch.clear();
+        lock.lock();
+        dispatching_ = false;
+    }
+}
+
+BatchMetrics BatchStage::get_metrics() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    BatchMetrics metrics;
+    metrics.batches = batches_;
+    metrics.frames = frames_;
+    metrics.failed = failed_;
+    metrics.pending = pending_.size();
+    metrics.mean_batch_size =
+        batches_ > 0 ? static_cast<double>(frames_) / batches_ : 0;
+    metrics.mean_batch_latency_us =
+        batches_ > 0 ? (total_latency_ns_ / 1000.0) / batches_ : 0;
+    metrics.last_error = last_error_;
+    return metrics;
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,377 @@
+#include "zwo_asi/benchmark.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "zwo_asi/camera.hpp"
+
+namespace zwo_asi
+{
+BenchmarkOptions::BenchmarkOptions()
+    : duration{std::chrono::milliseconds(2000)},
+      bandwidths{100, 80, 60, 40},
+      sweep_high_speed{true}
+{
+}
+
+static bool has_control(const std::map<std::string, Controllable>& controls,
+                        std::string name)
+{
+    return controls.find(name) != controls.end();
+}
+
+namespace
+{
+// restores the roi, BandWidth, HighSpeedMode and video streaming of the
+// camera when the benchmark ends (or fails). Errors are ignored, so that
+// the exception that ended the benchmark (if any) is not replaced.
+class Restore
+{
+public:
+    Restore(Camera& camera,
+            const std::map<std::string, Controllable>& controls)
+        : camera_(camera),
+          roi_{camera.get_roi()},
+          bandwidth_{controls.at("BandWidth")},
+          has_high_speed_{has_control(controls, "HighSpeedMode")},
+          was_active_{camera.is_video_active()}
+    {
+        if (has_high_speed_) high_speed_ = controls.at("HighSpeedMode");
+    }
+
+    ~Restore()
+    {
+        attempt([this] {
+            if (camera_.is_video_active()) camera_.stop_video();
+        });
+        attempt([this] { camera_.set_roi(roi_); });
+        attempt([this] { restore(bandwidth_); });
+        if (has_high_speed_) attempt([this] { restore(high_speed_); });
+        if (was_active_) attempt([this] { camera_.start_video(); });
+    }
+
+private:
+    template <typename F>
+    static void attempt(F function)
+    {
+        try
+        {
+            function();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void restore(const Controllable& control)
+    {
+        if (control.is_auto)
+            camera_.set_auto(control.name);
+        else
+            camera_.set_control(control.name, control.value);
+    }
+
+private:
+    Camera& camera_;
+    ROI roi_;
+    Controllable bandwidth_;
+    bool has_high_speed_;
+    Controllable high_speed_;
+    bool was_active_;
+};
+}  // namespace
+
+std::vector<BenchmarkResult> run_benchmark(Camera& camera,
+                                           const BenchmarkOptions& options)
+{
+    std::map<std::string, Controllable> controls = camera.get_controls();
+    if (!has_control(controls, "BandWidth"))
+    {
+        throw std::runtime_error(
+            "benchmark: the camera has no BandWidth control");
+    }
+    bool has_high_speed = has_control(controls, "HighSpeedMode");
+    long initial_high_speed =
+        has_high_speed ? controls.at("HighSpeedMode").value : 0;
+    const ROI initial_roi = camera.get_roi();
+    const CameraInfo& info = camera.get_info();
+
+    std::set<ImageType> types = options.types;
+    if (types.empty()) types = info.supported_image_types;
+    std::vector<bool> high_speeds{initial_high_speed != 0};
+    if (has_high_speed && options.sweep_high_speed)
+    {
+        high_speeds = {false, true};
+    }
+
+    int wait_ms = get_video_wait_ms(camera);
+    Restore restore(camera, controls);
+    std::vector<BenchmarkResult> results;
+    for (ImageType type : types)
+    {
+        if (info.supported_image_types.count(type) == 0) continue;
+        // the roi can not be changed while streaming
+        if (camera.is_video_active()) camera.stop_video();
+        ROI roi = initial_roi;
+        roi.type = type;
+        camera.set_roi(roi);
+        Frame frame(roi.width, roi.height, roi.type);
+        camera.start_video();
+        for (bool high_speed : high_speeds)
+        {
+            if (has_high_speed)
+            {
+                camera.set_control("HighSpeedMode", high_speed ? 1 : 0);
+            }
+            for (int bandwidth : options.bandwidths)
+            {
+                camera.set_control("BandWidth", bandwidth);
+                BandwidthTrial trial =
+                    measure_video(camera, frame, wait_ms, options.duration);
+                BenchmarkResult result;
+                result.type = type;
+                result.high_speed = high_speed;
+                result.bandwidth_percent = bandwidth;
+                result.frames = trial.frames;
+                result.dropped = trial.dropped;
+                result.timeouts = trial.timeouts;
+                result.fps = trial.fps;
+                result.throughput_mb_s = trial.fps * frame.size() / 1e6;
+                results.push_back(result);
+            }
+        }
+    }
+    return results;
+}
+
+static bool better(const BenchmarkResult& a, const BenchmarkResult& b)
+{
+    long a_lost = a.dropped + a.timeouts;
+    long b_lost = b.dropped + b.timeouts;
+    if (a_lost != b_lost) return a_lost < b_lost;
+    if (a.fps != b.fps) return a.fps > b.fps;
+    return a.bandwidth_percent < b.bandwidth_percent;
+}
+
+std::vector<ThroughputProfile> select_profiles(
+    const CameraInfo& info,
+    const ROI& roi,
+    const std::vector<BenchmarkResult>& results)
+{
+    std::map<ImageType, const BenchmarkResult*> best;
+    for (const BenchmarkResult& result : results)
+    {
+        auto it = best.find(result.type);
+        if (it == best.end() || better(result, *(it->second)))
+        {
+            best[result.type] = &result;
+        }
+    }
+    std::vector<ThroughputProfile> profiles;
+    std::string host = get_host_name();
+    for (const auto& type_result : best)
+    {
+        const BenchmarkResult& result = *(type_result.second);
+        ThroughputProfile profile;
+        profile.camera_model = info.name;
+        profile.host = host;
+        profile.type = result.type;
+        profile.high_speed = result.high_speed;
+        profile.bandwidth_percent = result.bandwidth_percent;
+        profile.width = roi.width;
+        profile.height = roi.height;
+        profile.bins = roi.bins;
+        profile.fps = result.fps;
+        profile.dropped = result.dropped;
+        profiles.push_back(profile);
+    }
+    return profiles;
+}
+
+std::string get_host_name()
+{
+    char buffer[256];
+    if (gethostname(buffer, sizeof(buffer)) != 0) return "unknown";
+    buffer[sizeof(buffer) - 1] = '\0';
+    return std::string(buffer);
+}
+
+std::filesystem::path get_default_profile_cache()
+{
+    std::filesystem::path cache;
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    const char* home = std::getenv("HOME");
+    if (xdg != nullptr && xdg[0] != '\0')
+        cache = xdg;
+    else if (home != nullptr)
+        cache = std::filesystem::path(home) / ".cache";
+    else
+        cache = std::filesystem::temp_directory_path();
+    return cache / "camera_zwo_asi" / "throughput_profiles";
+}
+
+std::string ThroughputProfile::to_string() const
+{
+    std::ostringstream s;
+    s << camera_model << " on " << host << " (" << zwo_asi::to_string(type)
+      << ", " << width << "x" << height << " bin " << bins
+      << "): high speed mode: " << (high_speed ? "*" : "-")
+      << " | bandwidth: " << bandwidth_percent << "% | fps: " << fps
+      << " | dropped: " << dropped;
+    return s.str();
+}
+
+ProfileCache::ProfileCache(std::filesystem::path path) : path_{path}
+{
+}
+
+// one profile per line, tab separated (camera models have spaces)
+static const char* CACHE_HEADER =
+    "# camera_model\thost\ttype\thigh_speed\tbandwidth\twidth\theight\tbins"
+    "\tfps\tdropped";
+
+bool ProfileCache::load()
+{
+    std::ifstream f(path_);
+    if (!f.is_open()) return false;
+    profiles_.clear();
+    std::string line;
+    int line_number = 0;
+    while (std::getline(f, line))
+    {
+        line_number++;
+        if (line.empty() || line[0] == '#') continue;
+        std::vector<std::string> fields;
+        std::istringstream l(line);
+        std::string field;
+        while (std::getline(l, field, '\t')) fields.push_back(field);
+        if (fields.size() != 10)
+        {
+            std::ostringstream s;
+            s << "invalid throughput profile in " << path_ << " (line "
+              << line_number << ")";
+            throw std::runtime_error(s.str());
+        }
+        ThroughputProfile p;
+        try
+        {
+            p.camera_model = fields[0];
+            p.host = fields[1];
+            p.type = get_image_type(fields[2]);
+            p.high_speed = std::stoi(fields[3]) != 0;
+            p.bandwidth_percent = std::stoi(fields[4]);
+            p.width = std::stoi(fields[5]);
+            p.height = std::stoi(fields[6]);
+            p.bins = std::stoi(fields[7]);
+            p.fps = std::stod(fields[8]);
+            p.dropped = std::stol(fields[9]);
+        }
+        catch (const std::exception& e)
+        {
+            std::ostringstream s;
+            s << "invalid throughput profile in " << path_ << " (line "
+              << line_number << "): " << e.what();
+            throw std::runtime_error(s.str());
+        }
+        set(p);
+    }
+    return true;
+}
+
+void ProfileCache::save() const
+{
+    std::filesystem::create_directories(path_.parent_path());
+    // written to a temporary file first, so that an interrupted
+    // save does not corrupt the cache
+    std::filesystem::path tmp = path_;
+    tmp += ".tmp";
+    {
+        std::ofstream f(tmp);
+        if (!f.is_open())
+        {
+            throw std::runtime_error("failed to write " + tmp.string());
+        }
+        f << CACHE_HEADER << "\n";
+        for (const auto& key_profile : profiles_)
+        {
+            const ThroughputProfile& p = key_profile.second;
+            f << p.camera_model << "\t" << p.host << "\t"
+              << zwo_asi::to_string(p.type) << "\t" << p.high_speed << "\t"
+              << p.bandwidth_percent << "\t" << p.width << "\t" << p.height
+              << "\t" << p.bins << "\t" << p.fps << "\t" << p.dropped << "\n";
+        }
+    }
+    std::filesystem::rename(tmp, path_);
+}
+
+const ThroughputProfile* ProfileCache::get(std::string camera_model,
+                                           std::string host,
+                                           ImageType type) const
+{
+    auto it = profiles_.find(Key(camera_model, host, type));
+    if (it == profiles_.end()) return nullptr;
+    return &(it->second);
+}
+
+void ProfileCache::set(const ThroughputProfile& profile)
+{
+    profiles_[Key(profile.camera_model, profile.host, profile.type)] = profile;
+}
+
+std::vector<ThroughputProfile> ProfileCache::get_profiles() const
+{
+    std::vector<ThroughputProfile> profiles;
+    for (const auto& key_profile : profiles_)
+    {
+        profiles.push_back(key_profile.second);
+    }
+    return profiles;
+}
+
+const std::filesystem::path& ProfileCache::get_path() const
+{
+    return path_;
+}
+
+static void apply_profile(Camera& camera, const ThroughputProfile& profile)
+{
+    std::map<std::string, Controllable> controls = camera.get_controls();
+    if (has_control(controls, "HighSpeedMode"))
+    {
+        camera.set_control("HighSpeedMode", profile.high_speed ? 1 : 0);
+    }
+    camera.set_control("BandWidth", profile.bandwidth_percent);
+}
+
+std::vector<ThroughputProfile> calibrate(Camera& camera,
+                                         const BenchmarkOptions& options,
+                                         std::filesystem::path cache)
+{
+    ROI roi = camera.get_roi();
+    std::vector<BenchmarkResult> results = run_benchmark(camera, options);
+    std::vector<ThroughputProfile> profiles =
+        select_profiles(camera.get_info(), roi, results);
+    ProfileCache profile_cache(cache);
+    profile_cache.load();
+    for (const ThroughputProfile& profile : profiles)
+    {
+        profile_cache.set(profile);
+        if (profile.type == roi.type) apply_profile(camera, profile);
+    }
+    profile_cache.save();
+    return profiles;
+}
+
+bool apply_cached_profile(Camera& camera, std::filesystem::path cache)
+{
+    ProfileCache profile_cache(cache);
+    if (!profile_cache.load()) return false;
+    const ThroughputProfile* profile = profile_cache.get(
+        camera.get_info().name, get_host_name(), camera.get_roi().type);
+    if (profile == nullptr) return false;
+    apply_profile(camera, *profile);
+    return true;
+}
+
+}  // namespace zwo_asi
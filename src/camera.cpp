@@ -1,15 +1,21 @@
 #include "zwo_asi/camera.hpp"
+#include <mutex>
+#include "zwo_asi/camera_registry.hpp"
+#include "zwo_asi/sdk.hpp"
+#include "zwo_asi/toml_config.hpp"
 
 namespace zwo_asi
 {
 std::string get_sdk_version()
 {
-    return std::string(ASIGetSDKVersion());
+    return std::string(get_sdk()->GetSDKVersion());
 }
 
 void close_camera(int camera_index)
 {
-    ASI_ERROR_CODE error = ASICloseCamera(camera_index);
+    CameraRegistry& registry = CameraRegistry::instance();
+    int camera_id = registry.get_camera_info(camera_index).camera_id;
+    ASI_ERROR_CODE error = registry.close(*get_sdk(), camera_id);
     if (error != ASI_SUCCESS)
     {
         throw CameraException(
@@ -17,32 +23,181 @@ void close_camera(int camera_index)
     }
 }
 
+void close_cameras()
+{
+    CameraRegistry& registry = CameraRegistry::instance();
+    std::shared_ptr<Sdk> sdk = get_sdk();
+    for (int camera_id : registry.get_opened())
+    {
+        registry.close(*sdk, camera_id);
+    }
+}
+
+std::string to_string(CameraState state)
+{
+    switch (state)
+    {
+        case CameraState::idle:
+            return "idle";
+        case CameraState::exposing:
+            return "exposing";
+        case CameraState::streaming:
+            return "streaming";
+        case CameraState::reconfiguring:
+            return "reconfiguring";
+    }
+    return "unknown";
+}
+
+namespace
+{
+// sets the camera state back to idle when going out of scope
+class IdleOnExit
+{
+public:
+    IdleOnExit(std::atomic<CameraState>& state) : state_{state}
+    {
+    }
+
+    ~IdleOnExit()
+    {
+        state_ = CameraState::idle;
+    }
+
+private:
+    std::atomic<CameraState>& state_;
+};
+}  // namespace
+
 Camera::Camera(int camera_index)
-    : camera_info_(get_camera_info(camera_index)), camera_index_{camera_index}
+    : sdk_{get_sdk()},
+      camera_info_(get_camera_info(camera_index)),
+      camera_index_{camera_index},
+      camera_id_{camera_info_.camera_id},
+      nb_captured_{0},
+      state_{CameraState::idle},
+      active_preset_{nullptr}
 {
+    CameraRegistry& registry = CameraRegistry::instance();
     ASI_ERROR_CODE error;
-    error = ASIOpenCamera(camera_info_.camera_id);
+    error = registry.open(*sdk_, camera_id_);
+    if (error == ASI_ERROR_INVALID_ID || error == ASI_ERROR_CAMERA_REMOVED)
+    {
+        // the cached enumeration is outdated (camera unplugged or
+        // replaced since the last refresh): enumerating again, and
+        // opening the camera now at this index
+        registry.refresh();
+        camera_info_ = get_camera_info(camera_index);
+        camera_id_ = camera_info_.camera_id;
+        error = registry.open(*sdk_, camera_id_);
+    }
     if (error != ASI_SUCCESS)
     {
         throw CameraException("failed to open the camera", camera_index, error);
     }
-    error = ASIInitCamera(camera_info_.camera_id);
+    // the cached identity of the index may be the one of another camera
+    // of the same model (see open_by_identity)
+    registry.update_identity(camera_index_, read_identity(*sdk_, camera_id_));
+    error = sdk_->InitCamera(camera_id_);
     if (error != ASI_SUCCESS)
     {
         throw CameraException("failed to init the camera", camera_index, error);
     }
     read_control_caps(controls_);
+    read_settings();
 }
 
 Camera::~Camera()
 {
-    ASICloseCamera(camera_info_.camera_id);
+    if (state_ == CameraState::streaming)
+    {
+        sdk_->StopVideoCapture(camera_id_);
+    }
+    CameraRegistry::instance().close(*sdk_, camera_id_);
+}
+
+std::unique_ptr<Camera> Camera::open_by_identity(
+    std::function<bool(const CameraIdentity&)> match, std::string description)
+{
+    CameraRegistry& registry = CameraRegistry::instance();
+    // the camera is found from the cached identities, which are checked
+    // against the identity read once the camera is opened: if cameras
+    // swapped their camera ids, the cache has been dropped and the
+    // camera is looked up again
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        int camera_index = registry.find_by_identity(match);
+        if (camera_index < 0) break;
+        std::unique_ptr<Camera> camera =
+            std::make_unique<Camera>(camera_index);
+        if (match(registry.get_identity(camera_index))) return camera;
+    }
+    std::ostringstream s;
+    s << "failed to find a camera with " << description;
+    throw CameraException(s.str(), -1, ASI_ERROR_INVALID_INDEX);
+}
+
+std::unique_ptr<Camera> Camera::open_by_serial(std::string serial)
+{
+    return open_by_identity(
+        [&serial](const CameraIdentity& identity) {
+            return identity.serial == serial;
+        },
+        "serial number " + serial);
+}
+
+std::unique_ptr<Camera> Camera::open_by_id(std::string id)
+{
+    return open_by_identity(
+        [&id](const CameraIdentity& identity) { return identity.id == id; },
+        "id " + id);
+}
+
+std::unique_ptr<Camera> Camera::open_by_name(std::string name)
+{
+    int camera_index = CameraRegistry::instance().find_by_name(name);
+    if (camera_index < 0)
+    {
+        std::ostringstream s;
+        s << "failed to find a camera named " << name;
+        throw CameraException(s.str(), -1, ASI_ERROR_INVALID_INDEX);
+    }
+    return std::make_unique<Camera>(camera_index);
+}
+
+std::string Camera::get_serial() const
+{
+    return CameraRegistry::instance().get_serial(camera_index_);
+}
+
+std::string Camera::get_id() const
+{
+    return CameraRegistry::instance().get_identity(camera_index_).id;
+}
+
+void Camera::set_id(std::string id)
+{
+    std::unique_lock<std::shared_mutex> lock(control_mutex_);
+    ASI_ERROR_CODE error =
+        sdk_->SetID(camera_id_, string_to_id(id));
+    if (error != ASI_SUCCESS)
+    {
+        throw CameraException(
+            "failed to set the camera id", camera_index_, error);
+    }
+    CameraRegistry::instance().set_id(camera_index_, id);
+}
+
+int Camera::get_index() const
+{
+    return camera_index_;
 }
 
 std::map<std::string, Controllable> Camera::get_controls() const
 {
     std::map<std::string, std::shared_ptr<ASI_CONTROL_CAPS>>::const_iterator it;
     std::map<std::string, Controllable> controls;
+    std::shared_lock<std::shared_mutex> lock(control_mutex_);
     for (it = controls_.begin(); it != controls_.end(); it++)
     {
         controls[it->first] = get_controllable(*(it->second));
@@ -52,26 +207,43 @@ std::map<std::string, Controllable> Camera::get_controls() const
 
 void Camera::set_control(std::string control, long value)
 {
-    const ASI_CONTROL_CAPS& caps = get_control_caps(control);
-    Controllable controllable = get_controllable(caps);
-    ASI_ERROR_CODE error =
-        ASISetControlValue(camera_index_, caps.ControlType, value, ASI_FALSE);
-    if (error != ASI_SUCCESS)
+    // throws a ControllableException if no such control
+    get_control_caps(control);
+    Result result = try_set_control(control, value);
+    if (!result)
     {
         std::ostringstream s;
         s << "failed to set values for controllable: " << control;
-        throw CameraException(s.str(), camera_index_, error);
+        throw CameraException(s.str(), camera_index_, result.error_code);
     }
 }
 
+Result Camera::try_set_control(const std::string& control,
+                               long value) noexcept
+{
+    auto it = controls_.find(control);
+    if (it == controls_.end())
+    {
+        return Result(ResultCode::invalid,
+                      ASI_ERROR_INVALID_CONTROL_TYPE,
+                      "no such controllable");
+    }
+    std::unique_lock<std::shared_mutex> lock(control_mutex_);
+    active_preset_ = nullptr;
+    return Result(write_control(it->second->ControlType, value, false),
+                  "failed to set the value of the controllable");
+}
+
 void Camera::set_auto(std::string control)
 {
     const ASI_CONTROL_CAPS& caps = get_control_caps(control);
+    std::unique_lock<std::shared_mutex> lock(control_mutex_);
+    active_preset_ = nullptr;
     Controllable controllable = get_controllable(caps);
     if (!controllable.supports_auto)
         throw ControllableException(control, false, false, true);
-    ASI_ERROR_CODE error = ASISetControlValue(
-        camera_index_, caps.ControlType, controllable.value, ASI_TRUE);
+    ASI_ERROR_CODE error =
+        write_control(caps.ControlType, controllable.value, true);
     if (error != ASI_SUCCESS)
     {
         std::ostringstream s;
@@ -80,6 +252,128 @@ void Camera::set_auto(std::string control)
     }
 }
 
+void Camera::set_exposure_and_gain(long exposure_us, long gain)
+{
+    // throw ControllableException if not supported by the camera
+    get_control_caps("Exposure");
+    get_control_caps("Gain");
+    std::unique_lock<std::shared_mutex> lock(control_mutex_);
+    active_preset_ = nullptr;
+    FrameSettings settings = settings_;
+    // not using write_control: both values are recorded as one change
+    ASI_ERROR_CODE error = sdk_->SetControlValue(
+        camera_id_, ASI_EXPOSURE, exposure_us, ASI_FALSE);
+    if (error == ASI_SUCCESS)
+    {
+        settings.exposure_us = exposure_us;
+        error =
+            sdk_->SetControlValue(camera_id_, ASI_GAIN, gain, ASI_FALSE);
+        if (error == ASI_SUCCESS) settings.gain = gain;
+    }
+    record_settings(settings);
+    if (error != ASI_SUCCESS)
+    {
+        throw CameraException(
+            "failed to set the exposure and gain", camera_index_, error);
+    }
+}
+
+FrameSettings Camera::get_settings() const
+{
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    return settings_;
+}
+
+ASI_ERROR_CODE Camera::write_control(ASI_CONTROL_TYPE type,
+                                     long value,
+                                     bool is_auto) noexcept
+{
+    ASI_ERROR_CODE error = sdk_->SetControlValue(
+        camera_id_, type, value, is_auto ? ASI_TRUE : ASI_FALSE);
+    if (error != ASI_SUCCESS) return error;
+    FrameSettings settings = settings_;
+    if (type == ASI_EXPOSURE) settings.exposure_us = is_auto ? -1 : value;
+    if (type == ASI_GAIN) settings.gain = is_auto ? -1 : value;
+    record_settings(settings);
+    return error;
+}
+
+void Camera::record_settings(FrameSettings settings) noexcept
+{
+    if (settings.exposure_us == settings_.exposure_us &&
+        settings.gain == settings_.gain)
+    {
+        return;
+    }
+    settings.generation = settings_.generation + 1;
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    settings_ = settings;
+    // the frames being exposed when streaming keep the previous settings
+    if (state_ == CameraState::streaming)
+        settings_changes_.push_back(
+            SettingsChange{std::chrono::steady_clock::now(), settings});
+    else
+        video_settings_ = settings;
+}
+
+void Camera::read_settings()
+{
+    FrameSettings settings = settings_;
+    settings.exposure_us = -1;
+    settings.gain = -1;
+    for (const char* name : {"Exposure", "Gain"})
+    {
+        auto it = controls_.find(name);
+        if (it == controls_.end()) continue;
+        Controllable control = get_controllable(*(it->second));
+        long value = control.is_auto ? -1 : control.value;
+        if (it->second->ControlType == ASI_EXPOSURE)
+            settings.exposure_us = value;
+        else
+            settings.gain = value;
+    }
+    if (settings.exposure_us != settings_.exposure_us ||
+        settings.gain != settings_.gain)
+    {
+        settings.generation++;
+    }
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    settings_ = settings;
+    video_settings_ = settings;
+    settings_changes_.clear();
+    last_video_frame_ = std::chrono::steady_clock::time_point();
+}
+
+void Camera::tag_settings(Frame& frame) noexcept
+{
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    // the SDK does not report the settings of video frames: the exposure
+    // of a frame is considered to have started before its reading by
+    // its exposure time plus the readout and transfer time (estimated by
+    // the last frame period). A change applies to the frames which
+    // exposure started after it, so frames are tagged with new
+    // settings late rather than early.
+    std::chrono::steady_clock::duration period(0);
+    if (last_video_frame_ != std::chrono::steady_clock::time_point())
+    {
+        period = frame.timestamp - last_video_frame_;
+    }
+    last_video_frame_ = frame.timestamp;
+    bool changed = false;
+    while (!settings_changes_.empty())
+    {
+        const SettingsChange& change = settings_changes_.front();
+        std::chrono::microseconds exposure(
+            std::max(change.settings.exposure_us, 0L));
+        if (frame.timestamp - period - exposure < change.time) break;
+        video_settings_ = change.settings;
+        settings_changes_.pop_front();
+        changed = true;
+    }
+    frame.settings = video_settings_;
+    frame.settings_changed = changed;
+}
+
 const ASI_CONTROL_CAPS& Camera::get_control_caps(std::string control) const
 {
     std::map<std::string, std::shared_ptr<ASI_CONTROL_CAPS>>::const_iterator it;
@@ -96,8 +390,8 @@ Controllable Camera::get_controllable(const ASI_CONTROL_CAPS& cap) const
     Controllable r;
     r.name = std::string(cap.Name);
     ASI_BOOL is_auto_;
-    ASI_ERROR_CODE error = ASIGetControlValue(
-        camera_index_, cap.ControlType, &(r.value), &is_auto_);
+    ASI_ERROR_CODE error = sdk_->GetControlValue(
+        camera_id_, cap.ControlType, &(r.value), &is_auto_);
     if (error != ASI_SUCCESS)
     {
         std::ostringstream s;
@@ -143,13 +437,19 @@ ROI Camera::get_roi() const
 {
     ROI roi;
     ASI_IMG_TYPE type;
-    ASI_ERROR_CODE error = ASIGetROIFormat(
-        camera_index_, &roi.width, &roi.height, &roi.bins, &type);
+    ASI_ERROR_CODE error = sdk_->GetROIFormat(
+        camera_id_, &roi.width, &roi.height, &roi.bins, &type);
     if (error != ASI_SUCCESS)
     {
         throw CameraException(
             "failed to read the current ROI", camera_index_, error);
     }
+    error = sdk_->GetStartPos(camera_id_, &roi.start_x, &roi.start_y);
+    if (error != ASI_SUCCESS)
+    {
+        throw CameraException(
+            "failed to read the ROI starting position", camera_index_, error);
+    }
     switch (type)
     {
         case ASI_IMG_RAW8:
@@ -172,7 +472,8 @@ void Camera::read_control_caps(
     std::map<std::string, std::shared_ptr<ASI_CONTROL_CAPS>>& controls)
 {
     int nb_controls;
-    ASI_ERROR_CODE error = ASIGetNumOfControls(camera_index_, &nb_controls);
+    ASI_ERROR_CODE error =
+        sdk_->GetNumOfControls(camera_id_, &nb_controls);
     if (error != ASI_SUCCESS)
     {
         throw CameraException(
@@ -184,7 +485,8 @@ void Camera::read_control_caps(
     {
         std::shared_ptr<ASI_CONTROL_CAPS> caps =
             std::make_shared<ASI_CONTROL_CAPS>();
-        error = ASIGetControlCaps(camera_index_, control, caps.get());
+        error =
+            sdk_->GetControlCaps(camera_id_, control, caps.get());
         if (error != ASI_SUCCESS)
         {
             std::ostringstream s;
@@ -198,13 +500,25 @@ void Camera::read_control_caps(
 ASI_EXPOSURE_STATUS Camera::get_exposition_status() const
 {
     ASI_EXPOSURE_STATUS status;
-    ASI_ERROR_CODE error = ASIGetExpStatus(camera_index_, &status);
-    if (error != ASI_SUCCESS)
+    throw_on_error(try_get_exposure_status(status));
+    return status;
+}
+
+Result Camera::try_get_exposure_status(
+    ASI_EXPOSURE_STATUS& status) const noexcept
+{
+    return Result(sdk_->GetExpStatus(camera_id_, &status),
+                  "failed to read the exposure status");
+}
+
+void Camera::throw_on_error(const Result& result) const
+{
+    if (result) return;
+    if (result.error_code == ASI_SUCCESS)
     {
-        throw CameraException(
-            "failed to read the exposure status", camera_index_, error);
+        throw std::runtime_error(result.message);
     }
-    return status;
+    throw CameraException(result.message, camera_index_, result.error_code);
 }
 
 std::string Camera::to_string() const
@@ -276,25 +590,17 @@ std::string Camera::to_string() const
     return s.str();
 }
 
-void Camera::check_camera_ready() const
+Result Camera::wait_for_status_change(
+    ASI_EXPOSURE_STATUS current_status,
+    ASI_EXPOSURE_STATUS& status) const noexcept
 {
-    ASI_EXPOSURE_STATUS status = get_exposition_status();
-    if (status != ASI_EXP_IDLE)
-    {
-        throw std::runtime_error("could not take a picture: camera busy");
-    }
-}
-
-ASI_EXPOSURE_STATUS Camera::wait_for_status_change(
-    ASI_EXPOSURE_STATUS current_status) const
-{
-    ASI_EXPOSURE_STATUS status = get_exposition_status();
-    while (status == current_status)
+    Result result = try_get_exposure_status(status);
+    while (result && status == current_status)
     {
         usleep(500);
-        status = get_exposition_status();
+        result = try_get_exposure_status(status);
     }
-    return status;
+    return result;
 }
 
 void Camera::enable_dark_substract(std::filesystem::path bmp)
@@ -306,29 +612,34 @@ void Camera::enable_dark_substract(std::filesystem::path bmp)
         throw std::runtime_error(s.str());
     }
 
-    ASI_ERROR_CODE error =
-        ASIEnableDarkSubtract(camera_index_, (char*)bmp.string().c_str());
-    if (error != ASI_SUCCESS)
-    {
-        throw CameraException(
-            "failed to enable dark substract", camera_index_, error);
-    }
+    reconfigure("enable dark substract", [&]() {
+        ASI_ERROR_CODE error = sdk_->EnableDarkSubtract(
+            camera_id_, (char*)bmp.string().c_str());
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException(
+                "failed to enable dark substract", camera_index_, error);
+        }
+    });
 }
 
 void Camera::disable_dark_substract()
 {
-    ASI_ERROR_CODE error = ASIDisableDarkSubtract(camera_index_);
-    if (error != ASI_SUCCESS)
-    {
-        throw CameraException(
-            "failed to disable dark substract", camera_index_, error);
-    }
+    reconfigure("disable dark substract", [&]() {
+        ASI_ERROR_CODE error = sdk_->DisableDarkSubtract(camera_id_);
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException(
+                "failed to disable dark substract", camera_index_, error);
+        }
+    });
 }
 
 void Camera::set_pulse_guide_on(GuideDirection guide)
 {
+    std::unique_lock<std::shared_mutex> lock(control_mutex_);
     ASI_ERROR_CODE error =
-        ASIPulseGuideOn(camera_index_, zwo_asi::get_native(guide));
+        sdk_->PulseGuideOn(camera_id_, zwo_asi::get_native(guide));
     if (error != ASI_SUCCESS)
     {
         throw CameraException(
@@ -338,8 +649,9 @@ void Camera::set_pulse_guide_on(GuideDirection guide)
 
 void Camera::set_pulse_guide_off(GuideDirection guide)
 {
+    std::unique_lock<std::shared_mutex> lock(control_mutex_);
     ASI_ERROR_CODE error =
-        ASIPulseGuideOff(camera_index_, zwo_asi::get_native(guide));
+        sdk_->PulseGuideOff(camera_id_, zwo_asi::get_native(guide));
     if (error != ASI_SUCCESS)
     {
         throw CameraException(
@@ -349,33 +661,228 @@ void Camera::set_pulse_guide_off(GuideDirection guide)
 
 void Camera::set_camera_mode(CameraMode mode)
 {
-    ASI_ERROR_CODE error =
-        ASISetCameraMode(camera_index_, zwo_asi::get_native(mode));
-    if (error != ASI_SUCCESS)
-    {
-        throw CameraException(
-            "failed to set camera mode", camera_index_, error);
-    }
+    reconfigure("set the camera mode", [&]() {
+        std::unique_lock<std::shared_mutex> lock(control_mutex_);
+        active_preset_ = nullptr;
+        ASI_ERROR_CODE error =
+            sdk_->SetCameraMode(camera_id_, zwo_asi::get_native(mode));
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException(
+                "failed to set camera mode", camera_index_, error);
+        }
+    });
 }
 
 void Camera::set_roi(const ROI& roi)
 {
     roi.valid(camera_info_);
-    ASI_ERROR_CODE error = ASISetROIFormat(camera_index_,
-                                           roi.width,
-                                           roi.height,
-                                           roi.bins,
-                                           zwo_asi::get_native(roi.type));
-    if (error != ASI_SUCCESS)
+    reconfigure("set the ROI", [&]() {
+        std::unique_lock<std::shared_mutex> lock(control_mutex_);
+        active_preset_ = nullptr;
+        ASI_ERROR_CODE error =
+            sdk_->SetROIFormat(camera_id_,
+                                   roi.width,
+                                   roi.height,
+                                   roi.bins,
+                                   zwo_asi::get_native(roi.type));
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException(
+                "failed to set the ROI", camera_index_, error);
+        }
+        error = sdk_->SetStartPos(camera_id_, roi.start_x, roi.start_y);
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException("failed to set the ROI starting position",
+                                  camera_index_,
+                                  error);
+        }
+    });
+}
+
+void Camera::add_preset(std::string name,
+                        const CameraSnapshot& config,
+                        int nb_frames)
+{
+    std::vector<std::string> issues =
+        validate_config(config, camera_info_, get_controls());
+    if (!issues.empty())
     {
-        throw CameraException("failed to set the ROI", camera_index_, error);
+        std::ostringstream s;
+        s << "the preset " << name << " is not suitable for the camera: ";
+        for (size_t i = 0; i < issues.size(); i++)
+        {
+            if (i > 0) s << ", ";
+            s << issues[i];
+        }
+        throw std::runtime_error(s.str());
     }
-    error = ASISetStartPos(camera_index_, roi.start_x, roi.start_y);
-    if (error != ASI_SUCCESS)
+
+    std::unique_ptr<Preset> preset = std::make_unique<Preset>();
+    preset->name = name;
+    preset->width = config.roi.width;
+    preset->height = config.roi.height;
+    preset->bins = config.roi.bins;
+    preset->type = zwo_asi::get_native(config.roi.type);
+    preset->start_x = config.roi.start_x;
+    preset->start_y = config.roi.start_y;
+    // the mode of other cameras than trigger cameras is always normal
+    // (checked by validate_config)
+    preset->has_mode = config.has_mode && camera_info_.is_trigger;
+    preset->mode = zwo_asi::get_native(config.mode);
+    for (const auto& control : config.controls)
     {
-        throw CameraException(
-            "failed to set the ROI starting position", camera_index_, error);
+        preset->controls.push_back(
+            NativeControl{get_control_caps(control.first).ControlType,
+                          control.second.value,
+                          control.second.is_auto});
+    }
+    preset->pool = std::make_shared<FramePool>(
+        config.roi.width, config.roi.height, config.roi.type, nb_frames);
+
+    std::unique_lock<std::shared_mutex> lock(control_mutex_);
+    if (active_preset_ != nullptr && active_preset_->name == name)
+    {
+        active_preset_ = nullptr;
+    }
+    presets_[name] = std::move(preset);
+}
+
+const Camera::Preset& Camera::get_preset(const std::string& name) const
+{
+    auto it = presets_.find(name);
+    if (it == presets_.end())
+    {
+        throw std::runtime_error("no preset named " + name);
+    }
+    return *(it->second);
+}
+
+bool Camera::same_geometry(const Preset& a, const Preset& b)
+{
+    return a.width == b.width && a.height == b.height && a.bins == b.bins &&
+           a.type == b.type && a.start_x == b.start_x &&
+           a.start_y == b.start_y && a.has_mode == b.has_mode &&
+           (!a.has_mode || a.mode == b.mode);
+}
+
+int Camera::write_preset(const Preset& preset, const Preset* active)
+{
+    // called with the control lock held. Geometry changes require the
+    // camera to be reconfiguring (see apply_preset)
+    int nb_writes = 0;
+    ASI_ERROR_CODE error = ASI_SUCCESS;
+    active_preset_ = nullptr;
+    if (active == nullptr || active->width != preset.width ||
+        active->height != preset.height || active->bins != preset.bins ||
+        active->type != preset.type)
+    {
+        error = sdk_->SetROIFormat(camera_id_,
+                                       preset.width,
+                                       preset.height,
+                                       preset.bins,
+                                       preset.type);
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException(
+                "failed to set the ROI", camera_index_, error);
+        }
+        nb_writes++;
+    }
+    if (active == nullptr || active->start_x != preset.start_x ||
+        active->start_y != preset.start_y)
+    {
+        error =
+            sdk_->SetStartPos(camera_id_, preset.start_x, preset.start_y);
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException("failed to set the ROI starting position",
+                                  camera_index_,
+                                  error);
+        }
+        nb_writes++;
+    }
+    if (preset.has_mode &&
+        (active == nullptr || !active->has_mode || active->mode != preset.mode))
+    {
+        error = sdk_->SetCameraMode(camera_id_, preset.mode);
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException(
+                "failed to set camera mode", camera_index_, error);
+        }
+        nb_writes++;
+    }
+    for (const NativeControl& control : preset.controls)
+    {
+        if (active != nullptr &&
+            std::any_of(active->controls.begin(),
+                        active->controls.end(),
+                        [&control](const NativeControl& c) {
+                            return c.type == control.type &&
+                                   c.is_auto == control.is_auto &&
+                                   (c.is_auto || c.value == control.value);
+                        }))
+        {
+            continue;
+        }
+        error = write_control(control.type, control.value, control.is_auto);
+        if (error != ASI_SUCCESS)
+        {
+            std::ostringstream s;
+            s << "failed to apply the preset " << preset.name;
+            throw CameraException(s.str(), camera_index_, error);
+        }
+        nb_writes++;
+    }
+    active_preset_ = &preset;
+    return nb_writes;
+}
+
+int Camera::apply_preset(std::string name)
+{
+    {
+        std::unique_lock<std::shared_mutex> lock(control_mutex_);
+        const Preset& preset = get_preset(name);
+        if (active_preset_ == &preset) return 0;
+        // only controls to write: no need to interrupt the acquisition
+        if (active_preset_ != nullptr &&
+            same_geometry(*active_preset_, preset))
+        {
+            return write_preset(preset, active_preset_);
+        }
     }
+    bool video = is_video_active();
+    if (video) stop_video();
+    int nb_writes = 0;
+    reconfigure("apply the preset " + name, [&]() {
+        std::unique_lock<std::shared_mutex> lock(control_mutex_);
+        nb_writes = write_preset(get_preset(name), active_preset_);
+    });
+    if (video) start_video();
+    return nb_writes;
+}
+
+std::shared_ptr<FramePool> Camera::get_preset_pool(std::string name) const
+{
+    std::shared_lock<std::shared_mutex> lock(control_mutex_);
+    return get_preset(name).pool;
+}
+
+std::vector<std::string> Camera::get_presets() const
+{
+    std::shared_lock<std::shared_mutex> lock(control_mutex_);
+    std::vector<std::string> names;
+    for (const auto& preset : presets_) names.push_back(preset.first);
+    return names;
+}
+
+std::string Camera::get_active_preset() const
+{
+    std::shared_lock<std::shared_mutex> lock(control_mutex_);
+    if (active_preset_ == nullptr) return std::string();
+    return active_preset_->name;
 }
 
 const CameraInfo& Camera::get_info() const
@@ -385,39 +892,217 @@ const CameraInfo& Camera::get_info() const
 
 void Camera::capture(unsigned char* buffer, int image_size)
 {
-    // check that the camera is currently idle, otherwise throws a runtime error
-    check_camera_ready();
+    throw_on_error(try_capture(buffer, image_size));
+}
 
-    // starting exposure. note: exposure time setup by the
-    // ASI_EXPOSURE controllable
-    ASI_ERROR_CODE error = ASIStartExposure(camera_index_, ASI_FALSE);
-    if (error != ASI_SUCCESS)
+Result Camera::try_capture(unsigned char* buffer, int image_size) noexcept
+{
+    // reserving the camera, so that no other thread starts an exposure,
+    // the video or a reconfiguration while exposing
+    CameraState idle = CameraState::idle;
+    if (!state_.compare_exchange_strong(idle, CameraState::exposing))
     {
-        throw CameraException("failed to start exposure", camera_index_, error);
+        return Result(ResultCode::busy,
+                      ASI_SUCCESS,
+                      "could not take a picture: camera busy");
     }
+    IdleOnExit idle_on_exit(state_);
+
+    // check that the camera is currently idle
+    ASI_EXPOSURE_STATUS status;
+    Result result = try_get_exposure_status(status);
+    if (!result) return result;
+    if (status != ASI_EXP_IDLE)
+    {
+        return Result(ResultCode::busy,
+                      ASI_SUCCESS,
+                      "could not take a picture: camera busy");
+    }
+
+    // starting exposure. note: exposure time setup by the
+    // ASI_EXPOSURE controllable
+    result = Result(sdk_->StartExposure(camera_id_, ASI_FALSE),
+                    "failed to start exposure");
+    if (!result) return result;
 
     // status is expected to switch status from idle to working to ...
-    wait_for_status_change(ASI_EXP_IDLE);
-    ASI_EXPOSURE_STATUS new_status = wait_for_status_change(ASI_EXP_WORKING);
+    result = wait_for_status_change(ASI_EXP_IDLE, status);
+    if (!result) return result;
+    result = wait_for_status_change(ASI_EXP_WORKING, status);
+    if (!result) return result;
 
     // ... failed !
-    if (new_status == ASI_EXP_FAILED)
+    if (status == ASI_EXP_FAILED)
     {
-        throw std::runtime_error("failed to get exposure");
+        return Result(
+            ResultCode::failed, ASI_SUCCESS, "failed to get exposure");
     }
 
     // ... success ? getting data
-    else
+    return Result(sdk_->GetDataAfterExp(camera_id_, buffer, image_size),
+                  "failed to read image after capture");
+}
+
+void Camera::capture(Frame& frame)
+{
+    throw_on_error(try_capture(frame));
+}
+
+Result Camera::try_capture(Frame& frame) noexcept
+{
+    FrameSettings settings;
+    {
+        std::lock_guard<std::mutex> lock(settings_mutex_);
+        settings = settings_;
+    }
+    Result result = try_capture(frame.data.data(), frame.size());
+    if (!result) return result;
+    frame.timestamp = std::chrono::steady_clock::now();
+    frame.index = nb_captured_++;
+    frame.settings = settings;
+    frame.settings_changed = false;
+    return result;
+}
+
+void Camera::start_video()
+{
+    CameraState current = CameraState::idle;
+    if (!state_.compare_exchange_strong(current, CameraState::streaming))
+    {
+        if (current == CameraState::streaming) return;
+        throw std::runtime_error("failed to start video capture: camera " +
+                                 zwo_asi::to_string(current));
+    }
+    try
+    {
+        std::unique_lock<std::shared_mutex> lock(control_mutex_);
+        read_settings();
+    }
+    catch (...)
+    {
+        state_ = CameraState::idle;
+        throw;
+    }
+    ASI_ERROR_CODE error = sdk_->StartVideoCapture(camera_id_);
+    if (error != ASI_SUCCESS)
+    {
+        state_ = CameraState::idle;
+        throw CameraException(
+            "failed to start video capture", camera_index_, error);
+    }
+}
+
+void Camera::stop_video()
+{
+    ASI_ERROR_CODE error = sdk_->StopVideoCapture(camera_id_);
+    CameraState streaming = CameraState::streaming;
+    state_.compare_exchange_strong(streaming, CameraState::idle);
+    if (error != ASI_SUCCESS)
+    {
+        throw CameraException(
+            "failed to stop video capture", camera_index_, error);
+    }
+}
+
+bool Camera::is_video_active() const
+{
+    return state_ == CameraState::streaming;
+}
+
+CameraState Camera::get_state() const
+{
+    return state_;
+}
+
+template <typename F>
+void Camera::reconfigure(const std::string& operation, F function)
+{
+    // changing the roi or mode while an exposure or the video is running
+    // would corrupt the frames being read: failing rather than waiting
+    // for the acquisition to end (which may never happen for the video)
+    CameraState current = CameraState::idle;
+    if (!state_.compare_exchange_strong(current, CameraState::reconfiguring))
+    {
+        std::ostringstream s;
+        s << "failed to " << operation << ": camera "
+          << zwo_asi::to_string(current);
+        throw std::runtime_error(s.str());
+    }
+    IdleOnExit idle_on_exit(state_);
+    function();
+}
+
+void Camera::get_video_frame(unsigned char* buffer,
+                             int image_size,
+                             int wait_ms)
+{
+    throw_on_error(try_get_video_frame(buffer, image_size, wait_ms));
+}
+
+Result Camera::try_get_video_frame(unsigned char* buffer,
+                                   int image_size,
+                                   int wait_ms) noexcept
+{
+    return Result(
+        sdk_->GetVideoData(camera_id_, buffer, image_size, wait_ms),
+        "failed to get video frame");
+}
+
+void Camera::get_video_frame(Frame& frame, int wait_ms)
+{
+    throw_on_error(try_get_video_frame(frame, wait_ms));
+}
+
+Result Camera::try_get_video_frame(Frame& frame, int wait_ms) noexcept
+{
+    Result result =
+        try_get_video_frame(frame.data.data(), frame.size(), wait_ms);
+    if (!result) return result;
+    frame.timestamp = std::chrono::steady_clock::now();
+    frame.index = nb_captured_++;
+    tag_settings(frame);
+    return result;
+}
+
+int Camera::get_dropped_frames() const
+{
+    int dropped;
+    ASI_ERROR_CODE error = sdk_->GetDroppedFrames(camera_id_, &dropped);
+    if (error != ASI_SUCCESS)
     {
-        error = ASIGetDataAfterExp(camera_index_, buffer, image_size);
+        throw CameraException("failed to read the number of dropped frames",
+                              camera_index_,
+                              error);
     }
+    return dropped;
+}
 
-    // did not retrieve the data with success
+CameraMode Camera::get_camera_mode() const
+{
+    ASI_CAMERA_MODE mode;
+    ASI_ERROR_CODE error = sdk_->GetCameraMode(camera_id_, &mode);
     if (error != ASI_SUCCESS)
     {
         throw CameraException(
-            "failed to read image after capture", camera_index_, error);
+            "failed to read the camera mode", camera_index_, error);
     }
+    return zwo_asi::get_camera_mode(mode);
+}
+
+GainOffset Camera::get_gain_offset() const
+{
+    GainOffset r;
+    ASI_ERROR_CODE error = sdk_->GetGainOffset(camera_id_,
+                                                   &r.offset_highest_dr,
+                                                   &r.offset_unity_gain,
+                                                   &r.gain_lowest_rn,
+                                                   &r.offset_lowest_rn);
+    if (error != ASI_SUCCESS)
+    {
+        throw CameraException(
+            "failed to read the gain and offset values", camera_index_, error);
+    }
+    return r;
 }
 
 }  // namespace zwo_asi
@@ -6,14 +6,16 @@ CameraException::CameraException(std::string error_message,
                                  int camera_index,
                                  ASI_ERROR_CODE error_code,
                                  bool udev)
+    : error_code_{error_code}, camera_index_{camera_index}
 {
     if (udev)
     {
         bool udev_created = internal::create_udev_file();
         std::ostringstream u;
         u << "ASI Camera:\n"
-          << "the command '" << UDEV_CHECK
-          << "' did not return the expected value of '200' "
+          << "the file '" << USBFS_MEMORY_MB
+          << "' does not contain the expected value of (at least) '"
+          << USBFS_MEMORY_MB_MIN << "' "
           << "which may indicate incorrect udev rules for the ASI camera.\n";
         if (udev_created)
         {
@@ -36,75 +38,9 @@ CameraException::CameraException(std::string error_message,
 
     std::ostringstream s;
     s << "ASI Camera: "
-      << "(camera index: " << camera_index << ") " << error_message_ << " "
-      << "(error code: " << error_code << ": ";
-    switch (error_code)
-    {
-        case ASI_ERROR_INVALID_INDEX:
-            s << "ASI_ERROR_INVALID_INDEX"
-              << ")";
-            break;
-        case ASI_ERROR_INVALID_ID:
-            s << "ASI_ERROR_ID"
-              << ")";
-            break;
-        case ASI_ERROR_INVALID_CONTROL_TYPE:
-            s << "ASI_ERROR_INVALID_CONTROL_TYPE"
-              << ")";
-            break;
-        case ASI_ERROR_CAMERA_CLOSED:
-            s << "ASI_ERROR_CAMERA_CLOSED"
-              << ")";
-            break;
-        case ASI_ERROR_CAMERA_REMOVED:
-            s << "ASI_ERROR_CAMERA_REMOVED"
-              << ")";
-            break;
-        case ASI_ERROR_INVALID_PATH:
-            s << "ASI_ERROR_INVALID_PATH"
-              << ")";
-            break;
-        case ASI_ERROR_INVALID_FILEFORMAT:
-            s << "ASI_ERROR_INVALID_FILEFORMAT"
-              << ")";
-            break;
-        case ASI_ERROR_INVALID_SIZE:
-            s << "ASI_ERROR_INVALID_SIZE"
-              << ")";
-            break;
-        case ASI_ERROR_INVALID_IMGTYPE:
-            s << "ASI_ERROR_INVALID_IMGTYPE"
-              << ")";
-            break;
-        case ASI_ERROR_OUTOF_BOUNDARY:
-            s << "ASI_ERROR_OUTOF_BOUNDARY"
-              << ")";
-            break;
-        case ASI_ERROR_TIMEOUT:
-            s << "ASI_ERROR_TIMEOUT"
-              << ")";
-            break;
-        case ASI_ERROR_INVALID_SEQUENCE:
-            s << "ASI_ERROR_INVALID_SEQUENCE"
-              << ")";
-            break;
-        case ASI_ERROR_BUFFER_TOO_SMALL:
-            s << "ASI_ERROR_BUFFER_TOO_SMALL"
-              << ")";
-            break;
-        case ASI_ERROR_VIDEO_MODE_ACTIVE:
-            s << "ASI_ERROR_VIDEO_MODE_ACTIVE"
-              << ")";
-            break;
-        case ASI_ERROR_EXPOSURE_IN_PROGRESS:
-            s << "ASI_ERROR_EXPOSURE_IN_PROGRESS"
-              << ")";
-            break;
-        case ASI_ERROR_GENERAL_ERROR:
-            s << "ASI_ERROR_GENERAL_ERROR"
-              << ")";
-            break;
-    }
+      << "(camera index: " << camera_index << ") " << error_message << " "
+      << "(error code: " << error_code << ": " << get_error_name(error_code)
+      << ")";
     error_message_ = s.str();
 }
 
@@ -113,4 +49,14 @@ const char* CameraException::what() const throw()
     return error_message_.c_str();
 }
 
+ASI_ERROR_CODE CameraException::get_error_code() const
+{
+    return error_code_;
+}
+
+int CameraException::get_camera_index() const
+{
+    return camera_index_;
+}
+
 }  // namespace zwo_asi
@@ -1,4 +1,5 @@
 #include "zwo_asi/camera_info.hpp"
+#include "zwo_asi/camera_registry.hpp"
 #include "zwo_asi/utils.hpp"
 
 namespace zwo_asi
@@ -11,10 +12,9 @@ static bool get_bool(ASI_BOOL value)
 
 void check_system_udev()
 {
-    std::string command(UDEV_CHECK);
-    std::string usbfs_memory_mb = internal::run_system_command(command);
-    usbfs_memory_mb.pop_back();  // last char is return to line
-    if (usbfs_memory_mb != std::string("200"))
+    int usbfs_memory_mb = internal::read_usbfs_memory_mb();
+    // 0: no limit
+    if (usbfs_memory_mb != 0 && usbfs_memory_mb < USBFS_MEMORY_MB_MIN)
     {
         throw CameraException("udev error", -1, ASI_ERROR_GENERAL_ERROR, true);
     }
@@ -22,27 +22,17 @@ void check_system_udev()
 
 int get_nb_cameras()
 {
-    return ASIGetNumOfConnectedCameras();
+    return CameraRegistry::instance().get_nb_cameras();
 }
 
 CameraInfo get_camera_info(int camera_index)
 {
-    // check_system_udev();
-
-    // no idea why, connecting to the camera may not work if this is not
-    // called first
-    get_nb_cameras();
+    return CameraRegistry::instance().get_camera_info(camera_index);
+}
 
-    ASI_CAMERA_INFO cam_info;
+CameraInfo get_camera_info(const ASI_CAMERA_INFO& cam_info)
+{
     CameraInfo info;
-    ASI_ERROR_CODE error;
-    error = ASIGetCameraProperty(&cam_info, camera_index);
-    if (error != ASI_SUCCESS)
-    {
-        throw CameraException(
-            "failed to read camera infos", camera_index, error);
-    }
-
     info.name = std::string(cam_info.Name);
     info.camera_id = cam_info.CameraID;
     info.max_height = cam_info.MaxHeight;
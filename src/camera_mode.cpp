@@ -1,4 +1,5 @@
 #include "zwo_asi/camera_mode.hpp"
+#include <stdexcept>
 
 namespace zwo_asi
 {
@@ -23,4 +24,59 @@ ASI_CAMERA_MODE get_native(CameraMode mode)
     }
     return ASI_MODE_TRIG_LOW_LEVEL;
 }
+
+CameraMode get_camera_mode(ASI_CAMERA_MODE mode)
+{
+    switch (mode)
+    {
+        case ASI_MODE_TRIG_SOFT_EDGE:
+            return CameraMode::soft_edge;
+        case ASI_MODE_TRIG_RISE_EDGE:
+            return CameraMode::rise_edge;
+        case ASI_MODE_TRIG_FALL_EDGE:
+            return CameraMode::fall_edge;
+        case ASI_MODE_TRIG_SOFT_LEVEL:
+            return CameraMode::soft_level;
+        case ASI_MODE_TRIG_HIGH_LEVEL:
+            return CameraMode::high_level;
+        case ASI_MODE_TRIG_LOW_LEVEL:
+            return CameraMode::low_level;
+        default:
+            return CameraMode::normal;
+    }
+}
+std::string to_string(CameraMode mode)
+{
+    switch (mode)
+    {
+        case CameraMode::normal:
+            return "normal";
+        case CameraMode::soft_edge:
+            return "soft_edge";
+        case CameraMode::rise_edge:
+            return "rise_edge";
+        case CameraMode::fall_edge:
+            return "fall_edge";
+        case CameraMode::soft_level:
+            return "soft_level";
+        case CameraMode::high_level:
+            return "high_level";
+        case CameraMode::low_level:
+            return "low_level";
+    }
+    return "";
+}
+
+CameraMode get_camera_mode(std::string mode)
+{
+    if (mode == "normal") return CameraMode::normal;
+    if (mode == "soft_edge") return CameraMode::soft_edge;
+    if (mode == "rise_edge") return CameraMode::rise_edge;
+    if (mode == "fall_edge") return CameraMode::fall_edge;
+    if (mode == "soft_level") return CameraMode::soft_level;
+    if (mode == "high_level") return CameraMode::high_level;
+    if (mode == "low_level") return CameraMode::low_level;
+    throw std::runtime_error("unknown camera mode: " + mode);
+}
+
 }  // namespace zwo_asi
@@ -0,0 +1,418 @@
+#include "zwo_asi/camera_registry.hpp"
+#include "zwo_asi/sdk.hpp"
+#include "zwo_asi/utils.hpp"
+
+namespace zwo_asi
+{
+std::string to_string(const ASI_ID& id)
+{
+    std::ostringstream s;
+    s << std::hex;
+    for (int i = 0; i < 8; i++)
+    {
+        s.width(2);
+        s.fill('0');
+        s << static_cast<int>(id.id[i]);
+    }
+    return s.str();
+}
+
+std::string id_to_string(const ASI_ID& id)
+{
+    std::string s;
+    for (int i = 0; i < 8 && id.id[i] != 0; i++)
+    {
+        s += static_cast<char>(id.id[i]);
+    }
+    return s;
+}
+
+ASI_ID string_to_id(std::string id)
+{
+    if (id.size() > 8)
+    {
+        std::ostringstream s;
+        s << "camera id '" << id << "' is longer than 8 characters";
+        throw std::runtime_error(s.str());
+    }
+    ASI_ID r;
+    for (int i = 0; i < 8; i++)
+    {
+        r.id[i] = i < static_cast<int>(id.size())
+                      ? static_cast<unsigned char>(id[i])
+                      : 0;
+    }
+    return r;
+}
+
+CameraIdentity read_identity(Sdk& sdk, int camera_id)
+{
+    ASI_SN sn;
+    ASI_ID id;
+    CameraIdentity identity;
+    // older cameras do not have a serial number, and only USB3 cameras
+    // have an id: left empty
+    if (sdk.GetSerialNumber(camera_id, &sn) == ASI_SUCCESS)
+    {
+        identity.serial = zwo_asi::to_string(sn);
+    }
+    if (sdk.GetID(camera_id, &id) == ASI_SUCCESS)
+    {
+        identity.id = id_to_string(id);
+    }
+    return identity;
+}
+
+CameraRegistry& CameraRegistry::instance()
+{
+    static CameraRegistry registry;
+    return registry;
+}
+
+CameraRegistry::CameraRegistry()
+    : enumerated_{false}, next_listener_{0}, monitoring_{false}
+{
+}
+
+CameraRegistry::~CameraRegistry()
+{
+    stop_monitoring();
+}
+
+static bool same_cameras(const std::vector<CameraInfo>& a,
+                         const std::vector<CameraInfo>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].name != b[i].name || a[i].camera_id != b[i].camera_id)
+            return false;
+    }
+    return true;
+}
+
+void CameraRegistry::enumerate()
+{
+    // (kept alive for the time of the enumeration, even if replaced by
+    // set_sdk meanwhile)
+    std::shared_ptr<Sdk> sdk = get_sdk();
+    // note: the SDK requires ASIGetNumOfConnectedCameras to be called
+    // before the properties of the cameras can be read
+    int nb_cameras = sdk->GetNumOfConnectedCameras();
+    std::vector<CameraInfo> cameras;
+    for (int index = 0; index < nb_cameras; index++)
+    {
+        ASI_CAMERA_INFO cam_info;
+        ASI_ERROR_CODE error =
+            sdk->GetCameraProperty(&cam_info, index);
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException("failed to read camera infos", index, error);
+        }
+        cameras.push_back(zwo_asi::get_camera_info(cam_info));
+    }
+    // if a camera has been plugged or unplugged, the SDK may have given
+    // new camera ids to the others: their cached identities are dropped
+    if (!same_cameras(cameras_, cameras))
+    {
+        identities_.clear();
+    }
+    cameras_ = cameras;
+    enumerated_ = true;
+}
+
+CameraRegistry::IdentityKey CameraRegistry::get_key(const CameraInfo& info)
+{
+    return IdentityKey(info.camera_id, info.name);
+}
+
+void CameraRegistry::ensure_enumerated()
+{
+    if (!enumerated_) enumerate();
+}
+
+bool CameraRegistry::refresh()
+{
+    std::vector<CameraInfo> cameras;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        // the number of connected cameras is not enough: a camera may
+        // have been unplugged and plugged again (or replaced by another
+        // one) since the last refresh. Reading the properties of the
+        // cameras does not require opening them.
+        std::vector<CameraInfo> previous = cameras_;
+        bool first = !enumerated_;
+        enumerate();
+        if (first || same_cameras(previous, cameras_)) return false;
+        cameras = cameras_;
+    }
+    notify(cameras);
+    return true;
+}
+
+void CameraRegistry::invalidate()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    enumerated_ = false;
+    cameras_.clear();
+    opened_.clear();
+}
+
+int CameraRegistry::get_nb_cameras()
+{
+    // from the cache: cameras plugged since the last enumeration are
+    // counted once the monitoring (or an explicit refresh) found them
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    ensure_enumerated();
+    return cameras_.size();
+}
+
+std::vector<CameraInfo> CameraRegistry::get_cameras()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    ensure_enumerated();
+    return cameras_;
+}
+
+CameraInfo CameraRegistry::get_camera_info(int camera_index)
+{
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        ensure_enumerated();
+        if (camera_index >= 0 &&
+            camera_index < static_cast<int>(cameras_.size()))
+        {
+            return cameras_[camera_index];
+        }
+    }
+    // the camera may have been plugged since the last enumeration.
+    // Refreshed without holding the lock, as the listeners may be
+    // notified.
+    refresh();
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (camera_index < 0 || camera_index >= static_cast<int>(cameras_.size()))
+    {
+        throw CameraException("failed to read camera infos",
+                              camera_index,
+                              ASI_ERROR_INVALID_INDEX);
+    }
+    return cameras_[camera_index];
+}
+
+CameraIdentity CameraRegistry::get_identity(int camera_index)
+{
+    // (before locking, see get_camera_info)
+    CameraInfo info = get_camera_info(camera_index);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto it = identities_.find(get_key(info));
+    if (it != identities_.end()) return it->second;
+
+    // the identity can be read only from an opened camera. If the
+    // camera is not opened by this process, it is opened only for the
+    // time of reading it (holding the lock, so that a camera being
+    // opened by this process is not closed here, see open).
+    int camera_id = info.camera_id;
+    bool opened = opened_.find(camera_id) != opened_.end();
+    std::shared_ptr<Sdk> sdk = get_sdk();
+    ASI_ERROR_CODE error;
+    if (!opened)
+    {
+        error = sdk->OpenCamera(camera_id);
+        if (error != ASI_SUCCESS)
+        {
+            throw CameraException(
+                "failed to open the camera", camera_index, error);
+        }
+    }
+    CameraIdentity identity = read_identity(*sdk, camera_id);
+    if (!opened)
+    {
+        sdk->CloseCamera(camera_id);
+    }
+    identities_[get_key(info)] = identity;
+    return identity;
+}
+
+std::string CameraRegistry::get_serial(int camera_index)
+{
+    CameraIdentity identity = get_identity(camera_index);
+    if (identity.serial.empty())
+    {
+        throw CameraException("failed to read the serial number",
+                              camera_index,
+                              ASI_ERROR_GENERAL_ERROR);
+    }
+    return identity.serial;
+}
+
+void CameraRegistry::set_id(int camera_index, std::string id)
+{
+    IdentityKey key = get_key(get_camera_info(camera_index));
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto it = identities_.find(key);
+    if (it != identities_.end()) it->second.id = id;
+}
+
+bool CameraRegistry::update_identity(int camera_index,
+                                     const CameraIdentity& identity)
+{
+    IdentityKey key = get_key(get_camera_info(camera_index));
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto it = identities_.find(key);
+    bool same = it == identities_.end() ||
+                (it->second.serial == identity.serial &&
+                 it->second.id == identity.id);
+    // cameras swapped their camera ids since their identities have been
+    // cached: all of them are likely wrong
+    if (!same) identities_.clear();
+    identities_[key] = identity;
+    return same;
+}
+
+int CameraRegistry::find_by_name(std::string name)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    ensure_enumerated();
+    for (size_t index = 0; index < cameras_.size(); index++)
+    {
+        if (cameras_[index].name == name) return index;
+    }
+    return -1;
+}
+
+int CameraRegistry::find_by_identity(
+    std::function<bool(const CameraIdentity&)> match)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    ensure_enumerated();
+    // cached identities first, so that cameras are opened only if required
+    int nb_cameras = cameras_.size();
+    for (int index = 0; index < nb_cameras; index++)
+    {
+        auto it = identities_.find(get_key(cameras_[index]));
+        if (it != identities_.end() && match(it->second)) return index;
+    }
+    for (int index = 0; index < nb_cameras; index++)
+    {
+        if (identities_.count(get_key(cameras_[index])) > 0) continue;
+        try
+        {
+            if (match(get_identity(index))) return index;
+        }
+        catch (const CameraException&)
+        {
+            // camera opened by another process
+        }
+    }
+    return -1;
+}
+
+int CameraRegistry::find_by_serial(std::string serial)
+{
+    return find_by_identity([&serial](const CameraIdentity& identity) {
+        return identity.serial == serial;
+    });
+}
+
+int CameraRegistry::find_by_id(std::string id)
+{
+    return find_by_identity(
+        [&id](const CameraIdentity& identity) { return identity.id == id; });
+}
+
+ASI_ERROR_CODE CameraRegistry::open(Sdk& sdk, int camera_id)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    ASI_ERROR_CODE error = sdk.OpenCamera(camera_id);
+    if (error == ASI_SUCCESS) opened_.insert(camera_id);
+    return error;
+}
+
+ASI_ERROR_CODE CameraRegistry::close(Sdk& sdk, int camera_id)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    ASI_ERROR_CODE error = sdk.CloseCamera(camera_id);
+    opened_.erase(camera_id);
+    return error;
+}
+
+std::vector<int> CameraRegistry::get_opened()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return std::vector<int>(opened_.begin(), opened_.end());
+}
+
+int CameraRegistry::add_listener(Listener listener)
+{
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    int listener_id = next_listener_++;
+    listeners_[listener_id] = listener;
+    return listener_id;
+}
+
+void CameraRegistry::remove_listener(int listener_id)
+{
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    listeners_.erase(listener_id);
+}
+
+void CameraRegistry::clear_listeners()
+{
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    listeners_.clear();
+}
+
+void CameraRegistry::notify(const std::vector<CameraInfo>& cameras)
+{
+    std::map<int, Listener> listeners;
+    {
+        std::lock_guard<std::mutex> lock(listeners_mutex_);
+        listeners = listeners_;
+    }
+    for (auto& listener : listeners)
+    {
+        listener.second(cameras);
+    }
+}
+
+void CameraRegistry::start_monitoring(std::chrono::milliseconds period)
+{
+    std::lock_guard<std::mutex> lock(monitor_mutex_);
+    if (monitoring_) return;
+    monitoring_ = true;
+    monitor_thread_ = std::thread(&CameraRegistry::monitor, this, period);
+}
+
+void CameraRegistry::stop_monitoring()
+{
+    {
+        std::lock_guard<std::mutex> lock(monitor_mutex_);
+        if (!monitoring_) return;
+        monitoring_ = false;
+    }
+    monitor_condition_.notify_all();
+    monitor_thread_.join();
+}
+
+void CameraRegistry::monitor(std::chrono::milliseconds period)
+{
+    std::unique_lock<std::mutex> lock(monitor_mutex_);
+    while (monitoring_)
+    {
+        lock.unlock();
+        try
+        {
+            refresh();
+        }
+        catch (const std::exception&)
+        {
+            // camera unplugged while being enumerated: trying again
+            // at the next period
+        }
+        lock.lock();
+        monitor_condition_.wait_for(
+            lock, period, [this] { return !monitoring_; });
+    }
+}
+
+}  // namespace zwo_asi
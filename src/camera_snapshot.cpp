@@ -0,0 +1,412 @@
+#include "zwo_asi/camera_snapshot.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include "zwo_asi/camera.hpp"
+
+namespace zwo_asi
+{
+bool ControlSetting::operator==(const ControlSetting& other) const
+{
+    // the value of a control in auto mode is set by the camera
+    if (is_auto || other.is_auto) return is_auto == other.is_auto;
+    return value == other.value;
+}
+
+bool ControlSetting::operator!=(const ControlSetting& other) const
+{
+    return !(*this == other);
+}
+
+CameraSnapshot::CameraSnapshot() : has_mode{false}, mode{CameraMode::normal}
+{
+}
+
+// binary encoding
+
+static const char SNAPSHOT_MAGIC[4] = {'Z', 'A', 'S', 'N'};
+static const char PROFILES_MAGIC[4] = {'Z', 'A', 'S', 'P'};
+static const uint8_t FORMAT_VERSION = 1;
+
+static void write_u8(std::vector<unsigned char>& data, uint8_t value)
+{
+    data.push_back(value);
+}
+
+static void write_i64(std::vector<unsigned char>& data, int64_t value)
+{
+    uint64_t v = static_cast<uint64_t>(value);
+    for (int i = 0; i < 8; i++) data.push_back((v >> (8 * i)) & 0xff);
+}
+
+static void write_string(std::vector<unsigned char>& data,
+                         const std::string& value)
+{
+    write_i64(data, value.size());
+    data.insert(data.end(), value.begin(), value.end());
+}
+
+static void write_magic(std::vector<unsigned char>& data, const char* magic)
+{
+    data.insert(data.end(), magic, magic + 4);
+    write_u8(data, FORMAT_VERSION);
+}
+
+namespace
+{
+class Reader
+{
+public:
+    Reader(const std::vector<unsigned char>& data, std::string what)
+        : data_{data}, position_{0}, what_{what}
+    {
+    }
+
+    uint8_t u8()
+    {
+        require(1);
+        return data_[position_++];
+    }
+
+    int64_t i64()
+    {
+        require(8);
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            v |= static_cast<uint64_t>(data_[position_++]) << (8 * i);
+        }
+        return static_cast<int64_t>(v);
+    }
+
+    std::string string()
+    {
+        int64_t size = i64();
+        if (size < 0) fail();
+        require(size);
+        std::string s(data_.begin() + position_,
+                      data_.begin() + position_ + size);
+        position_ += size;
+        return s;
+    }
+
+    void magic(const char* magic)
+    {
+        require(4);
+        if (!std::equal(magic, magic + 4, data_.begin() + position_)) fail();
+        position_ += 4;
+        if (u8() != FORMAT_VERSION)
+        {
+            throw std::runtime_error(what_ + ": unsupported format version");
+        }
+    }
+
+    bool done() const
+    {
+        return position_ == data_.size();
+    }
+
+    [[noreturn]] void fail() const
+    {
+        throw std::runtime_error(what_ + ": invalid or truncated data");
+    }
+
+private:
+    void require(int64_t size) const
+    {
+        if (size > (int64_t)(data_.size() - position_)) fail();
+    }
+
+private:
+    const std::vector<unsigned char>& data_;
+    size_t position_;
+    std::string what_;
+};
+}  // namespace
+
+static void encode(std::vector<unsigned char>& data,
+                   const CameraSnapshot& snapshot)
+{
+    write_i64(data, snapshot.roi.start_x);
+    write_i64(data, snapshot.roi.start_y);
+    write_i64(data, snapshot.roi.width);
+    write_i64(data, snapshot.roi.height);
+    write_i64(data, snapshot.roi.bins);
+    write_u8(data, snapshot.roi.type);
+    write_u8(data, snapshot.has_mode);
+    write_u8(data, snapshot.mode);
+    write_i64(data, snapshot.controls.size());
+    for (const auto& control : snapshot.controls)
+    {
+        write_string(data, control.first);
+        write_i64(data, control.second.value);
+        write_u8(data, control.second.is_auto);
+    }
+}
+
+static CameraSnapshot decode(Reader& reader)
+{
+    CameraSnapshot snapshot;
+    snapshot.roi.start_x = reader.i64();
+    snapshot.roi.start_y = reader.i64();
+    snapshot.roi.width = reader.i64();
+    snapshot.roi.height = reader.i64();
+    snapshot.roi.bins = reader.i64();
+    uint8_t type = reader.u8();
+    if (type > ImageType::y8) reader.fail();
+    snapshot.roi.type = static_cast<ImageType>(type);
+    snapshot.has_mode = reader.u8() != 0;
+    uint8_t mode = reader.u8();
+    if (mode > CameraMode::low_level) reader.fail();
+    snapshot.mode = static_cast<CameraMode>(mode);
+    int64_t nb_controls = reader.i64();
+    for (int64_t i = 0; i < nb_controls; i++)
+    {
+        std::string name = reader.string();
+        ControlSetting setting;
+        setting.value = reader.i64();
+        setting.is_auto = reader.u8() != 0;
+        snapshot.controls[name] = setting;
+    }
+    return snapshot;
+}
+
+std::vector<unsigned char> CameraSnapshot::to_binary() const
+{
+    std::vector<unsigned char> data;
+    write_magic(data, SNAPSHOT_MAGIC);
+    encode(data, *this);
+    return data;
+}
+
+CameraSnapshot CameraSnapshot::from_binary(
+    const std::vector<unsigned char>& data)
+{
+    Reader reader(data, "camera snapshot");
+    reader.magic(SNAPSHOT_MAGIC);
+    CameraSnapshot snapshot = decode(reader);
+    if (!reader.done()) reader.fail();
+    return snapshot;
+}
+
+std::string CameraSnapshot::to_toml() const
+{
+    std::ostringstream s;
+    if (has_mode)
+    {
+        s << "camera_mode = \"" << zwo_asi::to_string(mode) << "\"\n\n";
+    }
+    s << "[controllables]\n";
+    for (const auto& control : controls)
+    {
+        s << control.first << " = ";
+        if (control.second.is_auto)
+            s << "\"auto\"\n";
+        else
+            s << control.second.value << "\n";
+    }
+    s << "\n[roi]\n";
+    s << "start_x = " << roi.start_x << "\n";
+    s << "start_y = " << roi.start_y << "\n";
+    s << "width = " << roi.width << "\n";
+    s << "height = " << roi.height << "\n";
+    s << "bins = " << roi.bins << "\n";
+    s << "type = \"" << zwo_asi::to_string(roi.type) << "\"\n";
+    return s.str();
+}
+
+// snapshot and restore
+
+CameraSnapshot take_snapshot(const Camera& camera)
+{
+    CameraSnapshot snapshot;
+    snapshot.roi = camera.get_roi();
+    for (const auto& control : camera.get_controls())
+    {
+        if (!control.second.is_writable) continue;
+        ControlSetting setting;
+        setting.value = control.second.value;
+        setting.is_auto = control.second.is_auto;
+        snapshot.controls[control.first] = setting;
+    }
+    // only trigger cameras support other modes than normal
+    snapshot.has_mode = camera.get_info().is_trigger;
+    if (snapshot.has_mode) snapshot.mode = camera.get_camera_mode();
+    return snapshot;
+}
+
+static bool same_roi(const ROI& a, const ROI& b)
+{
+    return a.start_x == b.start_x && a.start_y == b.start_y &&
+           a.width == b.width && a.height == b.height && a.bins == b.bins &&
+           a.type == b.type;
+}
+
+int restore_snapshot(Camera& camera,
+                     const CameraSnapshot& snapshot,
+                     const CameraSnapshot& current)
+{
+    int nb_writes = 0;
+
+    // the roi and the camera mode can be set only when the camera is idle
+    bool roi = !same_roi(snapshot.roi, current.roi);
+    bool mode = snapshot.has_mode &&
+                (!current.has_mode || snapshot.mode != current.mode);
+    if (roi || mode)
+    {
+        bool video = camera.is_video_active();
+        if (video) camera.stop_video();
+        if (roi) camera.set_roi(snapshot.roi);
+        if (mode) camera.set_camera_mode(snapshot.mode);
+        if (video) camera.start_video();
+        nb_writes += roi + mode;
+    }
+
+    for (const auto& control : snapshot.controls)
+    {
+        auto it = current.controls.find(control.first);
+        if (it != current.controls.end() && it->second == control.second)
+        {
+            continue;
+        }
+        if (control.second.is_auto)
+            camera.set_auto(control.first);
+        else
+            camera.set_control(control.first, control.second.value);
+        nb_writes++;
+    }
+
+    return nb_writes;
+}
+
+int restore_snapshot(Camera& camera, const CameraSnapshot& snapshot)
+{
+    return restore_snapshot(camera, snapshot, take_snapshot(camera));
+}
+
+// named profiles
+
+ConfigurationProfiles::ConfigurationProfiles()
+    : has_current_{false}, current_camera_{-1}
+{
+}
+
+void ConfigurationProfiles::set(std::string name,
+                                const CameraSnapshot& snapshot)
+{
+    snapshots_[name] = snapshot;
+}
+
+void ConfigurationProfiles::save(std::string name, const Camera& camera)
+{
+    set(name, take_snapshot(camera));
+}
+
+const CameraSnapshot& ConfigurationProfiles::get(std::string name) const
+{
+    auto it = snapshots_.find(name);
+    if (it == snapshots_.end())
+    {
+        throw std::runtime_error("no configuration profile named " + name);
+    }
+    return it->second;
+}
+
+bool ConfigurationProfiles::has(std::string name) const
+{
+    return snapshots_.find(name) != snapshots_.end();
+}
+
+void ConfigurationProfiles::remove(std::string name)
+{
+    snapshots_.erase(name);
+}
+
+std::vector<std::string> ConfigurationProfiles::get_names() const
+{
+    std::vector<std::string> names;
+    for (const auto& snapshot : snapshots_) names.push_back(snapshot.first);
+    return names;
+}
+
+int ConfigurationProfiles::apply(std::string name, Camera& camera)
+{
+    const CameraSnapshot& snapshot = get(name);
+    if (!has_current_ || current_camera_ != camera.get_index())
+    {
+        current_ = take_snapshot(camera);
+        current_camera_ = camera.get_index();
+        has_current_ = true;
+    }
+    int nb_writes;
+    try
+    {
+        nb_writes = restore_snapshot(camera, snapshot, current_);
+    }
+    catch (...)
+    {
+        // the camera state is partially updated
+        invalidate();
+        throw;
+    }
+    current_.roi = snapshot.roi;
+    for (const auto& control : snapshot.controls)
+    {
+        current_.controls[control.first] = control.second;
+    }
+    if (snapshot.has_mode)
+    {
+        current_.has_mode = true;
+        current_.mode = snapshot.mode;
+    }
+    return nb_writes;
+}
+
+void ConfigurationProfiles::invalidate()
+{
+    has_current_ = false;
+}
+
+void ConfigurationProfiles::save_file(const std::filesystem::path& path) const
+{
+    std::vector<unsigned char> data;
+    write_magic(data, PROFILES_MAGIC);
+    write_i64(data, snapshots_.size());
+    for (const auto& snapshot : snapshots_)
+    {
+        write_string(data, snapshot.first);
+        encode(data, snapshot.second);
+    }
+    std::ofstream f(path, std::ios::binary);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("failed to open " + path.string());
+    }
+    f.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+void ConfigurationProfiles::load_file(const std::filesystem::path& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("failed to open " + path.string());
+    }
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(f)),
+                                    std::istreambuf_iterator<char>());
+    Reader reader(data, "configuration profiles " + path.string());
+    reader.magic(PROFILES_MAGIC);
+    std::map<std::string, CameraSnapshot> snapshots;
+    int64_t nb_snapshots = reader.i64();
+    for (int64_t i = 0; i < nb_snapshots; i++)
+    {
+        std::string name = reader.string();
+        snapshots[name] = decode(reader);
+    }
+    if (!reader.done()) reader.fail();
+    snapshots_ = snapshots;
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,491 @@
+#include "zwo_asi/dark_library.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace zwo_asi
+{
+DarkKey::DarkKey()
+    : exposure_us{0},
+      gain{0},
+      offset{0},
+      temperature_c{0.},
+      width{0},
+      height{0},
+      bins{1},
+      type{ImageType::raw8}
+{
+}
+
+std::string DarkKey::to_string() const
+{
+    std::ostringstream s;
+    s << "exposure " << exposure_us << "us, gain " << gain << ", offset "
+      << offset << ", temperature " << temperature_c << "C, " << width << "x"
+      << height << " bin " << bins << " " << zwo_asi::to_string(type);
+    return s.str();
+}
+
+DarkKey get_dark_key(const Camera& camera, const Frame& frame)
+{
+    std::map<std::string, Controllable> controls = camera.get_controls();
+    auto value = [&controls](const char* name, long default_value) {
+        auto it = controls.find(name);
+        return it == controls.end() ? default_value : it->second.value;
+    };
+    DarkKey key;
+    key.exposure_us = frame.settings.exposure_us >= 0
+                          ? frame.settings.exposure_us
+                          : value("Exposure", 0);
+    key.gain = frame.settings.gain >= 0 ? frame.settings.gain
+                                        : value("Gain", 0);
+    key.offset = value("Offset", 0);
+    // in 0.1 degree
+    key.temperature_c = value("Temperature", 0) / 10.;
+    key.width = frame.width;
+    key.height = frame.height;
+    key.bins = camera.get_roi().bins;
+    key.type = frame.type;
+    return key;
+}
+
+// file format: header (magic, version, key as little endian 64 bits
+// integers, padded to HEADER_SIZE), then one float per pixel value
+
+static const char DARK_MAGIC[4] = {'Z', 'A', 'D', 'K'};
+static const uint8_t FORMAT_VERSION = 1;
+static const size_t HEADER_SIZE = 128;
+
+static int get_nb_values(const DarkKey& key)
+{
+    return key.width * key.height * (key.type == ImageType::rgb24 ? 3 : 1);
+}
+
+// the members of frames are public: their data may not match their
+// geometry
+static bool has_nb_values(const Frame& frame, const DarkKey& key)
+{
+    size_t value_size = frame.type == ImageType::raw16 ? 2 : 1;
+    return frame.data.size() == get_nb_values(key) * value_size;
+}
+
+static void write_i64(std::vector<unsigned char>& data, int64_t value)
+{
+    uint64_t v = static_cast<uint64_t>(value);
+    for (int i = 0; i < 8; i++) data.push_back((v >> (8 * i)) & 0xff);
+}
+
+static int64_t read_i64(const unsigned char* data)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(data[i]) << (8 * i);
+    return static_cast<int64_t>(v);
+}
+
+static std::vector<unsigned char> encode_header(const DarkKey& key)
+{
+    std::vector<unsigned char> header(DARK_MAGIC, DARK_MAGIC + 4);
+    header.push_back(FORMAT_VERSION);
+    write_i64(header, key.exposure_us);
+    write_i64(header, key.gain);
+    write_i64(header, key.offset);
+    write_i64(header, std::lround(key.temperature_c * 1000.));
+    write_i64(header, key.width);
+    write_i64(header, key.height);
+    write_i64(header, key.bins);
+    write_i64(header, key.type);
+    header.resize(HEADER_SIZE, 0);
+    return header;
+}
+
+static DarkKey decode_header(const unsigned char* header,
+                             const std::filesystem::path& path)
+{
+    if (std::memcmp(header, DARK_MAGIC, 4) != 0 ||
+        header[4] != FORMAT_VERSION)
+    {
+        throw std::runtime_error("dark library: invalid file " +
+                                 path.string());
+    }
+    const unsigned char* values = header + 5;
+    DarkKey key;
+    key.exposure_us = read_i64(values);
+    key.gain = read_i64(values + 8);
+    key.offset = read_i64(values + 16);
+    key.temperature_c = read_i64(values + 24) / 1000.;
+    key.width = read_i64(values + 32);
+    key.height = read_i64(values + 40);
+    key.bins = read_i64(values + 48);
+    int64_t type = read_i64(values + 56);
+    if (type < 0 || type > ImageType::y8 || key.width <= 0 || key.height <= 0)
+    {
+        throw std::runtime_error("dark library: invalid file " +
+                                 path.string());
+    }
+    key.type = static_cast<ImageType>(type);
+    return key;
+}
+
+DarkLibrary::DarkLibrary(std::filesystem::path folder,
+                         int cache_size,
+                         double temperature_step_c)
+    : folder_{folder},
+      cache_size_{cache_size},
+      temperature_step_c_{temperature_step_c}
+{
+    if (temperature_step_c_ <= 0)
+    {
+        throw std::runtime_error(
+            "dark library: the temperature step must be positive");
+    }
+    std::filesystem::create_directories(folder_);
+    try
+    {
+        for (const auto& entry : std::filesystem::directory_iterator(folder_))
+        {
+            if (entry.path().extension() == ".dark") load(entry.path());
+        }
+    }
+    catch (...)
+    {
+        for (auto& dark : darks_) unmap(dark.second);
+        throw;
+    }
+}
+
+DarkLibrary::~DarkLibrary()
+{
+    for (auto& dark : darks_) unmap(dark.second);
+}
+
+DarkLibrary::Index DarkLibrary::get_index(const DarkKey& key) const
+{
+    return Index(key.exposure_us,
+                 key.gain,
+                 key.offset,
+                 std::lround(key.temperature_c / temperature_step_c_),
+                 key.width,
+                 key.height,
+                 key.bins,
+                 key.type);
+}
+
+void DarkLibrary::load(const std::filesystem::path& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("dark library: failed to open " +
+                                 path.string());
+    }
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)HEADER_SIZE)
+    {
+        mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // the mapping remains valid once the file is closed
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("dark library: failed to map " +
+                                 path.string());
+    }
+    Dark dark;
+    dark.path = path;
+    dark.mapping = mapping;
+    dark.mapping_size = st.st_size;
+    try
+    {
+        dark.key = decode_header(static_cast<unsigned char*>(mapping), path);
+    }
+    catch (...)
+    {
+        unmap(dark);
+        throw;
+    }
+    if (dark.mapping_size !=
+        HEADER_SIZE + get_nb_values(dark.key) * sizeof(float))
+    {
+        unmap(dark);
+        throw std::runtime_error("dark library: truncated file " +
+                                 path.string());
+    }
+    dark.data = reinterpret_cast<const float*>(
+        static_cast<unsigned char*>(mapping) + HEADER_SIZE);
+    Index index = get_index(dark.key);
+    auto it = darks_.find(index);
+    if (it != darks_.end()) unmap(it->second);
+    darks_[index] = dark;
+}
+
+void DarkLibrary::unmap(Dark& dark)
+{
+    if (dark.mapping != nullptr) munmap(dark.mapping, dark.mapping_size);
+    dark.mapping = nullptr;
+    dark.data = nullptr;
+}
+
+void DarkLibrary::add(const DarkKey& key,
+                      const std::vector<std::shared_ptr<Frame>>& frames)
+{
+    if (frames.empty())
+    {
+        throw std::runtime_error("dark library: no frame");
+    }
+    int nb_values = get_nb_values(key);
+    std::vector<float> master(nb_values, 0.f);
+    for (const std::shared_ptr<Frame>& frame : frames)
+    {
+        if (frame->width != key.width || frame->height != key.height ||
+            frame->type != key.type || !has_nb_values(*frame, key))
+        {
+            throw std::runtime_error(
+                "dark library: frames and key of different sizes or types");
+        }
+        if (frame->type == ImageType::raw16)
+        {
+            const uint16_t* values =
+                reinterpret_cast<const uint16_t*>(frame->data.data());
+            for (int i = 0; i < nb_values; i++) master[i] += values[i];
+        }
+        else
+        {
+            for (int i = 0; i < nb_values; i++) master[i] += frame->data[i];
+        }
+    }
+    float inv_nb_frames = 1.f / frames.size();
+    for (float& value : master) value *= inv_nb_frames;
+
+    Index index = get_index(key);
+    std::ostringstream name;
+    name << "dark_e" << key.exposure_us << "_g" << key.gain << "_o"
+         << key.offset << "_t" << std::get<3>(index) << "_b" << key.bins
+         << "_" << zwo_asi::to_string(key.type) << "_" << key.width << "x"
+         << key.height << ".dark";
+    std::filesystem::path path = folder_ / name.str();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // not overwriting a file that may be mapped
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        if (!f.is_open())
+        {
+            throw std::runtime_error("dark library: failed to open " +
+                                     tmp.string());
+        }
+        std::vector<unsigned char> header = encode_header(key);
+        f.write(reinterpret_cast<const char*>(header.data()), header.size());
+        f.write(reinterpret_cast<const char*>(master.data()),
+                master.size() * sizeof(float));
+        if (!f)
+        {
+            throw std::runtime_error("dark library: failed to write " +
+                                     tmp.string());
+        }
+    }
+    std::filesystem::rename(tmp, path);
+    load(path);
+    // prepared darks may depend on the replaced one
+    cache_.clear();
+    cached_.clear();
+}
+
+std::vector<DarkKey> DarkLibrary::get_keys() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<DarkKey> keys;
+    for (const auto& dark : darks_) keys.push_back(dark.second.key);
+    return keys;
+}
+
+const DarkLibrary::Dark* DarkLibrary::match(const DarkKey& key,
+                                            const Dark*& bias,
+                                            DarkMatch& match) const
+{
+    long bucket = std::get<3>(get_index(key));
+    const Dark* best = nullptr;
+    long best_bucket_distance = 0;
+    double best_exposure_distance = 0;
+    long bias_bucket_distance = 0;
+    bias = nullptr;
+    for (const auto& entry : darks_)
+    {
+        const DarkKey& k = entry.second.key;
+        if (k.width != key.width || k.height != key.height ||
+            k.bins != key.bins || k.type != key.type || k.gain != key.gain ||
+            k.offset != key.offset)
+        {
+            continue;
+        }
+        long bucket_distance = std::labs(std::get<3>(entry.first) - bucket);
+        if (k.exposure_us == 0 &&
+            (bias == nullptr || bucket_distance < bias_bucket_distance))
+        {
+            bias = &entry.second;
+            bias_bucket_distance = bucket_distance;
+        }
+        // bias frames are used for darks only if no exposure time
+        if ((k.exposure_us == 0) != (key.exposure_us == 0)) continue;
+        double exposure_distance =
+            key.exposure_us == 0
+                ? 0.
+                : std::fabs(std::log(static_cast<double>(key.exposure_us) /
+                                     k.exposure_us));
+        if (best == nullptr || bucket_distance < best_bucket_distance ||
+            (bucket_distance == best_bucket_distance &&
+             exposure_distance < best_exposure_distance))
+        {
+            best = &entry.second;
+            best_bucket_distance = bucket_distance;
+            best_exposure_distance = exposure_distance;
+        }
+    }
+    if (best == nullptr)
+    {
+        throw std::runtime_error("dark library: no dark for " +
+                                 key.to_string());
+    }
+    match.key = best->key;
+    match.scale = 1.;
+    if (bias != nullptr && bias != best &&
+        best->key.exposure_us != key.exposure_us)
+    {
+        match.scale =
+            static_cast<double>(key.exposure_us) / best->key.exposure_us;
+    }
+    else
+    {
+        bias = nullptr;
+    }
+    match.exact = best->key.exposure_us == key.exposure_us &&
+                  best_bucket_distance == 0;
+    return best;
+}
+
+DarkMatch DarkLibrary::find(const DarkKey& key) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Dark* bias;
+    DarkMatch m;
+    match(key, bias, m);
+    return m;
+}
+
+DarkLibrary::Prepared DarkLibrary::prepare(const DarkKey& key)
+{
+    const Dark* bias;
+    Prepared prepared;
+    prepared.key = key;
+    const Dark* dark = match(key, bias, prepared.match);
+    int nb_values = get_nb_values(key);
+    std::shared_ptr<std::vector<float>> data =
+        std::make_shared<std::vector<float>>(dark->data,
+                                             dark->data + nb_values);
+    if (bias != nullptr)
+    {
+        float scale = prepared.match.scale;
+        float* d = data->data();
+        // a noisy dark below the bias, scaled up, would add to the
+        // pixel values when subtracted
+        for (int i = 0; i < nb_values; i++)
+        {
+            float v = bias->data[i] + (d[i] - bias->data[i]) * scale;
+            d[i] = v < 0.f ? 0.f : v;
+        }
+    }
+    prepared.data = data;
+    return prepared;
+}
+
+// loop without branches, so that it is vectorized by the compiler
+// (see CMakeLists.txt). Clamped to the range of T, as converting an
+// out of range float is undefined
+template <typename T>
+static void subtract(T* values, const float* dark, int nb_values)
+{
+    const float max = static_cast<float>(std::numeric_limits<T>::max());
+    for (int i = 0; i < nb_values; i++)
+    {
+        float v = values[i] - dark[i] + 0.5f;
+        v = v < 0.f ? 0.f : v;
+        values[i] = static_cast<T>(v > max ? max : v);
+    }
+}
+
+DarkMatch DarkLibrary::calibrate(Frame& frame, const DarkKey& key)
+{
+    if (frame.width != key.width || frame.height != key.height ||
+        frame.type != key.type || !has_nb_values(frame, key))
+    {
+        throw std::runtime_error(
+            "dark library: frame and key of different sizes or types");
+    }
+    Prepared prepared;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Index index = get_index(key);
+        auto it = cached_.find(index);
+        if (it != cached_.end())
+        {
+            cache_.splice(cache_.begin(), cache_, it->second);
+            prepared = it->second->second;
+        }
+        else
+        {
+            prepared = prepare(key);
+            cache_.emplace_front(index, prepared);
+            cached_[index] = cache_.begin();
+            while ((int)cache_.size() > std::max(cache_size_, 1))
+            {
+                cached_.erase(cache_.back().first);
+                cache_.pop_back();
+            }
+        }
+    }
+    int nb_values = get_nb_values(key);
+    if (frame.type == ImageType::raw16)
+        subtract(reinterpret_cast<uint16_t*>(frame.data.data()),
+                 prepared.data->data(),
+                 nb_values);
+    else
+        subtract(frame.data.data(), prepared.data->data(), nb_values);
+    return prepared.match;
+}
+
+int DarkLibrary::get_nb_cached() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cache_.size();
+}
+
+std::vector<DarkKey> DarkLibrary::get_cached_keys() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<DarkKey> keys;
+    for (const auto& entry : cache_) keys.push_back(entry.second.key);
+    return keys;
+}
+
+void DarkLibrary::clear_cache()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    cache_.clear();
+    cached_.clear();
+}
+
+const std::filesystem::path& DarkLibrary::get_folder() const
+{
+    return folder_;
+}
+
+}  // namespace zwo_asi
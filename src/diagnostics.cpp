@@ -0,0 +1,200 @@
+#include "zwo_asi/diagnostics.hpp"
+#include <algorithm>
+#include "zwo_asi/camera.hpp"
+#include "zwo_asi/camera_registry.hpp"
+#include "zwo_asi/utils.hpp"
+
+namespace zwo_asi
+{
+// usb throughput at 100% bandwidth (bytes per microsecond)
+static const double USB3_THROUGHPUT = 380.;
+static const double USB2_THROUGHPUT = 40.;
+
+double get_usb_throughput(bool usb3)
+{
+    if (usb3) return USB3_THROUGHPUT;
+    return USB2_THROUGHPUT;
+}
+
+long get_frame_size(const ROI& roi)
+{
+    return (long)roi.width * roi.height * get_bytes_per_pixel(roi.type);
+}
+
+static double get_throughput(const CameraInfo& info, int bandwidth_percent)
+{
+    return get_usb_throughput(info.is_usb3 && info.is_usb3_host) *
+           bandwidth_percent / 100.;
+}
+
+double get_max_frame_rate(const CameraInfo& info,
+                          const ROI& roi,
+                          int bandwidth_percent,
+                          long exposure_us)
+{
+    long frame_size = get_frame_size(roi);
+    if (frame_size <= 0 || bandwidth_percent <= 0) return 0.;
+    double period_us = frame_size / get_throughput(info, bandwidth_percent);
+    period_us = std::max(period_us, (double)exposure_us);
+    return 1e6 / period_us;
+}
+
+static CameraDiagnostics diagnose(int camera_index,
+                                  const CameraInfo& info,
+                                  const ROI& roi,
+                                  int bandwidth_percent,
+                                  long exposure_us,
+                                  int usbfs_memory_mb)
+{
+    CameraDiagnostics d;
+    d.camera_index = camera_index;
+    d.name = info.name;
+    d.is_usb3 = info.is_usb3;
+    d.is_usb3_host = info.is_usb3_host;
+    d.roi = roi;
+    d.bandwidth_percent = bandwidth_percent;
+    d.exposure_us = exposure_us;
+    d.frame_size = get_frame_size(roi);
+    d.throughput_mb_s = get_throughput(info, bandwidth_percent);
+    d.max_fps =
+        get_max_frame_rate(info, roi, bandwidth_percent, exposure_us);
+
+    if (info.is_usb3 && !info.is_usb3_host)
+    {
+        std::ostringstream s;
+        s << "USB3 camera on a USB2 port: throughput limited to "
+          << d.throughput_mb_s << "MB/s";
+        d.warnings.push_back(s.str());
+    }
+    if (usbfs_memory_mb > 0 &&
+        d.frame_size > (long)usbfs_memory_mb * 1024 * 1024)
+    {
+        std::ostringstream s;
+        s << "frame size (" << d.frame_size / (1024 * 1024)
+          << "MB) exceeds the usbfs memory limit (" << usbfs_memory_mb
+          << "MB)";
+        d.warnings.push_back(s.str());
+    }
+    double transfer_fps = get_max_frame_rate(info, roi, bandwidth_percent);
+    if (exposure_us > 0 && bandwidth_percent < 100 &&
+        transfer_fps < 1e6 / exposure_us)
+    {
+        std::ostringstream s;
+        s << "frame rate limited by the usb bandwidth (" << bandwidth_percent
+          << "%) to " << d.max_fps << "fps";
+        d.warnings.push_back(s.str());
+    }
+    return d;
+}
+
+static long get_control_value(const std::map<std::string, Controllable>& c,
+                              std::string name,
+                              long default_value)
+{
+    auto it = c.find(name);
+    if (it == c.end()) return default_value;
+    return it->second.value;
+}
+
+CameraDiagnostics get_camera_diagnostics(const Camera& camera)
+{
+    std::map<std::string, Controllable> controls = camera.get_controls();
+    return diagnose(camera.get_index(),
+                    camera.get_info(),
+                    camera.get_roi(),
+                    get_control_value(controls, "BandWidth", 100),
+                    get_control_value(controls, "Exposure", 0),
+                    internal::read_usbfs_memory_mb());
+}
+
+Diagnostics get_system_diagnostics(bool refresh)
+{
+    Diagnostics d;
+    d.usbfs_memory_mb = internal::read_usbfs_memory_mb(refresh);
+    if (d.usbfs_memory_mb < 0)
+    {
+        d.warnings.push_back(std::string("failed to read ") +
+                             USBFS_MEMORY_MB);
+    }
+    else if (d.usbfs_memory_mb > 0 && d.usbfs_memory_mb < USBFS_MEMORY_MB_MIN)
+    {
+        std::ostringstream s;
+        s << "usbfs memory limit (" << d.usbfs_memory_mb
+          << "MB) below the recommended " << USBFS_MEMORY_MB_MIN
+          << "MB: udev rules may be missing (see create_udev_file)";
+        d.warnings.push_back(s.str());
+    }
+
+    CameraRegistry& registry = CameraRegistry::instance();
+    if (refresh) registry.refresh();
+    std::vector<CameraInfo> cameras = registry.get_cameras();
+    for (size_t index = 0; index < cameras.size(); index++)
+    {
+        const CameraInfo& info = cameras[index];
+        ROI roi;
+        roi.width = info.max_width;
+        roi.height = info.max_height;
+        roi.bins = 1;
+        roi.type = ImageType::raw8;
+        if (info.supported_image_types.count(ImageType::raw16) > 0)
+        {
+            roi.type = ImageType::raw16;
+        }
+        d.cameras.push_back(
+            diagnose(index, info, roi, 100, 0, d.usbfs_memory_mb));
+    }
+    return d;
+}
+
+static void append_warnings(std::ostringstream& s,
+                            const std::vector<std::string>& warnings)
+{
+    for (const std::string& warning : warnings)
+    {
+        s << "warning: " << warning << std::endl;
+    }
+}
+
+std::string CameraDiagnostics::to_string() const
+{
+    std::ostringstream s;
+    s << name << " (index: " << camera_index << ")" << std::endl;
+    s << "usb3 camera: " << (is_usb3 ? "*" : "-")
+      << " | usb3 host: " << (is_usb3_host ? "*" : "-")
+      << " | throughput (MB/s): " << throughput_mb_s << " ("
+      << bandwidth_percent << "%)" << std::endl;
+    s << "roi: " << roi.width << "x" << roi.height << " bin " << roi.bins
+      << " " << zwo_asi::to_string(roi.type) << " | frame size (bytes): "
+      << frame_size << " | max fps: " << max_fps << std::endl;
+    append_warnings(s, warnings);
+    return s.str();
+}
+
+bool Diagnostics::ok() const
+{
+    if (!warnings.empty()) return false;
+    for (const CameraDiagnostics& camera : cameras)
+    {
+        if (!camera.warnings.empty()) return false;
+    }
+    return true;
+}
+
+std::string Diagnostics::to_string() const
+{
+    std::ostringstream s;
+    s << "usbfs memory (MB): ";
+    if (usbfs_memory_mb == 0)
+        s << "no limit";
+    else
+        s << usbfs_memory_mb;
+    s << std::endl;
+    append_warnings(s, warnings);
+    for (const CameraDiagnostics& camera : cameras)
+    {
+        s << camera.to_string();
+    }
+    return s.str();
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,78 @@
+#include "zwo_asi/frame.hpp"
+
+namespace zwo_asi
+{
+FrameSettings::FrameSettings() : exposure_us{-1}, gain{-1}, generation{-1}
+{
+}
+
+Frame::Frame(int width_, int height_, ImageType type_)
+    : width{width_},
+      height{height_},
+      type{type_},
+      index{-1},
+      settings_changed{false},
+      data(width_ * height_ * get_bytes_per_pixel(type_))
+{
+}
+
+int Frame::size() const
+{
+    return data.size();
+}
+
+FramePool::FramePool(int width, int height, ImageType type, int nb_frames)
+    : state_{std::make_shared<State>()}, capacity_{nb_frames}
+{
+    for (int i = 0; i < nb_frames; i++)
+    {
+        state_->free.push_back(std::make_unique<Frame>(width, height, type));
+    }
+}
+
+std::shared_ptr<Frame> FramePool::wrap(std::unique_ptr<Frame> frame)
+{
+    // the deleter keeps the state alive, so frames may safely
+    // outlive the pool
+    std::shared_ptr<State> state = state_;
+    return std::shared_ptr<Frame>(frame.release(), [state](Frame* f) {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->free.push_back(std::unique_ptr<Frame>(f));
+        }
+        state->condition.notify_one();
+    });
+}
+
+std::shared_ptr<Frame> FramePool::acquire()
+{
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->condition.wait(lock, [this] { return !state_->free.empty(); });
+    std::unique_ptr<Frame> frame = std::move(state_->free.back());
+    state_->free.pop_back();
+    lock.unlock();
+    return wrap(std::move(frame));
+}
+
+std::shared_ptr<Frame> FramePool::try_acquire()
+{
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    if (state_->free.empty()) return nullptr;
+    std::unique_ptr<Frame> frame = std::move(state_->free.back());
+    state_->free.pop_back();
+    lock.unlock();
+    return wrap(std::move(frame));
+}
+
+int FramePool::available() const
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->free.size();
+}
+
+int FramePool::capacity() const
+{
+    return capacity_;
+}
+
+}  // namespace zwo_asi
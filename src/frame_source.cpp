@@ -0,0 +1,671 @@
+#include "zwo_asi/frame_source.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace zwo_asi
+{
+FrameSource::~FrameSource()
+{
+}
+
+CameraSource::CameraSource(Camera& camera, int wait_ms)
+    : camera_(camera), roi_{camera.get_roi()}, wait_ms_{wait_ms}
+{
+}
+
+int CameraSource::get_width() const
+{
+    return roi_.width;
+}
+
+int CameraSource::get_height() const
+{
+    return roi_.height;
+}
+
+ImageType CameraSource::get_type() const
+{
+    return roi_.type;
+}
+
+long CameraSource::get_nb_frames() const
+{
+    return -1;
+}
+
+bool CameraSource::read(Frame& frame)
+{
+    if (camera_.is_video_active())
+        camera_.get_video_frame(frame, wait_ms_);
+    else
+        camera_.capture(frame);
+    return true;
+}
+
+FileSource::FileSource() : position_{0}
+{
+}
+
+bool FileSource::read(Frame& frame)
+{
+    if (position_ >= get_nb_frames()) return false;
+    // skipped if it fails to decode
+    long index = position_++;
+    decode(index, frame);
+    return true;
+}
+
+void FileSource::seek(long index)
+{
+    position_ = std::min(std::max(index, 0L), get_nb_frames());
+}
+
+long FileSource::get_position() const
+{
+    return position_;
+}
+
+void FileSource::prepare(long index, Frame& frame) const
+{
+    if (index < 0 || index >= get_nb_frames())
+    {
+        std::ostringstream s;
+        s << "frame source: no frame " << index << " (" << get_nb_frames()
+          << " frames)";
+        throw std::runtime_error(s.str());
+    }
+    if (frame.width != get_width() || frame.height != get_height() ||
+        frame.type != get_type())
+    {
+        throw std::runtime_error(
+            "frame source: frame of a different size or type");
+    }
+    frame.index = index;
+    frame.timestamp = std::chrono::steady_clock::now();
+    frame.settings = FrameSettings();
+    frame.settings_changed = false;
+}
+
+// SER format: 178 bytes header (little endian 32 bits integers), then
+// the frames, then (optionally) their timestamps
+static const size_t SER_HEADER_SIZE = 178;
+static const int SER_MONO = 0;
+static const int SER_BAYER_FIRST = 8;
+static const int SER_BAYER_LAST = 19;
+static const int SER_RGB = 100;
+static const int SER_BGR = 101;
+
+static int32_t read_le32(const unsigned char* data)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | data[i];
+    return static_cast<int32_t>(value);
+}
+
+SerSource::SerSource(std::filesystem::path path)
+    : path_{path}, rgb_{false}, mapping_{nullptr}, mapping_size_{0}
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("ser: failed to open " + path.string());
+    }
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)SER_HEADER_SIZE)
+    {
+        mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // the mapping remains valid once the file is closed
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("ser: failed to map " + path.string());
+    }
+    mapping_ = mapping;
+    mapping_size_ = st.st_size;
+
+    const unsigned char* header = static_cast<unsigned char*>(mapping_);
+    int color = read_le32(header + 18);
+    width_ = read_le32(header + 26);
+    height_ = read_le32(header + 30);
+    int depth = read_le32(header + 34);
+    nb_frames_ = read_le32(header + 38);
+    std::string error;
+    if (std::memcmp(header, "LUCAM-RECORDER", 14) != 0)
+        error = "not a SER file";
+    else if (width_ <= 0 || height_ <= 0 || nb_frames_ < 0)
+        error = "invalid geometry";
+    else if (depth < 1 || depth > 16)
+        error = "invalid pixel depth";
+    else if (color == SER_MONO ||
+             (color >= SER_BAYER_FIRST && color <= SER_BAYER_LAST))
+        type_ = depth > 8 ? ImageType::raw16 : ImageType::raw8;
+    else if ((color == SER_RGB || color == SER_BGR) && depth <= 8)
+    {
+        type_ = ImageType::rgb24;
+        rgb_ = color == SER_RGB;
+    }
+    else
+        error = "unsupported color format";
+    if (error.empty())
+    {
+        size_t frame_size = static_cast<size_t>(width_) * height_ *
+                            get_bytes_per_pixel(type_);
+        if (mapping_size_ < SER_HEADER_SIZE + nb_frames_ * frame_size)
+        {
+            error = "truncated file";
+        }
+    }
+    if (!error.empty())
+    {
+        munmap(mapping_, mapping_size_);
+        throw std::runtime_error("ser: " + error + " (" + path.string() +
+                                 ")");
+    }
+}
+
+SerSource::~SerSource()
+{
+    munmap(mapping_, mapping_size_);
+}
+
+int SerSource::get_width() const
+{
+    return width_;
+}
+
+int SerSource::get_height() const
+{
+    return height_;
+}
+
+ImageType SerSource::get_type() const
+{
+    return type_;
+}
+
+long SerSource::get_nb_frames() const
+{
+    return nb_frames_;
+}
+
+void SerSource::decode(long index, Frame& frame) const
+{
+    prepare(index, frame);
+    size_t frame_size = frame.data.size();
+    const unsigned char* data = static_cast<unsigned char*>(mapping_) +
+                                SER_HEADER_SIZE + index * frame_size;
+    // (supported hosts are little endian)
+    std::memcpy(frame.data.data(), data, frame_size);
+    if (rgb_)
+    {
+        unsigned char* values = frame.data.data();
+        for (size_t i = 0; i < frame_size; i += 3)
+        {
+            std::swap(values[i], values[i + 2]);
+        }
+    }
+}
+
+// FITS format: header of 80 characters cards (in blocks of 2880 bytes),
+// followed by the big endian data
+static const size_t FITS_BLOCK_SIZE = 2880;
+static const size_t FITS_CARD_SIZE = 80;
+
+namespace
+{
+class FitsHeader
+{
+public:
+    int bitpix = 0;
+    std::vector<long> axes;
+    double bzero = 0.;
+    double bscale = 1.;
+    size_t data_offset = 0;
+};
+}  // namespace
+
+static FitsHeader read_fits_header(std::ifstream& f,
+                                   const std::filesystem::path& path)
+{
+    FitsHeader header;
+    std::vector<char> block(FITS_BLOCK_SIZE);
+    bool end = false;
+    try
+    {
+        while (!end)
+        {
+            if (!f.read(block.data(), block.size()))
+            {
+                throw std::runtime_error("no END card");
+            }
+            header.data_offset += FITS_BLOCK_SIZE;
+            for (size_t c = 0; c < FITS_BLOCK_SIZE && !end;
+                 c += FITS_CARD_SIZE)
+            {
+                std::string card(block.data() + c, FITS_CARD_SIZE);
+                std::string key = card.substr(0, 8);
+                key.erase(key.find_last_not_of(' ') + 1);
+                if (key == "END")
+                {
+                    end = true;
+                    continue;
+                }
+                if (card.compare(8, 2, "= ") != 0) continue;
+                std::string value = card.substr(10);
+                value = value.substr(0, value.find('/'));
+                if (key == "BITPIX")
+                    header.bitpix = std::stoi(value);
+                else if (key == "NAXIS")
+                    header.axes.resize(std::stoi(value));
+                else if (key.compare(0, 5, "NAXIS") == 0)
+                {
+                    size_t axis = std::stoul(key.substr(5));
+                    if (axis < 1 || axis > header.axes.size())
+                    {
+                        throw std::runtime_error("invalid " + key);
+                    }
+                    header.axes[axis - 1] = std::stol(value);
+                }
+                else if (key == "BZERO")
+                    header.bzero = std::stod(value);
+                else if (key == "BSCALE")
+                    header.bscale = std::stod(value);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        throw std::runtime_error("fits: invalid header in " + path.string() +
+                                 ": " + e.what());
+    }
+    return header;
+}
+
+// geometry of the frames of the file
+static void get_fits_geometry(const FitsHeader& header,
+                              const std::filesystem::path& path,
+                              int& width,
+                              int& height,
+                              ImageType& type)
+{
+    const std::vector<long>& axes = header.axes;
+    bool mono = axes.size() == 2;
+    bool color = axes.size() == 3 && axes[2] == 3 && header.bitpix == 8;
+    if ((!mono && !color) || (header.bitpix != 8 && header.bitpix != 16) ||
+        header.bscale != 1.)
+    {
+        throw std::runtime_error(
+            "fits: unsupported format (2D 8 or 16 bits images, or 8 bits "
+            "color images, are supported): " +
+            path.string());
+    }
+    width = axes[0];
+    height = axes[1];
+    if (color)
+        type = ImageType::rgb24;
+    else
+        type = header.bitpix == 8 ? ImageType::raw8 : ImageType::raw16;
+}
+
+FitsSource::FitsSource(std::vector<std::filesystem::path> paths)
+    : paths_{paths}, width_{0}, height_{0}, type_{ImageType::raw8}
+{
+    if (paths_.empty())
+    {
+        throw std::runtime_error("fits: no file");
+    }
+    std::ifstream f(paths_[0], std::ios::binary);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("fits: failed to open " + paths_[0].string());
+    }
+    FitsHeader header = read_fits_header(f, paths_[0]);
+    get_fits_geometry(header, paths_[0], width_, height_, type_);
+}
+
+std::vector<std::filesystem::path> FitsSource::list(
+    const std::filesystem::path& folder)
+{
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(folder))
+    {
+        std::string extension = entry.path().extension().string();
+        std::transform(
+            extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension == ".fits" || extension == ".fit" ||
+            extension == ".fts")
+        {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+int FitsSource::get_width() const
+{
+    return width_;
+}
+
+int FitsSource::get_height() const
+{
+    return height_;
+}
+
+ImageType FitsSource::get_type() const
+{
+    return type_;
+}
+
+long FitsSource::get_nb_frames() const
+{
+    return paths_.size();
+}
+
+void FitsSource::decode(long index, Frame& frame) const
+{
+    prepare(index, frame);
+    const std::filesystem::path& path = paths_[index];
+    std::ifstream f(path, std::ios::binary);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("fits: failed to open " + path.string());
+    }
+    FitsHeader header = read_fits_header(f, path);
+    int width, height;
+    ImageType type;
+    get_fits_geometry(header, path, width, height, type);
+    if (width != width_ || height != height_ || type != type_)
+    {
+        throw std::runtime_error("fits: frame of a different size or type: " +
+                                 path.string());
+    }
+    std::vector<unsigned char> data(frame.data.size());
+    if (!f.read(reinterpret_cast<char*>(data.data()), data.size()))
+    {
+        throw std::runtime_error("fits: truncated file " + path.string());
+    }
+    unsigned char* values = frame.data.data();
+    int nb_pixels = width * height;
+    if (type == ImageType::raw16)
+    {
+        // big endian signed values, offset by bzero (usually 32768)
+        int bzero = static_cast<int>(std::lround(header.bzero));
+        uint16_t* output = reinterpret_cast<uint16_t*>(values);
+        for (int i = 0; i < nb_pixels; i++)
+        {
+            int16_t raw = static_cast<int16_t>((data[2 * i] << 8) |
+                                               data[2 * i + 1]);
+            int value = raw + bzero;
+            value = value < 0 ? 0 : value;
+            value = value > 65535 ? 65535 : value;
+            output[i] = static_cast<uint16_t>(value);
+        }
+    }
+    else if (type == ImageType::rgb24)
+    {
+        // planes (red, green, blue) to interleaved bgr
+        for (int i = 0; i < nb_pixels; i++)
+        {
+            values[3 * i] = data[2 * nb_pixels + i];
+            values[3 * i + 1] = data[nb_pixels + i];
+            values[3 * i + 2] = data[i];
+        }
+    }
+    else
+    {
+        std::copy(data.begin(), data.end(), values);
+    }
+}
+
+RawSource::RawSource(std::filesystem::path folder,
+                     int width,
+                     int height,
+                     ImageType type,
+                     std::string prefix)
+    : width_{width}, height_{height}, type_{type}
+{
+    for (const auto& entry : std::filesystem::directory_iterator(folder))
+    {
+        std::string name = entry.path().filename().string();
+        if (entry.path().extension() != ".raw" ||
+            name.compare(0, prefix.size(), prefix) != 0)
+        {
+            continue;
+        }
+        std::string index = entry.path().stem().string().substr(prefix.size());
+        if (index.empty() ||
+            index.find_first_not_of("0123456789") != std::string::npos)
+        {
+            continue;
+        }
+        files_.emplace_back(std::stol(index), entry.path());
+    }
+    std::sort(files_.begin(), files_.end());
+}
+
+int RawSource::get_width() const
+{
+    return width_;
+}
+
+int RawSource::get_height() const
+{
+    return height_;
+}
+
+ImageType RawSource::get_type() const
+{
+    return type_;
+}
+
+long RawSource::get_nb_frames() const
+{
+    return files_.size();
+}
+
+void RawSource::decode(long index, Frame& frame) const
+{
+    prepare(index, frame);
+    const std::filesystem::path& path = files_[index].second;
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("raw: failed to open " + path.string());
+    }
+    if (static_cast<size_t>(f.tellg()) != frame.data.size())
+    {
+        throw std::runtime_error("raw: file of a different size: " +
+                                 path.string());
+    }
+    f.seekg(0);
+    if (!f.read(reinterpret_cast<char*>(frame.data.data()), frame.data.size()))
+    {
+        throw std::runtime_error("raw: failed to read " + path.string());
+    }
+    frame.index = files_[index].first;
+}
+
+ReadaheadSource::Slot::Slot(int width, int height, ImageType type)
+    : frame(width, height, type), ready{false}
+{
+}
+
+ReadaheadSource::ReadaheadSource(std::shared_ptr<FileSource> source,
+                                 int nb_frames,
+                                 int nb_threads)
+    : source_{source}, next_{source->get_position()}, pool_{nb_threads}
+{
+    if (nb_frames < 1)
+    {
+        throw std::runtime_error("readahead: at least one frame required");
+    }
+    for (int i = 0; i < nb_frames; i++)
+    {
+        slots_.push_back(std::make_unique<Slot>(
+            source_->get_width(), source_->get_height(), source_->get_type()));
+    }
+    long end = std::min(next_ + nb_frames, source_->get_nb_frames());
+    for (long index = next_; index < end; index++)
+    {
+        schedule(index);
+    }
+}
+
+ReadaheadSource::~ReadaheadSource()
+{
+    pool_.wait_idle();
+}
+
+int ReadaheadSource::get_width() const
+{
+    return source_->get_width();
+}
+
+int ReadaheadSource::get_height() const
+{
+    return source_->get_height();
+}
+
+ImageType ReadaheadSource::get_type() const
+{
+    return source_->get_type();
+}
+
+long ReadaheadSource::get_nb_frames() const
+{
+    return source_->get_nb_frames();
+}
+
+void ReadaheadSource::schedule(long index)
+{
+    Slot* slot = slots_[index % slots_.size()].get();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot->ready = false;
+        slot->error = nullptr;
+    }
+    pool_.submit([this, slot, index]() {
+        std::exception_ptr error;
+        try
+        {
+            source_->decode(index, slot->frame);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slot->ready = true;
+            slot->error = error;
+        }
+        condition_.notify_all();
+    });
+}
+
+bool ReadaheadSource::read(Frame& frame)
+{
+    long nb_frames = source_->get_nb_frames();
+    if (next_ >= nb_frames) return false;
+    if (frame.width != get_width() || frame.height != get_height() ||
+        frame.type != get_type())
+    {
+        throw std::runtime_error(
+            "frame source: frame of a different size or type");
+    }
+    Slot& slot = *slots_[next_ % slots_.size()];
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [&slot] { return slot.ready; });
+        error = slot.error;
+    }
+    if (!error)
+    {
+        // the slot gets the buffer of the frame, to decode the next one
+        frame.data.swap(slot.frame.data);
+        frame.index = slot.frame.index;
+        frame.timestamp = slot.frame.timestamp;
+        frame.settings = slot.frame.settings;
+        frame.settings_changed = slot.frame.settings_changed;
+    }
+    // skipped if it failed to decode, as by FileSource::read
+    long index = next_ + slots_.size();
+    next_++;
+    source_->seek(next_);
+    if (index < nb_frames) schedule(index);
+    if (error) std::rethrow_exception(error);
+    return true;
+}
+
+ReadErrors::ReadErrors() : failed{0}
+{
+}
+
+bool read_skipping_errors(FrameSource& source,
+                          Frame& frame,
+                          ReadErrors* errors)
+{
+    // a recorded source moves to the next frame after a failed read
+    // (see FileSource::read), so that this loop ends
+    while (true)
+    {
+        try
+        {
+            return source.read(frame);
+        }
+        catch (const std::exception& e)
+        {
+            if (source.get_nb_frames() < 0) throw;
+            if (errors != nullptr)
+            {
+                errors->failed++;
+                errors->last_error = e.what();
+            }
+        }
+    }
+}
+
+long replay(FrameSource& source,
+            Pipeline& pipeline,
+            long nb_frames,
+            int nb_buffers,
+            ReadErrors* errors)
+{
+    FramePool pool(source.get_width(),
+                   source.get_height(),
+                   source.get_type(),
+                   nb_buffers);
+    long nb_pushed = 0;
+    try
+    {
+        while (nb_frames < 0 || nb_pushed < nb_frames)
+        {
+            std::shared_ptr<Frame> frame = pool.acquire();
+            if (!read_skipping_errors(source, *frame, errors)) break;
+            pipeline.push(frame);
+            nb_pushed++;
+        }
+    }
+    catch (...)
+    {
+        // the frames being processed belong to the pool
+        pipeline.wait();
+        throw;
+    }
+    pipeline.wait();
+    return nb_pushed;
+}
+
+}  // namespace zwo_asi
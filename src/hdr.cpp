@@ -0,0 +1,243 @@
+#include "zwo_asi/hdr.hpp"
+#include <cmath>
+#include <cstdint>
+
+namespace zwo_asi
+{
+HdrOptions::HdrOptions() : saturation{0.95}, rolloff{0.1}, black_level{0.}
+{
+}
+
+HdrFrame::HdrFrame(int width_, int height_, ImageType type_)
+    : width{width_},
+      height{height_},
+      type{type_},
+      index{-1},
+      data(width_ * height_ * (type_ == ImageType::rgb24 ? 3 : 1)),
+      weights(data.size())
+{
+}
+
+int HdrFrame::size() const
+{
+    return data.size();
+}
+
+// gain in 0.1 dB
+static double get_scale(const FrameSettings& settings)
+{
+    return 1e6 / (settings.exposure_us *
+                  std::pow(10., settings.gain / 200.));
+}
+
+// loops without branches, so that they are vectorized by the compiler
+// (see CMakeLists.txt)
+
+template <typename T>
+static void add_frame(const T* values,
+                      int nb_values,
+                      float scale,
+                      float weight,
+                      float saturation,
+                      float inv_rolloff,
+                      float black_level,
+                      float* sum,
+                      float* weights)
+{
+    for (int i = 0; i < nb_values; i++)
+    {
+        float v = values[i];
+        // 1 below the rolloff, decreasing to 0 at saturation
+        float w = (saturation - v) * inv_rolloff;
+        w = w < 0.f ? 0.f : w;
+        w = weight * (w > 1.f ? 1.f : w);
+        sum[i] += w * (v - black_level) * scale;
+        weights[i] += w;
+    }
+}
+
+template <typename T>
+static void normalize(const T* shortest,
+                      int nb_values,
+                      float scale,
+                      float black_level,
+                      float* sum,
+                      const float* weights)
+{
+    for (int i = 0; i < nb_values; i++)
+    {
+        float fallback = (shortest[i] - black_level) * scale;
+        float w = weights[i];
+        float value = sum[i] / (w > 0.f ? w : 1.f);
+        sum[i] = w > 0.f ? value : fallback;
+    }
+}
+
+void merge_hdr(const std::vector<std::shared_ptr<Frame>>& frames,
+               HdrFrame& hdr,
+               const HdrOptions& options)
+{
+    if (frames.empty())
+    {
+        throw std::runtime_error("hdr merge: no frame");
+    }
+    const Frame& first = *frames.front();
+    if (hdr.width != first.width || hdr.height != first.height ||
+        hdr.type != first.type)
+    {
+        throw std::runtime_error(
+            "hdr merge: hdr frame and frames of different sizes or types");
+    }
+    long max_exposure_us = 0;
+    size_t shortest = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        const Frame& frame = *frames[i];
+        if (frame.width != first.width || frame.height != first.height ||
+            frame.type != first.type)
+        {
+            throw std::runtime_error(
+                "hdr merge: frames of different sizes or types");
+        }
+        if (frame.settings.exposure_us <= 0 || frame.settings.gain < 0)
+        {
+            throw std::runtime_error(
+                "hdr merge: exposure or gain of a frame unknown");
+        }
+        max_exposure_us = std::max(max_exposure_us, frame.settings.exposure_us);
+        if (get_scale(frame.settings) > get_scale(frames[shortest]->settings))
+        {
+            shortest = i;
+        }
+    }
+
+    bool is_16bits = first.type == ImageType::raw16;
+    float max_value = is_16bits ? 65535.f : 255.f;
+    float saturation = options.saturation * max_value;
+    float inv_rolloff = 1.f / std::max(options.rolloff * max_value, 1.);
+    float black_level = options.black_level;
+    int nb_values = hdr.size();
+    std::fill(hdr.data.begin(), hdr.data.end(), 0.f);
+    std::fill(hdr.weights.begin(), hdr.weights.end(), 0.f);
+
+    for (const std::shared_ptr<Frame>& frame : frames)
+    {
+        float scale = get_scale(frame->settings);
+        // longer exposures have a better signal to noise ratio
+        float weight =
+            static_cast<float>(frame->settings.exposure_us) / max_exposure_us;
+        if (is_16bits)
+            add_frame(reinterpret_cast<const uint16_t*>(frame->data.data()),
+                      nb_values,
+                      scale,
+                      weight,
+                      saturation,
+                      inv_rolloff,
+                      black_level,
+                      hdr.data.data(),
+                      hdr.weights.data());
+        else
+            add_frame(frame->data.data(),
+                      nb_values,
+                      scale,
+                      weight,
+                      saturation,
+                      inv_rolloff,
+                      black_level,
+                      hdr.data.data(),
+                      hdr.weights.data());
+    }
+
+    const Frame& short_frame = *frames[shortest];
+    float scale = get_scale(short_frame.settings);
+    if (is_16bits)
+        normalize(reinterpret_cast<const uint16_t*>(short_frame.data.data()),
+                  nb_values,
+                  scale,
+                  black_level,
+                  hdr.data.data(),
+                  hdr.weights.data());
+    else
+        normalize(short_frame.data.data(),
+                  nb_values,
+                  scale,
+                  black_level,
+                  hdr.data.data(),
+                  hdr.weights.data());
+
+    hdr.index = first.index;
+    hdr.timestamp = frames.back()->timestamp;
+}
+
+BracketSequencer::BracketSequencer(Camera& camera,
+                                   std::vector<BracketStep> steps,
+                                   HdrOptions options)
+    : camera_(camera),
+      steps_{steps},
+      options_{options},
+      last_duration_ms_{0.}
+{
+    if (steps_.empty())
+    {
+        throw std::runtime_error("bracket sequencer: no step");
+    }
+    ROI roi = camera_.get_roi();
+    for (size_t i = 0; i < steps_.size(); i++)
+    {
+        frames_.push_back(
+            std::make_shared<Frame>(roi.width, roi.height, roi.type));
+    }
+}
+
+void BracketSequencer::capture_video_frame(int step)
+{
+    Frame& frame = *frames_[step];
+    long generation = camera_.get_settings().generation;
+    // waiting for at least two exposures before reporting a timeout
+    int wait_ms = 500 + 2 * steps_[step].exposure_us / 1000;
+    // frames exposed before the new settings apply: usually one or two
+    const int max_frames = 10;
+    for (int i = 0; i < max_frames; i++)
+    {
+        camera_.get_video_frame(frame, wait_ms);
+        if (frame.settings.generation >= generation) return;
+    }
+    throw std::runtime_error(
+        "bracket sequencer: the new exposure and gain were not applied");
+}
+
+const std::vector<std::shared_ptr<Frame>>& BracketSequencer::capture()
+{
+    bool video = camera_.is_video_active();
+    for (size_t step = 0; step < steps_.size(); step++)
+    {
+        camera_.set_exposure_and_gain(steps_[step].exposure_us,
+                                      steps_[step].gain);
+        if (video)
+            capture_video_frame(step);
+        else
+            camera_.capture(*frames_[step]);
+    }
+    last_duration_ms_ = std::chrono::duration<double, std::milli>(
+                            frames_.back()->timestamp -
+                            frames_.front()->timestamp)
+                            .count();
+    return frames_;
+}
+
+void BracketSequencer::capture(HdrFrame& hdr)
+{
+    merge_hdr(capture(), hdr, options_);
+}
+
+const std::vector<BracketStep>& BracketSequencer::get_steps() const
+{
+    return steps_;
+}
+
+double BracketSequencer::get_last_duration_ms() const
+{
+    return last_duration_ms_;
+}
+
+}  // namespace zwo_asi
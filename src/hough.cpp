@@ -0,0 +1,293 @@
+#include "zwo_asi/hough.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace zwo_asi
+{
+// states of the pixels of the mask
+static const uint8_t EMPTY = 0;
+static const uint8_t VOTED = 2;
+
+double LineSegment::length() const
+{
+    return std::hypot(x1 - x0, y1 - y0);
+}
+
+std::string LineSegment::to_string() const
+{
+    std::ostringstream s;
+    s << "(" << x0 << ", " << y0 << ") - (" << x1 << ", " << y1
+      << "), length " << length() << ", " << votes << " votes";
+    return s.str();
+}
+
+HoughOptions::HoughOptions()
+    : threshold{15}, min_length{15}, max_gap{3}, nb_angles{180},
+      max_segments{16}
+{
+}
+
+LineDetector::LineDetector(int width, int height, HoughOptions options)
+    : width_{width}, height_{height}, options_{options}, random_{0}
+{
+    if (width <= 0 || height <= 0 || options.nb_angles <= 0)
+    {
+        throw std::runtime_error("line detector: invalid geometry");
+    }
+    // rho in [-(width + height), width + height]
+    nb_rho_ = 2 * (width + height) + 1;
+    cos_.resize(options.nb_angles);
+    sin_.resize(options.nb_angles);
+    for (int a = 0; a < options.nb_angles; a++)
+    {
+        double theta = M_PI * a / options.nb_angles;
+        cos_[a] = std::cos(theta);
+        sin_[a] = std::sin(theta);
+    }
+    accumulator_.resize(static_cast<size_t>(options.nb_angles) * nb_rho_);
+}
+
+int LineDetector::get_width() const
+{
+    return width_;
+}
+
+int LineDetector::get_height() const
+{
+    return height_;
+}
+
+const HoughOptions& LineDetector::get_options() const
+{
+    return options_;
+}
+
+void LineDetector::vote(int x, int y, int increment, int* max_votes,
+                        int* max_angle)
+{
+    int offset = width_ + height_;
+    for (int a = 0; a < options_.nb_angles; a++)
+    {
+        int rho = std::lround(x * cos_[a] + y * sin_[a]) + offset;
+        int& votes = accumulator_[a * nb_rho_ + rho];
+        votes += increment;
+        if (max_votes && votes > *max_votes)
+        {
+            *max_votes = votes;
+            *max_angle = a;
+        }
+    }
+}
+
+std::vector<LineSegment> LineDetector::detect(std::vector<uint8_t>& mask)
+{
+    if (mask.size() != static_cast<size_t>(width_) * height_)
+    {
+        throw std::runtime_error("line detector: mask of a different size");
+    }
+    std::vector<LineSegment> segments;
+    points_.clear();
+    for (int i = 0; i < static_cast<int>(mask.size()); i++)
+    {
+        if (mask[i] != EMPTY)
+        {
+            mask[i] = 1;
+            points_.push_back(i);
+        }
+    }
+    if (static_cast<int>(points_.size()) < options_.threshold)
+    {
+        return segments;
+    }
+    std::fill(accumulator_.begin(), accumulator_.end(), 0);
+    std::shuffle(points_.begin(), points_.end(), random_);
+    const int shift = 16;
+    for (int point : points_)
+    {
+        if (static_cast<int>(segments.size()) >= options_.max_segments) break;
+        // already removed with a segment
+        if (mask[point] == EMPTY) continue;
+        int x = point % width_;
+        int y = point / width_;
+        mask[point] = VOTED;
+        int max_votes = 0;
+        int max_angle = 0;
+        vote(x, y, 1, &max_votes, &max_angle);
+        if (max_votes < options_.threshold) continue;
+        // walking along the line (fixed point along its minor axis),
+        // from the point, in both directions
+        float a = -sin_[max_angle];
+        float b = cos_[max_angle];
+        bool along_x = std::fabs(a) > std::fabs(b);
+        long x0, y0, dx0, dy0;
+        if (along_x)
+        {
+            dx0 = a > 0 ? 1 : -1;
+            dy0 = std::lround(b * (1 << shift) / std::fabs(a));
+            x0 = x;
+            y0 = (static_cast<long>(y) << shift) + (1 << (shift - 1));
+        }
+        else
+        {
+            dy0 = b > 0 ? 1 : -1;
+            dx0 = std::lround(a * (1 << shift) / std::fabs(b));
+            y0 = y;
+            x0 = (static_cast<long>(x) << shift) + (1 << (shift - 1));
+        }
+        int ends[2][2] = {{x, y}, {x, y}};
+        auto walk = [&](int k, bool remove, bool good) {
+            long dx = k == 0 ? dx0 : -dx0;
+            long dy = k == 0 ? dy0 : -dy0;
+            long px = x0;
+            long py = y0;
+            int gap = 0;
+            while (true)
+            {
+                int j = along_x ? px : px >> shift;
+                int i = along_x ? py >> shift : py;
+                if (j < 0 || j >= width_ || i < 0 || i >= height_) break;
+                uint8_t& state = mask[i * width_ + j];
+                if (remove)
+                {
+                    if (state != EMPTY)
+                    {
+                        if (good && state == VOTED) vote(j, i, -1, 0, 0);
+                        state = EMPTY;
+                    }
+                    if (good)
+                    {
+                        // segments are often thicker than a pixel: the
+                        // neighbours across the line are removed too
+                        for (int side = -1; side <= 1; side += 2)
+                        {
+                            int nj = along_x ? j : j + side;
+                            int ni = along_x ? i + side : i;
+                            if (nj < 0 || nj >= width_ || ni < 0 ||
+                                ni >= height_)
+                                continue;
+                            uint8_t& neighbour = mask[ni * width_ + nj];
+                            if (neighbour == VOTED) vote(nj, ni, -1, 0, 0);
+                            neighbour = EMPTY;
+                        }
+                    }
+                    if (j == ends[k][0] && i == ends[k][1]) break;
+                }
+                else if (state != EMPTY)
+                {
+                    gap = 0;
+                    ends[k][0] = j;
+                    ends[k][1] = i;
+                }
+                else if (++gap > options_.max_gap)
+                {
+                    break;
+                }
+                px += dx;
+                py += dy;
+            }
+        };
+        walk(0, false, false);
+        walk(1, false, false);
+        bool good = std::max(std::abs(ends[1][0] - ends[0][0]),
+                             std::abs(ends[1][1] - ends[0][1])) >=
+                    options_.min_length;
+        walk(0, true, good);
+        walk(1, true, good);
+        if (good)
+        {
+            LineSegment segment;
+            segment.x0 = ends[0][0];
+            segment.y0 = ends[0][1];
+            segment.x1 = ends[1][0];
+            segment.y1 = ends[1][1];
+            segment.votes = max_votes;
+            segments.push_back(segment);
+        }
+    }
+    return segments;
+}
+
+template <typename T>
+static void bin_values(const T* values,
+                       int width,
+                       int channels,
+                       int binning,
+                       int binned_width,
+                       int binned_height,
+                       int32_t* binned)
+{
+    int row_size = binning * channels;
+    for (int by = 0; by < binned_height; by++)
+    {
+        int32_t* out = binned + static_cast<long>(by) * binned_width;
+        std::fill(out, out + binned_width, 0);
+        for (int dy = 0; dy < binning; dy++)
+        {
+            long y = by * binning + dy;
+            const T* row = values + y * width * channels;
+            for (int bx = 0; bx < binned_width; bx++)
+            {
+                const T* bin = row + bx * row_size;
+                int32_t sum = 0;
+                for (int v = 0; v < row_size; v++) sum += bin[v];
+                out[bx] += sum;
+            }
+        }
+    }
+}
+
+void bin_frame(const Frame& frame,
+               int binning,
+               int binned_width,
+               int binned_height,
+               int32_t* binned)
+{
+    int channels = frame.type == ImageType::rgb24 ? 3 : 1;
+    if (frame.type == ImageType::raw16)
+        bin_values(reinterpret_cast<const uint16_t*>(frame.data.data()),
+                   frame.width,
+                   channels,
+                   binning,
+                   binned_width,
+                   binned_height,
+                   binned);
+    else
+        bin_values(frame.data.data(),
+                   frame.width,
+                   channels,
+                   binning,
+                   binned_width,
+                   binned_height,
+                   binned);
+}
+
+template <typename R>
+static double estimate_noise(const int32_t* values,
+                             const R* reference,
+                             int size)
+{
+    double sum_abs = 0.;
+    for (int i = 0; i < size; i++)
+    {
+        sum_abs += std::fabs(values[i] - reference[i]);
+    }
+    return size > 0 ? 1.2533 * sum_abs / size : 0.;
+}
+
+double estimate_difference_noise(const int32_t* values,
+                                 const int32_t* reference,
+                                 int size)
+{
+    return estimate_noise(values, reference, size);
+}
+
+double estimate_difference_noise(const int32_t* values,
+                                 const float* reference,
+                                 int size)
+{
+    return estimate_noise(values, reference, size);
+}
+
+}  // namespace zwo_asi
@@ -1,4 +1,5 @@
 #include "zwo_asi/image_type.hpp"
+#include <stdexcept>
 
 namespace zwo_asi
 {
@@ -18,6 +19,15 @@ std::string to_string(ImageType type)
     return "";
 }
 
+ImageType get_image_type(std::string type)
+{
+    if (type == "raw8") return ImageType::raw8;
+    if (type == "rgb24") return ImageType::rgb24;
+    if (type == "raw16") return ImageType::raw16;
+    if (type == "y8") return ImageType::y8;
+    throw std::runtime_error("unknown image type: " + type);
+}
+
 ASI_IMG_TYPE get_native(ImageType type)
 {
     switch (type)
@@ -33,4 +43,20 @@ ASI_IMG_TYPE get_native(ImageType type)
     }
     return ASI_IMG_Y8;
 }
+
+int get_bytes_per_pixel(ImageType type)
+{
+    switch (type)
+    {
+        case ImageType::raw8:
+            return 1;
+        case ImageType::y8:
+            return 1;
+        case ImageType::raw16:
+            return 2;
+        case ImageType::rgb24:
+            return 3;
+    }
+    return 1;
+}
 }  // namespace zwo_asi
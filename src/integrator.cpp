@@ -0,0 +1,408 @@
+#include "zwo_asi/integrator.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace zwo_asi
+{
+IntegratorOptions::IntegratorOptions()
+    : nb_frames{10},
+      rejection_threshold{-1.},
+      trail_sigma{-1.},
+      trail_binning{4},
+      trail_width{4}
+{
+}
+
+IntegratedFrame::IntegratedFrame(int width_, int height_, ImageType type_)
+    : width{width_},
+      height{height_},
+      type{type_},
+      index{-1},
+      nb_frames{0},
+      exposure_us{-1},
+      nb_rejected{0},
+      nb_trails{0},
+      nb_masked{0},
+      data(width_ * height_ * (type_ == ImageType::rgb24 ? 3 : 1))
+{
+}
+
+int IntegratedFrame::size() const
+{
+    return data.size();
+}
+
+VideoIntegrator::VideoIntegrator(int width,
+                                 int height,
+                                 ImageType type,
+                                 IntegratorOptions options)
+    : options_{options},
+      nb_added_{0},
+      nb_integrated_{0},
+      integrated_(width, height, type),
+      frame_(width, height, type),
+      binned_width_{0},
+      binned_height_{0},
+      nb_trails_{0},
+      nb_masked_{0}
+{
+    if (options_.nb_frames < 1)
+    {
+        throw std::runtime_error("integrator: at least one frame required");
+    }
+    sum_.resize(integrated_.size());
+    max_.resize(integrated_.size());
+    if (options_.trail_sigma >= 0)
+    {
+        options_.trail_binning = std::max(1, options_.trail_binning);
+        binned_width_ = std::max(1, width / options_.trail_binning);
+        binned_height_ = std::max(1, height / options_.trail_binning);
+        trail_detector_.reset(new LineDetector(
+            binned_width_, binned_height_, options_.trail_hough));
+        size_t size = static_cast<size_t>(binned_width_) * binned_height_;
+        binned_.resize(size);
+        binned_mean_.resize(size);
+        binned_count_.resize(size);
+        binned_mask_.resize(size);
+        mask_.resize(integrated_.size());
+        count_.resize(integrated_.size());
+    }
+}
+
+// loops without branches, so that they are vectorized by the compiler
+// (see CMakeLists.txt)
+
+template <typename T>
+static void accumulate(const T* values,
+                       int nb_values,
+                       uint32_t* sum,
+                       uint32_t* max)
+{
+    for (int i = 0; i < nb_values; i++)
+    {
+        uint32_t v = values[i];
+        sum[i] += v;
+        max[i] = max[i] > v ? max[i] : v;
+    }
+}
+
+template <typename T>
+static void initialize(const T* values,
+                       int nb_values,
+                       uint32_t* sum,
+                       uint32_t* max)
+{
+    for (int i = 0; i < nb_values; i++)
+    {
+        sum[i] = values[i];
+        max[i] = values[i];
+    }
+}
+
+static long reject(const uint32_t* sum,
+                   const uint32_t* max,
+                   int nb_values,
+                   int nb_frames,
+                   float threshold,
+                   uint32_t* output)
+{
+    float inv_others = 1.f / (nb_frames - 1);
+    long nb_rejected = 0;
+    for (int i = 0; i < nb_values; i++)
+    {
+        uint32_t others = sum[i] - max[i];
+        float mean = others * inv_others;
+        bool outlier = max[i] - mean > threshold;
+        uint32_t replaced = others + static_cast<uint32_t>(mean + 0.5f);
+        output[i] = outlier ? replaced : sum[i];
+        nb_rejected += outlier;
+    }
+    return nb_rejected;
+}
+
+template <typename T>
+static long accumulate_masked(const T* values,
+                              const uint8_t* mask,
+                              int nb_values,
+                              uint32_t* sum,
+                              uint32_t* max,
+                              uint32_t* count)
+{
+    long nb_masked = 0;
+    for (int i = 0; i < nb_values; i++)
+    {
+        uint32_t keep = mask[i] == 0;
+        uint32_t v = values[i] * keep;
+        sum[i] += v;
+        max[i] = max[i] > v ? max[i] : v;
+        count[i] += keep;
+        nb_masked += 1 - keep;
+    }
+    return nb_masked;
+}
+
+// as reject, with the number of frames integrated for each value: the
+// sums are scaled to nb_frames frames. Negative threshold: no rejection.
+static long reject_masked(const uint32_t* sum,
+                          const uint32_t* max,
+                          const uint32_t* count,
+                          int nb_values,
+                          int nb_frames,
+                          float threshold,
+                          uint32_t* output)
+{
+    // no rejection: outliers can not exceed the mean by more than
+    // infinity
+    if (threshold < 0) threshold = INFINITY;
+    uint32_t k = nb_frames;
+    long nb_rejected = 0;
+    for (int i = 0; i < nb_values; i++)
+    {
+        float c = count[i];
+        float others = sum[i] - max[i];
+        // a single value is never rejected
+        float mean = c > 1.f ? others / (c - 1.f) : INFINITY;
+        bool outlier = max[i] - mean > threshold;
+        float replaced = mean * nb_frames + 0.5f;
+        float scaled = sum[i] * (nb_frames / c) + 0.5f;
+        // converted to float, unmasked sums above 2^24 would be rounded
+        uint32_t kept =
+            count[i] == k ? sum[i] : static_cast<uint32_t>(scaled);
+        output[i] = outlier ? static_cast<uint32_t>(replaced) : kept;
+        nb_rejected += outlier;
+    }
+    return nb_rejected;
+}
+
+// sets the values of the pixels at most half_width pixels (along x and
+// y) from the segment
+static void draw_segment(std::vector<uint8_t>& mask,
+                         int width,
+                         int height,
+                         int channels,
+                         double x0,
+                         double y0,
+                         double x1,
+                         double y1,
+                         int half_width)
+{
+    int steps = std::ceil(std::max(std::fabs(x1 - x0), std::fabs(y1 - y0)));
+    for (int step = 0; step <= steps; step++)
+    {
+        double t = steps > 0 ? static_cast<double>(step) / steps : 0.;
+        int x = std::lround(x0 + t * (x1 - x0));
+        int y = std::lround(y0 + t * (y1 - y0));
+        int first = std::max(0, x - half_width);
+        int last = std::min(width - 1, x + half_width);
+        if (first > last) continue;
+        for (int i = std::max(0, y - half_width);
+             i <= std::min(height - 1, y + half_width);
+             i++)
+        {
+            long offset = static_cast<long>(i) * width * channels;
+            uint8_t* row = mask.data() + offset;
+            std::fill(row + first * channels, row + (last + 1) * channels, 1);
+        }
+    }
+}
+
+bool VideoIntegrator::mask_trails(const Frame& frame)
+{
+    int channels = frame.type == ImageType::rgb24 ? 3 : 1;
+    int binning = options_.trail_binning;
+    bin_frame(frame, binning, binned_width_, binned_height_, binned_.data());
+    int size = binned_.size();
+    if (nb_added_ == 0)
+    {
+        std::copy(binned_.begin(), binned_.end(), binned_mean_.begin());
+        std::fill(binned_count_.begin(), binned_count_.end(), 1);
+        return false;
+    }
+    // residual from the frames already integrated
+    double sigma = estimate_difference_noise(
+        binned_.data(), binned_mean_.data(), size);
+    float threshold = std::max(1., options_.trail_sigma * sigma);
+    int nb_changed = 0;
+    for (int i = 0; i < size; i++)
+    {
+        uint8_t changed = binned_[i] - binned_mean_[i] > threshold;
+        binned_mask_[i] = changed;
+        nb_changed += changed;
+    }
+    std::vector<LineSegment> segments;
+    // a large part of the frame changed (e.g. clouds): not trails
+    if (nb_changed < 0.05 * size)
+    {
+        segments = trail_detector_->detect(binned_mask_);
+    }
+    std::fill(binned_mask_.begin(), binned_mask_.end(), 0);
+    for (const LineSegment& segment : segments)
+    {
+        // in pixels of the frame, extended by a bin on both ends
+        double x0 = segment.x0 * binning + binning / 2.;
+        double y0 = segment.y0 * binning + binning / 2.;
+        double x1 = segment.x1 * binning + binning / 2.;
+        double y1 = segment.y1 * binning + binning / 2.;
+        double length = std::max(1., std::hypot(x1 - x0, y1 - y0));
+        double ex = (x1 - x0) / length * binning;
+        double ey = (y1 - y0) / length * binning;
+        draw_segment(mask_,
+                     frame.width,
+                     frame.height,
+                     channels,
+                     x0 - ex,
+                     y0 - ey,
+                     x1 + ex,
+                     y1 + ey,
+                     options_.trail_width);
+        draw_segment(binned_mask_,
+                     binned_width_,
+                     binned_height_,
+                     1,
+                     segment.x0,
+                     segment.y0,
+                     segment.x1,
+                     segment.y1,
+                     options_.trail_width / binning + 1);
+    }
+    // the masked bins do not contribute to the mean
+    for (int i = 0; i < size; i++)
+    {
+        uint32_t keep = binned_mask_[i] == 0;
+        binned_count_[i] += keep;
+        float delta = (binned_[i] - binned_mean_[i]) / binned_count_[i];
+        binned_mean_[i] += keep ? delta : 0.f;
+    }
+    nb_trails_ += segments.size();
+    return !segments.empty();
+}
+
+bool VideoIntegrator::add(const Frame& frame)
+{
+    if (frame.width != integrated_.width ||
+        frame.height != integrated_.height || frame.type != integrated_.type)
+    {
+        throw std::runtime_error(
+            "integrator: frame of a different size or type");
+    }
+    if (nb_added_ > 0 && frame.settings.generation != settings_.generation)
+    {
+        reset();
+    }
+    int nb_values = integrated_.size();
+    bool is_16bits = frame.type == ImageType::raw16;
+    const uint16_t* values16 =
+        reinterpret_cast<const uint16_t*>(frame.data.data());
+    bool masked = trail_detector_ && mask_trails(frame);
+    if (nb_added_ == 0)
+    {
+        settings_ = frame.settings;
+        if (is_16bits)
+            initialize(values16, nb_values, sum_.data(), max_.data());
+        else
+            initialize(frame.data.data(), nb_values, sum_.data(), max_.data());
+        if (trail_detector_)
+        {
+            std::fill(count_.begin(), count_.end(), 1);
+            nb_trails_ = 0;
+            nb_masked_ = 0;
+        }
+    }
+    else if (trail_detector_)
+    {
+        if (is_16bits)
+            nb_masked_ += accumulate_masked(values16,
+                                            mask_.data(),
+                                            nb_values,
+                                            sum_.data(),
+                                            max_.data(),
+                                            count_.data());
+        else
+            nb_masked_ += accumulate_masked(frame.data.data(),
+                                            mask_.data(),
+                                            nb_values,
+                                            sum_.data(),
+                                            max_.data(),
+                                            count_.data());
+        if (masked) std::fill(mask_.begin(), mask_.end(), 0);
+    }
+    else
+    {
+        if (is_16bits)
+            accumulate(values16, nb_values, sum_.data(), max_.data());
+        else
+            accumulate(frame.data.data(), nb_values, sum_.data(), max_.data());
+    }
+    nb_added_++;
+    if (nb_added_ < options_.nb_frames) return false;
+    integrated_.timestamp = frame.timestamp;
+    complete();
+    return true;
+}
+
+void VideoIntegrator::complete()
+{
+    int nb_values = integrated_.size();
+    integrated_.nb_rejected = 0;
+    integrated_.nb_trails = nb_trails_;
+    integrated_.nb_masked = nb_masked_;
+    if (trail_detector_)
+    {
+        integrated_.nb_rejected = reject_masked(sum_.data(),
+                                                max_.data(),
+                                                count_.data(),
+                                                nb_values,
+                                                nb_added_,
+                                                options_.rejection_threshold,
+                                                integrated_.data.data());
+    }
+    else if (options_.rejection_threshold < 0 || nb_added_ < 2)
+    {
+        std::copy(sum_.begin(), sum_.end(), integrated_.data.begin());
+    }
+    else
+    {
+        integrated_.nb_rejected = reject(sum_.data(),
+                                         max_.data(),
+                                         nb_values,
+                                         nb_added_,
+                                         options_.rejection_threshold,
+                                         integrated_.data.data());
+    }
+    integrated_.index = nb_integrated_++;
+    integrated_.nb_frames = nb_added_;
+    integrated_.exposure_us =
+        settings_.exposure_us < 0 ? -1 : settings_.exposure_us * nb_added_;
+    nb_added_ = 0;
+}
+
+const IntegratedFrame& VideoIntegrator::get_frame() const
+{
+    return integrated_;
+}
+
+const IntegratedFrame& VideoIntegrator::capture(Camera& camera, int wait_ms)
+{
+    while (true)
+    {
+        camera.get_video_frame(frame_, wait_ms);
+        if (add(frame_)) return integrated_;
+    }
+}
+
+int VideoIntegrator::get_nb_added() const
+{
+    return nb_added_;
+}
+
+void VideoIntegrator::reset()
+{
+    nb_added_ = 0;
+}
+
+const IntegratorOptions& VideoIntegrator::get_options() const
+{
+    return options_;
+}
+
+}  // namespace zwo_asi
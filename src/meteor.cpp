@@ -0,0 +1,314 @@
+#include "zwo_asi/meteor.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace zwo_asi
+{
+MeteorOptions::MeteorOptions()
+    : binning{2},
+      sigma_threshold{5.},
+      max_changed_fraction{0.01},
+      pre_trigger_frames{25},
+      post_trigger_frames{25},
+      prefix{"meteor_"}
+{
+}
+
+std::string MeteorEvent::to_string() const
+{
+    std::ostringstream s;
+    s << "frame " << trigger_index << " (frames " << first_index << " to "
+      << last_index << "), " << segments.size() << " segment(s)";
+    for (const LineSegment& segment : segments)
+    {
+        s << "\n  " << segment.to_string();
+    }
+    if (!folder.empty()) s << "\n  " << folder.string();
+    return s.str();
+}
+
+static int get_binned(int size, int binning)
+{
+    return std::max(1, size / std::max(1, binning));
+}
+
+MeteorDetector::MeteorDetector(int width,
+                               int height,
+                               ImageType type,
+                               MeteorOptions options)
+    : width_{width},
+      height_{height},
+      type_{type},
+      options_{options},
+      binned_width_{get_binned(width, options.binning)},
+      binned_height_{get_binned(height, options.binning)},
+      detector_(binned_width_, binned_height_, options.hough),
+      has_previous_{false},
+      pool_(width,
+            height,
+            type,
+            2 * (std::max(0, options.pre_trigger_frames) +
+                 std::max(0, options.post_trigger_frames) + 1)),
+      remaining_{0},
+      nb_frames_{0},
+      nb_skipped_{0},
+      nb_dropped_{0},
+      writing_{false},
+      stop_{false}
+{
+    options_.binning = std::max(1, options_.binning);
+    options_.pre_trigger_frames = std::max(0, options_.pre_trigger_frames);
+    options_.post_trigger_frames = std::max(0, options_.post_trigger_frames);
+    if (!options_.folder.empty() &&
+        !std::filesystem::is_directory(options_.folder))
+    {
+        std::ostringstream s;
+        s << "meteor detector: folder not found: " << options_.folder;
+        throw std::runtime_error(s.str());
+    }
+    size_t size = static_cast<size_t>(binned_width_) * binned_height_;
+    current_.resize(size);
+    previous_.resize(size);
+    mask_.resize(size);
+    thread_ = std::thread(&MeteorDetector::run, this);
+}
+
+MeteorDetector::~MeteorDetector()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+static int threshold_difference(const int32_t* current,
+                                const int32_t* previous,
+                                int size,
+                                int32_t threshold,
+                                uint8_t* mask)
+{
+    int count = 0;
+    for (int i = 0; i < size; i++)
+    {
+        uint8_t changed = current[i] - previous[i] > threshold;
+        mask[i] = changed;
+        count += changed;
+    }
+    return count;
+}
+
+std::vector<LineSegment> MeteorDetector::detect(const Frame& frame)
+{
+    bin_frame(frame,
+              options_.binning,
+              binned_width_,
+              binned_height_,
+              current_.data());
+    std::vector<LineSegment> segments;
+    // no comparison with a frame acquired with other settings
+    if (has_previous_ && !frame.settings_changed)
+    {
+        int size = current_.size();
+        double sigma = estimate_difference_noise(
+            current_.data(), previous_.data(), size);
+        int32_t threshold =
+            std::max(1., options_.sigma_threshold * sigma);
+        int count = threshold_difference(current_.data(), previous_.data(),
+                                         size, threshold, mask_.data());
+        if (count > options_.max_changed_fraction * size)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            nb_skipped_++;
+        }
+        else
+        {
+            segments = detector_.detect(mask_);
+            for (LineSegment& segment : segments)
+            {
+                // center of the bins, in pixels of the frames
+                int b = options_.binning;
+                segment.x0 = segment.x0 * b + b / 2;
+                segment.y0 = segment.y0 * b + b / 2;
+                segment.x1 = segment.x1 * b + b / 2;
+                segment.y1 = segment.y1 * b + b / 2;
+            }
+        }
+    }
+    current_.swap(previous_);
+    has_previous_ = true;
+    return segments;
+}
+
+void MeteorDetector::process(Frame& frame)
+{
+    if (frame.width != width_ || frame.height != height_ ||
+        frame.type != type_)
+    {
+        throw std::runtime_error(
+            "meteor detector: frame of a different size or type");
+    }
+    std::vector<LineSegment> segments = detect(frame);
+    std::shared_ptr<Frame> copy = pool_.try_acquire();
+    if (copy)
+    {
+        copy->index = frame.index;
+        copy->timestamp = frame.timestamp;
+        copy->settings = frame.settings;
+        copy->settings_changed = frame.settings_changed;
+        std::memcpy(copy->data.data(), frame.data.data(), frame.data.size());
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    nb_frames_++;
+    if (!copy)
+    {
+        nb_dropped_++;
+    }
+    if (event_)
+    {
+        // detections during the post trigger frames are added to the
+        // event, which is not extended
+        event_->info.segments.insert(
+            event_->info.segments.end(), segments.begin(), segments.end());
+        if (copy) event_->frames.push_back(copy);
+        event_->info.last_index = frame.index;
+        if (--remaining_ <= 0) complete_event();
+        return;
+    }
+    if (copy) ring_.push_back(copy);
+    if (!segments.empty())
+    {
+        event_.reset(new Event);
+        event_->info.trigger_index = frame.index;
+        event_->info.first_index =
+            ring_.empty() ? frame.index : ring_.front()->index;
+        event_->info.last_index = frame.index;
+        event_->info.segments = segments;
+        event_->frames.assign(ring_.begin(), ring_.end());
+        ring_.clear();
+        remaining_ = options_.post_trigger_frames;
+        if (remaining_ <= 0) complete_event();
+        return;
+    }
+    while (static_cast<int>(ring_.size()) > options_.pre_trigger_frames)
+    {
+        ring_.pop_front();
+    }
+}
+
+// mutex_ locked
+void MeteorDetector::complete_event()
+{
+    queue_.push_back(std::move(event_));
+    condition_.notify_all();
+}
+
+void MeteorDetector::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (event_) complete_event();
+    written_.wait(lock, [this] { return queue_.empty() && !writing_; });
+}
+
+void MeteorDetector::write(Event& event)
+{
+    std::ostringstream name;
+    name << options_.prefix << event.info.trigger_index;
+    std::filesystem::path folder = options_.folder / name.str();
+    std::filesystem::create_directories(folder);
+    for (const std::shared_ptr<Frame>& frame : event.frames)
+    {
+        std::ostringstream frame_name;
+        frame_name << "frame_" << frame->index << ".raw";
+        std::filesystem::path path = folder / frame_name.str();
+        std::ofstream f(path, std::ios::binary);
+        f.write(reinterpret_cast<const char*>(frame->data.data()),
+                frame->data.size());
+        if (!f)
+        {
+            std::ostringstream s;
+            s << "failed to write " << path;
+            throw std::runtime_error(s.str());
+        }
+    }
+    std::ofstream f(folder / "event.txt");
+    f << width_ << " x " << height_ << " " << zwo_asi::to_string(type_)
+      << "\n"
+      << event.info.to_string() << "\n";
+    event.info.folder = folder;
+}
+
+void MeteorDetector::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        if (queue_.empty())
+        {
+            written_.notify_all();
+            if (stop_) return;
+            condition_.wait(lock);
+            continue;
+        }
+        std::unique_ptr<Event> event = std::move(queue_.front());
+        queue_.pop_front();
+        writing_ = true;
+        lock.unlock();
+        std::string error;
+        if (!options_.folder.empty())
+        {
+            try
+            {
+                write(*event);
+            }
+            catch (const std::exception& e)
+            {
+                error = std::string("meteor detector: ") + e.what();
+            }
+        }
+        // returning the frames to the pool
+        event->frames.clear();
+        lock.lock();
+        writing_ = false;
+        if (!error.empty()) last_error_ = error;
+        events_.push_back(event->info);
+    }
+}
+
+std::vector<MeteorEvent> MeteorDetector::get_events() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_;
+}
+
+long MeteorDetector::get_nb_frames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_frames_;
+}
+
+long MeteorDetector::get_nb_skipped() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_skipped_;
+}
+
+long MeteorDetector::get_nb_dropped() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_dropped_;
+}
+
+std::string MeteorDetector::get_last_error() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_error_;
+}
+
+}  // namespace zwo_asi
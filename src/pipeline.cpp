@@ -0,0 +1,349 @@
+#include "zwo_asi/pipeline.hpp"
+#include "zwo_asi/utils.hpp"
+
+namespace zwo_asi
+{
+Stage::~Stage()
+{
+}
+
+void Stage::submit(std::shared_ptr<Frame> frame)
+{
+    process(*frame);
+}
+
+FunctionStage::FunctionStage(std::function<void(Frame&)> function)
+    : function_{function}
+{
+}
+
+void FunctionStage::process(Frame& frame)
+{
+    function_(frame);
+}
+
+struct Pipeline::Job
+{
+    std::shared_ptr<Frame> frame;
+    std::unique_ptr<std::atomic<int>[]> waiting_for;
+    std::unique_ptr<std::chrono::steady_clock::time_point[]> ready_at;
+    // set when a predecessor failed or was skipped
+    std::unique_ptr<std::atomic<bool>[]> skipped;
+    std::atomic<int> remaining;
+};
+
+static void update_max(std::atomic<long>& max_value, long value)
+{
+    long current = max_value.load();
+    while (value > current && !max_value.compare_exchange_weak(current, value))
+    {
+    }
+}
+
+Pipeline::Pipeline(int nb_threads, int max_in_flight)
+    : max_in_flight_{std::max(1, max_in_flight)},
+      in_flight_{0},
+      pushed_{0},
+      completed_{0},
+      rejected_{0},
+      started_{false},
+      pool_{nb_threads}
+{
+}
+
+Pipeline::~Pipeline()
+{
+    wait();
+}
+
+void Pipeline::add_stage(std::string name,
+                         std::shared_ptr<Stage> stage,
+                         std::vector<std::string> after,
+                         bool serialized)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (started_)
+    {
+        throw std::runtime_error(
+            "pipeline: stages can not be added once frames have been pushed");
+    }
+    if (indexes_.find(name) != indexes_.end())
+    {
+        std::ostringstream s;
+        s << "pipeline: a stage named " << name << " already exists";
+        throw std::runtime_error(s.str());
+    }
+    // predecessors must already be in the graph, so stages are always
+    // added in topological order and no cycle can be created
+    std::vector<int> predecessors;
+    for (const std::string& a : after)
+    {
+        auto it = indexes_.find(a);
+        if (it == indexes_.end())
+        {
+            std::ostringstream s;
+            s << "pipeline: stage " << name << " is declared after the "
+              << "unknown stage " << a;
+            throw std::runtime_error(s.str());
+        }
+        predecessors.push_back(it->second);
+    }
+    int index = nodes_.size();
+    std::unique_ptr<Node> node = std::make_unique<Node>();
+    node->name = name;
+    node->stage = stage;
+    node->nb_predecessors = predecessors.size();
+    node->serialized = serialized;
+    node->processed = 0;
+    node->failed = 0;
+    node->queued = 0;
+    node->max_queued = 0;
+    node->total_latency_ns = 0;
+    node->max_latency_ns = 0;
+    node->total_wait_ns = 0;
+    for (int p : predecessors)
+    {
+        nodes_[p]->successors.push_back(index);
+    }
+    if (predecessors.empty())
+    {
+        roots_.push_back(index);
+    }
+    nodes_.push_back(std::move(node));
+    indexes_[name] = index;
+}
+
+void Pipeline::push(std::shared_ptr<Frame> frame)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this] { return in_flight_ < max_in_flight_; });
+        in_flight_++;
+        pushed_++;
+        started_ = true;
+    }
+    start(frame);
+}
+
+bool Pipeline::try_push(std::shared_ptr<Frame> frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (in_flight_ >= max_in_flight_)
+        {
+            rejected_++;
+            return false;
+        }
+        in_flight_++;
+        pushed_++;
+        started_ = true;
+    }
+    start(frame);
+    return true;
+}
+
+void Pipeline::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this] { return in_flight_ == 0; });
+}
+
+void Pipeline::start(std::shared_ptr<Frame> frame)
+{
+    if (nodes_.empty())
+    {
+        complete();
+        return;
+    }
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    int nb_nodes = nodes_.size();
+    job->frame = frame;
+    job->waiting_for = std::make_unique<std::atomic<int>[]>(nb_nodes);
+    job->ready_at =
+        std::make_unique<std::chrono::steady_clock::time_point[]>(nb_nodes);
+    job->skipped = std::make_unique<std::atomic<bool>[]>(nb_nodes);
+    for (int i = 0; i < nb_nodes; i++)
+    {
+        job->waiting_for[i] = nodes_[i]->nb_predecessors;
+        job->skipped[i] = false;
+    }
+    job->remaining = nb_nodes;
+    for (int root : roots_)
+    {
+        schedule(job, root);
+    }
+}
+
+void Pipeline::schedule(std::shared_ptr<Job> job, int node)
+{
+    Node& n = *nodes_[node];
+    update_max(n.max_queued, ++n.queued);
+    job->ready_at[node] = std::chrono::steady_clock::now();
+    pool_.submit([this, job, node]() { execute(job, node); });
+}
+
+void Pipeline::execute(std::shared_ptr<Job> job, int node)
+{
+    Node& n = *nodes_[node];
+    n.queued--;
+
+    // if an upstream stage failed, the downstream stages are skipped
+    // (stages of other branches still run), but the graph is still
+    // walked so that the frame completes
+    bool skipped = job->skipped[node];
+    if (!skipped)
+    {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        try
+        {
+            if (n.serialized)
+            {
+                std::lock_guard<std::mutex> lock(n.mutex);
+                n.stage->submit(job->frame);
+            }
+            else
+            {
+                n.stage->submit(job->frame);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            fail(n, e.what());
+            skipped = true;
+        }
+        catch (...)
+        {
+            // (not letting it terminate the worker thread)
+            fail(n, "unknown exception");
+            skipped = true;
+        }
+        std::chrono::steady_clock::time_point end =
+            std::chrono::steady_clock::now();
+        long latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           end - start)
+                           .count();
+        long wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        start - job->ready_at[node])
+                        .count();
+        n.processed++;
+        n.total_latency_ns += latency;
+        n.total_wait_ns += wait;
+        update_max(n.max_latency_ns, latency);
+    }
+
+    for (int successor : n.successors)
+    {
+        if (skipped)
+        {
+            job->skipped[successor] = true;
+        }
+        if (--job->waiting_for[successor] == 0)
+        {
+            schedule(job, successor);
+        }
+    }
+
+    if (--job->remaining == 0)
+    {
+        // releasing the frame before signaling completion, so that
+        // frames from a FramePool are available again when push returns
+        job->frame.reset();
+        complete();
+    }
+}
+
+void Pipeline::fail(Node& node, std::string error)
+{
+    node.failed++;
+    std::lock_guard<std::mutex> lock(mutex_);
+    node.last_error = error;
+}
+
+void Pipeline::complete()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_--;
+        completed_++;
+    }
+    condition_.notify_all();
+}
+
+PipelineMetrics Pipeline::get_metrics() const
+{
+    PipelineMetrics metrics;
+    std::lock_guard<std::mutex> lock(mutex_);
+    metrics.pushed = pushed_;
+    metrics.completed = completed_;
+    metrics.rejected = rejected_;
+    metrics.in_flight = in_flight_;
+    metrics.max_in_flight = max_in_flight_;
+    for (const std::unique_ptr<Node>& node : nodes_)
+    {
+        StageMetrics sm;
+        sm.name = node->name;
+        sm.processed = node->processed;
+        sm.failed = node->failed;
+        sm.queued = node->queued;
+        sm.max_queued = node->max_queued;
+        if (sm.processed > 0)
+        {
+            sm.mean_latency_us =
+                (node->total_latency_ns / 1000.0) / sm.processed;
+            sm.mean_wait_us = (node->total_wait_ns / 1000.0) / sm.processed;
+        }
+        else
+        {
+            sm.mean_latency_us = 0;
+            sm.mean_wait_us = 0;
+        }
+        sm.max_latency_us = node->max_latency_ns / 1000.0;
+        sm.last_error = node->last_error;
+        metrics.stages.push_back(sm);
+    }
+    return metrics;
+}
+
+std::vector<std::string> Pipeline::get_stages() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> names;
+    for (const std::unique_ptr<Node>& node : nodes_)
+    {
+        names.push_back(node->name);
+    }
+    return names;
+}
+
+std::string PipelineMetrics::to_string() const
+{
+    std::vector<std::string> names;
+    for (const StageMetrics& stage : stages)
+    {
+        names.push_back(stage.name);
+    }
+    int names_max = std::max(internal::max_size(names), 5);
+    internal::fix_lengths(names, names_max + 2);
+    std::string stage("stage");
+    internal::fix_length(stage, names_max + 2);
+
+    std::ostringstream s;
+    s << "pushed: " << pushed << " | completed: " << completed
+      << " | rejected: " << rejected << " | in flight: " << in_flight << "/"
+      << max_in_flight << std::endl;
+    s << "|" << stage
+      << "|processed |failed |queued (max) |latency us (mean/max) |wait us "
+         "(mean)\n--\n";
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        const StageMetrics& sm = stages[i];
+        s << "|" << names[i] << "|" << sm.processed << " |" << sm.failed
+          << " |" << sm.queued << " (" << sm.max_queued << ") |"
+          << sm.mean_latency_us << "/" << sm.max_latency_us << " |"
+          << sm.mean_wait_us << std::endl;
+    }
+    return s.str();
+}
+
+}  // namespace zwo_asi
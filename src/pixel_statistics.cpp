@@ -0,0 +1,273 @@
+#include "zwo_asi/pixel_statistics.hpp"
+#include <algorithm>
+
+namespace zwo_asi
+{
+PixelStatisticsOptions::PixelStatisticsOptions()
+    : precision{StatisticsPrecision::float32},
+      nb_threads{0},
+      band_bytes{256 * 1024},
+      batch_size{8}
+{
+}
+
+PixelStatistics::PixelStatistics(int width,
+                                 int height,
+                                 ImageType type,
+                                 PixelStatisticsOptions options)
+    : width_{width},
+      height_{height},
+      type_{type},
+      options_{options},
+      row_size_{width * (type == ImageType::rgb24 ? 3 : 1)},
+      nb_frames_{0},
+      pool_{options.nb_threads}
+{
+    if (options_.batch_size < 1)
+    {
+        throw std::runtime_error(
+            "pixel statistics: batch size must be at least 1");
+    }
+    size_t size = static_cast<size_t>(row_size_) * height_;
+    if (options_.precision == StatisticsPrecision::float32)
+    {
+        mean32_.resize(size);
+        m2_32_.resize(size);
+    }
+    else
+    {
+        mean64_.resize(size);
+        m2_64_.resize(size);
+    }
+}
+
+// Welford update of a row segment, without branches so that it is
+// vectorized by the compiler
+template <typename T, typename P>
+static void update(
+    const T* values, int nb_values, P inv_count, P* mean, P* m2)
+{
+    for (int i = 0; i < nb_values; i++)
+    {
+        P v = values[i];
+        P delta = v - mean[i];
+        mean[i] += delta * inv_count;
+        m2[i] += delta * (v - mean[i]);
+    }
+}
+
+// adds the frames to the accumulators of the rows [y0, y1[, frame after
+// frame (the accumulators of the band stay in cache)
+template <typename T, typename P>
+static void update_band(const std::vector<const Frame*>& frames,
+                        long nb_frames,
+                        int row_size,
+                        int y0,
+                        int y1,
+                        P* mean,
+                        P* m2)
+{
+    size_t begin = static_cast<size_t>(y0) * row_size;
+    int nb_values = (y1 - y0) * row_size;
+    for (const Frame* frame : frames)
+    {
+        nb_frames++;
+        const T* values = reinterpret_cast<const T*>(frame->data.data());
+        update(values + begin,
+               nb_values,
+               static_cast<P>(1. / nb_frames),
+               mean + begin,
+               m2 + begin);
+    }
+}
+
+template <typename P>
+void PixelStatistics::submit(const std::vector<const Frame*>& frames,
+                             std::vector<P>& mean,
+                             std::vector<P>& m2)
+{
+    auto batch = std::make_shared<const std::vector<const Frame*>>(frames);
+    long nb_frames = nb_frames_;
+    int row_size = row_size_;
+    long row_bytes = static_cast<long>(row_size_) * 2 * sizeof(P);
+    int band_height = std::max(1L, options_.band_bytes / row_bytes);
+    bool is_16bits = type_ == ImageType::raw16;
+    for (int y0 = 0; y0 < height_; y0 += band_height)
+    {
+        int y1 = std::min(y0 + band_height, height_);
+        P* pm = mean.data();
+        P* pm2 = m2.data();
+        pool_.submit([=]() {
+            if (is_16bits)
+                update_band<uint16_t>(
+                    *batch, nb_frames, row_size, y0, y1, pm, pm2);
+            else
+                update_band<unsigned char>(
+                    *batch, nb_frames, row_size, y0, y1, pm, pm2);
+        });
+    }
+    nb_frames_ += frames.size();
+}
+
+void PixelStatistics::submit(const std::vector<const Frame*>& frames)
+{
+    if (options_.precision == StatisticsPrecision::float32)
+        submit(frames, mean32_, m2_32_);
+    else
+        submit(frames, mean64_, m2_64_);
+}
+
+void PixelStatistics::check(const Frame& frame) const
+{
+    if (frame.width != width_ || frame.height != height_ ||
+        frame.type != type_)
+    {
+        throw std::runtime_error(
+            "pixel statistics: frame of a different size or type");
+    }
+}
+
+void PixelStatistics::add(const Frame& frame)
+{
+    check(frame);
+    submit(std::vector<const Frame*>{&frame});
+    pool_.wait_idle();
+}
+
+void PixelStatistics::add(const std::vector<std::shared_ptr<Frame>>& frames)
+{
+    std::vector<const Frame*> batch;
+    for (const std::shared_ptr<Frame>& frame : frames)
+    {
+        check(*frame);
+        batch.push_back(frame.get());
+    }
+    if (batch.empty()) return;
+    submit(batch);
+    pool_.wait_idle();
+}
+
+long PixelStatistics::add(FrameSource& source,
+                          long nb_frames,
+                          ReadErrors* errors)
+{
+    if (source.get_width() != width_ || source.get_height() != height_ ||
+        source.get_type() != type_)
+    {
+        throw std::runtime_error(
+            "pixel statistics: source of a different size or type");
+    }
+    // two sets of frames: one being added, the other being read
+    std::vector<Frame> frames[2];
+    for (std::vector<Frame>& set : frames)
+    {
+        for (int i = 0; i < options_.batch_size; i++)
+        {
+            set.emplace_back(width_, height_, type_);
+        }
+    }
+    int current = 0;
+    long nb_read = 0;
+    bool end = false;
+    try
+    {
+        while (!end && (nb_frames < 0 || nb_read < nb_frames))
+        {
+            std::vector<const Frame*> batch;
+            while ((int)batch.size() < options_.batch_size &&
+                   (nb_frames < 0 || nb_read < nb_frames))
+            {
+                Frame& frame = frames[current][batch.size()];
+                if (!read_skipping_errors(source, frame, errors))
+                {
+                    end = true;
+                    break;
+                }
+                batch.push_back(&frame);
+                nb_read++;
+            }
+            // the previous batch must be added first (and its frames
+            // are then free to be reused)
+            pool_.wait_idle();
+            if (batch.empty()) break;
+            submit(batch);
+            current = 1 - current;
+        }
+    }
+    catch (...)
+    {
+        pool_.wait_idle();
+        throw;
+    }
+    pool_.wait_idle();
+    return nb_read;
+}
+
+void PixelStatistics::capture(Camera& camera, long nb_frames, int wait_ms)
+{
+    CameraSource source(camera, wait_ms);
+    add(source, nb_frames);
+}
+
+long PixelStatistics::get_nb_frames() const
+{
+    return nb_frames_;
+}
+
+template <typename P>
+static std::vector<double> get_values(const std::vector<P>& values,
+                                      double scale)
+{
+    std::vector<double> r(values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        r[i] = values[i] * scale;
+    }
+    return r;
+}
+
+std::vector<double> PixelStatistics::get_mean() const
+{
+    if (options_.precision == StatisticsPrecision::float32)
+        return get_values(mean32_, 1.);
+    return get_values(mean64_, 1.);
+}
+
+std::vector<double> PixelStatistics::get_variance() const
+{
+    double scale = nb_frames_ > 1 ? 1. / (nb_frames_ - 1) : 0.;
+    if (options_.precision == StatisticsPrecision::float32)
+        return get_values(m2_32_, scale);
+    return get_values(m2_64_, scale);
+}
+
+void PixelStatistics::reset()
+{
+    nb_frames_ = 0;
+    std::fill(mean32_.begin(), mean32_.end(), 0.f);
+    std::fill(m2_32_.begin(), m2_32_.end(), 0.f);
+    std::fill(mean64_.begin(), mean64_.end(), 0.);
+    std::fill(m2_64_.begin(), m2_64_.end(), 0.);
+}
+
+int PixelStatistics::get_width() const
+{
+    return width_;
+}
+
+int PixelStatistics::get_height() const
+{
+    return height_;
+}
+
+ImageType PixelStatistics::get_type() const
+{
+    return type_;
+}
+
+const PixelStatisticsOptions& PixelStatistics::get_options() const
+{
+    return options_;
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,418 @@
+#include "zwo_asi/ptc.hpp"
+#include "zwo_asi/benchmark.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+namespace zwo_asi
+{
+// single pass over the rows of the region. Squared differences fit in
+// 32 bits (up to 65535^2), and are summed per row so that the inner loop
+// is vectorized by the compiler
+template <typename T>
+static void accumulate_pair(const T* a,
+                            const T* b,
+                            int row_size,
+                            int x0,
+                            int x1,
+                            int y0,
+                            int y1,
+                            int64_t& sum,
+                            int64_t& sum_difference,
+                            uint64_t& sum_squared_difference)
+{
+    for (int y = y0; y < y1; y++)
+    {
+        const T* ra = a + static_cast<long>(y) * row_size;
+        const T* rb = b + static_cast<long>(y) * row_size;
+        int64_t s = 0;
+        int64_t sd = 0;
+        uint64_t ssd = 0;
+        for (int x = x0; x < x1; x++)
+        {
+            int32_t va = ra[x];
+            int32_t vb = rb[x];
+            int32_t d = va - vb;
+            uint32_t ad = d < 0 ? -d : d;
+            s += va + vb;
+            sd += d;
+            ssd += ad * ad;
+        }
+        sum += s;
+        sum_difference += sd;
+        sum_squared_difference += ssd;
+    }
+}
+
+PairStatistics compute_pair_statistics(const Frame& a,
+                                       const Frame& b,
+                                       double region)
+{
+    if (a.width != b.width || a.height != b.height || a.type != b.type)
+    {
+        throw std::runtime_error(
+            "pair statistics: frames of different sizes or types");
+    }
+    if (region <= 0. || region > 1.)
+    {
+        throw std::runtime_error(
+            "pair statistics: region must be in ]0, 1]");
+    }
+    int channels = a.type == ImageType::rgb24 ? 3 : 1;
+    int width = std::max(1, static_cast<int>(a.width * region));
+    int height = std::max(1, static_cast<int>(a.height * region));
+    int x0 = (a.width - width) / 2 * channels;
+    int x1 = x0 + width * channels;
+    int y0 = (a.height - height) / 2;
+    int y1 = y0 + height;
+    int row_size = a.width * channels;
+
+    int64_t sum = 0;
+    int64_t sum_difference = 0;
+    uint64_t sum_squared_difference = 0;
+    if (a.type == ImageType::raw16)
+        accumulate_pair(reinterpret_cast<const uint16_t*>(a.data.data()),
+                        reinterpret_cast<const uint16_t*>(b.data.data()),
+                        row_size,
+                        x0,
+                        x1,
+                        y0,
+                        y1,
+                        sum,
+                        sum_difference,
+                        sum_squared_difference);
+    else
+        accumulate_pair(a.data.data(),
+                        b.data.data(),
+                        row_size,
+                        x0,
+                        x1,
+                        y0,
+                        y1,
+                        sum,
+                        sum_difference,
+                        sum_squared_difference);
+
+    PairStatistics stats;
+    stats.nb_values = static_cast<long>(x1 - x0) * (y1 - y0);
+    double n = stats.nb_values;
+    stats.mean = sum / (2. * n);
+    double mean_difference = sum_difference / n;
+    double centered =
+        sum_squared_difference - n * mean_difference * mean_difference;
+    stats.difference_variance = n > 1 ? centered / (n - 1) : 0.;
+    return stats;
+}
+
+PtcOptions::PtcOptions()
+    : exposures_us{1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000,
+                   500000, 1000000},
+      region{0.5}
+{
+}
+
+std::string GainCharacterization::to_string() const
+{
+    std::ostringstream s;
+    s << "gain " << gain << " (offset " << offset << "): " << elec_per_adu
+      << " e-/ADU | read noise: " << read_noise_e << " e- ("
+      << read_noise_adu << " ADU) | full well: " << (saturated ? "" : ">")
+      << full_well_e << " e- | bias: " << bias_adu << " ADU";
+    return s.str();
+}
+
+const GainCharacterization* PtcProfile::get(long gain) const
+{
+    for (const GainCharacterization& g : gains)
+    {
+        if (g.gain == gain) return &g;
+    }
+    return nullptr;
+}
+
+std::string PtcProfile::to_string() const
+{
+    std::ostringstream s;
+    s << camera_model << " (serial: " << serial << ")" << std::endl;
+    for (const GainCharacterization& g : gains)
+    {
+        s << g.to_string() << std::endl;
+    }
+    return s.str();
+}
+
+static const char* PROFILE_HEADER =
+    "# gain\toffset\telec_per_adu\tbias_adu\tread_noise_adu\tread_noise_e"
+    "\tfull_well_e\tsaturated";
+
+void PtcProfile::save(const std::filesystem::path& path) const
+{
+    if (path.has_parent_path())
+    {
+        std::filesystem::create_directories(path.parent_path());
+    }
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream f(tmp);
+        if (!f.is_open())
+        {
+            throw std::runtime_error("failed to write " + tmp.string());
+        }
+        f << "camera_model\t" << camera_model << "\n";
+        f << "serial\t" << serial << "\n";
+        f << PROFILE_HEADER << "\n";
+        f.precision(10);
+        for (const GainCharacterization& g : gains)
+        {
+            f << g.gain << "\t" << g.offset << "\t" << g.elec_per_adu << "\t"
+              << g.bias_adu << "\t" << g.read_noise_adu << "\t"
+              << g.read_noise_e << "\t" << g.full_well_e << "\t"
+              << g.saturated << "\n";
+        }
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+PtcProfile PtcProfile::load(const std::filesystem::path& path)
+{
+    std::ifstream f(path);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("failed to open " + path.string());
+    }
+    PtcProfile profile;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(f, line))
+    {
+        line_number++;
+        if (line.empty() || line[0] == '#') continue;
+        std::vector<std::string> fields;
+        std::istringstream l(line);
+        std::string field;
+        while (std::getline(l, field, '\t')) fields.push_back(field);
+        if (fields.size() == 2 && fields[0] == "camera_model")
+        {
+            profile.camera_model = fields[1];
+            continue;
+        }
+        if (fields.size() >= 1 && fields[0] == "serial")
+        {
+            profile.serial = fields.size() == 2 ? fields[1] : "";
+            continue;
+        }
+        GainCharacterization g;
+        try
+        {
+            if (fields.size() != 8) throw std::invalid_argument(line);
+            g.gain = std::stol(fields[0]);
+            g.offset = std::stol(fields[1]);
+            g.elec_per_adu = std::stod(fields[2]);
+            g.bias_adu = std::stod(fields[3]);
+            g.read_noise_adu = std::stod(fields[4]);
+            g.read_noise_e = std::stod(fields[5]);
+            g.full_well_e = std::stod(fields[6]);
+            g.saturated = std::stoi(fields[7]) != 0;
+        }
+        catch (const std::logic_error&)
+        {
+            std::ostringstream s;
+            s << "invalid photon transfer profile in " << path << " (line "
+              << line_number << ")";
+            throw std::runtime_error(s.str());
+        }
+        profile.gains.push_back(g);
+    }
+    return profile;
+}
+
+std::filesystem::path get_default_ptc_profile(const Camera& camera)
+{
+    // next to the throughput profiles
+    std::filesystem::path folder =
+        get_default_profile_cache().parent_path() / "ptc";
+    std::string name = camera.get_info().name + "_" + camera.get_serial();
+    std::replace(name.begin(), name.end(), ' ', '_');
+    std::replace(name.begin(), name.end(), '/', '_');
+    return folder / name;
+}
+
+GainCharacterization fit_ptc(long gain,
+                             double bias_adu,
+                             double read_noise_adu,
+                             std::vector<PtcPoint> points)
+{
+    std::sort(points.begin(),
+              points.end(),
+              [](const PtcPoint& a, const PtcPoint& b) {
+                  return a.signal < b.signal;
+              });
+    GainCharacterization g;
+    g.gain = gain;
+    g.offset = 0;
+    g.bias_adu = bias_adu;
+    g.read_noise_adu = read_noise_adu;
+    g.points = points;
+
+    // beyond the full well, the variance decreases
+    size_t peak = 0;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        if (points[i].shot_variance > points[peak].shot_variance) peak = i;
+    }
+    g.saturated = false;
+    for (size_t i = peak + 1; i < points.size(); i++)
+    {
+        if (points[i].shot_variance < 0.9 * points[peak].shot_variance)
+        {
+            g.saturated = true;
+        }
+    }
+
+    // least squares fit of variance = signal / elec_per_adu, on the
+    // points below the peak (the variance is compressed close to it)
+    size_t end = g.saturated && peak > 0 ? peak : peak + 1;
+    double sum_s2 = 0;
+    double sum_sv = 0;
+    for (size_t i = 0; i < end && i < points.size(); i++)
+    {
+        if (points[i].signal <= 0 || points[i].shot_variance <= 0) continue;
+        sum_s2 += points[i].signal * points[i].signal;
+        sum_sv += points[i].signal * points[i].shot_variance;
+    }
+    if (sum_sv <= 0)
+    {
+        std::ostringstream s;
+        s << "photon transfer curve (gain " << gain
+          << "): not enough signal to fit (is the sensor illuminated ?)";
+        throw std::runtime_error(s.str());
+    }
+    g.elec_per_adu = sum_s2 / sum_sv;
+    g.read_noise_e = read_noise_adu * g.elec_per_adu;
+    g.full_well_e = points[peak].signal * g.elec_per_adu;
+    return g;
+}
+
+namespace
+{
+// restores the roi, exposure and gain of the camera when going out of
+// scope
+class Restore
+{
+public:
+    Restore(Camera& camera) : camera_(camera), roi_{camera.get_roi()}
+    {
+        std::map<std::string, Controllable> controls = camera.get_controls();
+        exposure_ = controls.at("Exposure");
+        gain_ = controls.at("Gain");
+    }
+
+    ~Restore()
+    {
+        try
+        {
+            camera_.set_roi(roi_);
+            restore(exposure_);
+            restore(gain_);
+        }
+        catch (...)
+        {
+        }
+    }
+
+private:
+    void restore(const Controllable& control)
+    {
+        if (control.is_auto)
+            camera_.set_auto(control.name);
+        else
+            camera_.set_control(control.name, control.value);
+    }
+
+private:
+    Camera& camera_;
+    ROI roi_;
+    Controllable exposure_;
+    Controllable gain_;
+};
+}  // namespace
+
+PtcProfile characterize(Camera& camera,
+                        const PtcOptions& options,
+                        std::function<void()> on_flats)
+{
+    const CameraInfo& info = camera.get_info();
+    std::map<std::string, Controllable> controls = camera.get_controls();
+    if (controls.find("Exposure") == controls.end() ||
+        controls.find("Gain") == controls.end())
+    {
+        throw std::runtime_error(
+            "photon transfer curve: exposure and gain controls required");
+    }
+    std::vector<long> gains = options.gains;
+    if (gains.empty()) gains.push_back(controls["Gain"].value);
+    long offset =
+        controls.count("Offset") > 0 ? controls["Offset"].value : 0;
+    long bias_exposure_us = std::max(controls["Exposure"].min_value, 1L);
+
+    Restore restore(camera);
+    ROI roi = camera.get_roi();
+    if (info.supported_image_types.count(ImageType::raw16) > 0)
+    {
+        roi.type = ImageType::raw16;
+        camera.set_roi(roi);
+    }
+    // raw16 values are left aligned, 8 bits values are the most
+    // significant bits
+    double to_adu = roi.type == ImageType::raw16
+                        ? 1. / (1 << (16 - info.bit_depth))
+                        : (1 << std::max(info.bit_depth - 8, 0));
+    double to_adu2 = to_adu * to_adu;
+    Frame a(roi.width, roi.height, roi.type);
+    Frame b(roi.width, roi.height, roi.type);
+    auto capture_pair = [&](long exposure_us, long gain) {
+        camera.set_exposure_and_gain(exposure_us, gain);
+        camera.capture(a);
+        camera.capture(b);
+        return compute_pair_statistics(a, b, options.region);
+    };
+
+    std::vector<double> bias(gains.size());
+    std::vector<double> read_noise_variance(gains.size());
+    for (size_t i = 0; i < gains.size(); i++)
+    {
+        PairStatistics stats = capture_pair(bias_exposure_us, gains[i]);
+        bias[i] = stats.mean * to_adu;
+        read_noise_variance[i] = stats.difference_variance / 2. * to_adu2;
+    }
+
+    if (on_flats) on_flats();
+
+    PtcProfile profile;
+    profile.camera_model = info.name;
+    profile.serial = camera.get_serial();
+    for (size_t i = 0; i < gains.size(); i++)
+    {
+        std::vector<PtcPoint> points;
+        for (long exposure_us : options.exposures_us)
+        {
+            PairStatistics stats = capture_pair(exposure_us, gains[i]);
+            PtcPoint point;
+            point.exposure_us = exposure_us;
+            point.signal = stats.mean * to_adu - bias[i];
+            point.shot_variance = stats.difference_variance / 2. * to_adu2 -
+                                  read_noise_variance[i];
+            points.push_back(point);
+        }
+        GainCharacterization g = fit_ptc(
+            gains[i], bias[i], std::sqrt(read_noise_variance[i]), points);
+        g.offset = offset;
+        profile.gains.push_back(g);
+    }
+    return profile;
+}
+
+}  // namespace zwo_asi
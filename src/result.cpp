@@ -0,0 +1,107 @@
+#include "zwo_asi/result.hpp"
+
+namespace zwo_asi
+{
+const char* get_error_name(ASI_ERROR_CODE error_code) noexcept
+{
+    switch (error_code)
+    {
+        case ASI_SUCCESS:
+            return "ASI_SUCCESS";
+        case ASI_ERROR_INVALID_INDEX:
+            return "ASI_ERROR_INVALID_INDEX";
+        case ASI_ERROR_INVALID_ID:
+            return "ASI_ERROR_INVALID_ID";
+        case ASI_ERROR_INVALID_CONTROL_TYPE:
+            return "ASI_ERROR_INVALID_CONTROL_TYPE";
+        case ASI_ERROR_CAMERA_CLOSED:
+            return "ASI_ERROR_CAMERA_CLOSED";
+        case ASI_ERROR_CAMERA_REMOVED:
+            return "ASI_ERROR_CAMERA_REMOVED";
+        case ASI_ERROR_INVALID_PATH:
+            return "ASI_ERROR_INVALID_PATH";
+        case ASI_ERROR_INVALID_FILEFORMAT:
+            return "ASI_ERROR_INVALID_FILEFORMAT";
+        case ASI_ERROR_INVALID_SIZE:
+            return "ASI_ERROR_INVALID_SIZE";
+        case ASI_ERROR_INVALID_IMGTYPE:
+            return "ASI_ERROR_INVALID_IMGTYPE";
+        case ASI_ERROR_OUTOF_BOUNDARY:
+            return "ASI_ERROR_OUTOF_BOUNDARY";
+        case ASI_ERROR_TIMEOUT:
+            return "ASI_ERROR_TIMEOUT";
+        case ASI_ERROR_INVALID_SEQUENCE:
+            return "ASI_ERROR_INVALID_SEQUENCE";
+        case ASI_ERROR_BUFFER_TOO_SMALL:
+            return "ASI_ERROR_BUFFER_TOO_SMALL";
+        case ASI_ERROR_VIDEO_MODE_ACTIVE:
+            return "ASI_ERROR_VIDEO_MODE_ACTIVE";
+        case ASI_ERROR_EXPOSURE_IN_PROGRESS:
+            return "ASI_ERROR_EXPOSURE_IN_PROGRESS";
+        case ASI_ERROR_GENERAL_ERROR:
+            return "ASI_ERROR_GENERAL_ERROR";
+        default:
+            return "unknown error";
+    }
+}
+
+ResultCode get_result_code(ASI_ERROR_CODE error_code) noexcept
+{
+    switch (error_code)
+    {
+        case ASI_SUCCESS:
+            return ResultCode::ok;
+        case ASI_ERROR_TIMEOUT:
+            return ResultCode::timeout;
+        case ASI_ERROR_CAMERA_CLOSED:
+        case ASI_ERROR_CAMERA_REMOVED:
+            return ResultCode::disconnected;
+        case ASI_ERROR_VIDEO_MODE_ACTIVE:
+        case ASI_ERROR_EXPOSURE_IN_PROGRESS:
+        case ASI_ERROR_INVALID_SEQUENCE:
+            return ResultCode::busy;
+        case ASI_ERROR_INVALID_INDEX:
+        case ASI_ERROR_INVALID_ID:
+        case ASI_ERROR_INVALID_CONTROL_TYPE:
+        case ASI_ERROR_INVALID_PATH:
+        case ASI_ERROR_INVALID_FILEFORMAT:
+        case ASI_ERROR_INVALID_SIZE:
+        case ASI_ERROR_INVALID_IMGTYPE:
+        case ASI_ERROR_OUTOF_BOUNDARY:
+        case ASI_ERROR_BUFFER_TOO_SMALL:
+            return ResultCode::invalid;
+        default:
+            return ResultCode::failed;
+    }
+}
+
+Result::Result() noexcept
+    : code{ResultCode::ok}, error_code{ASI_SUCCESS}, message{nullptr}
+{
+}
+
+Result::Result(ASI_ERROR_CODE error_code, const char* message) noexcept
+    : code{get_result_code(error_code)},
+      error_code{error_code},
+      message{error_code == ASI_SUCCESS ? nullptr : message}
+{
+}
+
+Result::Result(ResultCode code,
+               ASI_ERROR_CODE error_code,
+               const char* message) noexcept
+    : code{code}, error_code{error_code}, message{message}
+{
+}
+
+bool Result::ok() const noexcept
+{
+    return code == ResultCode::ok;
+}
+
+Result::operator bool() const noexcept
+{
+    return ok();
+}
+
+}  // namespace zwo_asi
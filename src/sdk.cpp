@@ -0,0 +1,237 @@
+#include "zwo_asi/sdk.hpp"
+#include <mutex>
+#include "zwo_asi/camera_registry.hpp"
+
+namespace zwo_asi
+{
+Sdk::~Sdk()
+{
+}
+
+int NativeSdk::GetNumOfConnectedCameras()
+{
+    return ASIGetNumOfConnectedCameras();
+}
+
+ASI_ERROR_CODE NativeSdk::GetCameraProperty(ASI_CAMERA_INFO* info,
+                                            int camera_index)
+{
+    return ASIGetCameraProperty(info, camera_index);
+}
+
+ASI_ERROR_CODE NativeSdk::OpenCamera(int camera_id)
+{
+    return ASIOpenCamera(camera_id);
+}
+
+ASI_ERROR_CODE NativeSdk::InitCamera(int camera_id)
+{
+    return ASIInitCamera(camera_id);
+}
+
+ASI_ERROR_CODE NativeSdk::CloseCamera(int camera_id)
+{
+    return ASICloseCamera(camera_id);
+}
+
+ASI_ERROR_CODE NativeSdk::GetNumOfControls(int camera_id, int* nb_controls)
+{
+    return ASIGetNumOfControls(camera_id, nb_controls);
+}
+
+ASI_ERROR_CODE NativeSdk::GetControlCaps(int camera_id,
+                                         int control_index,
+                                         ASI_CONTROL_CAPS* caps)
+{
+    return ASIGetControlCaps(camera_id, control_index, caps);
+}
+
+ASI_ERROR_CODE NativeSdk::GetControlValue(int camera_id,
+                                          ASI_CONTROL_TYPE control,
+                                          long* value,
+                                          ASI_BOOL* is_auto)
+{
+    return ASIGetControlValue(camera_id, control, value, is_auto);
+}
+
+ASI_ERROR_CODE NativeSdk::SetControlValue(int camera_id,
+                                          ASI_CONTROL_TYPE control,
+                                          long value,
+                                          ASI_BOOL is_auto)
+{
+    return ASISetControlValue(camera_id, control, value, is_auto);
+}
+
+ASI_ERROR_CODE NativeSdk::SetROIFormat(int camera_id,
+                                       int width,
+                                       int height,
+                                       int bin,
+                                       ASI_IMG_TYPE type)
+{
+    return ASISetROIFormat(camera_id, width, height, bin, type);
+}
+
+ASI_ERROR_CODE NativeSdk::GetROIFormat(int camera_id,
+                                       int* width,
+                                       int* height,
+                                       int* bin,
+                                       ASI_IMG_TYPE* type)
+{
+    return ASIGetROIFormat(camera_id, width, height, bin, type);
+}
+
+ASI_ERROR_CODE NativeSdk::SetStartPos(int camera_id, int start_x, int start_y)
+{
+    return ASISetStartPos(camera_id, start_x, start_y);
+}
+
+ASI_ERROR_CODE NativeSdk::GetStartPos(int camera_id, int* start_x, int* start_y)
+{
+    return ASIGetStartPos(camera_id, start_x, start_y);
+}
+
+ASI_ERROR_CODE NativeSdk::GetDroppedFrames(int camera_id, int* dropped_frames)
+{
+    return ASIGetDroppedFrames(camera_id, dropped_frames);
+}
+
+ASI_ERROR_CODE NativeSdk::EnableDarkSubtract(int camera_id, char* bmp_path)
+{
+    return ASIEnableDarkSubtract(camera_id, bmp_path);
+}
+
+ASI_ERROR_CODE NativeSdk::DisableDarkSubtract(int camera_id)
+{
+    return ASIDisableDarkSubtract(camera_id);
+}
+
+ASI_ERROR_CODE NativeSdk::StartVideoCapture(int camera_id)
+{
+    return ASIStartVideoCapture(camera_id);
+}
+
+ASI_ERROR_CODE NativeSdk::StopVideoCapture(int camera_id)
+{
+    return ASIStopVideoCapture(camera_id);
+}
+
+ASI_ERROR_CODE NativeSdk::GetVideoData(int camera_id,
+                                       unsigned char* buffer,
+                                       long buffer_size,
+                                       int wait_ms)
+{
+    return ASIGetVideoData(camera_id, buffer, buffer_size, wait_ms);
+}
+
+ASI_ERROR_CODE NativeSdk::PulseGuideOn(int camera_id,
+                                       ASI_GUIDE_DIRECTION direction)
+{
+    return ASIPulseGuideOn(camera_id, direction);
+}
+
+ASI_ERROR_CODE NativeSdk::PulseGuideOff(int camera_id,
+                                        ASI_GUIDE_DIRECTION direction)
+{
+    return ASIPulseGuideOff(camera_id, direction);
+}
+
+ASI_ERROR_CODE NativeSdk::StartExposure(int camera_id, ASI_BOOL is_dark)
+{
+    return ASIStartExposure(camera_id, is_dark);
+}
+
+ASI_ERROR_CODE NativeSdk::StopExposure(int camera_id)
+{
+    return ASIStopExposure(camera_id);
+}
+
+ASI_ERROR_CODE NativeSdk::GetExpStatus(int camera_id,
+                                       ASI_EXPOSURE_STATUS* status)
+{
+    return ASIGetExpStatus(camera_id, status);
+}
+
+ASI_ERROR_CODE NativeSdk::GetDataAfterExp(int camera_id,
+                                          unsigned char* buffer,
+                                          long buffer_size)
+{
+    return ASIGetDataAfterExp(camera_id, buffer, buffer_size);
+}
+
+ASI_ERROR_CODE NativeSdk::GetID(int camera_id, ASI_ID* id)
+{
+    return ASIGetID(camera_id, id);
+}
+
+ASI_ERROR_CODE NativeSdk::SetID(int camera_id, ASI_ID id)
+{
+    return ASISetID(camera_id, id);
+}
+
+ASI_ERROR_CODE NativeSdk::GetGainOffset(int camera_id,
+                                        int* offset_highest_dr,
+                                        int* offset_unity_gain,
+                                        int* gain_lowest_rn,
+                                        int* offset_lowest_rn)
+{
+    return ASIGetGainOffset(camera_id,
+                            offset_highest_dr,
+                            offset_unity_gain,
+                            gain_lowest_rn,
+                            offset_lowest_rn);
+}
+
+const char* NativeSdk::GetSDKVersion()
+{
+    return ASIGetSDKVersion();
+}
+
+ASI_ERROR_CODE NativeSdk::GetCameraMode(int camera_id, ASI_CAMERA_MODE* mode)
+{
+    return ASIGetCameraMode(camera_id, mode);
+}
+
+ASI_ERROR_CODE NativeSdk::SetCameraMode(int camera_id, ASI_CAMERA_MODE mode)
+{
+    return ASISetCameraMode(camera_id, mode);
+}
+
+ASI_ERROR_CODE NativeSdk::SendSoftTrigger(int camera_id, ASI_BOOL start)
+{
+    return ASISendSoftTrigger(camera_id, start);
+}
+
+ASI_ERROR_CODE NativeSdk::GetSerialNumber(int camera_id, ASI_SN* sn)
+{
+    return ASIGetSerialNumber(camera_id, sn);
+}
+
+static std::mutex sdk_mutex;
+
+static std::shared_ptr<Sdk>& sdk_instance()
+{
+    static std::shared_ptr<Sdk> sdk = std::make_shared<NativeSdk>();
+    return sdk;
+}
+
+std::shared_ptr<Sdk> get_sdk()
+{
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    return sdk_instance();
+}
+
+void set_sdk(std::shared_ptr<Sdk> sdk)
+{
+    if (!sdk)
+    {
+        sdk = std::make_shared<NativeSdk>();
+    }
+    {
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        // the previous sdk is destroyed (if no longer used) out of the lock
+        sdk_instance().swap(sdk);
+    }
+    CameraRegistry::instance().invalidate();
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,336 @@
+#include "zwo_asi/session.hpp"
+#include <cmath>
+#include <thread>
+#include "zwo_asi/camera_registry.hpp"
+
+namespace zwo_asi
+{
+// delay between two attempts at finding the camera again
+static const std::chrono::milliseconds RETRY_PERIOD(100);
+// added to the exposure (or frame period) for the delay after which a
+// video frame is late (readout and USB transfer)
+static const double FRAME_MARGIN_MS = 200;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start,
+                         std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+Session::Session(int camera_index,
+                 std::chrono::milliseconds recovery_timeout,
+                 int max_consecutive_timeouts)
+    : camera_{std::make_unique<Camera>(camera_index)},
+      camera_index_{camera_index},
+      recovery_timeout_{recovery_timeout},
+      max_consecutive_timeouts_{max_consecutive_timeouts},
+      consecutive_timeouts_{0},
+      video_{false},
+      nb_frames_{0},
+      frame_period_ms_{0},
+      waiting_since_{std::chrono::steady_clock::now()},
+      in_gap_{false}
+{
+    name_ = camera_->get_info().name;
+    try
+    {
+        serial_ = camera_->get_serial();
+    }
+    catch (const CameraException&)
+    {
+        // older cameras do not have a serial number, the camera
+        // will be searched by name
+    }
+    read_state();
+    metrics_.recoveries = 0;
+    metrics_.failed_recoveries = 0;
+    metrics_.timeouts = 0;
+    metrics_.last_recovery_ms = 0;
+    metrics_.max_recovery_ms = 0;
+    metrics_.total_recovery_ms = 0;
+    metrics_.last_gap_ms = 0;
+    metrics_.total_gap_ms = 0;
+    metrics_.lost_frames = 0;
+}
+
+void Session::read_state()
+{
+    roi_ = camera_->get_roi();
+    // only trigger cameras support other modes than normal
+    mode_ = CameraMode::normal;
+    if (camera_->get_info().is_trigger)
+    {
+        mode_ = camera_->get_camera_mode();
+    }
+    controls_.clear();
+    for (const auto& control : camera_->get_controls())
+    {
+        if (!control.second.is_writable) continue;
+        controls_[control.first] =
+            ControlState{control.second.value, control.second.is_auto};
+    }
+}
+
+bool Session::is_fault(ASI_ERROR_CODE error_code)
+{
+    switch (error_code)
+    {
+        case ASI_ERROR_CAMERA_REMOVED:
+        case ASI_ERROR_CAMERA_CLOSED:
+        case ASI_ERROR_INVALID_ID:
+        case ASI_ERROR_INVALID_INDEX:
+            return true;
+        default:
+            return false;
+    }
+}
+
+template <typename F>
+auto Session::run(F function) -> decltype(function())
+{
+    if (!camera_) recover();
+    try
+    {
+        return function();
+    }
+    catch (const CameraException& e)
+    {
+        if (!is_fault(e.get_error_code())) throw;
+    }
+    recover();
+    return function();
+}
+
+Camera& Session::get_camera()
+{
+    if (!camera_) recover();
+    return *camera_;
+}
+
+void Session::set_roi(const ROI& roi)
+{
+    run([this, &roi]() { camera_->set_roi(roi); });
+    roi_ = roi;
+}
+
+void Session::set_control(std::string control, long value)
+{
+    run([this, &control, value]() { camera_->set_control(control, value); });
+    controls_[control] = ControlState{value, false};
+}
+
+void Session::set_auto(std::string control)
+{
+    run([this, &control]() { camera_->set_auto(control); });
+    controls_[control].is_auto = true;
+}
+
+void Session::set_exposure_and_gain(long exposure_us, long gain)
+{
+    run([this, exposure_us, gain]() {
+        camera_->set_exposure_and_gain(exposure_us, gain);
+    });
+    controls_["Exposure"] = ControlState{exposure_us, false};
+    controls_["Gain"] = ControlState{gain, false};
+}
+
+void Session::set_camera_mode(CameraMode mode)
+{
+    run([this, mode]() { camera_->set_camera_mode(mode); });
+    mode_ = mode;
+}
+
+void Session::capture(Frame& frame)
+{
+    run([this, &frame]() { camera_->capture(frame); });
+    frame.index = nb_frames_++;
+    frame_received();
+}
+
+void Session::start_video()
+{
+    run([this]() { camera_->start_video(); });
+    video_ = true;
+    consecutive_timeouts_ = 0;
+    waiting_since_ = std::chrono::steady_clock::now();
+}
+
+void Session::stop_video()
+{
+    video_ = false;
+    run([this]() { camera_->stop_video(); });
+}
+
+bool Session::get_video_frame(Frame& frame, int wait_ms)
+{
+    if (!camera_) recover();
+    // timeouts are expected while streaming: using the non throwing
+    // api rather than run
+    Result result = camera_->try_get_video_frame(frame, wait_ms);
+    if (!result && is_fault(result.error_code))
+    {
+        recover();
+        result = camera_->try_get_video_frame(frame, wait_ms);
+    }
+    if (result.code == ResultCode::timeout)
+    {
+        metrics_.timeouts++;
+        // wait_ms may be shorter than the exposure: only the timeouts
+        // once a frame is late are counted, once per expected frame
+        // interval
+        std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        if (elapsed_ms(waiting_since_, now) >= get_frame_interval_ms())
+        {
+            waiting_since_ = now;
+            if (++consecutive_timeouts_ >= max_consecutive_timeouts_)
+            {
+                // the camera is likely stalled without being reported
+                // as removed
+                recover();
+            }
+        }
+        return false;
+    }
+    if (!result)
+    {
+        throw CameraException(
+            result.message, camera_index_, result.error_code);
+    }
+    consecutive_timeouts_ = 0;
+    frame.index = nb_frames_++;
+    frame_received();
+    return true;
+}
+
+void Session::frame_received()
+{
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    if (nb_frames_ > 1)
+    {
+        double interval = elapsed_ms(last_frame_, now);
+        if (in_gap_)
+        {
+            // gap in the data due to the fault: frames that would have
+            // been received at the usual rate are considered lost
+            metrics_.last_gap_ms = interval;
+            metrics_.total_gap_ms += interval;
+            if (frame_period_ms_ > 0)
+            {
+                metrics_.lost_frames += std::max(
+                    0L, std::lround(interval / frame_period_ms_) - 1);
+            }
+            in_gap_ = false;
+        }
+        else if (frame_period_ms_ == 0)
+        {
+            frame_period_ms_ = interval;
+        }
+        else
+        {
+            frame_period_ms_ = 0.9 * frame_period_ms_ + 0.1 * interval;
+        }
+    }
+    last_frame_ = now;
+    waiting_since_ = now;
+}
+
+double Session::get_frame_interval_ms() const
+{
+    double exposure_ms = 0;
+    auto exposure = controls_.find("Exposure");
+    if (exposure != controls_.end())
+    {
+        exposure_ms = exposure->second.value / 1000.0;
+    }
+    return std::max(exposure_ms, frame_period_ms_) + FRAME_MARGIN_MS;
+}
+
+void Session::replay()
+{
+    if (camera_->get_info().is_trigger)
+    {
+        camera_->set_camera_mode(mode_);
+    }
+    camera_->set_roi(roi_);
+    for (const auto& control : controls_)
+    {
+        if (control.second.is_auto)
+            camera_->set_auto(control.first);
+        else
+            camera_->set_control(control.first, control.second.value);
+    }
+    if (video_)
+    {
+        camera_->start_video();
+    }
+}
+
+void Session::recover()
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = start + recovery_timeout_;
+    if (nb_frames_ > 0) in_gap_ = true;
+    consecutive_timeouts_ = 0;
+
+    // closing (errors are ignored by the destructor, the camera
+    // is likely gone)
+    camera_.reset();
+
+    CameraRegistry& registry = CameraRegistry::instance();
+    while (true)
+    {
+        try
+        {
+            // the camera may have been removed and plugged again since
+            // the last enumeration
+            registry.refresh();
+            if (serial_.empty())
+            {
+                int index = registry.find_by_name(name_);
+                if (index >= 0) camera_ = std::make_unique<Camera>(index);
+            }
+            else if (registry.find_by_serial(serial_) >= 0)
+            {
+                // checks the serial number of the opened camera
+                camera_ = Camera::open_by_serial(serial_);
+            }
+            if (camera_)
+            {
+                replay();
+                camera_index_ = camera_->get_index();
+                break;
+            }
+        }
+        catch (const std::exception&)
+        {
+            camera_.reset();
+        }
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            metrics_.failed_recoveries++;
+            throw CameraException("failed to recover the camera",
+                                  camera_index_,
+                                  ASI_ERROR_CAMERA_REMOVED);
+        }
+        std::this_thread::sleep_for(RETRY_PERIOD);
+    }
+
+    std::chrono::steady_clock::time_point end =
+        std::chrono::steady_clock::now();
+    waiting_since_ = end;
+    double duration = elapsed_ms(start, end);
+    metrics_.recoveries++;
+    metrics_.last_recovery_ms = duration;
+    metrics_.total_recovery_ms += duration;
+    metrics_.max_recovery_ms = std::max(metrics_.max_recovery_ms, duration);
+}
+
+RecoveryMetrics Session::get_metrics() const
+{
+    return metrics_;
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,818 @@
+#include "zwo_asi/simulated_sdk.hpp"
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include "zwo_asi/diagnostics.hpp"
+
+namespace zwo_asi
+{
+// electrons per ADU at gain 0
+static const double ELEC_PER_ADU = 4.0;
+// number of frames the video mode buffers before dropping
+static const int VIDEO_BUFFER = 2;
+
+static ASI_CONTROL_CAPS make_caps(const char* name,
+                                  ASI_CONTROL_TYPE type,
+                                  long min_value,
+                                  long max_value,
+                                  long default_value,
+                                  bool supports_auto,
+                                  bool writable)
+{
+    ASI_CONTROL_CAPS caps;
+    std::memset(&caps, 0, sizeof(caps));
+    std::strncpy(caps.Name, name, sizeof(caps.Name) - 1);
+    std::strncpy(caps.Description, name, sizeof(caps.Description) - 1);
+    caps.MinValue = min_value;
+    caps.MaxValue = max_value;
+    caps.DefaultValue = default_value;
+    caps.IsAutoSupported = supports_auto ? ASI_TRUE : ASI_FALSE;
+    caps.IsWritable = writable ? ASI_TRUE : ASI_FALSE;
+    caps.ControlType = type;
+    return caps;
+}
+
+// xorshift64*
+static inline unsigned long long next_random(unsigned long long& state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+// approximation of a standard normal sample: sum of 4 uniform
+// samples (Irwin-Hall), centered and scaled to unit variance
+static inline double normal_random(unsigned long long& state)
+{
+    unsigned long long r = next_random(state);
+    double sum = (r & 0xffff) + ((r >> 16) & 0xffff) + ((r >> 32) & 0xffff) +
+                 ((r >> 48) & 0xffff);
+    return (sum / 65536. - 2.) * 1.7320508075688772;
+}
+
+SimulatedSdk::SimulatedSdk(int nb_cameras,
+                           std::string name,
+                           int max_width,
+                           int max_height,
+                           bool usb3,
+                           bool color)
+    : flux_{2000.}, read_noise_{3.}, full_well_{16000.}
+{
+    for (int index = 0; index < nb_cameras; index++)
+    {
+        SimulatedCamera camera;
+        ASI_CAMERA_INFO& info = camera.info;
+        std::memset(&info, 0, sizeof(info));
+        std::strncpy(info.Name, name.c_str(), sizeof(info.Name) - 1);
+        info.CameraID = index;
+        info.MaxWidth = max_width;
+        info.MaxHeight = max_height;
+        info.IsColorCam = color ? ASI_TRUE : ASI_FALSE;
+        info.BayerPattern = ASI_BAYER_RG;
+        info.SupportedBins[0] = 1;
+        info.SupportedBins[1] = 2;
+        info.SupportedBins[2] = 4;
+        // mono cameras have no rgb24 format
+        int nb_formats = 0;
+        info.SupportedVideoFormat[nb_formats++] = ASI_IMG_RAW8;
+        if (color) info.SupportedVideoFormat[nb_formats++] = ASI_IMG_RGB24;
+        info.SupportedVideoFormat[nb_formats++] = ASI_IMG_RAW16;
+        info.SupportedVideoFormat[nb_formats++] = ASI_IMG_Y8;
+        info.SupportedVideoFormat[nb_formats] = ASI_IMG_END;
+        info.PixelSize = 3.75;
+        info.MechanicalShutter = ASI_FALSE;
+        info.ST4Port = ASI_TRUE;
+        info.IsCoolerCam = ASI_FALSE;
+        info.IsUSB3Host = usb3 ? ASI_TRUE : ASI_FALSE;
+        info.IsUSB3Camera = usb3 ? ASI_TRUE : ASI_FALSE;
+        info.ElecPerADU = ELEC_PER_ADU;
+        info.BitDepth = 12;
+        info.IsTriggerCam = ASI_FALSE;
+
+        for (int i = 0; i < 8; i++)
+        {
+            camera.serial.id[i] =
+                static_cast<unsigned char>(0x10 * (i + 1) + index);
+            camera.id.id[i] = 0;
+        }
+
+        camera.caps.push_back(
+            make_caps("Gain", ASI_GAIN, 0, 600, 200, true, true));
+        camera.caps.push_back(make_caps(
+            "Exposure", ASI_EXPOSURE, 32, 2000000000, 10000, true, true));
+        camera.caps.push_back(
+            make_caps("Offset", ASI_OFFSET, 0, 80, 8, false, true));
+        camera.caps.push_back(make_caps(
+            "BandWidth", ASI_BANDWIDTHOVERLOAD, 40, 100, 50, true, true));
+        camera.caps.push_back(
+            make_caps("Flip", ASI_FLIP, 0, 3, 0, false, true));
+        camera.caps.push_back(make_caps(
+            "AutoExpMaxGain", ASI_AUTO_MAX_GAIN, 0, 600, 300, false, true));
+        camera.caps.push_back(make_caps(
+            "AutoExpMaxExpMS", ASI_AUTO_MAX_EXP, 1, 60000, 30000, false, true));
+        camera.caps.push_back(make_caps("AutoExpTargetBrightness",
+                                        ASI_AUTO_TARGET_BRIGHTNESS,
+                                        50,
+                                        160,
+                                        100,
+                                        false,
+                                        true));
+        camera.caps.push_back(make_caps(
+            "HighSpeedMode", ASI_HIGH_SPEED_MODE, 0, 1, 0, false, true));
+        camera.caps.push_back(make_caps(
+            "Temperature", ASI_TEMPERATURE, -500, 1000, 200, false, false));
+        camera.caps.push_back(
+            make_caps("WB_R", ASI_WB_R, 1, 99, 52, true, true));
+        camera.caps.push_back(
+            make_caps("WB_B", ASI_WB_B, 1, 99, 95, true, true));
+        for (const ASI_CONTROL_CAPS& caps : camera.caps)
+        {
+            camera.values[caps.ControlType] = caps.DefaultValue;
+            camera.is_auto[caps.ControlType] = false;
+        }
+
+        camera.connected = true;
+        camera.reconnect_at = clock::time_point::max();
+        camera.opened = false;
+        camera.initialized = false;
+        camera.width = max_width;
+        camera.height = max_height;
+        camera.bin = 1;
+        camera.type = ASI_IMG_RAW8;
+        camera.start_x = 0;
+        camera.start_y = 0;
+        camera.mode = ASI_MODE_NORMAL;
+        camera.status = ASI_EXP_IDLE;
+        camera.dark = false;
+        camera.video = false;
+        camera.buffered = 0;
+        camera.dropped = 0;
+        camera.timeouts = 0;
+        camera.seed = 0x9E3779B97F4A7C15ULL + index;
+        cameras_.push_back(camera);
+    }
+}
+
+void SimulatedSdk::disconnect(int camera_id,
+                              std::chrono::milliseconds duration)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    SimulatedCamera& camera = cameras_.at(camera_id);
+    camera.connected = false;
+    camera.opened = false;
+    camera.initialized = false;
+    camera.video = false;
+    camera.status = ASI_EXP_IDLE;
+    if (duration.count() > 0)
+    {
+        camera.reconnect_at = clock::now() + duration;
+    }
+    else
+    {
+        camera.reconnect_at = clock::time_point::max();
+    }
+}
+
+void SimulatedSdk::reconnect(int camera_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    SimulatedCamera& camera = cameras_.at(camera_id);
+    camera.connected = true;
+    camera.reconnect_at = clock::time_point::max();
+}
+
+void SimulatedSdk::inject_timeouts(int camera_id, int nb_calls)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    cameras_.at(camera_id).timeouts = nb_calls;
+}
+
+void SimulatedSdk::swap(int camera_id_a, int camera_id_b)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(cameras_.at(camera_id_a), cameras_.at(camera_id_b));
+    cameras_[camera_id_a].info.CameraID = camera_id_a;
+    cameras_[camera_id_b].info.CameraID = camera_id_b;
+}
+
+void SimulatedSdk::set_flux(double electrons_per_second)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    flux_ = electrons_per_second;
+}
+
+void SimulatedSdk::set_read_noise(double electrons)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    read_noise_ = electrons;
+}
+
+void SimulatedSdk::set_full_well(double electrons)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    full_well_ = electrons;
+}
+
+SimulatedSdk::SimulatedCamera* SimulatedSdk::find(int camera_id,
+                                                  ASI_ERROR_CODE& error,
+                                                  bool must_be_opened)
+{
+    if (camera_id < 0 || static_cast<size_t>(camera_id) >= cameras_.size())
+    {
+        error = ASI_ERROR_INVALID_ID;
+        return nullptr;
+    }
+    SimulatedCamera& camera = cameras_[camera_id];
+    if (!camera.connected && clock::now() >= camera.reconnect_at)
+    {
+        camera.connected = true;
+        camera.reconnect_at = clock::time_point::max();
+    }
+    if (!camera.connected)
+    {
+        error = ASI_ERROR_CAMERA_REMOVED;
+        return nullptr;
+    }
+    if (must_be_opened && !camera.opened)
+    {
+        error = ASI_ERROR_CAMERA_CLOSED;
+        return nullptr;
+    }
+    error = ASI_SUCCESS;
+    return &camera;
+}
+
+long SimulatedSdk::frame_size(const SimulatedCamera& camera) const
+{
+    long pixels = static_cast<long>(camera.width) * camera.height;
+    switch (camera.type)
+    {
+        case ASI_IMG_RAW16:
+            return pixels * 2;
+        case ASI_IMG_RGB24:
+            return pixels * 3;
+        default:
+            return pixels;
+    }
+}
+
+double SimulatedSdk::frame_period_us(const SimulatedCamera& camera) const
+{
+    double throughput = get_usb_throughput(
+        camera.info.IsUSB3Host == ASI_TRUE &&
+        camera.info.IsUSB3Camera == ASI_TRUE);
+    throughput *= camera.values.at(ASI_BANDWIDTHOVERLOAD) / 100.;
+    double transfer_us = frame_size(camera) / throughput;
+    double exposure_us = camera.values.at(ASI_EXPOSURE);
+    return std::max(exposure_us, transfer_us);
+}
+
+void SimulatedSdk::generate(SimulatedCamera& camera,
+                            unsigned char* buffer,
+                            bool dark)
+{
+    double exposure_s = camera.values.at(ASI_EXPOSURE) / 1e6;
+    // gain in 0.1 dB
+    double elec_per_adu =
+        ELEC_PER_ADU * std::pow(10., -camera.values.at(ASI_GAIN) / 200.);
+    long offset = camera.values.at(ASI_OFFSET);
+    int bit_depth = camera.info.BitDepth;
+    double max_adu = (1 << bit_depth) - 1;
+    double bin_area = camera.bin * camera.bin;
+    double full_well = full_well_ * bin_area;
+    double read_noise = read_noise_ * std::sqrt(bin_area);
+    int w = camera.width;
+    int h = camera.height;
+    double norm = 1. / (w + h);
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            // gradient over the sensor, from 50% to 100% of the flux
+            double mean = dark ? 0. : flux_ * bin_area * exposure_s *
+                                          (0.5 + 0.5 * (x + y) * norm);
+            double electrons = mean +
+                               std::sqrt(mean) * normal_random(camera.seed) +
+                               read_noise * normal_random(camera.seed);
+            electrons = std::min(std::max(electrons, 0.), full_well);
+            double adu = std::min(electrons / elec_per_adu + offset, max_adu);
+            unsigned int value = static_cast<unsigned int>(adu + 0.5);
+            long index = static_cast<long>(y) * w + x;
+            switch (camera.type)
+            {
+                case ASI_IMG_RAW16:
+                    reinterpret_cast<uint16_t*>(buffer)[index] =
+                        value << (16 - bit_depth);
+                    break;
+                case ASI_IMG_RGB24:
+                    buffer[3 * index] = value >> (bit_depth - 8);
+                    buffer[3 * index + 1] = value >> (bit_depth - 8);
+                    buffer[3 * index + 2] = value >> (bit_depth - 8);
+                    break;
+                default:
+                    buffer[index] = value >> (bit_depth - 8);
+                    break;
+            }
+        }
+    }
+}
+
+int SimulatedSdk::GetNumOfConnectedCameras()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int nb_cameras = 0;
+    ASI_ERROR_CODE error;
+    for (size_t camera_id = 0; camera_id < cameras_.size(); camera_id++)
+    {
+        find(camera_id, error, false);
+        if (error == ASI_SUCCESS) nb_cameras++;
+    }
+    return nb_cameras;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetCameraProperty(ASI_CAMERA_INFO* info,
+                                               int camera_index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int index = 0;
+    ASI_ERROR_CODE error;
+    for (size_t camera_id = 0; camera_id < cameras_.size(); camera_id++)
+    {
+        SimulatedCamera* camera = find(camera_id, error, false);
+        if (camera == nullptr) continue;
+        if (index == camera_index)
+        {
+            *info = camera->info;
+            return ASI_SUCCESS;
+        }
+        index++;
+    }
+    return ASI_ERROR_INVALID_INDEX;
+}
+
+ASI_ERROR_CODE SimulatedSdk::OpenCamera(int camera_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error, false);
+    if (camera == nullptr) return error;
+    camera->opened = true;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::InitCamera(int camera_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    camera->initialized = true;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::CloseCamera(int camera_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    camera->opened = false;
+    camera->initialized = false;
+    camera->video = false;
+    camera->status = ASI_EXP_IDLE;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetNumOfControls(int camera_id, int* nb_controls)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    *nb_controls = camera->caps.size();
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetControlCaps(int camera_id,
+                                            int control_index,
+                                            ASI_CONTROL_CAPS* caps)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    if (control_index < 0 ||
+        static_cast<size_t>(control_index) >= camera->caps.size())
+    {
+        return ASI_ERROR_INVALID_CONTROL_TYPE;
+    }
+    *caps = camera->caps[control_index];
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetControlValue(int camera_id,
+                                             ASI_CONTROL_TYPE control,
+                                             long* value,
+                                             ASI_BOOL* is_auto)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    auto it = camera->values.find(control);
+    if (it == camera->values.end()) return ASI_ERROR_INVALID_CONTROL_TYPE;
+    *value = it->second;
+    *is_auto = camera->is_auto[control] ? ASI_TRUE : ASI_FALSE;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::SetControlValue(int camera_id,
+                                             ASI_CONTROL_TYPE control,
+                                             long value,
+                                             ASI_BOOL is_auto)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    for (const ASI_CONTROL_CAPS& caps : camera->caps)
+    {
+        if (caps.ControlType != control) continue;
+        if (caps.IsWritable != ASI_TRUE) return ASI_ERROR_GENERAL_ERROR;
+        if (is_auto == ASI_TRUE && caps.IsAutoSupported != ASI_TRUE)
+        {
+            return ASI_ERROR_GENERAL_ERROR;
+        }
+        // as the SDK, values out of range are clamped
+        camera->values[control] =
+            std::min(std::max(value, caps.MinValue), caps.MaxValue);
+        camera->is_auto[control] = is_auto == ASI_TRUE;
+        return ASI_SUCCESS;
+    }
+    return ASI_ERROR_INVALID_CONTROL_TYPE;
+}
+
+ASI_ERROR_CODE SimulatedSdk::SetROIFormat(
+    int camera_id, int width, int height, int bin, ASI_IMG_TYPE type)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    bool bin_supported = false;
+    for (int i = 0; i < 16 && camera->info.SupportedBins[i] != 0; i++)
+    {
+        if (camera->info.SupportedBins[i] == bin) bin_supported = true;
+    }
+    if (!bin_supported || width <= 0 || height <= 0 || width % 8 != 0 ||
+        height % 2 != 0 || width * bin > camera->info.MaxWidth ||
+        height * bin > camera->info.MaxHeight)
+    {
+        return ASI_ERROR_INVALID_SIZE;
+    }
+    bool type_supported = false;
+    const ASI_IMG_TYPE* formats = camera->info.SupportedVideoFormat;
+    for (int i = 0; i < 8 && formats[i] != ASI_IMG_END; i++)
+    {
+        if (formats[i] == type) type_supported = true;
+    }
+    if (!type_supported) return ASI_ERROR_INVALID_IMGTYPE;
+    camera->width = width;
+    camera->height = height;
+    camera->bin = bin;
+    camera->type = type;
+    // as the SDK, the ROI is centered
+    camera->start_x = (camera->info.MaxWidth / bin - width) / 2;
+    camera->start_y = (camera->info.MaxHeight / bin - height) / 2;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetROIFormat(
+    int camera_id, int* width, int* height, int* bin, ASI_IMG_TYPE* type)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    *width = camera->width;
+    *height = camera->height;
+    *bin = camera->bin;
+    *type = camera->type;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::SetStartPos(int camera_id,
+                                         int start_x,
+                                         int start_y)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    if (start_x < 0 || start_y < 0 ||
+        start_x + camera->width > camera->info.MaxWidth / camera->bin ||
+        start_y + camera->height > camera->info.MaxHeight / camera->bin)
+    {
+        return ASI_ERROR_OUTOF_BOUNDARY;
+    }
+    camera->start_x = start_x;
+    camera->start_y = start_y;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetStartPos(int camera_id,
+                                         int* start_x,
+                                         int* start_y)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    *start_x = camera->start_x;
+    *start_y = camera->start_y;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetDroppedFrames(int camera_id,
+                                              int* dropped_frames)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    *dropped_frames = camera->dropped;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::EnableDarkSubtract(int camera_id, char*)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::DisableDarkSubtract(int camera_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::StartVideoCapture(int camera_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    if (camera->status == ASI_EXP_WORKING)
+        return ASI_ERROR_EXPOSURE_IN_PROGRESS;
+    camera->video = true;
+    camera->next_frame_at =
+        clock::now() +
+        std::chrono::microseconds(static_cast<long>(frame_period_us(*camera)));
+    camera->buffered = 0;
+    camera->dropped = 0;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::StopVideoCapture(int camera_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    camera->video = false;
+    return ASI_SUCCESS;
+}
+
+void SimulatedSdk::produce(SimulatedCamera& camera)
+{
+    // frames completed since the last call are buffered, or dropped
+    // if the buffer is full
+    clock::time_point now = clock::now();
+    if (now < camera.next_frame_at) return;
+    double period_us = frame_period_us(camera);
+    long nb_frames =
+        1 + static_cast<long>(
+                std::chrono::duration<double, std::micro>(
+                    now - camera.next_frame_at)
+                    .count() /
+                period_us);
+    long buffered = std::min<long>(nb_frames, VIDEO_BUFFER - camera.buffered);
+    camera.buffered += buffered;
+    camera.dropped += nb_frames - buffered;
+    camera.next_frame_at += std::chrono::microseconds(
+        static_cast<long>(nb_frames * period_us));
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetVideoData(int camera_id,
+                                          unsigned char* buffer,
+                                          long buffer_size,
+                                          int wait_ms)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    if (!camera->video) return ASI_ERROR_INVALID_SEQUENCE;
+    if (buffer_size < frame_size(*camera)) return ASI_ERROR_BUFFER_TOO_SMALL;
+    if (camera->timeouts > 0)
+    {
+        camera->timeouts--;
+        return ASI_ERROR_TIMEOUT;
+    }
+    clock::time_point deadline =
+        wait_ms < 0 ? clock::time_point::max()
+                    : clock::now() + std::chrono::milliseconds(wait_ms);
+    produce(*camera);
+    while (camera->buffered == 0)
+    {
+        clock::time_point next = camera->next_frame_at;
+        if (next > deadline)
+        {
+            lock.unlock();
+            std::this_thread::sleep_until(deadline);
+            return ASI_ERROR_TIMEOUT;
+        }
+        lock.unlock();
+        std::this_thread::sleep_until(next);
+        lock.lock();
+        // the camera may have been stopped or disconnected meanwhile
+        camera = find(camera_id, error);
+        if (camera == nullptr) return error;
+        if (!camera->video) return ASI_ERROR_INVALID_SEQUENCE;
+        produce(*camera);
+    }
+    camera->buffered--;
+    generate(*camera, buffer, false);
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::PulseGuideOn(int camera_id,
+                                          ASI_GUIDE_DIRECTION)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    find(camera_id, error);
+    return error;
+}
+
+ASI_ERROR_CODE SimulatedSdk::PulseGuideOff(int camera_id,
+                                           ASI_GUIDE_DIRECTION)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    find(camera_id, error);
+    return error;
+}
+
+ASI_ERROR_CODE SimulatedSdk::StartExposure(int camera_id, ASI_BOOL is_dark)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    if (camera->video) return ASI_ERROR_VIDEO_MODE_ACTIVE;
+    if (camera->status == ASI_EXP_WORKING)
+        return ASI_ERROR_EXPOSURE_IN_PROGRESS;
+    camera->status = ASI_EXP_WORKING;
+    camera->dark = is_dark == ASI_TRUE;
+    camera->exposure_end =
+        clock::now() +
+        std::chrono::microseconds(static_cast<long>(frame_period_us(*camera)));
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::StopExposure(int camera_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    camera->status = ASI_EXP_IDLE;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetExpStatus(int camera_id,
+                                          ASI_EXPOSURE_STATUS* status)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    if (camera->status == ASI_EXP_WORKING &&
+        clock::now() >= camera->exposure_end)
+    {
+        camera->status = ASI_EXP_SUCCESS;
+    }
+    *status = camera->status;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetDataAfterExp(int camera_id,
+                                             unsigned char* buffer,
+                                             long buffer_size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    if (camera->status != ASI_EXP_SUCCESS) return ASI_ERROR_GENERAL_ERROR;
+    if (buffer_size < frame_size(*camera)) return ASI_ERROR_BUFFER_TOO_SMALL;
+    generate(*camera, buffer, camera->dark);
+    camera->status = ASI_EXP_IDLE;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetID(int camera_id, ASI_ID* id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    // as the SDK: ids are supported by USB3 cameras only
+    if (camera->info.IsUSB3Camera != ASI_TRUE) return ASI_ERROR_GENERAL_ERROR;
+    *id = camera->id;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::SetID(int camera_id, ASI_ID id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    // as the SDK: ids are supported by USB3 cameras only
+    if (camera->info.IsUSB3Camera != ASI_TRUE) return ASI_ERROR_GENERAL_ERROR;
+    camera->id = id;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetGainOffset(int camera_id,
+                                           int* offset_highest_dr,
+                                           int* offset_unity_gain,
+                                           int* gain_lowest_rn,
+                                           int* offset_lowest_rn)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    *offset_highest_dr = 5;
+    *offset_unity_gain = 8;
+    *gain_lowest_rn = 300;
+    *offset_lowest_rn = 20;
+    return ASI_SUCCESS;
+}
+
+const char* SimulatedSdk::GetSDKVersion()
+{
+    return "1, 24, simulated";
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetCameraMode(int camera_id,
+                                           ASI_CAMERA_MODE* mode)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    *mode = camera->mode;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::SetCameraMode(int camera_id,
+                                           ASI_CAMERA_MODE mode)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    camera->mode = mode;
+    return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE SimulatedSdk::SendSoftTrigger(int camera_id, ASI_BOOL)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    find(camera_id, error);
+    return error;
+}
+
+ASI_ERROR_CODE SimulatedSdk::GetSerialNumber(int camera_id, ASI_SN* sn)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ASI_ERROR_CODE error;
+    SimulatedCamera* camera = find(camera_id, error);
+    if (camera == nullptr) return error;
+    *sn = camera->serial;
+    return ASI_SUCCESS;
+}
+
+}  // namespace zwo_asi
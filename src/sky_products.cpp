@@ -0,0 +1,508 @@
+#include "zwo_asi/sky_products.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "zwo_asi/stages.hpp"
+
+namespace zwo_asi
+{
+// checkpoint format: magic, version, little endian 64 bits integers
+// (geometry, then counters), then the values in the byte order of the
+// host
+
+static const uint8_t FORMAT_VERSION = 1;
+
+static void write_i64(std::ostream& f, int64_t value)
+{
+    uint64_t v = static_cast<uint64_t>(value);
+    for (int i = 0; i < 8; i++) f.put(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+static int64_t read_i64(std::istream& f)
+{
+    unsigned char data[8];
+    if (!f.read(reinterpret_cast<char*>(data), 8))
+    {
+        throw std::runtime_error("truncated file");
+    }
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(data[i]) << (8 * i);
+    return static_cast<int64_t>(v);
+}
+
+// opens a temporary file next to path, and writes the header
+static std::ofstream create_checkpoint(const std::filesystem::path& tmp,
+                                       const char* magic,
+                                       int width,
+                                       int height,
+                                       ImageType type)
+{
+    std::ofstream f(tmp, std::ios::binary);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("failed to write " + tmp.string());
+    }
+    f.write(magic, 4);
+    f.put(FORMAT_VERSION);
+    write_i64(f, width);
+    write_i64(f, height);
+    write_i64(f, type);
+    return f;
+}
+
+// opens the file, and checks its header matches the geometry
+static std::ifstream open_checkpoint(const std::filesystem::path& path,
+                                     const char* magic,
+                                     int width,
+                                     int height,
+                                     ImageType type)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("failed to open " + path.string());
+    }
+    char header[5];
+    if (!f.read(header, 5) || std::memcmp(header, magic, 4) != 0 ||
+        header[4] != FORMAT_VERSION)
+    {
+        throw std::runtime_error("invalid file " + path.string());
+    }
+    try
+    {
+        if (read_i64(f) != width || read_i64(f) != height ||
+            read_i64(f) != type)
+        {
+            throw std::runtime_error("frames of a different size or type");
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        throw std::runtime_error(path.string() + ": " + e.what());
+    }
+    return f;
+}
+
+template <typename T>
+static void write_values(std::ostream& f, const std::vector<T>& values)
+{
+    f.write(reinterpret_cast<const char*>(values.data()),
+            values.size() * sizeof(T));
+}
+
+template <typename T>
+static void read_values(std::istream& f,
+                        std::vector<T>& values,
+                        const std::filesystem::path& path)
+{
+    if (!f.read(reinterpret_cast<char*>(values.data()),
+                values.size() * sizeof(T)))
+    {
+        throw std::runtime_error("truncated file " + path.string());
+    }
+}
+
+static double get_max_value(ImageType type)
+{
+    return type == ImageType::raw16 ? 65535. : 255.;
+}
+
+KeogramOptions::KeogramOptions()
+    : column{-1}, strip_width{1}, max_columns{2048}, checkpoint_interval{0}
+{
+}
+
+static const char KEOGRAM_MAGIC[4] = {'Z', 'A', 'K', 'G'};
+
+KeogramStage::KeogramStage(int width,
+                           int height,
+                           ImageType type,
+                           KeogramOptions options)
+    : width_{width},
+      height_{height},
+      type_{type},
+      options_{options},
+      channels_{type == ImageType::rgb24 ? 3 : 1},
+      column_size_{height * channels_},
+      frames_per_column_{1},
+      nb_frames_{0}
+{
+    if (options_.column < 0) options_.column = width / 2;
+    options_.strip_width = std::max(1, options_.strip_width);
+    if (options_.column - options_.strip_width / 2 < 0 ||
+        options_.column - options_.strip_width / 2 + options_.strip_width >
+            width)
+    {
+        throw std::runtime_error("keogram: strip out of the frames");
+    }
+    if (options_.max_columns < 2)
+    {
+        throw std::runtime_error("keogram: at least 2 columns required");
+    }
+    if (!options_.checkpoint.empty() &&
+        std::filesystem::exists(options_.checkpoint))
+    {
+        load(options_.checkpoint);
+    }
+}
+
+// adds the strip of the frame (averaged over its width) to the column
+template <typename T>
+static void add_strip(const T* values,
+                      int width,
+                      int height,
+                      int channels,
+                      int first,
+                      int strip_width,
+                      uint32_t* column)
+{
+    for (int y = 0; y < height; y++)
+    {
+        const T* row =
+            values + (static_cast<long>(y) * width + first) * channels;
+        for (int c = 0; c < channels; c++)
+        {
+            uint32_t sum = 0;
+            for (int x = 0; x < strip_width; x++) sum += row[x * channels + c];
+            column[y * channels + c] += (sum + strip_width / 2) / strip_width;
+        }
+    }
+}
+
+void KeogramStage::process(Frame& frame)
+{
+    if (frame.width != width_ || frame.height != height_ ||
+        frame.type != type_)
+    {
+        throw std::runtime_error("keogram: frame of a different size or type");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (counts_.empty() || counts_.back() >= frames_per_column_)
+    {
+        if (static_cast<int>(counts_.size()) >= options_.max_columns)
+        {
+            // halving the time resolution
+            int nb_columns = counts_.size();
+            for (int i = 0; i < nb_columns / 2; i++)
+            {
+                const uint32_t* a = sums_.data() + 2 * i * column_size_;
+                const uint32_t* b = a + column_size_;
+                uint32_t* merged = sums_.data() + i * column_size_;
+                for (int v = 0; v < column_size_; v++) merged[v] = a[v] + b[v];
+                counts_[i] = counts_[2 * i] + counts_[2 * i + 1];
+            }
+            if (nb_columns % 2 == 1)
+            {
+                // the last column (complete) is kept as it is
+                std::copy(sums_.end() - column_size_,
+                          sums_.end(),
+                          sums_.begin() + (nb_columns / 2) * column_size_);
+                counts_[nb_columns / 2] = counts_.back();
+            }
+            int kept = (nb_columns + 1) / 2;
+            counts_.resize(kept);
+            sums_.resize(static_cast<size_t>(kept) * column_size_);
+            frames_per_column_ *= 2;
+        }
+        if (counts_.empty() || counts_.back() >= frames_per_column_)
+        {
+            counts_.push_back(0);
+            sums_.resize(sums_.size() + column_size_, 0);
+        }
+    }
+    uint32_t* column = sums_.data() + (counts_.size() - 1) * column_size_;
+    int first = options_.column - options_.strip_width / 2;
+    if (type_ == ImageType::raw16)
+        add_strip(reinterpret_cast<const uint16_t*>(frame.data.data()),
+                  width_,
+                  height_,
+                  channels_,
+                  first,
+                  options_.strip_width,
+                  column);
+    else
+        add_strip(frame.data.data(),
+                  width_,
+                  height_,
+                  channels_,
+                  first,
+                  options_.strip_width,
+                  column);
+    counts_.back()++;
+    nb_frames_++;
+    if (!options_.checkpoint.empty() && options_.checkpoint_interval > 0 &&
+        nb_frames_ % options_.checkpoint_interval == 0)
+    {
+        save_locked(options_.checkpoint);
+    }
+}
+
+template <typename T>
+static void fill_image(const std::vector<uint32_t>& sums,
+                       const std::vector<int>& counts,
+                       int height,
+                       int channels,
+                       T* image)
+{
+    int nb_columns = counts.size();
+    int column_size = height * channels;
+    for (int x = 0; x < nb_columns; x++)
+    {
+        const uint32_t* column = sums.data() + x * column_size;
+        uint32_t count = counts[x];
+        for (int y = 0; y < height; y++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                image[(y * nb_columns + x) * channels + c] =
+                    (column[y * channels + c] + count / 2) / count;
+            }
+        }
+    }
+}
+
+Frame KeogramStage::get_image() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Frame image(counts_.size(), height_, type_);
+    image.index = nb_frames_;
+    if (type_ == ImageType::raw16)
+        fill_image(sums_,
+                   counts_,
+                   height_,
+                   channels_,
+                   reinterpret_cast<uint16_t*>(image.data.data()));
+    else
+        fill_image(sums_, counts_, height_, channels_, image.data.data());
+    return image;
+}
+
+long KeogramStage::get_nb_frames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_frames_;
+}
+
+int KeogramStage::get_nb_columns() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counts_.size();
+}
+
+int KeogramStage::get_frames_per_column() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frames_per_column_;
+}
+
+void KeogramStage::save(const std::filesystem::path& path) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    save_locked(path);
+}
+
+void KeogramStage::save_locked(const std::filesystem::path& path) const
+{
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream f =
+            create_checkpoint(tmp, KEOGRAM_MAGIC, width_, height_, type_);
+        write_i64(f, options_.column);
+        write_i64(f, options_.strip_width);
+        write_i64(f, nb_frames_);
+        write_i64(f, frames_per_column_);
+        write_i64(f, counts_.size());
+        write_values(f, counts_);
+        write_values(f, sums_);
+        if (!f)
+        {
+            throw std::runtime_error("keogram: failed to write " +
+                                     tmp.string());
+        }
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+void KeogramStage::load(const std::filesystem::path& path)
+{
+    std::ifstream f =
+        open_checkpoint(path, KEOGRAM_MAGIC, width_, height_, type_);
+    if (read_i64(f) != options_.column ||
+        read_i64(f) != options_.strip_width)
+    {
+        throw std::runtime_error("keogram: " + path.string() +
+                                 ": different strip");
+    }
+    long nb_frames = read_i64(f);
+    int frames_per_column = read_i64(f);
+    long nb_columns = read_i64(f);
+    if (nb_frames < 0 || nb_columns < 0 ||
+        nb_columns > options_.max_columns || frames_per_column < 1)
+    {
+        throw std::runtime_error("keogram: invalid file " + path.string());
+    }
+    std::vector<int> counts(nb_columns);
+    std::vector<uint32_t> sums(nb_columns * column_size_);
+    read_values(f, counts, path);
+    read_values(f, sums, path);
+    // the columns are divided by their counts (see get_image)
+    for (int count : counts)
+    {
+        if (count < 1 || count > frames_per_column)
+        {
+            throw std::runtime_error("keogram: invalid file " +
+                                     path.string());
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    nb_frames_ = nb_frames;
+    frames_per_column_ = frames_per_column;
+    counts_.swap(counts);
+    sums_.swap(sums);
+}
+
+void KeogramStage::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    counts_.clear();
+    sums_.clear();
+    frames_per_column_ = 1;
+    nb_frames_ = 0;
+}
+
+StartrailOptions::StartrailOptions()
+    : min_mean{0.}, max_mean{1.}, checkpoint_interval{0}
+{
+}
+
+static const char STARTRAIL_MAGIC[4] = {'Z', 'A', 'S', 'T'};
+
+StartrailStage::StartrailStage(int width,
+                               int height,
+                               ImageType type,
+                               StartrailOptions options)
+    : width_{width},
+      height_{height},
+      type_{type},
+      options_{options},
+      max_(width, height, type),
+      nb_frames_{0},
+      nb_skipped_{0}
+{
+    std::fill(max_.data.begin(), max_.data.end(), 0);
+    if (!options_.checkpoint.empty() &&
+        std::filesystem::exists(options_.checkpoint))
+    {
+        load(options_.checkpoint);
+    }
+}
+
+// without branches, so that it is vectorized by the compiler
+template <typename T>
+static void update_max(const T* values, int nb_values, T* max)
+{
+    for (int i = 0; i < nb_values; i++)
+    {
+        max[i] = values[i] > max[i] ? values[i] : max[i];
+    }
+}
+
+void StartrailStage::process(Frame& frame)
+{
+    if (frame.width != width_ || frame.height != height_ ||
+        frame.type != type_)
+    {
+        throw std::runtime_error(
+            "startrails: frame of a different size or type");
+    }
+    double mean = compute_statistics(frame).mean / get_max_value(type_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mean < options_.min_mean || mean > options_.max_mean)
+    {
+        nb_skipped_++;
+        return;
+    }
+    if (type_ == ImageType::raw16)
+        update_max(reinterpret_cast<const uint16_t*>(frame.data.data()),
+                   frame.size() / 2,
+                   reinterpret_cast<uint16_t*>(max_.data.data()));
+    else
+        update_max(frame.data.data(), frame.size(), max_.data.data());
+    max_.timestamp = frame.timestamp;
+    nb_frames_++;
+    if (!options_.checkpoint.empty() && options_.checkpoint_interval > 0 &&
+        nb_frames_ % options_.checkpoint_interval == 0)
+    {
+        save_locked(options_.checkpoint);
+    }
+}
+
+Frame StartrailStage::get_image() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Frame image = max_;
+    image.index = nb_frames_;
+    return image;
+}
+
+long StartrailStage::get_nb_frames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_frames_;
+}
+
+long StartrailStage::get_nb_skipped() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_skipped_;
+}
+
+void StartrailStage::save(const std::filesystem::path& path) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    save_locked(path);
+}
+
+void StartrailStage::save_locked(const std::filesystem::path& path) const
+{
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream f =
+            create_checkpoint(tmp, STARTRAIL_MAGIC, width_, height_, type_);
+        write_i64(f, nb_frames_);
+        write_i64(f, nb_skipped_);
+        write_values(f, max_.data);
+        if (!f)
+        {
+            throw std::runtime_error("startrails: failed to write " +
+                                     tmp.string());
+        }
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+void StartrailStage::load(const std::filesystem::path& path)
+{
+    std::ifstream f =
+        open_checkpoint(path, STARTRAIL_MAGIC, width_, height_, type_);
+    long nb_frames = read_i64(f);
+    long nb_skipped = read_i64(f);
+    std::vector<unsigned char> data(max_.data.size());
+    read_values(f, data, path);
+    std::lock_guard<std::mutex> lock(mutex_);
+    nb_frames_ = nb_frames;
+    nb_skipped_ = nb_skipped;
+    max_.data.swap(data);
+}
+
+void StartrailStage::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::fill(max_.data.begin(), max_.data.end(), 0);
+    nb_frames_ = 0;
+    nb_skipped_ = 0;
+}
+
+}  // namespace zwo_asi
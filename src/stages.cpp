@@ -0,0 +1,107 @@
+#include "zwo_asi/stages.hpp"
+
+namespace zwo_asi
+{
+template <typename T>
+static void accumulate(const T* data,
+                       int nb_values,
+                       double& min_value,
+                       double& max_value,
+                       double& sum)
+{
+    T min_ = data[0];
+    T max_ = data[0];
+    unsigned long long sum_ = 0;
+    for (int i = 0; i < nb_values; i++)
+    {
+        min_ = std::min(min_, data[i]);
+        max_ = std::max(max_, data[i]);
+        sum_ += data[i];
+    }
+    min_value = min_;
+    max_value = max_;
+    sum = sum_;
+}
+
+FrameStatistics compute_statistics(const Frame& frame)
+{
+    FrameStatistics stats;
+    stats.index = frame.index;
+    stats.min_value = 0;
+    stats.max_value = 0;
+    stats.mean = 0;
+    if (frame.data.empty()) return stats;
+    double sum;
+    int nb_values;
+    if (frame.type == ImageType::raw16)
+    {
+        nb_values = frame.data.size() / 2;
+        accumulate(reinterpret_cast<const uint16_t*>(frame.data.data()),
+                   nb_values,
+                   stats.min_value,
+                   stats.max_value,
+                   sum);
+    }
+    else
+    {
+        nb_values = frame.data.size();
+        accumulate(frame.data.data(),
+                   nb_values,
+                   stats.min_value,
+                   stats.max_value,
+                   sum);
+    }
+    stats.mean = sum / nb_values;
+    return stats;
+}
+
+StatisticsStage::StatisticsStage()
+{
+    last_.index = -1;
+    last_.min_value = 0;
+    last_.max_value = 0;
+    last_.mean = 0;
+}
+
+void StatisticsStage::process(Frame& frame)
+{
+    FrameStatistics stats = compute_statistics(frame);
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_ = stats;
+}
+
+FrameStatistics StatisticsStage::get_last() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_;
+}
+
+RawWriterStage::RawWriterStage(std::filesystem::path folder,
+                               std::string prefix)
+    : folder_{folder}, prefix_{prefix}
+{
+    if (!std::filesystem::is_directory(folder))
+    {
+        std::ostringstream s;
+        s << "folder not found: " << folder;
+        throw std::runtime_error(s.str());
+    }
+}
+
+void RawWriterStage::process(Frame& frame)
+{
+    std::ostringstream name;
+    name << prefix_ << frame.index << ".raw";
+    std::filesystem::path path = folder_ / name.str();
+    std::ofstream f(path, std::ios::binary);
+    if (!f.is_open())
+    {
+        std::ostringstream s;
+        s << "failed to open " << path << " for writing";
+        throw std::runtime_error(s.str());
+    }
+    f.write(reinterpret_cast<const char*>(frame.data.data()),
+            frame.data.size());
+}
+
+}  // namespace zwo_asi
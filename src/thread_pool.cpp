@@ -0,0 +1,137 @@
+#include "zwo_asi/thread_pool.hpp"
+
+namespace zwo_asi
+{
+// index of the worker running on the current thread, and the pool
+// it belongs to (so that a task submitted from a worker of another
+// pool is not mistaken for a local one)
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+ThreadPool::ThreadPool(int nb_threads)
+    : queued_{0}, pending_{0}, next_{0}, stop_{false}
+{
+    if (nb_threads <= 0)
+    {
+        nb_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < nb_threads; i++)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < nb_threads; i++)
+    {
+        threads_.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait_idle();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+int ThreadPool::size() const
+{
+    return workers_.size();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    int index;
+    if (current_pool == this)
+    {
+        index = current_worker;
+    }
+    else
+    {
+        index = next_++ % workers_.size();
+    }
+    pending_++;
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // taking the lock so that a worker about to sleep does not
+        // miss the notification
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_++;
+    }
+    wake_.notify_one();
+}
+
+void ThreadPool::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool ThreadPool::pop(int index, std::function<void()>& task)
+{
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) return false;
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(int index, std::function<void()>& task)
+{
+    int nb_workers = workers_.size();
+    for (int i = 1; i < nb_workers; i++)
+    {
+        Worker& victim = *workers_[(index + i) % nb_workers];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty()) continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(int index)
+{
+    current_pool = this;
+    current_worker = index;
+    std::function<void()> task;
+    while (true)
+    {
+        if (pop(index, task) || steal(index, task))
+        {
+            queued_--;
+            // tasks are expected to handle their own errors: an exception
+            // escaping one must not terminate the worker thread (nor leave
+            // wait_idle waiting for it)
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+            }
+            task = nullptr;
+            if (--pending_ == 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                idle_.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        if (stop_ && queued_ == 0) return;
+    }
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,529 @@
+#include "zwo_asi/toml_config.hpp"
+#include <cctype>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include "zwo_asi/camera.hpp"
+
+namespace zwo_asi
+{
+namespace
+{
+class TomlValue
+{
+public:
+    enum Kind
+    {
+        integer,
+        string,
+        boolean
+    };
+
+public:
+    Kind kind;
+    long integer_value;
+    std::string string_value;
+    bool boolean_value;
+    int line;
+};
+
+typedef std::map<std::string, TomlValue> TomlTable;
+
+// parser of the TOML subset used by zwo_asi.toml
+class TomlParser
+{
+public:
+    TomlParser(std::string source) : source_{source}, line_{0}
+    {
+    }
+
+    std::map<std::string, TomlTable> parse(const std::string& content)
+    {
+        std::map<std::string, TomlTable> tables;
+        std::string table;
+        tables[table];
+        std::istringstream stream(content);
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            line_++;
+            text_ = line;
+            position_ = 0;
+            skip_spaces();
+            if (at_end_of_line()) continue;
+            if (text_[position_] == '[')
+            {
+                table = parse_table_header();
+                if (tables.find(table) != tables.end())
+                {
+                    fail("table [" + table + "] defined twice");
+                }
+                tables[table];
+                continue;
+            }
+            std::string key = parse_key();
+            skip_spaces();
+            expect('=');
+            skip_spaces();
+            TomlValue value = parse_value();
+            skip_spaces();
+            if (!at_end_of_line()) fail("unexpected characters after value");
+            if (tables[table].find(key) != tables[table].end())
+            {
+                fail("key " + key + " defined twice");
+            }
+            tables[table][key] = value;
+        }
+        return tables;
+    }
+
+    // line: -1 for the current line, 0 for none
+    [[noreturn]] void fail(std::string message, int line = -1) const
+    {
+        std::ostringstream s;
+        s << source_;
+        if (line < 0) line = line_;
+        if (line > 0) s << " (line " << line << ")";
+        s << ": " << message;
+        throw std::runtime_error(s.str());
+    }
+
+private:
+    bool at_end_of_line() const
+    {
+        return position_ >= text_.size() || text_[position_] == '#';
+    }
+
+    void skip_spaces()
+    {
+        while (position_ < text_.size() &&
+               (text_[position_] == ' ' || text_[position_] == '\t' ||
+                text_[position_] == '\r'))
+        {
+            position_++;
+        }
+    }
+
+    void expect(char c)
+    {
+        if (position_ >= text_.size() || text_[position_] != c)
+        {
+            fail(std::string("expected '") + c + "'");
+        }
+        position_++;
+    }
+
+    std::string parse_table_header()
+    {
+        expect('[');
+        if (position_ < text_.size() && text_[position_] == '[')
+        {
+            fail("arrays of tables are not supported");
+        }
+        skip_spaces();
+        std::string name = parse_key();
+        skip_spaces();
+        if (position_ < text_.size() && text_[position_] == '.')
+        {
+            fail("dotted table names are not supported");
+        }
+        expect(']');
+        skip_spaces();
+        if (!at_end_of_line()) fail("unexpected characters after table name");
+        return name;
+    }
+
+    std::string parse_key()
+    {
+        if (position_ < text_.size() &&
+            (text_[position_] == '"' || text_[position_] == '\''))
+        {
+            return parse_string();
+        }
+        size_t start = position_;
+        while (position_ < text_.size() &&
+               (std::isalnum((unsigned char)text_[position_]) ||
+                text_[position_] == '_' || text_[position_] == '-'))
+        {
+            position_++;
+        }
+        if (position_ == start) fail("expected a key");
+        return text_.substr(start, position_ - start);
+    }
+
+    std::string parse_string()
+    {
+        char quote = text_[position_++];
+        std::string value;
+        while (position_ < text_.size() && text_[position_] != quote)
+        {
+            char c = text_[position_++];
+            if (c == '\\' && quote == '"')
+            {
+                if (position_ >= text_.size()) break;
+                char e = text_[position_++];
+                switch (e)
+                {
+                    case 'n':
+                        c = '\n';
+                        break;
+                    case 't':
+                        c = '\t';
+                        break;
+                    case '"':
+                    case '\\':
+                        c = e;
+                        break;
+                    default:
+                        fail(std::string("unsupported escape sequence \\") +
+                             e);
+                }
+            }
+            value += c;
+        }
+        expect(quote);
+        return value;
+    }
+
+    TomlValue parse_value()
+    {
+        TomlValue value;
+        value.line = line_;
+        if (position_ >= text_.size()) fail("missing value");
+        char c = text_[position_];
+        if (c == '"' || c == '\'')
+        {
+            value.kind = TomlValue::string;
+            value.string_value = parse_string();
+            return value;
+        }
+        if (c == '[' || c == '{')
+        {
+            fail("arrays and inline tables are not supported");
+        }
+        size_t start = position_;
+        while (position_ < text_.size() &&
+               (std::isalnum((unsigned char)text_[position_]) ||
+                text_[position_] == '_' || text_[position_] == '+' ||
+                text_[position_] == '-' || text_[position_] == '.'))
+        {
+            position_++;
+        }
+        std::string token = text_.substr(start, position_ - start);
+        if (token == "true" || token == "false")
+        {
+            value.kind = TomlValue::boolean;
+            value.boolean_value = token == "true";
+            return value;
+        }
+        std::string digits;
+        for (char d : token)
+        {
+            if (d != '_') digits += d;
+        }
+        size_t end = 0;
+        try
+        {
+            value.integer_value = std::stol(digits, &end);
+        }
+        catch (const std::exception&)
+        {
+            end = 0;
+        }
+        if (digits.empty() || end != digits.size())
+        {
+            fail("expected an integer, a string or a boolean, got '" + token +
+                 "'");
+        }
+        value.kind = TomlValue::integer;
+        return value;
+    }
+
+private:
+    std::string source_;
+    int line_;
+    std::string text_;
+    size_t position_;
+};
+
+}  // namespace
+
+static const TomlTable& get_table(const std::map<std::string, TomlTable>& t,
+                                  std::string name,
+                                  const TomlParser& parser)
+{
+    auto it = t.find(name);
+    if (it == t.end())
+    {
+        parser.fail("missing the table [" + name + "]", 0);
+    }
+    return it->second;
+}
+
+CameraSnapshot parse_toml_config(const std::string& content,
+                                 std::string source)
+{
+    TomlParser parser(source);
+    std::map<std::string, TomlTable> tables = parser.parse(content);
+    CameraSnapshot config;
+
+    const TomlTable& root = tables.at("");
+    auto mode = root.find("camera_mode");
+    if (mode != root.end())
+    {
+        if (mode->second.kind != TomlValue::string)
+        {
+            parser.fail("camera_mode must be a string", mode->second.line);
+        }
+        try
+        {
+            config.mode = get_camera_mode(mode->second.string_value);
+        }
+        catch (const std::runtime_error& e)
+        {
+            parser.fail(e.what(), mode->second.line);
+        }
+        config.has_mode = true;
+    }
+
+    for (const auto& key_value : get_table(tables, "controllables", parser))
+    {
+        const TomlValue& value = key_value.second;
+        ControlSetting setting;
+        setting.value = 0;
+        setting.is_auto = false;
+        if (value.kind == TomlValue::integer)
+        {
+            setting.value = value.integer_value;
+        }
+        else if (value.kind == TomlValue::string &&
+                 value.string_value == "auto")
+        {
+            setting.is_auto = true;
+        }
+        else
+        {
+            parser.fail(key_value.first + ": expected an integer or \"auto\"",
+                        value.line);
+        }
+        config.controls[key_value.first] = setting;
+    }
+
+    const TomlTable& roi = get_table(tables, "roi", parser);
+    std::map<std::string, int*> fields{{"start_x", &config.roi.start_x},
+                                       {"start_y", &config.roi.start_y},
+                                       {"width", &config.roi.width},
+                                       {"height", &config.roi.height},
+                                       {"bins", &config.roi.bins}};
+    std::vector<std::string> missing;
+    for (const auto& field : fields)
+    {
+        auto it = roi.find(field.first);
+        if (it == roi.end())
+        {
+            missing.push_back(field.first);
+            continue;
+        }
+        if (it->second.kind != TomlValue::integer)
+        {
+            parser.fail("roi " + field.first + " must be an integer",
+                        it->second.line);
+        }
+        long value = it->second.integer_value;
+        if (value < std::numeric_limits<int>::min() ||
+            value > std::numeric_limits<int>::max())
+        {
+            parser.fail("roi " + field.first + " is out of range",
+                        it->second.line);
+        }
+        *(field.second) = static_cast<int>(value);
+    }
+    auto type = roi.find("type");
+    if (type == roi.end())
+    {
+        missing.push_back("type");
+    }
+    else
+    {
+        if (type->second.kind != TomlValue::string)
+        {
+            parser.fail("roi type must be a string", type->second.line);
+        }
+        try
+        {
+            config.roi.type = get_image_type(type->second.string_value);
+        }
+        catch (const std::runtime_error& e)
+        {
+            parser.fail(e.what(), type->second.line);
+        }
+    }
+    if (!missing.empty())
+    {
+        std::ostringstream s;
+        s << "missing roi configuration for:";
+        for (const std::string& key : missing) s << " " << key;
+        parser.fail(s.str(), 0);
+    }
+    for (const auto& key_value : roi)
+    {
+        if (fields.find(key_value.first) == fields.end() &&
+            key_value.first != "type")
+        {
+            parser.fail("unknown roi key " + key_value.first,
+                        key_value.second.line);
+        }
+    }
+
+    return config;
+}
+
+CameraSnapshot load_toml_config(const std::filesystem::path& path)
+{
+    std::ifstream f(path);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("failed to configure camera from " +
+                                 path.string() + ": file not found");
+    }
+    std::stringstream content;
+    content << f.rdbuf();
+    return parse_toml_config(content.str(), path.string());
+}
+
+std::vector<std::string> validate_config(
+    const CameraSnapshot& config,
+    const CameraInfo& info,
+    const std::map<std::string, Controllable>& controls)
+{
+    std::vector<std::string> issues;
+    const ROI& roi = config.roi;
+
+    if (info.supported_bins.count(roi.bins) == 0)
+    {
+        std::ostringstream s;
+        s << roi.bins << " bin(s) not supported (supported:";
+        for (int bin : info.supported_bins) s << " " << bin;
+        s << ")";
+        issues.push_back(s.str());
+    }
+    if (info.supported_image_types.count(roi.type) == 0)
+    {
+        std::ostringstream s;
+        s << "image type " << zwo_asi::to_string(roi.type)
+          << " not supported (supported:";
+        for (ImageType type : info.supported_image_types)
+        {
+            s << " " << zwo_asi::to_string(type);
+        }
+        s << ")";
+        issues.push_back(s.str());
+    }
+    if (roi.width <= 0 || roi.height <= 0)
+    {
+        issues.push_back("width and height must be positive");
+    }
+    if (roi.start_x < 0 || roi.start_y < 0)
+    {
+        issues.push_back("start position can not be negative");
+    }
+    if (roi.width % 8 != 0)
+    {
+        issues.push_back("width " + std::to_string(roi.width) +
+                         " is not a multiple of 8");
+    }
+    if (roi.height % 2 != 0)
+    {
+        issues.push_back("height " + std::to_string(roi.height) +
+                         " is not a multiple of 2");
+    }
+    if (info.name == std::string("ASI120") && !info.is_usb3 &&
+        roi.width * roi.height % 1024 != 0)
+    {
+        issues.push_back("width x height must be a multiple of 1024 (ASI120)");
+    }
+    if (roi.bins > 0)
+    {
+        if (roi.start_x + roi.width > info.max_width / roi.bins)
+        {
+            issues.push_back(
+                "roi and start position larger than binned sensor width");
+        }
+        if (roi.start_y + roi.height > info.max_height / roi.bins)
+        {
+            issues.push_back(
+                "roi and start position larger than binned sensor height");
+        }
+    }
+
+    for (const auto& control : config.controls)
+    {
+        auto it = controls.find(control.first);
+        if (it == controls.end())
+        {
+            issues.push_back("no such controllable: " + control.first);
+            continue;
+        }
+        const Controllable& caps = it->second;
+        if (!caps.is_writable)
+        {
+            issues.push_back("controllable " + control.first +
+                             " is not writable");
+            continue;
+        }
+        if (control.second.is_auto)
+        {
+            if (!caps.supports_auto)
+            {
+                issues.push_back("controllable " + control.first +
+                                 " does not support auto mode");
+            }
+            continue;
+        }
+        if (control.second.value < caps.min_value ||
+            control.second.value > caps.max_value)
+        {
+            std::ostringstream s;
+            s << "controllable " << control.first << ": value "
+              << control.second.value << " out of range [" << caps.min_value
+              << ", " << caps.max_value << "]";
+            issues.push_back(s.str());
+        }
+    }
+
+    if (config.has_mode && config.mode != CameraMode::normal &&
+        !info.is_trigger)
+    {
+        issues.push_back("camera mode " + zwo_asi::to_string(config.mode) +
+                         " requires a trigger camera");
+    }
+
+    return issues;
+}
+
+int configure_from_toml(Camera& camera, const std::filesystem::path& path)
+{
+    CameraSnapshot config = load_toml_config(path);
+    CameraSnapshot current = take_snapshot(camera);
+    std::map<std::string, Controllable> controls = camera.get_controls();
+    std::vector<std::string> issues =
+        validate_config(config, camera.get_info(), controls);
+    if (!issues.empty())
+    {
+        std::ostringstream s;
+        s << "the configuration " << path.string()
+          << " is not suitable for the camera: ";
+        for (size_t i = 0; i < issues.size(); i++)
+        {
+            if (i > 0) s << ", ";
+            s << issues[i];
+        }
+        throw std::runtime_error(s.str());
+    }
+    // the mode of other cameras than trigger cameras is always normal
+    // (checked by validate_config)
+    if (!camera.get_info().is_trigger) config.has_mode = false;
+    return restore_snapshot(camera, config, current);
+}
+
+}  // namespace zwo_asi
@@ -0,0 +1,1037 @@
+#include "zwo_asi/trace_sdk.hpp"
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include "zwo_asi/result.hpp"
+
+namespace zwo_asi
+{
+static const char* FUNCTION_NAMES[] = {"GetNumOfConnectedCameras",
+                                       "GetCameraProperty",
+                                       "OpenCamera",
+                                       "InitCamera",
+                                       "CloseCamera",
+                                       "GetNumOfControls",
+                                       "GetControlCaps",
+                                       "GetControlValue",
+                                       "SetControlValue",
+                                       "SetROIFormat",
+                                       "GetROIFormat",
+                                       "SetStartPos",
+                                       "GetStartPos",
+                                       "GetDroppedFrames",
+                                       "EnableDarkSubtract",
+                                       "DisableDarkSubtract",
+                                       "StartVideoCapture",
+                                       "StopVideoCapture",
+                                       "GetVideoData",
+                                       "PulseGuideOn",
+                                       "PulseGuideOff",
+                                       "StartExposure",
+                                       "StopExposure",
+                                       "GetExpStatus",
+                                       "GetDataAfterExp",
+                                       "GetID",
+                                       "SetID",
+                                       "GetGainOffset",
+                                       "GetSDKVersion",
+                                       "GetCameraMode",
+                                       "SetCameraMode",
+                                       "SendSoftTrigger",
+                                       "GetSerialNumber"};
+static const int NB_FUNCTIONS =
+    sizeof(FUNCTION_NAMES) / sizeof(FUNCTION_NAMES[0]);
+
+std::string to_string(TraceFunction function)
+{
+    int index = static_cast<int>(function);
+    if (index < 0 || index >= NB_FUNCTIONS) return "unknown";
+    return FUNCTION_NAMES[index];
+}
+
+std::string TraceRecord::to_string() const
+{
+    std::ostringstream s;
+    s << start_ns * 1e-9 << "s: " << zwo_asi::to_string(function) << "(";
+    if (camera_id >= 0) s << "camera " << camera_id;
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        s << (i > 0 || camera_id >= 0 ? ", " : "") << args[i];
+    }
+    s << ") -> ";
+    if (function == TraceFunction::GetNumOfConnectedCameras ||
+        function == TraceFunction::GetSDKVersion)
+        s << result;
+    else
+        s << get_error_name(static_cast<ASI_ERROR_CODE>(result));
+    s << " in " << duration_ns * 1e-6 << "ms";
+    if (data_size > 0)
+    {
+        s << " (" << data_size << " bytes, hash " << std::hex << data_hash
+          << std::dec << ")";
+    }
+    return s.str();
+}
+
+// file format: magic and version, then the records, each a function
+// index followed by little endian 64 bits integers and byte arrays
+// (preceded by their size)
+
+static const char TRACE_MAGIC[4] = {'Z', 'A', 'T', 'R'};
+static const uint8_t FORMAT_VERSION = 1;
+
+static void write_i64(std::vector<unsigned char>& data, int64_t value)
+{
+    uint64_t v = static_cast<uint64_t>(value);
+    for (int i = 0; i < 8; i++) data.push_back((v >> (8 * i)) & 0xff);
+}
+
+static void write_bytes(std::vector<unsigned char>& data,
+                        const std::vector<unsigned char>& bytes)
+{
+    write_i64(data, bytes.size());
+    data.insert(data.end(), bytes.begin(), bytes.end());
+}
+
+static int64_t read_i64(std::istream& f)
+{
+    unsigned char data[8];
+    if (!f.read(reinterpret_cast<char*>(data), 8))
+    {
+        throw std::runtime_error("truncated record");
+    }
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(data[i]) << (8 * i);
+    return static_cast<int64_t>(v);
+}
+
+static std::vector<unsigned char> read_bytes(std::istream& f)
+{
+    int64_t size = read_i64(f);
+    if (size < 0 || size > (int64_t(1) << 32))
+    {
+        throw std::runtime_error("invalid record");
+    }
+    std::vector<unsigned char> bytes(size);
+    if (!f.read(reinterpret_cast<char*>(bytes.data()), size))
+    {
+        throw std::runtime_error("truncated record");
+    }
+    return bytes;
+}
+
+std::vector<TraceRecord> read_trace(const std::filesystem::path& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f.is_open())
+    {
+        throw std::runtime_error("trace: failed to open " + path.string());
+    }
+    char magic[5];
+    if (!f.read(magic, 5) || std::memcmp(magic, TRACE_MAGIC, 4) != 0 ||
+        magic[4] != FORMAT_VERSION)
+    {
+        throw std::runtime_error("trace: invalid file " + path.string());
+    }
+    std::vector<TraceRecord> records;
+    try
+    {
+        while (true)
+        {
+            int function = f.get();
+            if (function == std::char_traits<char>::eof()) break;
+            if (function >= NB_FUNCTIONS)
+            {
+                throw std::runtime_error("invalid function");
+            }
+            TraceRecord record;
+            record.function = static_cast<TraceFunction>(function);
+            record.camera_id = read_i64(f);
+            record.result = read_i64(f);
+            record.start_ns = read_i64(f);
+            record.duration_ns = read_i64(f);
+            int64_t nb_args = read_i64(f);
+            if (nb_args < 0 || nb_args > 16)
+            {
+                throw std::runtime_error("invalid record");
+            }
+            for (int64_t i = 0; i < nb_args; i++)
+            {
+                record.args.push_back(read_i64(f));
+            }
+            record.output = read_bytes(f);
+            record.data_hash = static_cast<uint64_t>(read_i64(f));
+            record.data_size = read_i64(f);
+            record.data = read_bytes(f);
+            records.push_back(std::move(record));
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::ostringstream s;
+        s << "trace: " << e.what() << " in " << path << " (record "
+          << records.size() << ")";
+        throw std::runtime_error(s.str());
+    }
+    return records;
+}
+
+// FNV-1a
+static uint64_t hash(const unsigned char* data, long size)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (long i = 0; i < size; i++)
+    {
+        h = (h ^ data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// Record of a call, written to the trace when going out of scope
+class RecordedCall
+{
+public:
+    RecordedCall(RecordingSdk& sdk,
+                 TraceFunction function,
+                 int camera_id,
+                 std::vector<int64_t> args = {})
+        : sdk_(sdk), start_{std::chrono::steady_clock::now()}
+    {
+        record_.function = function;
+        record_.camera_id = camera_id;
+        record_.args = std::move(args);
+        record_.result = 0;
+        record_.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               start_ - sdk.start_)
+                               .count();
+        record_.duration_ns = 0;
+        record_.data_hash = 0;
+        record_.data_size = 0;
+    }
+
+    ~RecordedCall()
+    {
+        sdk_.write(record_);
+    }
+
+    // to be called once the sdk returned (end of the call)
+    void returned(int result)
+    {
+        record_.result = result;
+        record_.duration_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_)
+                .count();
+    }
+
+    template <typename T>
+    void output(const T* value)
+    {
+        output(value, sizeof(T));
+    }
+
+    void output(const void* value, size_t size)
+    {
+        size_t offset = record_.output.size();
+        record_.output.resize(offset + size);
+        if (value != nullptr)
+        {
+            std::memcpy(record_.output.data() + offset, value, size);
+        }
+    }
+
+    void data(const unsigned char* buffer, long size)
+    {
+        if (buffer == nullptr || size <= 0) return;
+        record_.data_size = size;
+        record_.data_hash = hash(buffer, size);
+        if (sdk_.data_ == TraceData::full)
+        {
+            record_.data.assign(buffer, buffer + size);
+        }
+    }
+
+private:
+    RecordingSdk& sdk_;
+    std::chrono::steady_clock::time_point start_;
+    TraceRecord record_;
+};
+
+RecordingSdk::RecordingSdk(std::shared_ptr<Sdk> sdk,
+                           std::filesystem::path path,
+                           TraceData data)
+    : sdk_{sdk},
+      data_{data},
+      start_{std::chrono::steady_clock::now()},
+      file_(path, std::ios::binary),
+      nb_records_{0}
+{
+    if (!file_.is_open())
+    {
+        throw std::runtime_error("trace: failed to open " + path.string() +
+                                 " for writing");
+    }
+    file_.write(TRACE_MAGIC, 4);
+    file_.put(FORMAT_VERSION);
+}
+
+RecordingSdk::~RecordingSdk()
+{
+    flush();
+}
+
+long RecordingSdk::get_nb_records() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_records_;
+}
+
+void RecordingSdk::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.flush();
+}
+
+void RecordingSdk::write(const TraceRecord& record)
+{
+    std::vector<unsigned char> data;
+    data.push_back(static_cast<unsigned char>(record.function));
+    write_i64(data, record.camera_id);
+    write_i64(data, record.result);
+    write_i64(data, record.start_ns);
+    write_i64(data, record.duration_ns);
+    write_i64(data, record.args.size());
+    for (int64_t arg : record.args) write_i64(data, arg);
+    write_bytes(data, record.output);
+    write_i64(data, static_cast<int64_t>(record.data_hash));
+    write_i64(data, record.data_size);
+    write_bytes(data, record.data);
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.write(reinterpret_cast<const char*>(data.data()), data.size());
+    nb_records_++;
+}
+
+int RecordingSdk::GetNumOfConnectedCameras()
+{
+    RecordedCall call(*this, TraceFunction::GetNumOfConnectedCameras, -1);
+    int nb_cameras = sdk_->GetNumOfConnectedCameras();
+    call.returned(nb_cameras);
+    return nb_cameras;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetCameraProperty(ASI_CAMERA_INFO* info,
+                                               int camera_index)
+{
+    RecordedCall call(*this, TraceFunction::GetCameraProperty, camera_index);
+    ASI_ERROR_CODE error = sdk_->GetCameraProperty(info, camera_index);
+    call.returned(error);
+    call.output(info);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::OpenCamera(int camera_id)
+{
+    RecordedCall call(*this, TraceFunction::OpenCamera, camera_id);
+    ASI_ERROR_CODE error = sdk_->OpenCamera(camera_id);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::InitCamera(int camera_id)
+{
+    RecordedCall call(*this, TraceFunction::InitCamera, camera_id);
+    ASI_ERROR_CODE error = sdk_->InitCamera(camera_id);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::CloseCamera(int camera_id)
+{
+    RecordedCall call(*this, TraceFunction::CloseCamera, camera_id);
+    ASI_ERROR_CODE error = sdk_->CloseCamera(camera_id);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetNumOfControls(int camera_id, int* nb_controls)
+{
+    RecordedCall call(*this, TraceFunction::GetNumOfControls, camera_id);
+    ASI_ERROR_CODE error = sdk_->GetNumOfControls(camera_id, nb_controls);
+    call.returned(error);
+    call.output(nb_controls);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetControlCaps(int camera_id,
+                                            int control_index,
+                                            ASI_CONTROL_CAPS* caps)
+{
+    RecordedCall call(
+        *this, TraceFunction::GetControlCaps, camera_id, {control_index});
+    ASI_ERROR_CODE error = sdk_->GetControlCaps(camera_id, control_index, caps);
+    call.returned(error);
+    call.output(caps);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetControlValue(int camera_id,
+                                             ASI_CONTROL_TYPE control,
+                                             long* value,
+                                             ASI_BOOL* is_auto)
+{
+    RecordedCall call(
+        *this, TraceFunction::GetControlValue, camera_id, {control});
+    ASI_ERROR_CODE error =
+        sdk_->GetControlValue(camera_id, control, value, is_auto);
+    call.returned(error);
+    call.output(value);
+    call.output(is_auto);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::SetControlValue(int camera_id,
+                                             ASI_CONTROL_TYPE control,
+                                             long value,
+                                             ASI_BOOL is_auto)
+{
+    RecordedCall call(*this,
+                      TraceFunction::SetControlValue,
+                      camera_id,
+                      {control, value, is_auto});
+    ASI_ERROR_CODE error =
+        sdk_->SetControlValue(camera_id, control, value, is_auto);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::SetROIFormat(
+    int camera_id, int width, int height, int bin, ASI_IMG_TYPE type)
+{
+    RecordedCall call(*this,
+                      TraceFunction::SetROIFormat,
+                      camera_id,
+                      {width, height, bin, type});
+    ASI_ERROR_CODE error =
+        sdk_->SetROIFormat(camera_id, width, height, bin, type);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetROIFormat(
+    int camera_id, int* width, int* height, int* bin, ASI_IMG_TYPE* type)
+{
+    RecordedCall call(*this, TraceFunction::GetROIFormat, camera_id);
+    ASI_ERROR_CODE error =
+        sdk_->GetROIFormat(camera_id, width, height, bin, type);
+    call.returned(error);
+    call.output(width);
+    call.output(height);
+    call.output(bin);
+    call.output(type);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::SetStartPos(int camera_id,
+                                         int start_x,
+                                         int start_y)
+{
+    RecordedCall call(
+        *this, TraceFunction::SetStartPos, camera_id, {start_x, start_y});
+    ASI_ERROR_CODE error = sdk_->SetStartPos(camera_id, start_x, start_y);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetStartPos(int camera_id,
+                                         int* start_x,
+                                         int* start_y)
+{
+    RecordedCall call(*this, TraceFunction::GetStartPos, camera_id);
+    ASI_ERROR_CODE error = sdk_->GetStartPos(camera_id, start_x, start_y);
+    call.returned(error);
+    call.output(start_x);
+    call.output(start_y);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetDroppedFrames(int camera_id,
+                                              int* dropped_frames)
+{
+    RecordedCall call(*this, TraceFunction::GetDroppedFrames, camera_id);
+    ASI_ERROR_CODE error = sdk_->GetDroppedFrames(camera_id, dropped_frames);
+    call.returned(error);
+    call.output(dropped_frames);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::EnableDarkSubtract(int camera_id, char* bmp_path)
+{
+    RecordedCall call(*this, TraceFunction::EnableDarkSubtract, camera_id);
+    ASI_ERROR_CODE error = sdk_->EnableDarkSubtract(camera_id, bmp_path);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::DisableDarkSubtract(int camera_id)
+{
+    RecordedCall call(*this, TraceFunction::DisableDarkSubtract, camera_id);
+    ASI_ERROR_CODE error = sdk_->DisableDarkSubtract(camera_id);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::StartVideoCapture(int camera_id)
+{
+    RecordedCall call(*this, TraceFunction::StartVideoCapture, camera_id);
+    ASI_ERROR_CODE error = sdk_->StartVideoCapture(camera_id);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::StopVideoCapture(int camera_id)
+{
+    RecordedCall call(*this, TraceFunction::StopVideoCapture, camera_id);
+    ASI_ERROR_CODE error = sdk_->StopVideoCapture(camera_id);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetVideoData(int camera_id,
+                                          unsigned char* buffer,
+                                          long buffer_size,
+                                          int wait_ms)
+{
+    RecordedCall call(*this,
+                      TraceFunction::GetVideoData,
+                      camera_id,
+                      {buffer_size, wait_ms});
+    ASI_ERROR_CODE error =
+        sdk_->GetVideoData(camera_id, buffer, buffer_size, wait_ms);
+    call.returned(error);
+    if (error == ASI_SUCCESS) call.data(buffer, buffer_size);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::PulseGuideOn(int camera_id,
+                                          ASI_GUIDE_DIRECTION direction)
+{
+    RecordedCall call(
+        *this, TraceFunction::PulseGuideOn, camera_id, {direction});
+    ASI_ERROR_CODE error = sdk_->PulseGuideOn(camera_id, direction);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::PulseGuideOff(int camera_id,
+                                           ASI_GUIDE_DIRECTION direction)
+{
+    RecordedCall call(
+        *this, TraceFunction::PulseGuideOff, camera_id, {direction});
+    ASI_ERROR_CODE error = sdk_->PulseGuideOff(camera_id, direction);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::StartExposure(int camera_id, ASI_BOOL is_dark)
+{
+    RecordedCall call(
+        *this, TraceFunction::StartExposure, camera_id, {is_dark});
+    ASI_ERROR_CODE error = sdk_->StartExposure(camera_id, is_dark);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::StopExposure(int camera_id)
+{
+    RecordedCall call(*this, TraceFunction::StopExposure, camera_id);
+    ASI_ERROR_CODE error = sdk_->StopExposure(camera_id);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetExpStatus(int camera_id,
+                                          ASI_EXPOSURE_STATUS* status)
+{
+    RecordedCall call(*this, TraceFunction::GetExpStatus, camera_id);
+    ASI_ERROR_CODE error = sdk_->GetExpStatus(camera_id, status);
+    call.returned(error);
+    call.output(status);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetDataAfterExp(int camera_id,
+                                             unsigned char* buffer,
+                                             long buffer_size)
+{
+    RecordedCall call(
+        *this, TraceFunction::GetDataAfterExp, camera_id, {buffer_size});
+    ASI_ERROR_CODE error =
+        sdk_->GetDataAfterExp(camera_id, buffer, buffer_size);
+    call.returned(error);
+    if (error == ASI_SUCCESS) call.data(buffer, buffer_size);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetID(int camera_id, ASI_ID* id)
+{
+    RecordedCall call(*this, TraceFunction::GetID, camera_id);
+    ASI_ERROR_CODE error = sdk_->GetID(camera_id, id);
+    call.returned(error);
+    call.output(id);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::SetID(int camera_id, ASI_ID id)
+{
+    RecordedCall call(*this, TraceFunction::SetID, camera_id);
+    call.output(&id);
+    ASI_ERROR_CODE error = sdk_->SetID(camera_id, id);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetGainOffset(int camera_id,
+                                           int* offset_highest_dr,
+                                           int* offset_unity_gain,
+                                           int* gain_lowest_rn,
+                                           int* offset_lowest_rn)
+{
+    RecordedCall call(*this, TraceFunction::GetGainOffset, camera_id);
+    ASI_ERROR_CODE error = sdk_->GetGainOffset(camera_id,
+                                               offset_highest_dr,
+                                               offset_unity_gain,
+                                               gain_lowest_rn,
+                                               offset_lowest_rn);
+    call.returned(error);
+    call.output(offset_highest_dr);
+    call.output(offset_unity_gain);
+    call.output(gain_lowest_rn);
+    call.output(offset_lowest_rn);
+    return error;
+}
+
+const char* RecordingSdk::GetSDKVersion()
+{
+    RecordedCall call(*this, TraceFunction::GetSDKVersion, -1);
+    const char* version = sdk_->GetSDKVersion();
+    call.returned(0);
+    if (version != nullptr) call.output(version, std::strlen(version) + 1);
+    return version;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetCameraMode(int camera_id,
+                                           ASI_CAMERA_MODE* mode)
+{
+    RecordedCall call(*this, TraceFunction::GetCameraMode, camera_id);
+    ASI_ERROR_CODE error = sdk_->GetCameraMode(camera_id, mode);
+    call.returned(error);
+    call.output(mode);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::SetCameraMode(int camera_id, ASI_CAMERA_MODE mode)
+{
+    RecordedCall call(*this, TraceFunction::SetCameraMode, camera_id, {mode});
+    ASI_ERROR_CODE error = sdk_->SetCameraMode(camera_id, mode);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::SendSoftTrigger(int camera_id, ASI_BOOL start)
+{
+    RecordedCall call(
+        *this, TraceFunction::SendSoftTrigger, camera_id, {start});
+    ASI_ERROR_CODE error = sdk_->SendSoftTrigger(camera_id, start);
+    call.returned(error);
+    return error;
+}
+
+ASI_ERROR_CODE RecordingSdk::GetSerialNumber(int camera_id, ASI_SN* sn)
+{
+    RecordedCall call(*this, TraceFunction::GetSerialNumber, camera_id);
+    ASI_ERROR_CODE error = sdk_->GetSerialNumber(camera_id, sn);
+    call.returned(error);
+    call.output(sn);
+    return error;
+}
+
+// Replay of a call: the outputs of the matching record are copied, and
+// the call lasts (when going out of scope) as long as the recorded one
+// divided by the speed
+class ReplayedCall
+{
+public:
+    ReplayedCall(ReplaySdk& sdk,
+                 TraceFunction function,
+                 int camera_id,
+                 std::vector<int64_t> args = {})
+        : speed_{sdk.speed_},
+          start_{std::chrono::steady_clock::now()},
+          record_{sdk.next(function, camera_id, args)},
+          offset_{0}
+    {
+    }
+
+    ~ReplayedCall()
+    {
+        if (record_ == nullptr || speed_ <= 0.) return;
+        std::this_thread::sleep_until(
+            start_ + std::chrono::nanoseconds(static_cast<int64_t>(
+                         record_->duration_ns / speed_)));
+    }
+
+    const TraceRecord* get_record() const
+    {
+        return record_;
+    }
+
+    ASI_ERROR_CODE error() const
+    {
+        if (record_ == nullptr) return ASI_ERROR_GENERAL_ERROR;
+        return static_cast<ASI_ERROR_CODE>(record_->result);
+    }
+
+    template <typename T>
+    void output(T* value)
+    {
+        if (record_ != nullptr && value != nullptr &&
+            offset_ + sizeof(T) <= record_->output.size())
+        {
+            std::memcpy(value, record_->output.data() + offset_, sizeof(T));
+        }
+        offset_ += sizeof(T);
+    }
+
+    void data(unsigned char* buffer, long size)
+    {
+        if (record_ == nullptr || record_->result != ASI_SUCCESS ||
+            buffer == nullptr)
+        {
+            return;
+        }
+        if (static_cast<long>(record_->data.size()) == size)
+            std::memcpy(buffer, record_->data.data(), size);
+        else
+            std::memset(buffer, 0, size);
+    }
+
+private:
+    double speed_;
+    std::chrono::steady_clock::time_point start_;
+    const TraceRecord* record_;
+    size_t offset_;
+};
+
+ReplaySdk::ReplaySdk(std::filesystem::path path, double speed)
+    : speed_{speed},
+      records_{read_trace(path)},
+      nb_replayed_{0},
+      nb_unmatched_{0}
+{
+    for (const TraceRecord& record : records_)
+    {
+        pending_[Key(record.function, record.camera_id, record.args)]
+            .push_back(&record);
+    }
+}
+
+long ReplaySdk::get_nb_records() const
+{
+    return records_.size();
+}
+
+long ReplaySdk::get_nb_replayed() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_replayed_;
+}
+
+long ReplaySdk::get_nb_unmatched() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nb_unmatched_;
+}
+
+const TraceRecord* ReplaySdk::next(TraceFunction function,
+                                   int camera_id,
+                                   const std::vector<int64_t>& args)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_.find(Key(function, camera_id, args));
+    if (it == pending_.end() || it->second.empty())
+    {
+        nb_unmatched_++;
+        return nullptr;
+    }
+    const TraceRecord* record = it->second.front();
+    it->second.pop_front();
+    nb_replayed_++;
+    return record;
+}
+
+int ReplaySdk::GetNumOfConnectedCameras()
+{
+    ReplayedCall call(*this, TraceFunction::GetNumOfConnectedCameras, -1);
+    const TraceRecord* record = call.get_record();
+    return record == nullptr ? 0 : record->result;
+}
+
+ASI_ERROR_CODE ReplaySdk::GetCameraProperty(ASI_CAMERA_INFO* info,
+                                            int camera_index)
+{
+    ReplayedCall call(*this, TraceFunction::GetCameraProperty, camera_index);
+    call.output(info);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::OpenCamera(int camera_id)
+{
+    ReplayedCall call(*this, TraceFunction::OpenCamera, camera_id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::InitCamera(int camera_id)
+{
+    ReplayedCall call(*this, TraceFunction::InitCamera, camera_id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::CloseCamera(int camera_id)
+{
+    ReplayedCall call(*this, TraceFunction::CloseCamera, camera_id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetNumOfControls(int camera_id, int* nb_controls)
+{
+    ReplayedCall call(*this, TraceFunction::GetNumOfControls, camera_id);
+    call.output(nb_controls);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetControlCaps(int camera_id,
+                                         int control_index,
+                                         ASI_CONTROL_CAPS* caps)
+{
+    ReplayedCall call(
+        *this, TraceFunction::GetControlCaps, camera_id, {control_index});
+    call.output(caps);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetControlValue(int camera_id,
+                                          ASI_CONTROL_TYPE control,
+                                          long* value,
+                                          ASI_BOOL* is_auto)
+{
+    ReplayedCall call(
+        *this, TraceFunction::GetControlValue, camera_id, {control});
+    call.output(value);
+    call.output(is_auto);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::SetControlValue(int camera_id,
+                                          ASI_CONTROL_TYPE control,
+                                          long value,
+                                          ASI_BOOL is_auto)
+{
+    ReplayedCall call(*this,
+                      TraceFunction::SetControlValue,
+                      camera_id,
+                      {control, value, is_auto});
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::SetROIFormat(
+    int camera_id, int width, int height, int bin, ASI_IMG_TYPE type)
+{
+    ReplayedCall call(*this,
+                      TraceFunction::SetROIFormat,
+                      camera_id,
+                      {width, height, bin, type});
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetROIFormat(
+    int camera_id, int* width, int* height, int* bin, ASI_IMG_TYPE* type)
+{
+    ReplayedCall call(*this, TraceFunction::GetROIFormat, camera_id);
+    call.output(width);
+    call.output(height);
+    call.output(bin);
+    call.output(type);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::SetStartPos(int camera_id, int start_x, int start_y)
+{
+    ReplayedCall call(
+        *this, TraceFunction::SetStartPos, camera_id, {start_x, start_y});
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetStartPos(int camera_id,
+                                      int* start_x,
+                                      int* start_y)
+{
+    ReplayedCall call(*this, TraceFunction::GetStartPos, camera_id);
+    call.output(start_x);
+    call.output(start_y);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetDroppedFrames(int camera_id, int* dropped_frames)
+{
+    ReplayedCall call(*this, TraceFunction::GetDroppedFrames, camera_id);
+    call.output(dropped_frames);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::EnableDarkSubtract(int camera_id, char*)
+{
+    ReplayedCall call(*this, TraceFunction::EnableDarkSubtract, camera_id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::DisableDarkSubtract(int camera_id)
+{
+    ReplayedCall call(*this, TraceFunction::DisableDarkSubtract, camera_id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::StartVideoCapture(int camera_id)
+{
+    ReplayedCall call(*this, TraceFunction::StartVideoCapture, camera_id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::StopVideoCapture(int camera_id)
+{
+    ReplayedCall call(*this, TraceFunction::StopVideoCapture, camera_id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetVideoData(int camera_id,
+                                       unsigned char* buffer,
+                                       long buffer_size,
+                                       int wait_ms)
+{
+    ReplayedCall call(*this,
+                      TraceFunction::GetVideoData,
+                      camera_id,
+                      {buffer_size, wait_ms});
+    call.data(buffer, buffer_size);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::PulseGuideOn(int camera_id,
+                                       ASI_GUIDE_DIRECTION direction)
+{
+    ReplayedCall call(
+        *this, TraceFunction::PulseGuideOn, camera_id, {direction});
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::PulseGuideOff(int camera_id,
+                                        ASI_GUIDE_DIRECTION direction)
+{
+    ReplayedCall call(
+        *this, TraceFunction::PulseGuideOff, camera_id, {direction});
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::StartExposure(int camera_id, ASI_BOOL is_dark)
+{
+    ReplayedCall call(
+        *this, TraceFunction::StartExposure, camera_id, {is_dark});
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::StopExposure(int camera_id)
+{
+    ReplayedCall call(*this, TraceFunction::StopExposure, camera_id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetExpStatus(int camera_id,
+                                       ASI_EXPOSURE_STATUS* status)
+{
+    ReplayedCall call(*this, TraceFunction::GetExpStatus, camera_id);
+    call.output(status);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetDataAfterExp(int camera_id,
+                                          unsigned char* buffer,
+                                          long buffer_size)
+{
+    ReplayedCall call(
+        *this, TraceFunction::GetDataAfterExp, camera_id, {buffer_size});
+    call.data(buffer, buffer_size);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetID(int camera_id, ASI_ID* id)
+{
+    ReplayedCall call(*this, TraceFunction::GetID, camera_id);
+    call.output(id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::SetID(int camera_id, ASI_ID)
+{
+    ReplayedCall call(*this, TraceFunction::SetID, camera_id);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetGainOffset(int camera_id,
+                                        int* offset_highest_dr,
+                                        int* offset_unity_gain,
+                                        int* gain_lowest_rn,
+                                        int* offset_lowest_rn)
+{
+    ReplayedCall call(*this, TraceFunction::GetGainOffset, camera_id);
+    call.output(offset_highest_dr);
+    call.output(offset_unity_gain);
+    call.output(gain_lowest_rn);
+    call.output(offset_lowest_rn);
+    return call.error();
+}
+
+const char* ReplaySdk::GetSDKVersion()
+{
+    ReplayedCall call(*this, TraceFunction::GetSDKVersion, -1);
+    const TraceRecord* record = call.get_record();
+    if (record == nullptr || record->output.empty()) return "";
+    return reinterpret_cast<const char*>(record->output.data());
+}
+
+ASI_ERROR_CODE ReplaySdk::GetCameraMode(int camera_id, ASI_CAMERA_MODE* mode)
+{
+    ReplayedCall call(*this, TraceFunction::GetCameraMode, camera_id);
+    call.output(mode);
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::SetCameraMode(int camera_id, ASI_CAMERA_MODE mode)
+{
+    ReplayedCall call(*this, TraceFunction::SetCameraMode, camera_id, {mode});
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::SendSoftTrigger(int camera_id, ASI_BOOL start)
+{
+    ReplayedCall call(
+        *this, TraceFunction::SendSoftTrigger, camera_id, {start});
+    return call.error();
+}
+
+ASI_ERROR_CODE ReplaySdk::GetSerialNumber(int camera_id, ASI_SN* sn)
+{
+    ReplayedCall call(*this, TraceFunction::GetSerialNumber, camera_id);
+    call.output(sn);
+    return call.error();
+}
+
+}  // namespace zwo_asi
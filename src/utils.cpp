@@ -72,31 +72,19 @@ bool create_udev_file()
     }
 }
 
-std::string run_system_command(std::string command)
+int read_usbfs_memory_mb(bool refresh)
 {
-    // see:
-    // https://www.tutorialspoint.com/How-to-execute-a-command-and-get-the-output-of-command-within-Cplusplus-using-POSIX
-
-    char buffer[128];
-    std::string result = "";
-
-    // Open pipe to file
-    FILE* pipe = popen(command.c_str(), "r");
-    if (!pipe)
-    {
-        return "popen failed!";
-    }
-
-    // read till end of process:
-    while (!feof(pipe))
-    {
-        // use buffer to read and add to result
-        if (fgets(buffer, 128, pipe) != NULL) result += buffer;
-    }
-
-    pclose(pipe);
-
-    return result;
+    static std::mutex mutex;
+    static int usbfs_memory_mb;
+    static bool read = false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (read && !refresh) return usbfs_memory_mb;
+    usbfs_memory_mb = -1;
+    std::ifstream f(USBFS_MEMORY_MB);
+    int value;
+    if (f >> value) usbfs_memory_mb = value;
+    read = true;
+    return usbfs_memory_mb;
 }
 
 }  // namespace internal
@@ -1,7 +1,35 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
+#include <pybind11/functional.h>
+#include <pybind11/stl/filesystem.h>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "zwo_asi/allsky.hpp"
+#include "zwo_asi/bandwidth_planner.hpp"
+#include "zwo_asi/batch_stage.hpp"
+#include "zwo_asi/benchmark.hpp"
 #include "zwo_asi/camera.hpp"
+#include "zwo_asi/camera_registry.hpp"
+#include "zwo_asi/camera_snapshot.hpp"
+#include "zwo_asi/dark_library.hpp"
+#include "zwo_asi/diagnostics.hpp"
+#include "zwo_asi/frame_source.hpp"
+#include "zwo_asi/hdr.hpp"
+#include "zwo_asi/hough.hpp"
+#include "zwo_asi/integrator.hpp"
+#include "zwo_asi/meteor.hpp"
+#include "zwo_asi/pipeline.hpp"
+#include "zwo_asi/pixel_statistics.hpp"
+#include "zwo_asi/ptc.hpp"
+#include "zwo_asi/session.hpp"
+#include "zwo_asi/simulated_sdk.hpp"
+#include "zwo_asi/sky_products.hpp"
+#include "zwo_asi/stages.hpp"
+#include "zwo_asi/toml_config.hpp"
+#include "zwo_asi/trace_sdk.hpp"
 
 using namespace zwo_asi;
 
@@ -11,6 +39,129 @@ void capture(Camera& camera, pybind11::array_t<unsigned char>& image, int image_
   camera.capture((unsigned char*)buffer.ptr, image_size);
 }
 
+// numpy view over the frame data: no copy, the array keeps the
+// frame alive
+pybind11::array_t<unsigned char> frame_data(std::shared_ptr<Frame> frame)
+{
+  pybind11::capsule owner(new std::shared_ptr<Frame>(frame), [](void* p) {
+    delete reinterpret_cast<std::shared_ptr<Frame>*>(p);
+  });
+  return pybind11::array_t<unsigned char>(
+      {(pybind11::ssize_t)frame->data.size()}, frame->data.data(), owner);
+}
+
+// numpy views over the hdr frame values and weights
+pybind11::array_t<float> hdr_data(std::shared_ptr<HdrFrame> hdr,
+                                  std::vector<float>& values)
+{
+  pybind11::capsule owner(new std::shared_ptr<HdrFrame>(hdr), [](void* p) {
+    delete reinterpret_cast<std::shared_ptr<HdrFrame>*>(p);
+  });
+  return pybind11::array_t<float>(
+      {(pybind11::ssize_t)values.size()}, values.data(), owner);
+}
+
+// times as unix timestamps (seconds)
+std::chrono::system_clock::time_point to_time_point(double unix_s)
+{
+  return std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::duration<double>(unix_s)));
+}
+
+double to_unix_s(std::chrono::system_clock::time_point time)
+{
+  return std::chrono::duration<double>(time.time_since_epoch()).count();
+}
+
+// deleter releasing the GIL, for objects whose destructor waits for
+// threads that may need to acquire it
+template <typename T>
+struct GilReleaseDeleter
+{
+  void operator()(T* p) const
+  {
+    pybind11::gil_scoped_release release;
+    delete p;
+  }
+};
+
+// Pipeline stage calling a python callable with lists of frames:
+// the GIL is acquired once per batch rather than once per frame
+class PythonStage : public BatchStage
+{
+public:
+  PythonStage(pybind11::function callable,
+              int batch_size,
+              double max_latency_ms,
+              int max_pending)
+    : BatchStage(batch_size,
+                 std::chrono::microseconds((long)(max_latency_ms * 1000)),
+                 max_pending),
+      callable_(callable)
+  {
+  }
+
+  ~PythonStage()
+  {
+    // the dispatch thread needs the GIL to process the last batch
+    if (PyGILState_Check())
+    {
+      pybind11::gil_scoped_release release;
+      stop();
+    }
+    else
+    {
+      stop();
+    }
+    // this destructor may run on a worker thread
+    pybind11::gil_scoped_acquire acquire;
+    callable_.release().dec_ref();
+  }
+
+protected:
+  void process_batch(const std::vector<std::shared_ptr<Frame>>& frames)
+  {
+    pybind11::gil_scoped_acquire acquire;
+    try
+    {
+      callable_(frames);
+    }
+    catch (pybind11::error_already_set& e)
+    {
+      // converted while the GIL is held
+      throw std::runtime_error(e.what());
+    }
+  }
+
+private:
+  pybind11::function callable_;
+};
+
+// Pipeline stage calling a python callable with each frame, from the
+// worker threads. The callable is released with the GIL held, as the
+// stage may be destroyed by a pipeline which released it.
+std::shared_ptr<FunctionStage> function_stage(pybind11::function callable)
+{
+  std::shared_ptr<pybind11::function> f(
+      new pybind11::function(callable), [](pybind11::function* p) {
+        pybind11::gil_scoped_acquire acquire;
+        delete p;
+      });
+  return std::make_shared<FunctionStage>([f](Frame& frame) {
+    pybind11::gil_scoped_acquire acquire;
+    try
+    {
+      (*f)(pybind11::cast(&frame, pybind11::return_value_policy::reference));
+    }
+    catch (pybind11::error_already_set& e)
+    {
+      // converted while the GIL is held
+      throw std::runtime_error(e.what());
+    }
+  });
+}
+
 PYBIND11_MODULE(bindings, m)
 {
 
@@ -88,26 +239,1056 @@ PYBIND11_MODULE(bindings, m)
     .def_readonly("is_trigger",&CameraInfo::is_trigger)
     .def("__str__",&CameraInfo::to_string);
     
+  pybind11::enum_<ResultCode>(m, "ResultCode")
+    .value("ok", ResultCode::ok)
+    .value("timeout", ResultCode::timeout)
+    .value("disconnected", ResultCode::disconnected)
+    .value("busy", ResultCode::busy)
+    .value("invalid", ResultCode::invalid)
+    .value("failed", ResultCode::failed);
+
+  pybind11::enum_<CameraState>(m, "CameraState")
+    .value("idle", CameraState::idle)
+    .value("exposing", CameraState::exposing)
+    .value("streaming", CameraState::streaming)
+    .value("reconfiguring", CameraState::reconfiguring);
+
+  pybind11::class_<GainOffset>(m, "GainOffset")
+    .def_readonly("offset_highest_dr",&GainOffset::offset_highest_dr)
+    .def_readonly("offset_unity_gain",&GainOffset::offset_unity_gain)
+    .def_readonly("gain_lowest_rn",&GainOffset::gain_lowest_rn)
+    .def_readonly("offset_lowest_rn",&GainOffset::offset_lowest_rn);
+
+  pybind11::class_<Result>(m, "Result")
+    .def_readonly("code", &Result::code)
+    .def_property_readonly("error", [](const Result& r) {
+      return std::string(get_error_name(r.error_code));
+    })
+    .def_property_readonly("message", [](const Result& r) {
+      return r.message == nullptr ? std::string() : std::string(r.message);
+    })
+    .def("ok", &Result::ok)
+    .def("__bool__", &Result::ok);
+
   pybind11::class_<CameraException>(m, "CameraException")
     .def(pybind11::init<std::string,int,ASI_ERROR_CODE,bool>());
 
   m.def("get_nb_cameras", &get_nb_cameras);
   m.def("get_sdk_version", &get_sdk_version);
   m.def("close_camera", &close_camera);
+  m.def("close_cameras", &close_cameras);
   m.def("create_udev_file", &internal::create_udev_file);
+
+  m.def("get_cameras", []() {
+    return CameraRegistry::instance().get_cameras();
+  });
+  m.def("refresh_cameras", []() {
+    return CameraRegistry::instance().refresh();
+  });
+  m.def("get_camera_serial", [](int camera_index) {
+    return CameraRegistry::instance().get_serial(camera_index);
+  });
+  m.def("find_camera_by_name", [](std::string name) {
+    return CameraRegistry::instance().find_by_name(name);
+  });
+  m.def("find_camera_by_serial", [](std::string serial) {
+    return CameraRegistry::instance().find_by_serial(serial);
+  });
+  m.def("find_camera_by_id", [](std::string id) {
+    return CameraRegistry::instance().find_by_id(id);
+  });
+  m.def("add_hotplug_listener", [](CameraRegistry::Listener listener) {
+    return CameraRegistry::instance().add_listener(listener);
+  });
+  m.def("remove_hotplug_listener", [](int listener_id) {
+    CameraRegistry::instance().remove_listener(listener_id);
+  });
+  m.def("start_hotplug_monitoring", [](int period_ms) {
+    CameraRegistry::instance().start_monitoring(
+        std::chrono::milliseconds(period_ms));
+  }, pybind11::arg("period_ms")=1000);
+  m.def("stop_hotplug_monitoring", []() {
+    CameraRegistry::instance().stop_monitoring();
+  }, pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  // the monitoring thread and the listeners (python callables) must not
+  // outlive the interpreter
+  pybind11::module_::import("atexit").attr("register")(
+      pybind11::cpp_function([]() {
+        {
+          pybind11::gil_scoped_release release;
+          CameraRegistry::instance().stop_monitoring();
+        }
+        CameraRegistry::instance().clear_listeners();
+      }));
   
   pybind11::class_<Camera>(m, "Camera")
     .def(pybind11::init<int>())
     .def("set_roi", &Camera::set_roi)
+    .def("add_preset", &Camera::add_preset,
+         pybind11::arg("name"), pybind11::arg("config"),
+         pybind11::arg("nb_frames")=2)
+    .def("apply_preset", &Camera::apply_preset)
+    .def("get_preset_pool", &Camera::get_preset_pool)
+    .def("get_presets", &Camera::get_presets)
+    .def("get_active_preset", &Camera::get_active_preset)
     .def("get_roi", &Camera::get_roi)
     .def("get_controls", &Camera::get_controls)
     .def("set_control", &Camera::set_control)
     .def("set_auto", &Camera::set_auto)
+    .def("set_exposure_and_gain", &Camera::set_exposure_and_gain)
     .def("set_camera_mode", &Camera::set_camera_mode)
     .def("set_pulse_guide_on", &Camera::set_pulse_guide_on)
     .def("set_pulse_guide_off", &Camera::set_pulse_guide_off)
     .def("enable_dark_substract", &Camera::enable_dark_substract)
     .def("disable_dark_substract", &Camera::disable_dark_substract)
     .def("get_info", &Camera::get_info)
-    .def("capture", &capture);
+    .def("get_index", &Camera::get_index)
+    .def("get_serial", &Camera::get_serial)
+    .def("get_gain_offset", &Camera::get_gain_offset)
+    .def("get_id", &Camera::get_id)
+    .def("set_id", &Camera::set_id)
+    .def("capture", &capture)
+    .def("capture_frame",
+         pybind11::overload_cast<Frame&>(&Camera::capture),
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("start_video", &Camera::start_video)
+    .def("stop_video", &Camera::stop_video)
+    .def("is_video_active", &Camera::is_video_active)
+    .def("get_state", &Camera::get_state)
+    .def("get_video_frame",
+         pybind11::overload_cast<Frame&,int>(&Camera::get_video_frame),
+         pybind11::arg("frame"), pybind11::arg("wait_ms")=-1,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("try_capture_frame",
+         pybind11::overload_cast<Frame&>(&Camera::try_capture),
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("try_get_video_frame",
+         pybind11::overload_cast<Frame&,int>(&Camera::try_get_video_frame),
+         pybind11::arg("frame"), pybind11::arg("wait_ms")=-1,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("try_set_control", &Camera::try_set_control)
+    .def("get_dropped_frames", &Camera::get_dropped_frames)
+    .def("get_camera_mode", &Camera::get_camera_mode);
+
+  pybind11::class_<CameraDiagnostics>(m, "CameraDiagnostics")
+    .def_readonly("camera_index",&CameraDiagnostics::camera_index)
+    .def_readonly("name",&CameraDiagnostics::name)
+    .def_readonly("is_usb3",&CameraDiagnostics::is_usb3)
+    .def_readonly("is_usb3_host",&CameraDiagnostics::is_usb3_host)
+    .def_readonly("roi",&CameraDiagnostics::roi)
+    .def_readonly("bandwidth_percent",&CameraDiagnostics::bandwidth_percent)
+    .def_readonly("exposure_us",&CameraDiagnostics::exposure_us)
+    .def_readonly("frame_size",&CameraDiagnostics::frame_size)
+    .def_readonly("throughput_mb_s",&CameraDiagnostics::throughput_mb_s)
+    .def_readonly("max_fps",&CameraDiagnostics::max_fps)
+    .def_readonly("warnings",&CameraDiagnostics::warnings)
+    .def("__str__",&CameraDiagnostics::to_string);
+
+  pybind11::class_<Diagnostics>(m, "Diagnostics")
+    .def_readonly("usbfs_memory_mb",&Diagnostics::usbfs_memory_mb)
+    .def_readonly("cameras",&Diagnostics::cameras)
+    .def_readonly("warnings",&Diagnostics::warnings)
+    .def("ok",&Diagnostics::ok)
+    .def("__str__",&Diagnostics::to_string);
+
+  m.def("get_camera_diagnostics", &get_camera_diagnostics);
+  m.def("get_system_diagnostics", &get_system_diagnostics,
+        pybind11::arg("refresh")=false);
+  m.def("get_max_frame_rate", &get_max_frame_rate,
+        pybind11::arg("info"), pybind11::arg("roi"),
+        pybind11::arg("bandwidth_percent")=100,
+        pybind11::arg("exposure_us")=0);
+
+  pybind11::class_<PlannerTarget>(m, "PlannerTarget")
+    .def(pybind11::init<>())
+    .def_readwrite("fps",&PlannerTarget::fps)
+    .def_readwrite("exposure_us",&PlannerTarget::exposure_us)
+    .def_readwrite("types",&PlannerTarget::types)
+    .def_readwrite("prefer_resolution",&PlannerTarget::prefer_resolution)
+    .def_readwrite("bandwidth_percent",&PlannerTarget::bandwidth_percent);
+
+  pybind11::class_<BandwidthPlan>(m, "BandwidthPlan")
+    .def_readonly("roi",&BandwidthPlan::roi)
+    .def_readonly("bandwidth_percent",&BandwidthPlan::bandwidth_percent)
+    .def_readonly("throughput_mb_s",&BandwidthPlan::throughput_mb_s)
+    .def_readonly("required_mb_s",&BandwidthPlan::required_mb_s)
+    .def_readonly("predicted_fps",&BandwidthPlan::predicted_fps)
+    .def_readonly("field_of_view",&BandwidthPlan::field_of_view)
+    .def_readonly("meets_target",&BandwidthPlan::meets_target)
+    .def("__str__",&BandwidthPlan::to_string);
+
+  pybind11::class_<BandwidthTrial>(m, "BandwidthTrial")
+    .def_readonly("bandwidth_percent",&BandwidthTrial::bandwidth_percent)
+    .def_readonly("frames",&BandwidthTrial::frames)
+    .def_readonly("dropped",&BandwidthTrial::dropped)
+    .def_readonly("timeouts",&BandwidthTrial::timeouts)
+    .def_readonly("fps",&BandwidthTrial::fps);
+
+  pybind11::class_<BandwidthTuning>(m, "BandwidthTuning")
+    .def_readonly("bandwidth_percent",&BandwidthTuning::bandwidth_percent)
+    .def_readonly("trials",&BandwidthTuning::trials)
+    .def("__str__",&BandwidthTuning::to_string);
+
+  m.def("get_bandwidth_plans", &get_bandwidth_plans);
+  m.def("plan_bandwidth", &plan_bandwidth);
+  m.def("apply_plan", &apply_plan);
+  m.def("tune_bandwidth",
+        [](Camera& camera, int trial_duration_ms, int min_percent, int step) {
+          return tune_bandwidth(camera,
+                                std::chrono::milliseconds(trial_duration_ms),
+                                min_percent,
+                                step);
+        },
+        pybind11::arg("camera"), pybind11::arg("trial_duration_ms")=2000,
+        pybind11::arg("min_percent")=40, pybind11::arg("step")=10,
+        pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  pybind11::class_<BenchmarkOptions>(m, "BenchmarkOptions")
+    .def(pybind11::init<>())
+    .def_property("duration_ms",
+                  [](const BenchmarkOptions& o) { return o.duration.count(); },
+                  [](BenchmarkOptions& o, long duration_ms) {
+                    o.duration = std::chrono::milliseconds(duration_ms);
+                  })
+    .def_readwrite("bandwidths",&BenchmarkOptions::bandwidths)
+    .def_readwrite("types",&BenchmarkOptions::types)
+    .def_readwrite("sweep_high_speed",&BenchmarkOptions::sweep_high_speed);
+
+  pybind11::class_<BenchmarkResult>(m, "BenchmarkResult")
+    .def_readonly("type",&BenchmarkResult::type)
+    .def_readonly("high_speed",&BenchmarkResult::high_speed)
+    .def_readonly("bandwidth_percent",&BenchmarkResult::bandwidth_percent)
+    .def_readonly("frames",&BenchmarkResult::frames)
+    .def_readonly("dropped",&BenchmarkResult::dropped)
+    .def_readonly("timeouts",&BenchmarkResult::timeouts)
+    .def_readonly("fps",&BenchmarkResult::fps)
+    .def_readonly("throughput_mb_s",&BenchmarkResult::throughput_mb_s);
+
+  pybind11::class_<ThroughputProfile>(m, "ThroughputProfile")
+    .def_readonly("camera_model",&ThroughputProfile::camera_model)
+    .def_readonly("host",&ThroughputProfile::host)
+    .def_readonly("type",&ThroughputProfile::type)
+    .def_readonly("high_speed",&ThroughputProfile::high_speed)
+    .def_readonly("bandwidth_percent",&ThroughputProfile::bandwidth_percent)
+    .def_readonly("width",&ThroughputProfile::width)
+    .def_readonly("height",&ThroughputProfile::height)
+    .def_readonly("bins",&ThroughputProfile::bins)
+    .def_readonly("fps",&ThroughputProfile::fps)
+    .def_readonly("dropped",&ThroughputProfile::dropped)
+    .def("__str__",&ThroughputProfile::to_string);
+
+  pybind11::class_<ProfileCache>(m, "ProfileCache")
+    .def(pybind11::init<std::filesystem::path>(),
+         pybind11::arg("path")=get_default_profile_cache())
+    .def("load",&ProfileCache::load)
+    .def("save",&ProfileCache::save)
+    // None if no profile
+    .def("get",&ProfileCache::get,
+         pybind11::return_value_policy::reference_internal)
+    .def("set",&ProfileCache::set)
+    .def("get_profiles",&ProfileCache::get_profiles)
+    .def("get_path",&ProfileCache::get_path);
+
+  m.def("run_benchmark", &run_benchmark,
+        pybind11::arg("camera"), pybind11::arg("options")=BenchmarkOptions(),
+        pybind11::call_guard<pybind11::gil_scoped_release>());
+  m.def("calibrate", &calibrate,
+        pybind11::arg("camera"), pybind11::arg("options")=BenchmarkOptions(),
+        pybind11::arg("cache")=get_default_profile_cache(),
+        pybind11::call_guard<pybind11::gil_scoped_release>());
+  m.def("apply_cached_profile", &apply_cached_profile,
+        pybind11::arg("camera"),
+        pybind11::arg("cache")=get_default_profile_cache());
+  m.def("get_default_profile_cache", &get_default_profile_cache);
+
+  pybind11::class_<ControlSetting>(m, "ControlSetting")
+    .def(pybind11::init<>())
+    .def_readwrite("value",&ControlSetting::value)
+    .def_readwrite("is_auto",&ControlSetting::is_auto);
+
+  pybind11::class_<CameraSnapshot>(m, "CameraSnapshot")
+    .def(pybind11::init<>())
+    .def_readwrite("roi",&CameraSnapshot::roi)
+    .def_readwrite("controls",&CameraSnapshot::controls)
+    .def_readwrite("has_mode",&CameraSnapshot::has_mode)
+    .def_readwrite("mode",&CameraSnapshot::mode)
+    .def("to_binary", [](const CameraSnapshot& snapshot) {
+      std::vector<unsigned char> data = snapshot.to_binary();
+      return pybind11::bytes(reinterpret_cast<const char*>(data.data()),
+                             data.size());
+    })
+    .def_static("from_binary", [](pybind11::bytes b) {
+      std::string s = b;
+      return CameraSnapshot::from_binary(
+          std::vector<unsigned char>(s.begin(), s.end()));
+    })
+    .def("to_toml",&CameraSnapshot::to_toml);
+
+  m.def("take_snapshot", &take_snapshot);
+  m.def("restore_snapshot",
+        pybind11::overload_cast<Camera&, const CameraSnapshot&>(
+            &restore_snapshot));
+
+  m.def("parse_toml_config", &parse_toml_config,
+        pybind11::arg("content"),
+        pybind11::arg("source")="toml configuration");
+  m.def("load_toml_config", &load_toml_config);
+  m.def("configure_from_toml", &configure_from_toml,
+        pybind11::arg("camera"), pybind11::arg("path"));
+  m.def("validate_config", [](const CameraSnapshot& config, Camera& camera) {
+    return validate_config(config, camera.get_info(), camera.get_controls());
+  });
+
+  pybind11::class_<ConfigurationProfiles>(m, "ConfigurationProfiles")
+    .def(pybind11::init<>())
+    .def("set",&ConfigurationProfiles::set)
+    .def("save",&ConfigurationProfiles::save)
+    .def("get",&ConfigurationProfiles::get)
+    .def("has",&ConfigurationProfiles::has)
+    .def("remove",&ConfigurationProfiles::remove)
+    .def("get_names",&ConfigurationProfiles::get_names)
+    .def("apply",&ConfigurationProfiles::apply)
+    .def("invalidate",&ConfigurationProfiles::invalidate)
+    .def("save_file",&ConfigurationProfiles::save_file)
+    .def("load_file",&ConfigurationProfiles::load_file);
+
+  pybind11::class_<Sdk, std::shared_ptr<Sdk>>(m, "Sdk");
+
+  pybind11::class_<SimulatedSdk, Sdk, std::shared_ptr<SimulatedSdk>>(
+      m, "SimulatedSdk")
+    .def(pybind11::init<int,std::string,int,int,bool,bool>(),
+         pybind11::arg("nb_cameras")=1,
+         pybind11::arg("name")="ZWO ASI Simulator",
+         pybind11::arg("max_width")=1280, pybind11::arg("max_height")=960,
+         pybind11::arg("usb3")=true, pybind11::arg("color")=true)
+    .def("disconnect", [](SimulatedSdk& sdk, int camera_id, int duration_ms) {
+      sdk.disconnect(camera_id, std::chrono::milliseconds(duration_ms));
+    }, pybind11::arg("camera_id"), pybind11::arg("duration_ms")=0)
+    .def("reconnect",&SimulatedSdk::reconnect)
+    .def("inject_timeouts",&SimulatedSdk::inject_timeouts)
+    .def("swap",&SimulatedSdk::swap)
+    .def("set_flux",&SimulatedSdk::set_flux)
+    .def("set_read_noise",&SimulatedSdk::set_read_noise)
+    .def("set_full_well",&SimulatedSdk::set_full_well);
+
+  pybind11::class_<NativeSdk, Sdk, std::shared_ptr<NativeSdk>>(
+      m, "NativeSdk")
+    .def(pybind11::init<>());
+
+  pybind11::enum_<TraceFunction>(m, "TraceFunction")
+    .value("GetNumOfConnectedCameras", TraceFunction::GetNumOfConnectedCameras)
+    .value("GetCameraProperty", TraceFunction::GetCameraProperty)
+    .value("OpenCamera", TraceFunction::OpenCamera)
+    .value("InitCamera", TraceFunction::InitCamera)
+    .value("CloseCamera", TraceFunction::CloseCamera)
+    .value("GetNumOfControls", TraceFunction::GetNumOfControls)
+    .value("GetControlCaps", TraceFunction::GetControlCaps)
+    .value("GetControlValue", TraceFunction::GetControlValue)
+    .value("SetControlValue", TraceFunction::SetControlValue)
+    .value("SetROIFormat", TraceFunction::SetROIFormat)
+    .value("GetROIFormat", TraceFunction::GetROIFormat)
+    .value("SetStartPos", TraceFunction::SetStartPos)
+    .value("GetStartPos", TraceFunction::GetStartPos)
+    .value("GetDroppedFrames", TraceFunction::GetDroppedFrames)
+    .value("EnableDarkSubtract", TraceFunction::EnableDarkSubtract)
+    .value("DisableDarkSubtract", TraceFunction::DisableDarkSubtract)
+    .value("StartVideoCapture", TraceFunction::StartVideoCapture)
+    .value("StopVideoCapture", TraceFunction::StopVideoCapture)
+    .value("GetVideoData", TraceFunction::GetVideoData)
+    .value("PulseGuideOn", TraceFunction::PulseGuideOn)
+    .value("PulseGuideOff", TraceFunction::PulseGuideOff)
+    .value("StartExposure", TraceFunction::StartExposure)
+    .value("StopExposure", TraceFunction::StopExposure)
+    .value("GetExpStatus", TraceFunction::GetExpStatus)
+    .value("GetDataAfterExp", TraceFunction::GetDataAfterExp)
+    .value("GetID", TraceFunction::GetID)
+    .value("SetID", TraceFunction::SetID)
+    .value("GetGainOffset", TraceFunction::GetGainOffset)
+    .value("GetSDKVersion", TraceFunction::GetSDKVersion)
+    .value("GetCameraMode", TraceFunction::GetCameraMode)
+    .value("SetCameraMode", TraceFunction::SetCameraMode)
+    .value("SendSoftTrigger", TraceFunction::SendSoftTrigger)
+    .value("GetSerialNumber", TraceFunction::GetSerialNumber)
+    .def("__str__", [](TraceFunction function) {
+      return to_string(function);
+    });
+
+  pybind11::enum_<TraceData>(m, "TraceData")
+    .value("hash", TraceData::hash)
+    .value("full", TraceData::full);
+
+  pybind11::class_<TraceRecord>(m, "TraceRecord")
+    .def_readonly("function",&TraceRecord::function)
+    .def_readonly("camera_id",&TraceRecord::camera_id)
+    .def_readonly("args",&TraceRecord::args)
+    .def_readonly("result",&TraceRecord::result)
+    .def_readonly("start_ns",&TraceRecord::start_ns)
+    .def_readonly("duration_ns",&TraceRecord::duration_ns)
+    .def_readonly("data_hash",&TraceRecord::data_hash)
+    .def_readonly("data_size",&TraceRecord::data_size)
+    .def("get_function_name", [](const TraceRecord& record) {
+      return to_string(record.function);
+    })
+    .def("__str__",&TraceRecord::to_string);
+
+  m.def("read_trace", &read_trace);
+
+  pybind11::class_<RecordingSdk, Sdk, std::shared_ptr<RecordingSdk>>(
+      m, "RecordingSdk")
+    .def(pybind11::init<std::shared_ptr<Sdk>,std::filesystem::path,TraceData>(),
+         pybind11::arg("sdk"), pybind11::arg("path"),
+         pybind11::arg("data")=TraceData::hash)
+    .def("get_nb_records",&RecordingSdk::get_nb_records)
+    .def("flush",&RecordingSdk::flush);
+
+  pybind11::class_<ReplaySdk, Sdk, std::shared_ptr<ReplaySdk>>(
+      m, "ReplaySdk")
+    .def(pybind11::init<std::filesystem::path,double>(),
+         pybind11::arg("path"), pybind11::arg("speed")=1.)
+    .def("get_nb_records",&ReplaySdk::get_nb_records)
+    .def("get_nb_replayed",&ReplaySdk::get_nb_replayed)
+    .def("get_nb_unmatched",&ReplaySdk::get_nb_unmatched);
+
+  // None restores the native SDK
+  m.def("set_sdk", &set_sdk, pybind11::arg("sdk").none(true));
+
+  pybind11::class_<RecoveryMetrics>(m, "RecoveryMetrics")
+    .def_readonly("recoveries",&RecoveryMetrics::recoveries)
+    .def_readonly("failed_recoveries",&RecoveryMetrics::failed_recoveries)
+    .def_readonly("timeouts",&RecoveryMetrics::timeouts)
+    .def_readonly("last_recovery_ms",&RecoveryMetrics::last_recovery_ms)
+    .def_readonly("max_recovery_ms",&RecoveryMetrics::max_recovery_ms)
+    .def_readonly("total_recovery_ms",&RecoveryMetrics::total_recovery_ms)
+    .def_readonly("last_gap_ms",&RecoveryMetrics::last_gap_ms)
+    .def_readonly("total_gap_ms",&RecoveryMetrics::total_gap_ms)
+    .def_readonly("lost_frames",&RecoveryMetrics::lost_frames);
+
+  pybind11::class_<Session>(m, "Session")
+    .def(pybind11::init([](int camera_index,
+                           int recovery_timeout_ms,
+                           int max_consecutive_timeouts) {
+           return new Session(camera_index,
+                              std::chrono::milliseconds(recovery_timeout_ms),
+                              max_consecutive_timeouts);
+         }),
+         pybind11::arg("camera_index"),
+         pybind11::arg("recovery_timeout_ms")=10000,
+         pybind11::arg("max_consecutive_timeouts")=3)
+    .def("get_camera",&Session::get_camera,
+         pybind11::return_value_policy::reference_internal)
+    .def("set_roi",&Session::set_roi)
+    .def("set_control",&Session::set_control)
+    .def("set_auto",&Session::set_auto)
+    .def("set_exposure_and_gain",&Session::set_exposure_and_gain)
+    .def("set_camera_mode",&Session::set_camera_mode)
+    .def("capture",&Session::capture,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("start_video",&Session::start_video)
+    .def("stop_video",&Session::stop_video)
+    .def("get_video_frame",&Session::get_video_frame,
+         pybind11::arg("frame"), pybind11::arg("wait_ms")=-1,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("recover",&Session::recover,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_metrics",&Session::get_metrics);
+
+  // writable, e.g. for frames not acquired by a camera
+  pybind11::class_<FrameSettings>(m, "FrameSettings")
+    .def(pybind11::init<>())
+    .def_readwrite("exposure_us",&FrameSettings::exposure_us)
+    .def_readwrite("gain",&FrameSettings::gain)
+    .def_readwrite("generation",&FrameSettings::generation);
+
+  pybind11::class_<Frame, std::shared_ptr<Frame>>(m, "Frame")
+    .def(pybind11::init<int,int,ImageType>())
+    .def_readonly("width",&Frame::width)
+    .def_readonly("height",&Frame::height)
+    .def_readonly("type",&Frame::type)
+    .def_readwrite("index",&Frame::index)
+    .def_readwrite("settings",&Frame::settings)
+    .def_readonly("settings_changed",&Frame::settings_changed)
+    .def("size",&Frame::size)
+    .def("get_data",&frame_data);
+
+  pybind11::class_<FramePool, std::shared_ptr<FramePool>>(m, "FramePool")
+    .def(pybind11::init<int,int,ImageType,int>())
+    .def("acquire",&FramePool::acquire,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("try_acquire",&FramePool::try_acquire)
+    .def("available",&FramePool::available)
+    .def("capacity",&FramePool::capacity);
+
+  pybind11::class_<BracketStep>(m, "BracketStep")
+    .def(pybind11::init([](long exposure_us, long gain) {
+      return BracketStep{exposure_us, gain};
+    }), pybind11::arg("exposure_us"), pybind11::arg("gain")=0)
+    .def_readwrite("exposure_us",&BracketStep::exposure_us)
+    .def_readwrite("gain",&BracketStep::gain);
+
+  pybind11::class_<HdrOptions>(m, "HdrOptions")
+    .def(pybind11::init<>())
+    .def_readwrite("saturation",&HdrOptions::saturation)
+    .def_readwrite("rolloff",&HdrOptions::rolloff)
+    .def_readwrite("black_level",&HdrOptions::black_level);
+
+  pybind11::class_<HdrFrame, std::shared_ptr<HdrFrame>>(m, "HdrFrame")
+    .def(pybind11::init<int,int,ImageType>())
+    .def_readonly("width",&HdrFrame::width)
+    .def_readonly("height",&HdrFrame::height)
+    .def_readonly("type",&HdrFrame::type)
+    .def_readonly("index",&HdrFrame::index)
+    .def("size",&HdrFrame::size)
+    .def("get_data", [](std::shared_ptr<HdrFrame> hdr) {
+      return hdr_data(hdr, hdr->data);
+    })
+    .def("get_weights", [](std::shared_ptr<HdrFrame> hdr) {
+      return hdr_data(hdr, hdr->weights);
+    });
+
+  m.def("merge_hdr", &merge_hdr,
+        pybind11::arg("frames"), pybind11::arg("hdr"),
+        pybind11::arg("options")=HdrOptions(),
+        pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  pybind11::class_<BracketSequencer>(m, "BracketSequencer")
+    .def(pybind11::init<Camera&,std::vector<BracketStep>,HdrOptions>(),
+         pybind11::arg("camera"), pybind11::arg("steps"),
+         pybind11::arg("options")=HdrOptions(),
+         pybind11::keep_alive<1,2>())
+    .def("capture",
+         pybind11::overload_cast<>(&BracketSequencer::capture),
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("capture_hdr",
+         pybind11::overload_cast<HdrFrame&>(&BracketSequencer::capture),
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_steps",&BracketSequencer::get_steps)
+    .def("get_last_duration_ms",&BracketSequencer::get_last_duration_ms);
+
+  pybind11::class_<IntegratorOptions>(m, "IntegratorOptions")
+    .def(pybind11::init<>())
+    .def_readwrite("nb_frames",&IntegratorOptions::nb_frames)
+    .def_readwrite("rejection_threshold",
+                   &IntegratorOptions::rejection_threshold)
+    .def_readwrite("trail_sigma",&IntegratorOptions::trail_sigma)
+    .def_readwrite("trail_binning",&IntegratorOptions::trail_binning)
+    .def_readwrite("trail_width",&IntegratorOptions::trail_width)
+    .def_readwrite("trail_hough",&IntegratorOptions::trail_hough);
+
+  pybind11::class_<IntegratedFrame>(m, "IntegratedFrame")
+    .def_readonly("width",&IntegratedFrame::width)
+    .def_readonly("height",&IntegratedFrame::height)
+    .def_readonly("type",&IntegratedFrame::type)
+    .def_readonly("index",&IntegratedFrame::index)
+    .def_readonly("nb_frames",&IntegratedFrame::nb_frames)
+    .def_readonly("exposure_us",&IntegratedFrame::exposure_us)
+    .def_readonly("nb_rejected",&IntegratedFrame::nb_rejected)
+    .def_readonly("nb_trails",&IntegratedFrame::nb_trails)
+    .def_readonly("nb_masked",&IntegratedFrame::nb_masked)
+    .def("size",&IntegratedFrame::size)
+    // numpy view, valid until the next integration completes
+    .def("get_data", [](pybind11::object self) {
+      IntegratedFrame& frame = self.cast<IntegratedFrame&>();
+      return pybind11::array_t<uint32_t>(
+          {(pybind11::ssize_t)frame.data.size()}, frame.data.data(), self);
+    });
+
+  pybind11::class_<VideoIntegrator>(m, "VideoIntegrator")
+    .def(pybind11::init<int,int,ImageType,IntegratorOptions>(),
+         pybind11::arg("width"), pybind11::arg("height"),
+         pybind11::arg("type"), pybind11::arg("options")=IntegratorOptions())
+    .def("add",&VideoIntegrator::add,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_frame",&VideoIntegrator::get_frame,
+         pybind11::return_value_policy::reference_internal)
+    .def("capture",&VideoIntegrator::capture,
+         pybind11::arg("camera"), pybind11::arg("wait_ms")=-1,
+         pybind11::return_value_policy::reference_internal,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_nb_added",&VideoIntegrator::get_nb_added)
+    .def("reset",&VideoIntegrator::reset)
+    .def("get_options",&VideoIntegrator::get_options);
+
+  pybind11::class_<DarkKey>(m, "DarkKey")
+    .def(pybind11::init<>())
+    .def_readwrite("exposure_us",&DarkKey::exposure_us)
+    .def_readwrite("gain",&DarkKey::gain)
+    .def_readwrite("offset",&DarkKey::offset)
+    .def_readwrite("temperature_c",&DarkKey::temperature_c)
+    .def_readwrite("width",&DarkKey::width)
+    .def_readwrite("height",&DarkKey::height)
+    .def_readwrite("bins",&DarkKey::bins)
+    .def_readwrite("type",&DarkKey::type)
+    .def("__str__",&DarkKey::to_string);
+
+  pybind11::class_<DarkMatch>(m, "DarkMatch")
+    .def_readonly("key",&DarkMatch::key)
+    .def_readonly("scale",&DarkMatch::scale)
+    .def_readonly("exact",&DarkMatch::exact);
+
+  m.def("get_dark_key", &get_dark_key);
+
+  pybind11::class_<DarkLibrary>(m, "DarkLibrary")
+    .def(pybind11::init<std::filesystem::path,int,double>(),
+         pybind11::arg("folder"), pybind11::arg("cache_size")=8,
+         pybind11::arg("temperature_step_c")=2.)
+    .def("add",&DarkLibrary::add,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_keys",&DarkLibrary::get_keys)
+    .def("find",&DarkLibrary::find)
+    .def("calibrate",&DarkLibrary::calibrate,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_nb_cached",&DarkLibrary::get_nb_cached)
+    .def("get_cached_keys",&DarkLibrary::get_cached_keys)
+    .def("clear_cache",&DarkLibrary::clear_cache)
+    .def("get_folder",&DarkLibrary::get_folder);
+
+  pybind11::class_<PairStatistics>(m, "PairStatistics")
+    .def_readonly("mean",&PairStatistics::mean)
+    .def_readonly("difference_variance",&PairStatistics::difference_variance)
+    .def_readonly("nb_values",&PairStatistics::nb_values);
+
+  m.def("compute_pair_statistics", &compute_pair_statistics,
+        pybind11::arg("a"), pybind11::arg("b"), pybind11::arg("region")=1.);
+
+  pybind11::class_<PtcOptions>(m, "PtcOptions")
+    .def(pybind11::init<>())
+    .def_readwrite("gains",&PtcOptions::gains)
+    .def_readwrite("exposures_us",&PtcOptions::exposures_us)
+    .def_readwrite("region",&PtcOptions::region);
+
+  pybind11::class_<PtcPoint>(m, "PtcPoint")
+    .def(pybind11::init<>())
+    .def_readwrite("exposure_us",&PtcPoint::exposure_us)
+    .def_readwrite("signal",&PtcPoint::signal)
+    .def_readwrite("shot_variance",&PtcPoint::shot_variance);
+
+  pybind11::class_<GainCharacterization>(m, "GainCharacterization")
+    .def_readonly("gain",&GainCharacterization::gain)
+    .def_readonly("offset",&GainCharacterization::offset)
+    .def_readonly("elec_per_adu",&GainCharacterization::elec_per_adu)
+    .def_readonly("bias_adu",&GainCharacterization::bias_adu)
+    .def_readonly("read_noise_adu",&GainCharacterization::read_noise_adu)
+    .def_readonly("read_noise_e",&GainCharacterization::read_noise_e)
+    .def_readonly("full_well_e",&GainCharacterization::full_well_e)
+    .def_readonly("saturated",&GainCharacterization::saturated)
+    .def_readonly("points",&GainCharacterization::points)
+    .def("__str__",&GainCharacterization::to_string);
+
+  pybind11::class_<PtcProfile>(m, "PtcProfile")
+    .def_readonly("camera_model",&PtcProfile::camera_model)
+    .def_readonly("serial",&PtcProfile::serial)
+    .def_readonly("gains",&PtcProfile::gains)
+    .def("get",&PtcProfile::get,
+         pybind11::return_value_policy::reference_internal)
+    .def("save",&PtcProfile::save)
+    .def_static("load",&PtcProfile::load)
+    .def("__str__",&PtcProfile::to_string);
+
+  m.def("get_default_ptc_profile", &get_default_ptc_profile);
+
+  pybind11::enum_<StatisticsPrecision>(m, "StatisticsPrecision")
+    .value("float32", StatisticsPrecision::float32)
+    .value("float64", StatisticsPrecision::float64);
+
+  pybind11::class_<PixelStatisticsOptions>(m, "PixelStatisticsOptions")
+    .def(pybind11::init<>())
+    .def_readwrite("precision",&PixelStatisticsOptions::precision)
+    .def_readwrite("nb_threads",&PixelStatisticsOptions::nb_threads)
+    .def_readwrite("band_bytes",&PixelStatisticsOptions::band_bytes)
+    .def_readwrite("batch_size",&PixelStatisticsOptions::batch_size);
+
+  pybind11::class_<PixelStatistics>(m, "PixelStatistics")
+    .def(pybind11::init<int,int,ImageType,PixelStatisticsOptions>(),
+         pybind11::arg("width"), pybind11::arg("height"),
+         pybind11::arg("type"),
+         pybind11::arg("options")=PixelStatisticsOptions())
+    .def("add",pybind11::overload_cast<const Frame&>(&PixelStatistics::add),
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("add",
+         pybind11::overload_cast<const std::vector<std::shared_ptr<Frame>>&>(
+             &PixelStatistics::add),
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("add",
+         pybind11::overload_cast<FrameSource&,long,ReadErrors*>(
+             &PixelStatistics::add),
+         pybind11::arg("source"), pybind11::arg("nb_frames")=-1,
+         pybind11::arg("errors")=nullptr,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("capture",&PixelStatistics::capture,
+         pybind11::arg("camera"), pybind11::arg("nb_frames"),
+         pybind11::arg("wait_ms")=-1,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_nb_frames",&PixelStatistics::get_nb_frames)
+    // numpy arrays (copies), one value per pixel
+    .def("get_mean", [](const PixelStatistics& statistics) {
+      std::vector<double> values = statistics.get_mean();
+      return pybind11::array_t<double>(
+          {(pybind11::ssize_t)values.size()}, values.data());
+    })
+    .def("get_variance", [](const PixelStatistics& statistics) {
+      std::vector<double> values = statistics.get_variance();
+      return pybind11::array_t<double>(
+          {(pybind11::ssize_t)values.size()}, values.data());
+    })
+    .def("reset",&PixelStatistics::reset)
+    .def("get_width",&PixelStatistics::get_width)
+    .def("get_height",&PixelStatistics::get_height)
+    .def("get_type",&PixelStatistics::get_type)
+    .def("get_options",&PixelStatistics::get_options);
+  m.def("fit_ptc", &fit_ptc);
+  // on_flats is called (with the gil) between the bias and flat pairs
+  m.def("characterize", &characterize,
+        pybind11::arg("camera"), pybind11::arg("options")=PtcOptions(),
+        pybind11::arg("on_flats")=std::function<void()>(),
+        pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  pybind11::class_<StageMetrics>(m, "StageMetrics")
+    .def_readonly("name",&StageMetrics::name)
+    .def_readonly("processed",&StageMetrics::processed)
+    .def_readonly("failed",&StageMetrics::failed)
+    .def_readonly("queued",&StageMetrics::queued)
+    .def_readonly("max_queued",&StageMetrics::max_queued)
+    .def_readonly("mean_latency_us",&StageMetrics::mean_latency_us)
+    .def_readonly("max_latency_us",&StageMetrics::max_latency_us)
+    .def_readonly("mean_wait_us",&StageMetrics::mean_wait_us)
+    .def_readonly("last_error",&StageMetrics::last_error);
+
+  pybind11::class_<PipelineMetrics>(m, "PipelineMetrics")
+    .def_readonly("pushed",&PipelineMetrics::pushed)
+    .def_readonly("completed",&PipelineMetrics::completed)
+    .def_readonly("rejected",&PipelineMetrics::rejected)
+    .def_readonly("in_flight",&PipelineMetrics::in_flight)
+    .def_readonly("max_in_flight",&PipelineMetrics::max_in_flight)
+    .def_readonly("stages",&PipelineMetrics::stages)
+    .def("__str__",&PipelineMetrics::to_string);
+
+  pybind11::class_<Stage, std::shared_ptr<Stage>>(m, "Stage")
+    // the frame is processed directly, without a pipeline
+    .def("process",&Stage::process,
+         pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  pybind11::class_<FunctionStage, Stage, std::shared_ptr<FunctionStage>>(
+      m, "FunctionStage")
+    .def(pybind11::init(&function_stage), pybind11::arg("callable"));
+
+  pybind11::class_<FrameStatistics>(m, "FrameStatistics")
+    .def_readonly("index",&FrameStatistics::index)
+    .def_readonly("min_value",&FrameStatistics::min_value)
+    .def_readonly("max_value",&FrameStatistics::max_value)
+    .def_readonly("mean",&FrameStatistics::mean);
+
+  pybind11::class_<StatisticsStage, Stage, std::shared_ptr<StatisticsStage>>(
+      m, "StatisticsStage")
+    .def(pybind11::init<>())
+    .def("get_last",&StatisticsStage::get_last);
+
+  pybind11::class_<RawWriterStage, Stage, std::shared_ptr<RawWriterStage>>(
+      m, "RawWriterStage")
+    .def(pybind11::init<std::filesystem::path,std::string>(),
+         pybind11::arg("folder"), pybind11::arg("prefix")="frame_");
+
+  pybind11::class_<BatchMetrics>(m, "BatchMetrics")
+    .def_readonly("batches",&BatchMetrics::batches)
+    .def_readonly("frames",&BatchMetrics::frames)
+    .def_readonly("failed",&BatchMetrics::failed)
+    .def_readonly("pending",&BatchMetrics::pending)
+    .def_readonly("mean_batch_size",&BatchMetrics::mean_batch_size)
+    .def_readonly("mean_batch_latency_us",&BatchMetrics::mean_batch_latency_us)
+    .def_readonly("last_error",&BatchMetrics::last_error);
+
+  pybind11::class_<PythonStage, Stage, std::shared_ptr<PythonStage>>(
+      m, "PythonStage")
+    .def(pybind11::init<pybind11::function,int,double,int>(),
+         pybind11::arg("callable"), pybind11::arg("batch_size")=8,
+         pybind11::arg("max_latency_ms")=20., pybind11::arg("max_pending")=-1)
+    .def("flush",&PythonStage::flush,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_metrics",&PythonStage::get_metrics);
+
+  pybind11::class_<Pipeline, std::unique_ptr<Pipeline, GilReleaseDeleter<Pipeline>>>(
+      m, "Pipeline")
+    .def(pybind11::init<int,int>(),
+         pybind11::arg("nb_threads")=0, pybind11::arg("max_in_flight")=4)
+    .def("add_stage",&Pipeline::add_stage,
+         pybind11::arg("name"), pybind11::arg("stage"),
+         pybind11::arg("after")=std::vector<std::string>(),
+         pybind11::arg("serialized")=false)
+    .def("push",&Pipeline::push,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("try_push",&Pipeline::try_push,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("wait",&Pipeline::wait,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_metrics",&Pipeline::get_metrics)
+    .def("get_stages",&Pipeline::get_stages);
+
+  pybind11::class_<FrameSource, std::shared_ptr<FrameSource>>(
+      m, "FrameSource")
+    .def("get_width",&FrameSource::get_width)
+    .def("get_height",&FrameSource::get_height)
+    .def("get_type",&FrameSource::get_type)
+    .def("get_nb_frames",&FrameSource::get_nb_frames)
+    .def("read",&FrameSource::read,
+         pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  pybind11::class_<CameraSource, FrameSource, std::shared_ptr<CameraSource>>(
+      m, "CameraSource")
+    .def(pybind11::init<Camera&,int>(),
+         pybind11::arg("camera"), pybind11::arg("wait_ms")=-1,
+         pybind11::keep_alive<1,2>());
+
+  pybind11::class_<FileSource, FrameSource, std::shared_ptr<FileSource>>(
+      m, "FileSource")
+    .def("seek",&FileSource::seek)
+    .def("get_position",&FileSource::get_position)
+    .def("decode",&FileSource::decode,
+         pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  pybind11::class_<SerSource, FileSource, std::shared_ptr<SerSource>>(
+      m, "SerSource")
+    .def(pybind11::init<std::filesystem::path>());
+
+  pybind11::class_<FitsSource, FileSource, std::shared_ptr<FitsSource>>(
+      m, "FitsSource")
+    .def(pybind11::init<std::vector<std::filesystem::path>>())
+    .def_static("list",&FitsSource::list);
+
+  pybind11::class_<RawSource, FileSource, std::shared_ptr<RawSource>>(
+      m, "RawSource")
+    .def(pybind11::init<std::filesystem::path,int,int,ImageType,std::string>(),
+         pybind11::arg("folder"), pybind11::arg("width"),
+         pybind11::arg("height"), pybind11::arg("type"),
+         pybind11::arg("prefix")="frame_");
+
+  pybind11::class_<ReadaheadSource, FrameSource,
+                   std::shared_ptr<ReadaheadSource>>(m, "ReadaheadSource")
+    .def(pybind11::init<std::shared_ptr<FileSource>,int,int>(),
+         pybind11::arg("source"), pybind11::arg("nb_frames")=8,
+         pybind11::arg("nb_threads")=0);
+
+  pybind11::class_<ReadErrors>(m, "ReadErrors")
+    .def(pybind11::init<>())
+    .def_readonly("failed",&ReadErrors::failed)
+    .def_readonly("last_error",&ReadErrors::last_error);
+
+  m.def("replay", &replay,
+        pybind11::arg("source"), pybind11::arg("pipeline"),
+        pybind11::arg("nb_frames")=-1, pybind11::arg("nb_buffers")=8,
+        pybind11::arg("errors")=nullptr,
+        pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  m.def("get_solar_altitude",
+        [](double latitude_deg, double longitude_deg, double unix_s) {
+          return get_solar_altitude(
+              latitude_deg, longitude_deg, to_time_point(unix_s));
+        },
+        pybind11::arg("latitude_deg"), pybind11::arg("longitude_deg"),
+        pybind11::arg("unix_s"));
+
+  pybind11::class_<AllSkyPhase>(m, "AllSkyPhase")
+    .def(pybind11::init<std::string,double,long,long,long,double>(),
+         pybind11::arg("name"), pybind11::arg("min_sun_altitude_deg"),
+         pybind11::arg("gain"), pybind11::arg("min_exposure_us"),
+         pybind11::arg("max_exposure_us"), pybind11::arg("interval_s"))
+    .def_readwrite("name",&AllSkyPhase::name)
+    .def_readwrite("min_sun_altitude_deg",&AllSkyPhase::min_sun_altitude_deg)
+    .def_readwrite("gain",&AllSkyPhase::gain)
+    .def_readwrite("min_exposure_us",&AllSkyPhase::min_exposure_us)
+    .def_readwrite("max_exposure_us",&AllSkyPhase::max_exposure_us)
+    .def_readwrite("interval_s",&AllSkyPhase::interval_s);
+
+  pybind11::class_<AllSkyOptions>(m, "AllSkyOptions")
+    .def(pybind11::init<>())
+    .def_readwrite("latitude_deg",&AllSkyOptions::latitude_deg)
+    .def_readwrite("longitude_deg",&AllSkyOptions::longitude_deg)
+    .def_readwrite("phases",&AllSkyOptions::phases)
+    .def_readwrite("target_mean",&AllSkyOptions::target_mean)
+    .def_readwrite("max_exposure_step",&AllSkyOptions::max_exposure_step)
+    .def_readwrite("folder",&AllSkyOptions::folder)
+    .def_readwrite("prefix",&AllSkyOptions::prefix)
+    .def_readwrite("timelapse_scale",&AllSkyOptions::timelapse_scale)
+    .def_readwrite("retry_s",&AllSkyOptions::retry_s)
+    .def_readwrite("max_retry_s",&AllSkyOptions::max_retry_s);
+
+  pybind11::class_<AllSkyFrameInfo>(m, "AllSkyFrameInfo")
+    .def_readonly("index",&AllSkyFrameInfo::index)
+    .def_property_readonly("unix_s", [](const AllSkyFrameInfo& info) {
+      return to_unix_s(info.time);
+    })
+    .def_readonly("sun_altitude_deg",&AllSkyFrameInfo::sun_altitude_deg)
+    .def_readonly("phase",&AllSkyFrameInfo::phase)
+    .def_readonly("exposure_us",&AllSkyFrameInfo::exposure_us)
+    .def_readonly("gain",&AllSkyFrameInfo::gain)
+    .def_readonly("mean",&AllSkyFrameInfo::mean)
+    .def_readonly("path",&AllSkyFrameInfo::path)
+    .def_readonly("error",&AllSkyFrameInfo::error)
+    .def("__str__",&AllSkyFrameInfo::to_string);
+
+  pybind11::class_<AllSky>(m, "AllSky")
+    .def(pybind11::init<Camera&,AllSkyOptions>(),
+         pybind11::arg("camera"), pybind11::arg("options")=AllSkyOptions(),
+         pybind11::keep_alive<1,2>())
+    .def("add_stage",&AllSky::add_stage,
+         pybind11::arg("stage"),
+         pybind11::arg("phases")=std::vector<std::string>())
+    .def("step", pybind11::overload_cast<>(&AllSky::step),
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("step_at", [](AllSky& allsky, double unix_s) {
+      return allsky.step(to_time_point(unix_s));
+    }, pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("set_callback",&AllSky::set_callback)
+    .def("run", [](AllSky& allsky, double duration_s) {
+      // running on a thread of its own, so that this thread checks for
+      // signals (e.g. ctrl-c raising KeyboardInterrupt, which stops the
+      // acquisition)
+      std::mutex mutex;
+      std::condition_variable condition;
+      bool done = false;
+      std::exception_ptr error;
+      std::thread thread([&]() {
+        try {
+          allsky.run(duration_s);
+        } catch (...) {
+          error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        condition.notify_all();
+      });
+      while (true) {
+        {
+          pybind11::gil_scoped_release release;
+          std::unique_lock<std::mutex> lock(mutex);
+          condition.wait_for(lock, std::chrono::milliseconds(100),
+                             [&done] { return done; });
+          if (done) break;
+        }
+        if (PyErr_CheckSignals() != 0) {
+          allsky.stop();
+          {
+            pybind11::gil_scoped_release release;
+            thread.join();
+          }
+          throw pybind11::error_already_set();
+        }
+      }
+      {
+        pybind11::gil_scoped_release release;
+        thread.join();
+      }
+      if (error) std::rethrow_exception(error);
+    }, pybind11::arg("duration_s")=-1.)
+    .def("stop",&AllSky::stop)
+    .def("get_nb_frames",&AllSky::get_nb_frames)
+    .def("get_nb_errors",&AllSky::get_nb_errors)
+    .def("get_last",&AllSky::get_last)
+    .def("get_options",&AllSky::get_options);
+
+  pybind11::class_<KeogramOptions>(m, "KeogramOptions")
+    .def(pybind11::init<>())
+    .def_readwrite("column",&KeogramOptions::column)
+    .def_readwrite("strip_width",&KeogramOptions::strip_width)
+    .def_readwrite("max_columns",&KeogramOptions::max_columns)
+    .def_readwrite("checkpoint",&KeogramOptions::checkpoint)
+    .def_readwrite("checkpoint_interval",&KeogramOptions::checkpoint_interval);
+
+  pybind11::class_<KeogramStage, Stage, std::shared_ptr<KeogramStage>>(
+      m, "KeogramStage")
+    .def(pybind11::init<int,int,ImageType,KeogramOptions>(),
+         pybind11::arg("width"), pybind11::arg("height"),
+         pybind11::arg("type"), pybind11::arg("options")=KeogramOptions())
+    .def("get_image",&KeogramStage::get_image)
+    .def("get_nb_frames",&KeogramStage::get_nb_frames)
+    .def("get_nb_columns",&KeogramStage::get_nb_columns)
+    .def("get_frames_per_column",&KeogramStage::get_frames_per_column)
+    .def("save",&KeogramStage::save)
+    .def("load",&KeogramStage::load)
+    .def("reset",&KeogramStage::reset);
+
+  pybind11::class_<StartrailOptions>(m, "StartrailOptions")
+    .def(pybind11::init<>())
+    .def_readwrite("min_mean",&StartrailOptions::min_mean)
+    .def_readwrite("max_mean",&StartrailOptions::max_mean)
+    .def_readwrite("checkpoint",&StartrailOptions::checkpoint)
+    .def_readwrite("checkpoint_interval",
+                   &StartrailOptions::checkpoint_interval);
+
+  pybind11::class_<StartrailStage, Stage, std::shared_ptr<StartrailStage>>(
+      m, "StartrailStage")
+    .def(pybind11::init<int,int,ImageType,StartrailOptions>(),
+         pybind11::arg("width"), pybind11::arg("height"),
+         pybind11::arg("type"), pybind11::arg("options")=StartrailOptions())
+    .def("get_image",&StartrailStage::get_image)
+    .def("get_nb_frames",&StartrailStage::get_nb_frames)
+    .def("get_nb_skipped",&StartrailStage::get_nb_skipped)
+    .def("save",&StartrailStage::save)
+    .def("load",&StartrailStage::load)
+    .def("reset",&StartrailStage::reset);
+
+  pybind11::class_<LineSegment>(m, "LineSegment")
+    .def_readonly("x0",&LineSegment::x0)
+    .def_readonly("y0",&LineSegment::y0)
+    .def_readonly("x1",&LineSegment::x1)
+    .def_readonly("y1",&LineSegment::y1)
+    .def_readonly("votes",&LineSegment::votes)
+    .def("length",&LineSegment::length)
+    .def("__str__",&LineSegment::to_string);
+
+  pybind11::class_<HoughOptions>(m, "HoughOptions")
+    .def(pybind11::init<>())
+    .def_readwrite("threshold",&HoughOptions::threshold)
+    .def_readwrite("min_length",&HoughOptions::min_length)
+    .def_readwrite("max_gap",&HoughOptions::max_gap)
+    .def_readwrite("nb_angles",&HoughOptions::nb_angles)
+    .def_readwrite("max_segments",&HoughOptions::max_segments);
+
+  pybind11::class_<LineDetector>(m, "LineDetector")
+    .def(pybind11::init<int,int,HoughOptions>(),
+         pybind11::arg("width"), pybind11::arg("height"),
+         pybind11::arg("options")=HoughOptions())
+    // the mask (numpy array, non zero values for the pixels to
+    // consider) is copied
+    .def("detect", [](LineDetector& detector,
+                      pybind11::array_t<unsigned char> mask) {
+      pybind11::buffer_info buffer = mask.request();
+      const unsigned char* data = (const unsigned char*)buffer.ptr;
+      std::vector<uint8_t> copy(data, data + buffer.size);
+      pybind11::gil_scoped_release release;
+      return detector.detect(copy);
+    })
+    .def("get_options",&LineDetector::get_options);
+
+  pybind11::class_<MeteorOptions>(m, "MeteorOptions")
+    .def(pybind11::init<>())
+    .def_readwrite("binning",&MeteorOptions::binning)
+    .def_readwrite("sigma_threshold",&MeteorOptions::sigma_threshold)
+    .def_readwrite("max_changed_fraction",
+                   &MeteorOptions::max_changed_fraction)
+    .def_readwrite("hough",&MeteorOptions::hough)
+    .def_readwrite("pre_trigger_frames",&MeteorOptions::pre_trigger_frames)
+    .def_readwrite("post_trigger_frames",&MeteorOptions::post_trigger_frames)
+    .def_readwrite("folder",&MeteorOptions::folder)
+    .def_readwrite("prefix",&MeteorOptions::prefix);
+
+  pybind11::class_<MeteorEvent>(m, "MeteorEvent")
+    .def_readonly("trigger_index",&MeteorEvent::trigger_index)
+    .def_readonly("first_index",&MeteorEvent::first_index)
+    .def_readonly("last_index",&MeteorEvent::last_index)
+    .def_readonly("segments",&MeteorEvent::segments)
+    .def_readonly("folder",&MeteorEvent::folder)
+    .def("__str__",&MeteorEvent::to_string);
+
+  pybind11::class_<MeteorDetector, Stage, std::shared_ptr<MeteorDetector>>(
+      m, "MeteorDetector")
+    .def(pybind11::init<int,int,ImageType,MeteorOptions>(),
+         pybind11::arg("width"), pybind11::arg("height"),
+         pybind11::arg("type"), pybind11::arg("options")=MeteorOptions())
+    .def("flush",&MeteorDetector::flush,
+         pybind11::call_guard<pybind11::gil_scoped_release>())
+    .def("get_events",&MeteorDetector::get_events)
+    .def("get_nb_frames",&MeteorDetector::get_nb_frames)
+    .def("get_nb_skipped",&MeteorDetector::get_nb_skipped)
+    .def("get_nb_dropped",&MeteorDetector::get_nb_dropped)
+    .def("get_last_error",&MeteorDetector::get_last_error);
 }
@@ -1,11 +1,33 @@
+import _thread
 import toml
 import typing
 import pytest
 import camera_zwo_asi
+import numpy as np
 import tempfile
+import threading
+import time
 from pathlib import Path
 
 
+@pytest.fixture
+def use_sdk():
+    """
+    Yields a function replacing the SDK in use (see set_sdk) for the
+    time of the test, and returning it. The cameras still opened at the
+    end of the test (e.g. when an assertion failed) are closed before the
+    native SDK is restored.
+    """
+
+    def _use_sdk(sdk):
+        camera_zwo_asi.set_sdk(sdk)
+        return sdk
+
+    yield _use_sdk
+    camera_zwo_asi.close_cameras()
+    camera_zwo_asi.set_sdk(None)
+
+
 def test_roi_from_dict():
     """
     Test ROI can be instantiated from dictionaries
@@ -163,3 +185,1917 @@ def test_update_camera_config():
             else:
                 assert instance.value == int( (instance.max_value+instance.min_value) / 2. )
 
+
+
+def test_pipeline_graph():
+    """
+    Check the stages of a graph run in order for each frame (fan-out
+    and fan-in), no more than max_in_flight frames at a time, and are
+    all accounted for in the metrics
+    """
+
+    lock = threading.Lock()
+    order = []
+    active = [0, 0]  # current, max
+
+    def _stage(name):
+        def _process(frame):
+            with lock:
+                order.append((name, frame.index))
+                if name == "source":
+                    active[0] += 1
+                    active[1] = max(active)
+                elif name == "merge":
+                    active[0] -= 1
+            time.sleep(0.001)
+
+        return camera_zwo_asi.FunctionStage(_process)
+
+    pool = camera_zwo_asi.FramePool(64, 32, camera_zwo_asi.ImageType.raw8, 8)
+    pipeline = camera_zwo_asi.Pipeline(nb_threads=4, max_in_flight=3)
+    pipeline.add_stage("source", _stage("source"))
+    pipeline.add_stage("left", _stage("left"), after=["source"])
+    pipeline.add_stage("right", _stage("right"), after=["source"])
+    pipeline.add_stage("merge", _stage("merge"), after=["left", "right"])
+
+    nb_frames = 30
+    for index in range(nb_frames):
+        frame = pool.acquire()
+        frame.index = index
+        pipeline.push(frame)
+    pipeline.wait()
+
+    position = {entry: p for p, entry in enumerate(order)}
+    assert len(position) == 4 * nb_frames
+    for index in range(nb_frames):
+        assert position[("source", index)] < position[("left", index)]
+        assert position[("source", index)] < position[("right", index)]
+        assert position[("left", index)] < position[("merge", index)]
+        assert position[("right", index)] < position[("merge", index)]
+    assert active[1] <= 3
+
+    metrics = pipeline.get_metrics()
+    assert metrics.pushed == nb_frames
+    assert metrics.completed == nb_frames
+    assert metrics.in_flight == 0
+    assert [stage.name for stage in metrics.stages] == [
+        "source", "left", "right", "merge"
+    ]
+    for stage in metrics.stages:
+        assert stage.processed == nb_frames
+        assert stage.failed == 0
+        assert stage.queued == 0
+        assert stage.mean_latency_us >= 1000
+
+    # a failing stage is counted, and the stages after it are skipped
+    def _fail(frame):
+        if frame.index % 2:
+            raise ValueError("odd frame")
+
+    pipeline = camera_zwo_asi.Pipeline(nb_threads=2, max_in_flight=3)
+    pipeline.add_stage("fail", camera_zwo_asi.FunctionStage(_fail))
+    pipeline.add_stage("merge", _stage("merge"), after=["fail"])
+    for index in range(10):
+        frame = pool.acquire()
+        frame.index = index
+        pipeline.push(frame)
+    pipeline.wait()
+    fail, merge = pipeline.get_metrics().stages
+    assert fail.failed == 5
+    assert "odd frame" in fail.last_error
+    assert merge.processed == 5
+
+    # a failing stage does not skip the stages of a sibling branch, only
+    # its downstream stages (including the ones also after the sibling)
+    pipeline = camera_zwo_asi.Pipeline(nb_threads=4, max_in_flight=3)
+    pipeline.add_stage("source", _stage("source"))
+    pipeline.add_stage("fail", camera_zwo_asi.FunctionStage(_fail), after=["source"])
+    pipeline.add_stage("after_fail", _stage("after_fail"), after=["fail"])
+    pipeline.add_stage("ok", _stage("ok"), after=["source"])
+    pipeline.add_stage("after_ok", _stage("after_ok"), after=["ok"])
+    pipeline.add_stage("merge", _stage("merge"), after=["after_fail", "after_ok"])
+    for index in range(10):
+        frame = pool.acquire()
+        frame.index = index
+        pipeline.push(frame)
+    pipeline.wait()
+    processed = {
+        stage.name: (stage.processed, stage.failed)
+        for stage in pipeline.get_metrics().stages
+    }
+    assert processed == {
+        "source": (10, 0),
+        "fail": (10, 5),
+        "after_fail": (5, 0),
+        "ok": (10, 0),
+        "after_ok": (10, 0),
+        "merge": (5, 0),
+    }
+
+
+def test_python_stage():
+    """
+    Check python callables receive all the frames pushed
+    to a pipeline, in batches
+    """
+
+    received = []
+    batch_sizes = []
+
+    def _process(frames):
+        batch_sizes.append(len(frames))
+        received.extend([frame.index for frame in frames])
+
+    pool = camera_zwo_asi.FramePool(64, 32, camera_zwo_asi.ImageType.raw8, 8)
+    pipeline = camera_zwo_asi.Pipeline(nb_threads=2, max_in_flight=4)
+    stage = camera_zwo_asi.PythonStage(_process, batch_size=5, max_latency_ms=10.0)
+    pipeline.add_stage("python", stage)
+
+    nb_frames = 52
+    for index in range(nb_frames):
+        frame = pool.acquire()
+        frame.index = index
+        pipeline.push(frame)
+    pipeline.wait()
+    stage.flush()
+
+    assert sorted(received) == list(range(nb_frames))
+    assert max(batch_sizes) <= 5
+    assert stage.get_metrics().frames == nb_frames
+
+
+def test_open_swapped_cameras(use_sdk):
+    """
+    Check cameras of the same model are opened by serial number
+    after they swapped their camera ids (USB re-enumeration)
+    """
+
+    sdk = use_sdk(camera_zwo_asi.SimulatedSdk(nb_cameras=2))
+    serials = [camera_zwo_asi.get_camera_serial(index) for index in (0, 1)]
+    camera = camera_zwo_asi.Camera.from_serial(serials[1])
+    assert camera.get_index() == 1
+    del camera
+
+    # same names and camera ids: the enumeration does not change
+    sdk.swap(0, 1)
+    assert not camera_zwo_asi.refresh_cameras()
+
+    camera = camera_zwo_asi.Camera.from_serial(serials[1])
+    assert camera.get_index() == 0
+    assert camera.get_serial() == serials[1]
+    del camera
+    assert camera_zwo_asi.get_camera_serial(1) == serials[0]
+
+
+def test_camera_registry(use_sdk):
+    """
+    Check the cameras are enumerated once (cached until refreshed), the
+    hot-plug listeners are notified when cameras are unplugged or
+    plugged, and a camera replaced at an index is not mistaken for the
+    one it replaced
+    """
+
+    sdk = use_sdk(camera_zwo_asi.SimulatedSdk(nb_cameras=3))
+    notified = []
+
+    def _listener(cameras):
+        notified.append([info.camera_id for info in cameras])
+
+    listener = camera_zwo_asi.add_hotplug_listener(_listener)
+    try:
+        assert camera_zwo_asi.get_nb_cameras() == 3
+        serials = [camera_zwo_asi.get_camera_serial(index) for index in range(3)]
+        assert len(set(serials)) == 3
+
+        # unplugged: counted from the cache until refreshed
+        sdk.disconnect(1)
+        assert camera_zwo_asi.get_nb_cameras() == 3
+        assert camera_zwo_asi.refresh_cameras()
+        assert notified == [[0, 2]]
+        assert camera_zwo_asi.get_nb_cameras() == 2
+        assert not camera_zwo_asi.refresh_cameras()
+        assert len(notified) == 1
+
+        # the camera now at index 1 is not the one cached at this index
+        assert camera_zwo_asi.get_camera_serial(1) == serials[2]
+        assert camera_zwo_asi.find_camera_by_serial(serials[1]) == -1
+
+        # plugged again, found by the monitoring thread
+        camera_zwo_asi.start_hotplug_monitoring(period_ms=10)
+        try:
+            sdk.reconnect(1)
+            deadline = time.monotonic() + 5
+            while len(notified) < 2 and time.monotonic() < deadline:
+                time.sleep(0.01)
+        finally:
+            camera_zwo_asi.stop_hotplug_monitoring()
+        assert notified[1] == [0, 1, 2]
+        assert camera_zwo_asi.get_camera_serial(1) == serials[1]
+
+        # unplugged without a refresh: opening the camera at the (cached)
+        # index enumerates again, and opens the camera now at this index
+        sdk.disconnect(1)
+        camera = camera_zwo_asi.Camera(1)
+        assert camera.get_info().camera_id == 2
+        assert camera.get_serial() == serials[2]
+        assert notified[2] == [0, 2]
+        del camera
+    finally:
+        camera_zwo_asi.remove_hotplug_listener(listener)
+
+
+def test_session_recovery(use_sdk):
+    """
+    Check a session recovers from a (simulated) disconnection
+    of the camera, and applies its settings again
+    """
+
+    sdk = use_sdk(camera_zwo_asi.SimulatedSdk(nb_cameras=1))
+    session = camera_zwo_asi.Session(0, recovery_timeout_ms=2000)
+    session.set_control("Exposure", 5000)
+    roi = session.get_camera().get_roi()
+    frame = camera_zwo_asi.Frame(roi.width, roi.height, roi.type)
+
+    session.start_video()
+    for index in range(20):
+        if index == 10:
+            sdk.disconnect(0, duration_ms=200)
+        assert session.get_video_frame(frame, wait_ms=500)
+    session.stop_video()
+
+    metrics = session.get_metrics()
+    assert metrics.recoveries == 1
+    assert metrics.lost_frames > 0
+    controls = session.get_camera().get_controls()
+    assert controls["Exposure"].value == 5000
+
+
+def test_session_timeouts(use_sdk):
+    """
+    Check polling for video frames more often than they are delivered
+    is not taken for a stalled camera, while a camera not delivering
+    frames for longer than the exposure is recovered
+    """
+
+    sdk = use_sdk(camera_zwo_asi.SimulatedSdk(nb_cameras=1))
+    session = camera_zwo_asi.Session(0, recovery_timeout_ms=2000)
+    session.set_control("Exposure", 100000)
+    roi = session.get_camera().get_roi()
+    frame = camera_zwo_asi.Frame(roi.width, roi.height, roi.type)
+
+    session.start_video()
+    nb_frames = 0
+    while nb_frames < 5:
+        nb_frames += session.get_video_frame(frame, wait_ms=10)
+    metrics = session.get_metrics()
+    assert metrics.timeouts > 3
+    assert metrics.recoveries == 0
+    assert metrics.total_gap_ms == 0
+
+    # stalled: timing out without frames
+    sdk.inject_timeouts(0, 1000000)
+    deadline = time.monotonic() + 5
+    while session.get_metrics().recoveries == 0 and time.monotonic() < deadline:
+        assert not session.get_video_frame(frame, wait_ms=10)
+        time.sleep(0.01)
+    stalled = time.monotonic() - (deadline - 5)
+    assert session.get_metrics().recoveries == 1
+    # three frame intervals (exposure and margin)
+    assert stalled > 0.6
+    sdk.inject_timeouts(0, 0)
+    assert session.get_video_frame(frame, wait_ms=1000)
+    session.stop_video()
+    metrics = session.get_metrics()
+    assert metrics.total_gap_ms > 0
+    assert metrics.lost_frames > 0
+
+
+def test_diagnostics(use_sdk):
+    """
+    Check the diagnostics of the simulated cameras: full frame of the
+    connected cameras, and current settings of an opened camera
+    """
+
+    use_sdk(
+        camera_zwo_asi.SimulatedSdk(nb_cameras=2, max_width=640, max_height=480)
+    )
+    diagnostics = camera_zwo_asi.get_system_diagnostics(refresh=True)
+    assert [camera.camera_index for camera in diagnostics.cameras] == [0, 1]
+    for camera in diagnostics.cameras:
+        assert camera.name == "ZWO ASI Simulator"
+        assert camera.is_usb3 and camera.is_usb3_host
+        assert (camera.roi.width, camera.roi.height) == (640, 480)
+        assert camera.roi.type == camera_zwo_asi.ImageType.raw16
+        assert camera.frame_size == 640 * 480 * 2
+        assert camera.bandwidth_percent == 100
+        assert camera.throughput_mb_s == pytest.approx(380)
+        assert camera.max_fps == pytest.approx(380e6 / (640 * 480 * 2))
+        assert camera.warnings == []
+        assert "ZWO ASI Simulator" in str(camera)
+    assert "ZWO ASI Simulator (index: 1)" in str(diagnostics)
+
+    # the exposure allows 1000 fps, the bandwidth less
+    camera = camera_zwo_asi.Camera(1)
+    camera.set_control("BandWidth", 50)
+    camera.set_control("Exposure", 1000)
+    diagnostics = camera_zwo_asi.get_camera_diagnostics(camera)
+    roi = camera.get_roi()
+    assert diagnostics.camera_index == 1
+    assert diagnostics.bandwidth_percent == 50
+    assert diagnostics.exposure_us == 1000
+    assert diagnostics.throughput_mb_s == pytest.approx(190)
+    assert diagnostics.max_fps == pytest.approx(
+        camera_zwo_asi.get_max_frame_rate(camera.get_info(), roi, 50, 1000)
+    )
+    assert diagnostics.max_fps < 1000
+    assert len(diagnostics.warnings) == 1
+    assert "limited by the usb bandwidth (50%)" in diagnostics.warnings[0]
+
+    camera.set_control("BandWidth", 100)
+    camera.set_control("Exposure", 100000)
+    diagnostics = camera_zwo_asi.get_camera_diagnostics(camera)
+    assert diagnostics.max_fps == pytest.approx(10)
+    assert diagnostics.warnings == []
+    del camera
+
+    # usb2 camera
+    use_sdk(camera_zwo_asi.SimulatedSdk(nb_cameras=1, usb3=False))
+    (camera,) = camera_zwo_asi.get_system_diagnostics(refresh=True).cameras
+    assert not camera.is_usb3
+    assert camera.throughput_mb_s == pytest.approx(40)
+
+
+def test_bandwidth_planner(use_sdk):
+    """
+    Check the plans for the frame rate of a simulated usb3 camera
+    (1280x960, bins 1, 2 and 4): full frames while the throughput
+    allows, centered crops otherwise, binning or cropping first
+    """
+
+    use_sdk(camera_zwo_asi.SimulatedSdk(nb_cameras=1))
+    (info,) = camera_zwo_asi.get_cameras()
+    raw16 = camera_zwo_asi.ImageType.raw16
+
+    # 1280x960 raw16 at 100 fps: 246MB/s
+    target = camera_zwo_asi.PlannerTarget()
+    target.fps = 100
+    target.types = {raw16}
+    plans = camera_zwo_asi.get_bandwidth_plans(info, target)
+    assert [plan.roi.bins for plan in plans] == [1, 2, 4]
+    for plan in plans:
+        assert plan.meets_target
+        assert plan.field_of_view == pytest.approx(1)
+        assert plan.roi.width * plan.roi.bins == 1280
+        assert plan.roi.height * plan.roi.bins == 960
+    assert plans[0].required_mb_s == pytest.approx(245.76)
+    assert plans[0].throughput_mb_s == pytest.approx(380)
+
+    # at 300 fps, the full frame requires binning, or a crop
+    target.fps = 300
+    plans = camera_zwo_asi.get_bandwidth_plans(info, target)
+    assert [plan.roi.bins for plan in plans] == [2, 4, 1]
+    assert all(plan.meets_target for plan in plans)
+    crop = plans[2].roi
+    assert crop.width * crop.height * 2 * 300 <= 380e6
+    assert (crop.width, crop.height) == (912, 688)
+    assert (crop.start_x, crop.start_y) == ((1280 - 912) // 2, (960 - 688) // 2)
+    assert plans[2].field_of_view == pytest.approx(912 * 688 / (1280 * 960))
+    assert camera_zwo_asi.plan_bandwidth(info, target).roi.bins == 2
+    target.prefer_resolution = True
+    assert camera_zwo_asi.plan_bandwidth(info, target).roi.bins == 1
+
+    # a lower bandwidth requires smaller crops
+    target.bandwidth_percent = 50
+    plan = camera_zwo_asi.plan_bandwidth(info, target)
+    assert plan.roi.width * plan.roi.height < crop.width * crop.height
+    assert plan.throughput_mb_s == pytest.approx(190)
+    assert plan.predicted_fps >= 300
+
+    # no plan can be faster than the exposure
+    target.exposure_us = 20000
+    message = "exposure .* limits the frame rate to 50fps"
+    with pytest.raises(RuntimeError, match=message):
+        camera_zwo_asi.get_bandwidth_plans(info, target)
+    with pytest.raises(RuntimeError, match="exposure"):
+        camera_zwo_asi.plan_bandwidth(info, target)
+    target.fps = 0
+    plan = camera_zwo_asi.plan_bandwidth(info, target)
+    assert plan.meets_target
+    assert plan.predicted_fps == pytest.approx(50)
+
+    # tuning: the highest bandwidth without dropped frames is kept
+    camera = camera_zwo_asi.Camera(0)
+    camera.set_control("Exposure", 10000)
+    tuning = camera_zwo_asi.tune_bandwidth(
+        camera, trial_duration_ms=200, min_percent=40, step=30
+    )
+    assert [trial.bandwidth_percent for trial in tuning.trials][0] == 100
+    assert tuning.bandwidth_percent in (100, 70, 40)
+    assert camera.get_controls()["BandWidth"].value == tuning.bandwidth_percent
+    assert not camera.is_video_active()
+
+
+def test_throughput_profiles(use_sdk):
+    """
+    Check calibrate saves the best settings of each image type in the
+    profile cache, applies the one of the current image type, and
+    restores the other settings of the camera
+    """
+
+    use_sdk(
+        camera_zwo_asi.SimulatedSdk(nb_cameras=1, max_width=320, max_height=240)
+    )
+    raw8 = camera_zwo_asi.ImageType.raw8
+    raw16 = camera_zwo_asi.ImageType.raw16
+    camera = camera_zwo_asi.Camera(0)
+    roi = camera.get_roi()
+    roi.width, roi.height, roi.type = 160, 120, raw8
+    camera.set_roi(roi)
+    camera.set_control("Exposure", 5000)
+    camera.set_control("BandWidth", 55)
+    camera.start_video()
+
+    options = camera_zwo_asi.BenchmarkOptions()
+    options.duration_ms = 100
+    options.bandwidths = [100, 40]
+    options.types = {raw8, raw16}
+    with tempfile.TemporaryDirectory() as tmp:
+        path = Path(tmp) / "cache" / "throughput_profiles"
+        profiles = camera_zwo_asi.calibrate(camera, options, path)
+        assert {profile.type for profile in profiles} == {raw8, raw16}
+        (selected,) = [profile for profile in profiles if profile.type == raw8]
+        assert selected.bandwidth_percent in (100, 40)
+        assert (selected.width, selected.height, selected.bins) == (160, 120, 1)
+
+        # the roi, exposure and video are restored, the profile applied
+        assert camera.is_video_active()
+        camera.stop_video()
+        current = camera.get_roi()
+        assert (current.width, current.height, current.type) == (160, 120, raw8)
+        controls = camera.get_controls()
+        assert controls["Exposure"].value == 5000
+        assert controls["BandWidth"].value == selected.bandwidth_percent
+        assert controls["HighSpeedMode"].value == int(selected.high_speed)
+
+        # saved, and loaded again
+        cache = camera_zwo_asi.ProfileCache(path)
+        assert cache.load()
+        assert len(cache.get_profiles()) == 2
+        for profile in profiles:
+            loaded = cache.get(profile.camera_model, profile.host, profile.type)
+            for attr in (
+                "camera_model", "host", "type", "high_speed",
+                "bandwidth_percent", "width", "height", "bins", "dropped",
+            ):
+                assert getattr(loaded, attr) == getattr(profile, attr)
+            assert loaded.fps == pytest.approx(profile.fps, rel=1e-5)
+        assert cache.get("ASI120MM", selected.host, raw8) is None
+
+        # written again as read
+        copy = Path(tmp) / "copy"
+        cache = camera_zwo_asi.ProfileCache(copy)
+        assert not cache.load()
+        for profile in profiles:
+            cache.set(profile)
+        cache.save()
+        assert copy.read_text() == path.read_text()
+
+        camera.set_control("BandWidth", 55)
+        assert camera_zwo_asi.apply_cached_profile(camera, path)
+        assert camera.get_controls()["BandWidth"].value == selected.bandwidth_percent
+        assert not camera_zwo_asi.apply_cached_profile(camera, copy.with_name("none"))
+
+        # invalid line
+        with open(copy, "a") as f:
+            f.write("ZWO ASI Simulator\thost\traw8\n")
+        with pytest.raises(RuntimeError, match="line 4"):
+            camera_zwo_asi.ProfileCache(copy).load()
+
+
+def test_configuration_profiles(use_sdk):
+    """
+    Check switching between configuration profiles writes
+    only the values that changed
+    """
+
+    use_sdk(camera_zwo_asi.SimulatedSdk(nb_cameras=1))
+    camera = camera_zwo_asi.Camera(0)
+    profiles = camera_zwo_asi.ConfigurationProfiles()
+    profiles.save("deep-sky", camera)
+
+    roi = camera.get_roi()
+    roi.width, roi.height = 320, 240
+    camera.set_roi(roi)
+    camera.set_control("Exposure", 2000)
+    profiles.save("planetary", camera)
+
+    assert profiles.apply("deep-sky", camera) == 2
+    assert profiles.apply("deep-sky", camera) == 0
+    assert profiles.apply("planetary", camera) == 2
+    assert camera.get_roi().width == 320
+
+    snapshot = camera_zwo_asi.take_snapshot(camera)
+    restored = camera_zwo_asi.CameraSnapshot.from_binary(snapshot.to_binary())
+    assert restored.to_toml() == snapshot.to_toml()
+
+
+def _toml_config(controllables="", roi=None, header=""):
+    """
+    zwo_asi.toml content, roi: overrides of a 160x120 raw8 roi
+    """
+    values = {
+        "start_x": "0",
+        "start_y": "0",
+        "width": "160",
+        "height": "120",
+        "bins": "1",
+        "type": '"raw8"',
+    }
+    values.update(roi or {})
+    lines = [f"{key} = {value}" for key, value in values.items()]
+    return (
+        f"{header}\n[controllables]\n{controllables}\n\n[roi]\n"
+        + "\n".join(lines)
+        + "\n"
+    )
+
+
+def test_toml_config(use_sdk):
+    """
+    Check the native parser of zwo_asi.toml files against the toml
+    package, its errors, and the validation of configurations against
+    simulated cameras
+    """
+
+    use_sdk(
+        camera_zwo_asi.SimulatedSdk(nb_cameras=1, max_width=640, max_height=480)
+    )
+    camera = camera_zwo_asi.Camera(0)
+    camera.set_control("Gain", 150)
+    camera.set_control("Exposure", "auto")
+    roi = camera.get_roi()
+    roi.start_x, roi.start_y, roi.width, roi.height = 8, 4, 160, 120
+    roi.bins, roi.type = 2, camera_zwo_asi.ImageType.raw16
+    camera.set_roi(roi)
+
+    def _check_parity(content):
+        config = camera_zwo_asi.parse_toml_config(content)
+        expected = toml.loads(content)
+        assert sorted(config.controls) == sorted(expected["controllables"])
+        for name, value in expected["controllables"].items():
+            if value == "auto":
+                assert config.controls[name].is_auto
+            else:
+                assert not config.controls[name].is_auto
+                assert config.controls[name].value == value
+        for attr in ("start_x", "start_y", "width", "height", "bins"):
+            assert getattr(config.roi, attr) == expected["roi"][attr]
+        assert config.roi.type.name == expected["roi"]["type"]
+        return config
+
+    # output of Camera.to_toml
+    config = _check_parity(camera.to_toml())
+    assert config.controls["Exposure"].is_auto
+    assert config.controls["Gain"].value == 150
+    assert (config.roi.start_x, config.roi.start_y) == (8, 4)
+    assert not config.has_mode
+
+    # comments, quoted keys and strings, booleans and auto
+    content = _toml_config(
+        controllables=(
+            "# comment\n"
+            "Gain = 100  # trailing comment\n"
+            "\"Exposure\" = 'auto'\n"
+            "'Offset' = -3\n"
+        ),
+        roi={"start_x": "+8", "type": "'raw16'  # comment"},
+        header=(
+            'camera_mode = "normal"\n'
+            "verbose = true\n"
+            "\n"
+            "[other]\n"
+            'name = "a \\"quoted\\" # string"\n'
+            "enabled = false\n"
+        ),
+    )
+    config = _check_parity(content)
+    assert config.has_mode
+    assert config.mode == camera_zwo_asi.CameraMode.normal
+    assert config.controls["Offset"].value == -3
+    assert config.roi.start_x == 8
+    config = camera_zwo_asi.parse_toml_config(
+        _toml_config(controllables="Exposure = 1_000")
+    )
+    assert config.controls["Exposure"].value == 1000
+
+    # errors, with the line number (the first line of _toml_config is the
+    # header, the second the [controllables] table)
+    errors = [
+        ("Gain 100", "line 3", "expected '='"),
+        ("Gain = 100\nGain = 200", "line 4", "Gain defined twice"),
+        ("Gain = 1.5", "line 3", "got '1.5'"),
+        ("Gain = [1, 2]", "line 3", "arrays"),
+        ('Gain = "100', "line 3", "expected '\"'"),
+        ("Gain = true", "line 3", 'Gain: expected an integer or "auto"'),
+        ("Gain = \"manual\"", "line 3", 'Gain: expected an integer or "auto"'),
+        ("Gain = 100 200", "line 3", "unexpected characters after value"),
+        ("[controllables]", "line 3", r"table \[controllables\] defined twice"),
+        ("[[array]]", "line 3", "arrays of tables"),
+        ('Gain = "\\q"', "line 3", "unsupported escape sequence"),
+    ]
+    for controllables, line, message in errors:
+        message = rf"toml configuration \({line}\): .*{message}"
+        with pytest.raises(RuntimeError, match=message):
+            camera_zwo_asi.parse_toml_config(_toml_config(controllables))
+    with pytest.raises(RuntimeError, match=r"\(line 12\): unknown roi key depth"):
+        camera_zwo_asi.parse_toml_config(_toml_config(roi={"depth": "8"}))
+    with pytest.raises(RuntimeError, match=r"\(line 11\): .*raw12"):
+        camera_zwo_asi.parse_toml_config(_toml_config(roi={"type": '"raw12"'}))
+    with pytest.raises(RuntimeError, match=r"\(line 8\): roi width must be an integer"):
+        camera_zwo_asi.parse_toml_config(_toml_config(roi={"width": '"160"'}))
+    with pytest.raises(RuntimeError, match=r"\(line 1\): .*sideways"):
+        camera_zwo_asi.parse_toml_config(
+            _toml_config(header='camera_mode = "sideways"')
+        )
+    with pytest.raises(RuntimeError, match=r"^my.toml: missing the table \[roi\]$"):
+        camera_zwo_asi.parse_toml_config("[controllables]\n", "my.toml")
+    with pytest.raises(RuntimeError, match="missing roi configuration for: bins type"):
+        camera_zwo_asi.parse_toml_config(
+            "[controllables]\n[roi]\nstart_x = 0\nstart_y = 0\n"
+            "width = 8\nheight = 2\n"
+        )
+
+    # roi values not fitting in an int, or not in a long
+    out_of_range = r"\(line 8\): roi width is out of range"
+    for width in ("4294967304", "-2147483649"):
+        with pytest.raises(RuntimeError, match=out_of_range):
+            camera_zwo_asi.parse_toml_config(_toml_config(roi={"width": width}))
+    with pytest.raises(RuntimeError, match=r"\(line 8\): expected an integer"):
+        camera_zwo_asi.parse_toml_config(
+            _toml_config(roi={"width": "99999999999999999999"})
+        )
+
+    # validation against the (color, usb3, not trigger) camera: 640x480,
+    # bins 1, 2 and 4
+    def _issues(controllables="", roi=None, header=""):
+        config = camera_zwo_asi.parse_toml_config(
+            _toml_config(controllables, roi, header)
+        )
+        return camera_zwo_asi.validate_config(config, camera)
+
+    assert _issues("Gain = 100\nExposure = 'auto'") == []
+    assert _issues(roi={"bins": "4", "width": "160", "height": "120"}) == []
+    rules = [
+        ({"bins": "3"}, "", "", "3 bin(s) not supported (supported: 1 2 4)"),
+        ({"width": "0"}, "", "", "width and height must be positive"),
+        ({"height": "-2"}, "", "", "width and height must be positive"),
+        ({"start_x": "-8"}, "", "", "start position can not be negative"),
+        ({"start_y": "-2"}, "", "", "start position can not be negative"),
+        ({"width": "164"}, "", "", "width 164 is not a multiple of 8"),
+        ({"height": "121"}, "", "", "height 121 is not a multiple of 2"),
+        (
+            {"start_x": "488"}, "", "",
+            "roi and start position larger than binned sensor width",
+        ),
+        (
+            {"bins": "2", "height": "242"}, "", "",
+            "roi and start position larger than binned sensor height",
+        ),
+        ({}, "Focus = 10", "", "no such controllable: Focus"),
+        ({}, "Temperature = 10", "", "controllable Temperature is not writable"),
+        ({}, "Offset = 'auto'", "", "controllable Offset does not support auto mode"),
+        ({}, "Gain = 601", "", "controllable Gain: value 601 out of range [0, 600]"),
+        ({}, "Gain = -1", "", "controllable Gain: value -1 out of range [0, 600]"),
+        (
+            {}, "", 'camera_mode = "soft_edge"',
+            "camera mode soft_edge requires a trigger camera",
+        ),
+    ]
+    for roi, controllables, header, issue in rules:
+        assert _issues(controllables, roi, header) == [issue]
+    # all the issues are listed
+    assert len(_issues("Focus = 1\nGain = 601", {"bins": "3", "width": "4"})) == 4
+
+    # configured natively: nothing is written if the configuration is
+    # invalid
+    with tempfile.TemporaryDirectory() as tmp:
+        path = Path(tmp) / "zwo_asi.toml"
+        path.write_text(_toml_config("Gain = 700\nExposure = 2000", {"bins": "3"}))
+        with pytest.raises(RuntimeError, match="3 bin.*Gain: value 700"):
+            camera_zwo_asi.configure_from_toml(camera, path)
+        assert camera.get_controls()["Gain"].value == 150
+        assert camera.get_roi().bins == 2
+        path.write_text(_toml_config("Gain = 300\nExposure = 2000"))
+        assert camera_zwo_asi.configure_from_toml(camera, path) > 0
+        controls = camera.get_controls()
+        assert controls["Gain"].value == 300
+        assert controls["Exposure"].value == 2000
+        assert not controls["Exposure"].is_auto
+        roi = camera.get_roi()
+        assert (roi.width, roi.height, roi.bins) == (160, 120, 1)
+        assert roi.type == camera_zwo_asi.ImageType.raw8
+        assert camera_zwo_asi.configure_from_toml(camera, path) == 0
+        camera.to_toml(path)
+        assert camera_zwo_asi.load_toml_config(path).to_toml() == (
+            camera_zwo_asi.parse_toml_config(camera.to_toml()).to_toml()
+        )
+    del camera
+
+    # image type of a mono camera, and the ASI120 (usb2) size rule
+    use_sdk(
+        camera_zwo_asi.SimulatedSdk(
+            nb_cameras=1, name="ASI120", usb3=False, color=False
+        )
+    )
+    camera = camera_zwo_asi.Camera(0)
+    assert _issues(roi={"width": "128", "height": "64", "type": '"rgb24"'}) == [
+        "image type rgb24 not supported (supported: raw8 raw16 y8)"
+    ]
+    assert _issues(roi={"width": "120", "height": "100"}) == [
+        "width x height must be a multiple of 1024 (ASI120)"
+    ]
+    assert _issues(roi={"width": "128", "height": "64"}) == []
+
+
+def test_result_codes(use_sdk):
+    """
+    Check the outcome of the noexcept (try_*) methods on timeouts,
+    busy cameras, invalid controls and disconnections, and the error
+    raised by their throwing counterparts
+    """
+
+    sdk = use_sdk(camera_zwo_asi.SimulatedSdk(nb_cameras=1))
+    camera = camera_zwo_asi.Camera(0)
+    camera.set_control("Exposure", 1000)
+    roi = camera.get_roi()
+    frame = camera_zwo_asi.Frame(roi.width, roi.height, roi.type)
+    ResultCode = camera_zwo_asi.ResultCode
+
+    result = camera.try_get_video_frame(frame, wait_ms=10)
+    assert result.code == ResultCode.busy
+    assert result.error == "ASI_ERROR_INVALID_SEQUENCE"
+
+    camera.start_video()
+    result = camera.try_get_video_frame(frame, wait_ms=1000)
+    assert result
+    assert result.code == ResultCode.ok
+    assert result.error == "ASI_SUCCESS"
+    assert result.message == ""
+
+    # timeouts: reported, not raised
+    sdk.inject_timeouts(0, 2)
+    for _ in range(2):
+        result = camera.try_get_video_frame(frame, wait_ms=1000)
+        assert not result
+        assert result.code == ResultCode.timeout
+        assert result.error == "ASI_ERROR_TIMEOUT"
+        assert result.message == "failed to get video frame"
+    assert camera.try_get_video_frame(frame, wait_ms=1000)
+
+    result = camera.try_capture_frame(frame)
+    assert result.code == ResultCode.busy
+    assert result.error == "ASI_SUCCESS"
+    assert result.message == "could not take a picture: camera busy"
+    result = camera.try_set_control("Focus", 1)
+    assert result.code == ResultCode.invalid
+    assert result.error == "ASI_ERROR_INVALID_CONTROL_TYPE"
+    assert camera.try_set_control("Gain", 100)
+
+    # disconnection
+    sdk.disconnect(0)
+    result = camera.try_get_video_frame(frame, wait_ms=100)
+    assert result.code == ResultCode.disconnected
+    assert result.error == "ASI_ERROR_CAMERA_REMOVED"
+    assert result.message == "failed to get video frame"
+    result = camera.try_set_control("Gain", 100)
+    assert result.code == ResultCode.disconnected
+    assert result.message == "failed to set the value of the controllable"
+    with pytest.raises(
+        RuntimeError,
+        match=(
+            r"^ASI Camera: \(camera index: 0\) failed to get video frame "
+            r"\(error code: \d+: ASI_ERROR_CAMERA_REMOVED\)$"
+        ),
+    ):
+        camera.get_video_frame(frame, wait_ms=100)
+    with pytest.raises(RuntimeError, match="failed to stop video capture"):
+        camera.stop_video()
+    assert camera.get_state() == camera_zwo_asi.CameraState.idle
+    result = camera.try_capture_frame(frame)
+    assert result.code == ResultCode.disconnected
+    assert result.message == "failed to read the exposure status"
+
+    # reconnected, but to be opened again
+    sdk.reconnect(0)
+    result = camera.try_get_video_frame(frame, wait_ms=100)
+    assert result.code == ResultCode.disconnected
+    assert result.error == "ASI_ERROR_CAMERA_CLOSED"
+
+
+def test_concurrent_control(use_sdk):
+    """
+    Check controls can be written and read from a thread while another
+    one streams, and that reconfiguring a streaming camera throws
+    rather than blocks
+    """
+
+    use_sdk(camera_zwo_asi.SimulatedSdk(nb_cameras=1))
+    camera = camera_zwo_asi.Camera(0)
+    camera.set_control("Exposure", 1000)
+    roi = camera.get_roi()
+    frame = camera_zwo_asi.Frame(roi.width, roi.height, roi.type)
+    nb_frames = 30
+    received: typing.List[int] = []
+    errors: typing.List[Exception] = []
+
+    def _stream():
+        try:
+            for index in range(nb_frames):
+                camera.get_video_frame(frame, wait_ms=2000)
+                received.append(index)
+        except Exception as e:
+            errors.append(e)
+
+    camera.start_video()
+    thread = threading.Thread(target=_stream)
+    thread.start()
+    nb_writes = 0
+    streaming = True
+    while streaming:
+        streaming = thread.is_alive()
+        camera.set_control("Gain", nb_writes % 600)
+        camera.set_exposure_and_gain(1000 + nb_writes % 10, nb_writes % 600)
+        assert camera.get_controls()["Gain"].value == nb_writes % 600
+        nb_writes += 1
+    thread.join()
+    assert not errors
+    assert len(received) == nb_frames
+    assert 0 <= frame.settings.gain < 600
+
+    # roi, camera mode and dark substraction: only when idle
+    assert camera.get_state() == camera_zwo_asi.CameraState.streaming
+    roi.width, roi.height = 320, 240
+    reconfigurations = [
+        ("set the ROI", lambda: camera.set_roi(roi)),
+        (
+            "set the camera mode",
+            lambda: camera.set_camera_mode(camera_zwo_asi.CameraMode.normal),
+        ),
+        ("disable dark substract", camera.disable_dark_substract),
+    ]
+    for operation, reconfigure in reconfigurations:
+        with pytest.raises(
+            RuntimeError, match=rf"^failed to {operation}: camera streaming$"
+        ):
+            reconfigure()
+        assert camera.get_state() == camera_zwo_asi.CameraState.streaming
+        assert camera.is_video_active()
+    assert camera.get_roi().width == 1280
+    camera.stop_video()
+    assert camera.get_state() == camera_zwo_asi.CameraState.idle
+    camera.set_roi(roi)
+    assert (camera.get_roi().width, camera.get_roi().height) == (320, 240)
+
+
+def test_frame_settings(use_sdk):
+    """
+    Check exposure and gain changes while streaming are
+    tagged on the frames, without dropping frames
+    """
+
+    use_sdk(
+        camera_zwo_asi.SimulatedSdk(nb_cameras=1, max_width=320, max_height=240)
+    )
+    camera = camera_zwo_asi.Camera(0)
+    camera.set_exposure_and_gain(5000, 10)
+    roi = camera.get_roi()
+    frame = camera_zwo_asi.Frame(roi.width, roi.height, roi.type)
+
+    camera.start_video()
+    generations = []
+    changes = 0
+    for index in range(20):
+        camera.get_video_frame(frame, wait_ms=500)
+        generations.append(frame.settings.generation)
+        changes += frame.settings_changed
+        if index == 5:
+            camera.set_exposure_and_gain(10000, 50)
+    camera.stop_video()
+
+    assert changes == 1
+    assert generations == sorted(generations)
+    assert frame.settings.exposure_us == 10000
+    assert frame.settings.gain == 50
+    assert camera.get_dropped_frames() == 0
+
+
+def test_presets(use_sdk):
+    """
+    Check switching between presets writes only what differs, stops
+    and restarts the video only on geometry changes, and that each
+    preset has a pool of frames of its geometry
+    """
+
+    with tempfile.TemporaryDirectory() as tmp:
+        path = Path(tmp) / "presets.trace"
+        recorder = use_sdk(
+            camera_zwo_asi.RecordingSdk(
+                camera_zwo_asi.SimulatedSdk(
+                    nb_cameras=1, max_width=640, max_height=480
+                ),
+                path,
+            )
+        )
+        nb_seen = 0
+
+        def _calls():
+            # SDK calls (other than reads) since the last check
+            nonlocal nb_seen
+            recorder.flush()
+            records = camera_zwo_asi.read_trace(path)
+            calls = [
+                record.get_function_name()
+                for record in records[nb_seen:]
+                if not record.get_function_name().startswith("Get")
+            ]
+            nb_seen = len(records)
+            return calls
+
+        def _preset(controllables, width, height, bins, type_):
+            return camera_zwo_asi.parse_toml_config(
+                _toml_config(
+                    controllables,
+                    {
+                        "width": str(width),
+                        "height": str(height),
+                        "bins": str(bins),
+                        "type": f'"{type_}"',
+                    },
+                )
+            )
+
+        camera = camera_zwo_asi.Camera(0)
+        camera.add_preset(
+            "preview",
+            _preset("Gain = 100\nExposure = 1000", 320, 240, 2, "raw8"),
+            nb_frames=3,
+        )
+        camera.add_preset(
+            "science", _preset("Gain = 100\nExposure = 2000", 640, 480, 1, "raw16")
+        )
+        camera.add_preset(
+            "science_gain",
+            _preset("Gain = 300\nExposure = 2000", 640, 480, 1, "raw16"),
+        )
+        with pytest.raises(RuntimeError, match="the preset bad is not suitable"):
+            camera.add_preset("bad", _preset("", 320, 240, 3, "raw8"))
+        with pytest.raises(RuntimeError, match="no preset named bad"):
+            camera.apply_preset("bad")
+        assert camera.get_presets() == ["preview", "science", "science_gain"]
+        assert camera.get_active_preset() == ""
+        _calls()
+
+        # no active preset: everything is written
+        assert camera.apply_preset("preview") == 4
+        assert _calls() == [
+            "SetROIFormat", "SetStartPos", "SetControlValue", "SetControlValue"
+        ]
+        assert camera.get_active_preset() == "preview"
+        roi = camera.get_roi()
+        assert (roi.width, roi.height, roi.bins) == (320, 240, 2)
+
+        # geometry change: the video is stopped and restarted, the start
+        # position and the unchanged gain are not written
+        camera.start_video()
+        _calls()
+        assert camera.apply_preset("science") == 2
+        assert _calls() == [
+            "StopVideoCapture", "SetROIFormat", "SetControlValue", "StartVideoCapture"
+        ]
+        assert camera.is_video_active()
+        frame = camera.get_preset_pool("science").acquire()
+        camera.get_video_frame(frame, wait_ms=2000)
+
+        # same geometry: only the gain, without interrupting the video
+        assert camera.apply_preset("science_gain") == 1
+        assert _calls() == ["SetControlValue"]
+        assert camera.apply_preset("science_gain") == 0
+        assert _calls() == []
+        assert camera.get_controls()["Gain"].value == 300
+
+        # configuration changed by another method: all written again
+        camera.set_control("Gain", 250)
+        assert camera.get_active_preset() == ""
+        _calls()
+        assert camera.apply_preset("science_gain") == 4
+        assert camera.get_controls()["Gain"].value == 300
+        camera.stop_video()
+
+        # pools of the preset geometries
+        preview_pool = camera.get_preset_pool("preview")
+        assert preview_pool.capacity() == 3
+        assert camera.get_preset_pool("science").capacity() == 2
+        preview = preview_pool.acquire()
+        assert (preview.width, preview.height) == (320, 240)
+        assert preview.size() == 320 * 240
+        assert (frame.width, frame.height) == (640, 480)
+        assert frame.size() == 640 * 480 * 2
+        del camera
+
+
+def test_photon_transfer_curve(use_sdk):
+    """
+    Check the conversion gain measured on the simulated sensor
+    (4 e-/ADU at gain 0)
+    """
+
+    sdk = use_sdk(
+        camera_zwo_asi.SimulatedSdk(nb_cameras=1, max_width=320, max_height=240)
+    )
+    sdk.set_flux(1e5)
+    camera = camera_zwo_asi.Camera(0)
+    options = camera_zwo_asi.PtcOptions()
+    options.gains = [0]
+    options.exposures_us = [1000, 5000, 20000, 50000, 100000, 300000]
+    profile = camera_zwo_asi.characterize(camera, options)
+    gain = profile.get(0)
+    assert abs(gain.elec_per_adu - 4.0) < 0.2
+    assert gain.saturated
+
+
+def _frame(values, exposure_us, gain=0, image_type=None, index=0):
+    """
+    Frame (not acquired by a camera) with the given values (2d array)
+    and settings
+    """
+    height, width = values.shape
+    if image_type is None:
+        image_type = camera_zwo_asi.ImageType.raw16
+    frame = camera_zwo_asi.Frame(width, height, image_type)
+    frame.index = index
+    frame.settings.exposure_us = exposure_us
+    frame.settings.gain = gain
+    dtype = np.uint16 if image_type == camera_zwo_asi.ImageType.raw16 else np.uint8
+    frame.get_data().view(dtype)[:] = values.astype(dtype).ravel()
+    return frame
+
+
+def test_merge_hdr():
+    """
+    Check bracketed frames are merged into the radiance of the
+    pixels, ignoring the saturated values
+    """
+
+    # pixel values per second at gain 0, the last one saturated in
+    # all the frames
+    radiance = np.append(np.geomspace(1e3, 1e7, 31).round(), 1e9).reshape(4, 8)
+    # (exposure, gain in 0.1 dB): x0.001, x0.01 and x0.1
+    steps = [(1000, 0), (10000, 0), (10000, 200)]
+    frames = []
+    for exposure_us, gain in steps:
+        factor = exposure_us / 1e6 * 10 ** (gain / 200)
+        values = np.minimum((radiance * factor).round(), 65535)
+        frames.append(_frame(values, exposure_us, gain))
+
+    hdr = camera_zwo_asi.HdrFrame(8, 4, camera_zwo_asi.ImageType.raw16)
+    camera_zwo_asi.merge_hdr(frames, hdr)
+    data = hdr.get_data().reshape(4, 8)
+    weights = hdr.get_weights().reshape(4, 8)
+
+    # reference: weighted by exposure and distance to saturation
+    saturation, rolloff = 0.95 * 65535, 0.1 * 65535
+    total = np.zeros((4, 8))
+    total_weights = np.zeros((4, 8))
+    for frame, (exposure_us, gain) in zip(frames, steps):
+        values = frame.get_data().view(np.uint16).reshape(4, 8).astype(float)
+        weight = np.clip((saturation - values) / rolloff, 0, 1) * exposure_us / 10000
+        total += weight * values * 1e6 / (exposure_us * 10 ** (gain / 200))
+        total_weights += weight
+    assert np.allclose(weights, total_weights, rtol=1e-5)
+    reference = total / np.where(total_weights > 0, total_weights, 1)
+    assert np.allclose(data.ravel()[:-1], reference.ravel()[:-1], rtol=1e-4)
+    assert np.allclose(data.ravel()[:-1], radiance.ravel()[:-1], rtol=1e-2)
+
+    # saturated in all frames: estimated from the shortest exposure
+    assert weights[-1, -1] == 0
+    assert data[-1, -1] == pytest.approx(65535 * 1e3, rel=1e-5)
+
+    with pytest.raises(Exception):
+        camera_zwo_asi.merge_hdr([frames[0], _frame(np.zeros((2, 2)), 1000)], hdr)
+
+
+def test_video_integrator():
+    """
+    Check K video frames are summed, the outliers rejected and the
+    integration restarted when the settings change
+    """
+    rng = np.random.default_rng(0)
+    frames = rng.integers(900, 1100, size=(8, 6, 10))
+    options = camera_zwo_asi.IntegratorOptions()
+    options.nb_frames = 4
+    integrator = camera_zwo_asi.VideoIntegrator(
+        10, 6, camera_zwo_asi.ImageType.raw16, options
+    )
+
+    # sums of K frames, without rejection
+    for index, values in enumerate(frames):
+        completed = integrator.add(_frame(values, 1000, index=index))
+        assert completed == (index % 4 == 3)
+        if completed:
+            integrated = integrator.get_frame()
+            expected = frames[index - 3 : index + 1].sum(axis=0)
+            assert np.array_equal(integrated.get_data().reshape(6, 10), expected)
+            assert integrated.index == index // 4
+            assert integrated.nb_frames == 4
+            assert integrated.exposure_us == 4000
+            assert integrated.nb_rejected == 0
+
+    # the highest value of a pixel is replaced by the mean of the others
+    options.rejection_threshold = 500
+    integrator = camera_zwo_asi.VideoIntegrator(
+        10, 6, camera_zwo_asi.ImageType.raw16, options
+    )
+    values = frames[:4].copy()
+    values[2, 3, 4] = 20000
+    for index in range(4):
+        integrator.add(_frame(values[index], 1000, index=index))
+    integrated = integrator.get_frame().get_data().reshape(6, 10)
+    assert integrator.get_frame().nb_rejected == 1
+    expected = values.sum(axis=0)
+    others = [values[i, 3, 4] for i in (0, 1, 3)]
+    expected[3, 4] = sum(others) + int(np.mean(others) + 0.5)
+    assert np.array_equal(integrated, expected)
+
+    # a change of the settings restarts the integration
+    integrator = camera_zwo_asi.VideoIntegrator(
+        10, 6, camera_zwo_asi.ImageType.raw16, options
+    )
+    for index in range(3):
+        integrator.add(_frame(frames[index], 1000, index=index))
+    assert integrator.get_nb_added() == 3
+    changed = []
+    for index in range(3, 7):
+        frame = _frame(frames[index], 2000, index=index)
+        frame.settings.generation = 1
+        changed.append(integrator.add(frame))
+    assert changed == [False, False, False, True]
+    integrated = integrator.get_frame()
+    assert integrated.exposure_us == 8000
+    assert np.array_equal(
+        integrated.get_data().reshape(6, 10), frames[3:7].sum(axis=0)
+    )
+
+    with pytest.raises(Exception):
+        integrator.add(_frame(np.zeros((2, 2)), 1000))
+
+
+def _dark_key(exposure_us, temperature_c, width=4, height=2):
+    key = camera_zwo_asi.DarkKey()
+    key.exposure_us = exposure_us
+    key.temperature_c = temperature_c
+    key.width = width
+    key.height = height
+    key.type = camera_zwo_asi.ImageType.raw16
+    return key
+
+
+def test_dark_library():
+    """
+    Check the darks are matched by temperature then exposure, scaled
+    with the bias frame, cached and subtracted with clamping
+    """
+    bias = np.full((2, 4), 100)
+    dark_current = np.arange(8).reshape(2, 4)
+    # exposure, temperature, values
+    darks = [
+        (0, 0.0, bias),
+        (1000, 0.0, bias + dark_current),
+        (10000, 0.0, bias + 10 * dark_current),
+        (1000, 10.0, bias + 50),
+    ]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        library = camera_zwo_asi.DarkLibrary(tmp, cache_size=2)
+        for exposure_us, temperature_c, values in darks:
+            frames = [
+                _frame(values - 1, exposure_us),
+                _frame(values + 1, exposure_us),
+            ]
+            library.add(_dark_key(exposure_us, temperature_c), frames)
+        assert len(library.get_keys()) == 4
+
+        # the closest exposure, in the same temperature bucket
+        match = library.find(_dark_key(2000, 0.4))
+        assert match.key.exposure_us == 1000
+        assert match.scale == pytest.approx(2.0)
+        assert not match.exact
+        match = library.find(_dark_key(5000, 0.0))
+        assert match.key.exposure_us == 10000
+        assert match.scale == pytest.approx(0.5)
+        # the temperature bucket first
+        match = library.find(_dark_key(1000, 9.5))
+        assert match.key.temperature_c == 10.0
+        assert match.exact
+        match = library.find(_dark_key(10000, 7.0))
+        assert match.key.temperature_c == 10.0
+        assert match.scale == pytest.approx(10.0)
+        with pytest.raises(Exception):
+            library.find(_dark_key(1000, 0.0, width=8))
+
+        # dark current scaled from the bias frame, values clamped to 0
+        values = np.full((2, 4), 1000)
+        values[0, 0] = 50
+        frame = _frame(values, 2000)
+        match = library.calibrate(frame, _dark_key(2000, 0.0))
+        expected = np.maximum(values - bias - 2 * dark_current, 0)
+        calibrated = frame.get_data().view(np.uint16).reshape(2, 4)
+        assert np.array_equal(calibrated, expected)
+        assert calibrated[0, 0] == 0
+        with pytest.raises(Exception):
+            library.calibrate(_frame(np.zeros((2, 2)), 2000), _dark_key(2000, 0.0))
+
+        # least recently used darks are evicted
+        def cached():
+            return [key.exposure_us for key in library.get_cached_keys()]
+
+        assert cached() == [2000]
+        library.calibrate(_frame(values, 3000), _dark_key(3000, 0.0))
+        assert cached() == [3000, 2000]
+        library.calibrate(_frame(values, 2000), _dark_key(2000, 0.0))
+        assert cached() == [2000, 3000]
+        library.calibrate(_frame(values, 4000), _dark_key(4000, 0.0))
+        assert cached() == [4000, 2000]
+        assert library.get_nb_cached() == 2
+        library.clear_cache()
+        assert library.get_nb_cached() == 0
+
+        # the darks are reloaded from the folder
+        del library
+        library = camera_zwo_asi.DarkLibrary(tmp)
+        assert len(library.get_keys()) == 4
+        frame = _frame(values, 2000)
+        library.calibrate(frame, _dark_key(2000, 0.0))
+        calibrated = frame.get_data().view(np.uint16).reshape(2, 4)
+        assert np.array_equal(calibrated, expected)
+
+    # dark below the bias (noise), scaled up: the prepared dark is clamped
+    # to 0, and saturated pixels stay saturated
+    with tempfile.TemporaryDirectory() as tmp:
+        library = camera_zwo_asi.DarkLibrary(tmp)
+        library.add(_dark_key(0, 0.0), [_frame(bias, 0)])
+        library.add(_dark_key(1000, 0.0), [_frame(bias - 40, 1000)])
+        values = np.full((2, 4), 65535)
+        values[0, 0] = 50
+        frame = _frame(values, 10000)
+        library.calibrate(frame, _dark_key(10000, 0.0))
+        calibrated = frame.get_data().view(np.uint16).reshape(2, 4)
+        assert np.array_equal(calibrated, values)
+
+
+def test_pixel_statistics():
+    """
+    Check the per pixel mean and variance against numpy, for both
+    precisions and several bands and batches
+    """
+    rng = np.random.default_rng(1)
+    # pixels of different levels and noises
+    levels = rng.uniform(100, 60000, size=(12, 10))
+    sigmas = rng.uniform(1, 300, size=(12, 10))
+    values = np.clip(rng.normal(levels, sigmas, size=(23, 12, 10)), 0, 65535)
+    values = values.round().astype(np.uint16)
+    mean = values.mean(axis=0).ravel()
+    variance = values.var(axis=0, ddof=1).ravel()
+    raw16 = camera_zwo_asi.ImageType.raw16
+
+    with tempfile.TemporaryDirectory() as tmp:
+        for index, frame_values in enumerate(values):
+            frame_values.tofile(Path(tmp) / f"frame_{index}.raw")
+
+        for precision, rtol in (
+            (camera_zwo_asi.StatisticsPrecision.float32, 1e-3),
+            (camera_zwo_asi.StatisticsPrecision.float64, 1e-9),
+        ):
+            # bands of a single row, of a few rows, of the whole frame
+            for band_bytes in (1, 3 * 10 * 2 * 8, 256 * 1024):
+                for batch_size in (1, 3, 8):
+                    options = camera_zwo_asi.PixelStatisticsOptions()
+                    options.precision = precision
+                    options.band_bytes = band_bytes
+                    options.batch_size = batch_size
+                    options.nb_threads = 2
+
+                    # frame per frame, then as a list
+                    statistics = camera_zwo_asi.PixelStatistics(
+                        10, 12, raw16, options
+                    )
+                    for frame_values in values[:5]:
+                        statistics.add(_frame(frame_values, 1000))
+                    statistics.add([_frame(v, 1000) for v in values[5:]])
+                    assert statistics.get_nb_frames() == len(values)
+                    assert np.allclose(statistics.get_mean(), mean, rtol=rtol)
+                    assert np.allclose(
+                        statistics.get_variance(), variance, rtol=rtol
+                    )
+
+                    # from recorded frames, read while the previous
+                    # batch is added
+                    statistics.reset()
+                    source = camera_zwo_asi.RawSource(tmp, 10, 12, raw16)
+                    assert statistics.add(source, nb_frames=20) == 20
+                    assert statistics.add(source) == 3
+                    assert statistics.get_nb_frames() == len(values)
+                    assert np.allclose(statistics.get_mean(), mean, rtol=rtol)
+                    assert np.allclose(
+                        statistics.get_variance(), variance, rtol=rtol
+                    )
+
+    statistics = camera_zwo_asi.PixelStatistics(10, 12, raw16)
+    statistics.add(_frame(values[0], 1000))
+    assert np.array_equal(statistics.get_variance(), np.zeros(120))
+    with pytest.raises(Exception):
+        statistics.add(_frame(np.zeros((2, 2)), 1000))
+
+
+def _write_ser(path, frames, color):
+    """
+    SER file of the frames (n x height x width (x 3) array, uint8 or
+    uint16), color: 0 (mono) or 100 (rgb)
+    """
+    nb_frames, height, width = frames.shape[:3]
+    depth = 16 if frames.dtype == np.uint16 else 8
+    header = b"LUCAM-RECORDER"
+    header += np.array([0, color, 0, width, height, depth, nb_frames], "<i4").tobytes()
+    header += bytes(120) + np.zeros(2, "<i8").tobytes()
+    assert len(header) == 178
+    Path(path).write_bytes(header + frames.astype(frames.dtype.newbyteorder("<")).tobytes())
+
+
+def _write_fits(path, values):
+    """
+    FITS file of the values (height x width uint16 array, or
+    height x width x 3 uint8 array)
+    """
+    cards = ["SIMPLE  = T"]
+    if values.dtype == np.uint16:
+        height, width = values.shape
+        cards += ["BITPIX  = 16", "NAXIS   = 2"]
+        data = (values.astype(np.int32) - 32768).astype(">i2").tobytes()
+    else:
+        height, width = values.shape[:2]
+        cards += ["BITPIX  = 8", "NAXIS   = 3"]
+        data = np.moveaxis(values, 2, 0).tobytes()
+    cards += [f"NAXIS1  = {width}", f"NAXIS2  = {height}"]
+    if values.dtype == np.uint16:
+        cards.append("BZERO   = 32768")
+    else:
+        cards.append("NAXIS3  = 3")
+    cards.append("END")
+    header = "".join(card.ljust(80) for card in cards).encode()
+    header += b" " * (-len(header) % 2880)
+    data += bytes(-len(data) % 2880)
+    Path(path).write_bytes(header + data)
+
+
+def _read_all(source, shape, dtype):
+    frame = camera_zwo_asi.Frame(
+        source.get_width(), source.get_height(), source.get_type()
+    )
+    frames = []
+    while source.read(frame):
+        frames.append((frame.index, frame.get_data().view(dtype).reshape(shape).copy()))
+    return frames
+
+
+def test_frame_sources(use_sdk):
+    """
+    Check SER, FITS and raw files are read back with the values they
+    were written with, directly and with readahead, and that a frame
+    failing to decode is skipped, also when replayed or added to pixel
+    statistics
+    """
+    rng = np.random.default_rng(2)
+    mono = rng.integers(0, 65536, size=(5, 6, 8), dtype=np.uint16)
+    # red, green, blue
+    color = rng.integers(0, 256, size=(5, 6, 8, 3), dtype=np.uint8)
+    # frames are stored as bgr
+    bgr = color[..., ::-1]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        tmp = Path(tmp)
+
+        # SER
+        _write_ser(tmp / "mono.ser", mono, 0)
+        _write_ser(tmp / "color.ser", color, 100)
+        source = camera_zwo_asi.SerSource(tmp / "mono.ser")
+        assert source.get_type() == camera_zwo_asi.ImageType.raw16
+        assert source.get_nb_frames() == 5
+        read = _read_all(source, (6, 8), np.uint16)
+        assert [index for index, _ in read] == list(range(5))
+        assert np.array_equal(np.array([values for _, values in read]), mono)
+        source = camera_zwo_asi.SerSource(tmp / "color.ser")
+        assert source.get_type() == camera_zwo_asi.ImageType.rgb24
+        read = _read_all(source, (6, 8, 3), np.uint8)
+        assert np.array_equal(np.array([values for _, values in read]), bgr)
+        readahead = camera_zwo_asi.ReadaheadSource(
+            camera_zwo_asi.SerSource(tmp / "mono.ser"), nb_frames=2
+        )
+        read = _read_all(readahead, (6, 8), np.uint16)
+        assert np.array_equal(np.array([values for _, values in read]), mono)
+
+        # FITS
+        (tmp / "fits").mkdir()
+        for index, values in enumerate(mono):
+            _write_fits(tmp / "fits" / f"mono_{index}.fits", values)
+        paths = camera_zwo_asi.FitsSource.list(tmp / "fits")
+        assert len(paths) == 5
+        source = camera_zwo_asi.FitsSource(paths)
+        assert source.get_type() == camera_zwo_asi.ImageType.raw16
+        read = _read_all(source, (6, 8), np.uint16)
+        assert np.array_equal(np.array([values for _, values in read]), mono)
+        _write_fits(tmp / "color.fits", color[0])
+        source = camera_zwo_asi.FitsSource([tmp / "color.fits"])
+        assert source.get_type() == camera_zwo_asi.ImageType.rgb24
+        read = _read_all(source, (6, 8, 3), np.uint8)
+        assert np.array_equal(read[0][1], bgr[0])
+
+        # raw, written by the pipeline, with gaps in the indices
+        (tmp / "raw").mkdir()
+        pipeline = camera_zwo_asi.Pipeline(nb_threads=2)
+        pipeline.add_stage("writer", camera_zwo_asi.RawWriterStage(tmp / "raw"))
+        indices = [0, 1, 3, 10, 11]
+        for index, values in zip(indices, mono):
+            pipeline.push(_frame(values, 1000, index=index))
+        pipeline.wait()
+        source = camera_zwo_asi.RawSource(
+            tmp / "raw", 8, 6, camera_zwo_asi.ImageType.raw16
+        )
+        read = _read_all(source, (6, 8), np.uint16)
+        assert [index for index, _ in read] == indices
+        assert np.array_equal(np.array([values for _, values in read]), mono)
+
+        # a truncated file: its frame is skipped
+        path = tmp / "raw" / "frame_3.raw"
+        path.write_bytes(path.read_bytes()[:10])
+        for source in (
+            camera_zwo_asi.RawSource(tmp / "raw", 8, 6, camera_zwo_asi.ImageType.raw16),
+            camera_zwo_asi.ReadaheadSource(
+                camera_zwo_asi.RawSource(
+                    tmp / "raw", 8, 6, camera_zwo_asi.ImageType.raw16
+                ),
+                nb_frames=3,
+            ),
+        ):
+            frame = camera_zwo_asi.Frame(8, 6, camera_zwo_asi.ImageType.raw16)
+            read = []
+            for _ in range(5):
+                try:
+                    assert source.read(frame)
+                    read.append(frame.index)
+                except RuntimeError:
+                    read.append(None)
+            assert read == [0, 1, None, 10, 11]
+            assert not source.read(frame)
+
+        # replayed and added to statistics: skipped and counted
+        raw16 = camera_zwo_asi.ImageType.raw16
+        for prefix, readahead in (("direct_", False), ("readahead_", True)):
+            source = camera_zwo_asi.RawSource(tmp / "raw", 8, 6, raw16)
+            if readahead:
+                source = camera_zwo_asi.ReadaheadSource(source, nb_frames=3)
+            (tmp / prefix).mkdir()
+            pipeline = camera_zwo_asi.Pipeline(nb_threads=2)
+            pipeline.add_stage(
+                "writer", camera_zwo_asi.RawWriterStage(tmp / prefix)
+            )
+            errors = camera_zwo_asi.ReadErrors()
+            assert camera_zwo_asi.replay(source, pipeline, errors=errors) == 4
+            assert errors.failed == 1
+            assert "frame_3.raw" in errors.last_error
+            written = camera_zwo_asi.RawSource(tmp / prefix, 8, 6, raw16)
+            read = _read_all(written, (6, 8), np.uint16)
+            assert [index for index, _ in read] == [0, 1, 10, 11]
+        statistics = camera_zwo_asi.PixelStatistics(8, 6, raw16)
+        errors = camera_zwo_asi.ReadErrors()
+        source = camera_zwo_asi.RawSource(tmp / "raw", 8, 6, raw16)
+        assert statistics.add(source, errors=errors) == 4
+        assert errors.failed == 1
+        assert statistics.get_nb_frames() == 4
+        source = camera_zwo_asi.RawSource(tmp / "raw", 8, 6, raw16)
+        assert statistics.add(source, nb_frames=3) == 3
+
+    # errors of live sources are thrown, once the pipeline is done
+    sdk = use_sdk(
+        camera_zwo_asi.SimulatedSdk(nb_cameras=1, max_width=64, max_height=48)
+    )
+    camera = camera_zwo_asi.Camera(0)
+    camera.set_control("Exposure", 1000)
+    camera.start_video()
+    source = camera_zwo_asi.CameraSource(camera, wait_ms=500)
+    pipeline = camera_zwo_asi.Pipeline(nb_threads=2)
+    errors = camera_zwo_asi.ReadErrors()
+    disconnection = threading.Timer(0.1, sdk.disconnect, args=(0,))
+    disconnection.start()
+    with pytest.raises(RuntimeError, match="ASI_ERROR_CAMERA_REMOVED"):
+        camera_zwo_asi.replay(source, pipeline, nb_buffers=4, errors=errors)
+    disconnection.join()
+    assert errors.failed == 0
+    metrics = pipeline.get_metrics()
+    assert metrics.pushed > 0
+    assert metrics.in_flight == 0
+
+
+def test_allsky(use_sdk):
+    """
+    Check the phases follow the altitude of the sun, the timelapse
+    continues after a restart and failed frames are recorded without
+    stopping the acquisition
+    """
+    sdk = use_sdk(
+        camera_zwo_asi.SimulatedSdk(nb_cameras=1, max_width=64, max_height=48)
+    )
+    camera = camera_zwo_asi.Camera(0)
+    phases = {
+        "day": camera_zwo_asi.AllSkyPhase("day", -6.0, 0, 32, 1000, 60.0),
+        "twilight": camera_zwo_asi.AllSkyPhase("twilight", -12.0, 100, 100, 2000, 30.0),
+        "night": camera_zwo_asi.AllSkyPhase("night", -90.0, 200, 500, 5000, 30.0),
+    }
+    # 2024-03-20 00:00 UTC: at (0, 0), the sun sets at about 18:00
+    equinox = 1710892800
+    hours = [(12.0, "day"), (18.0, "day"), (18.75, "twilight"), (22.0, "night")]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        options = camera_zwo_asi.AllSkyOptions()
+        options.phases = list(phases.values())
+        options.folder = Path(tmp)
+        options.retry_s = 0.01
+        options.max_retry_s = 0.04
+        allsky = camera_zwo_asi.AllSky(camera, options)
+        for index, (hour, name) in enumerate(hours):
+            info = allsky.step_at(equinox + hour * 3600)
+            phase = phases[name]
+            assert info.phase == name
+            assert info.sun_altitude_deg >= phase.min_sun_altitude_deg
+            assert info.index == index
+            assert info.error == ""
+            assert phase.min_exposure_us <= info.exposure_us <= phase.max_exposure_us
+            assert info.gain == phase.gain
+            assert camera.get_controls()["Gain"].value == phase.gain
+            assert info.path == Path(tmp) / f"allsky_{index:06d}.pgm"
+            assert info.path.is_file()
+        assert allsky.get_nb_frames() == len(hours)
+        assert (Path(tmp) / "latest.pgm").is_file()
+
+        # a restart does not overwrite the timelapse
+        del allsky
+        allsky = camera_zwo_asi.AllSky(camera, options)
+        roi = camera.get_roi()
+        keogram = camera_zwo_asi.KeogramStage(roi.width, roi.height, roi.type)
+        startrails = camera_zwo_asi.StartrailStage(roi.width, roi.height, roi.type)
+        allsky.add_stage(keogram)
+        allsky.add_stage(startrails, phases=["twilight", "night"])
+        with pytest.raises(RuntimeError, match="no phase named dusk"):
+            allsky.add_stage(startrails, phases=["dusk"])
+        info = allsky.step_at(equinox + 23 * 3600)
+        assert info.index == len(hours)
+        assert len(list(Path(tmp).glob("allsky_*.pgm"))) == len(hours) + 1
+
+        # stages restricted to some phases
+        assert allsky.step_at(equinox + 36 * 3600).phase == "day"
+        assert keogram.get_nb_frames() == 2
+        assert startrails.get_nb_frames() == 1
+
+        # failed frames are recorded, and do not stop the acquisition
+        sdk.disconnect(0)
+        with pytest.raises(Exception):
+            allsky.step_at(equinox + 23.1 * 3600)
+        last = allsky.get_last()
+        assert last.index == -1
+        assert last.phase == "night"
+        assert last.error != ""
+        assert allsky.get_nb_errors() == 1
+        allsky.run(duration_s=0.3)
+        assert allsky.get_nb_errors() > 3
+        assert allsky.get_nb_frames() == 2
+
+        # the callback is called after each frame, and may stop run
+        received = []
+
+        def _callback(info):
+            received.append(info)
+            if len(received) == 3:
+                allsky.stop()
+
+        allsky.set_callback(_callback)
+        allsky.run()
+        assert len(received) == 3
+        assert all(info.error != "" for info in received)
+
+        # ctrl-c (KeyboardInterrupt) stops run
+        nb_errors = allsky.get_nb_errors()
+        interrupt = threading.Timer(0.2, _thread.interrupt_main)
+        interrupt.start()
+        with pytest.raises(KeyboardInterrupt):
+            allsky.run()
+        interrupt.join()
+        assert allsky.get_nb_errors() > nb_errors
+
+        # exceptions of the callback are raised by run
+        def _failing(info):
+            raise ValueError("callback failed")
+
+        allsky.set_callback(_failing)
+        with pytest.raises(ValueError, match="callback failed"):
+            allsky.run()
+
+
+def test_keogram():
+    """
+    Check the strips of the frames are averaged into columns, pairs of
+    columns merged once max_columns is reached, and the keogram resumed
+    from its checkpoint
+    """
+    raw16 = camera_zwo_asi.ImageType.raw16
+    nb_frames = 11
+    # strip of columns 3 to 5, of mean 100 * (index + 1) + y
+    frames = []
+    for index in range(nb_frames):
+        values = np.zeros((4, 8), dtype=np.uint16)
+        strip = 100 * (index + 1) + np.arange(4)
+        values[:, 3:6] = strip[:, None] + np.array([-1, 0, 1])
+        frames.append(_frame(values, 1000, index=index))
+
+    def _expected(groups):
+        columns = []
+        for group in groups:
+            sums = sum(100 * (index + 1) + np.arange(4) for index in group)
+            columns.append((sums + len(group) // 2) // len(group))
+        return np.array(columns).T
+
+    def _image(keogram):
+        image = keogram.get_image()
+        return image.get_data().view(np.uint16).reshape(4, image.width)
+
+    options = camera_zwo_asi.KeogramOptions()
+    options.strip_width = 3
+    options.max_columns = 4
+    keogram = camera_zwo_asi.KeogramStage(8, 4, raw16, options)
+    for frame in frames[:4]:
+        keogram.process(frame)
+    assert keogram.get_nb_columns() == 4
+    assert np.array_equal(_image(keogram), _expected([[0], [1], [2], [3]]))
+    # 4 columns of 1 frame, then 2 columns of 2 frames, then 2 columns
+    # of 4 frames
+    for frame in frames[4:]:
+        keogram.process(frame)
+    assert keogram.get_nb_frames() == nb_frames
+    assert keogram.get_frames_per_column() == 4
+    groups = [[0, 1, 2, 3], [4, 5, 6, 7], [8, 9, 10]]
+    assert np.array_equal(_image(keogram), _expected(groups))
+
+    # odd number of columns: the last one is kept as it is
+    options.max_columns = 3
+    keogram = camera_zwo_asi.KeogramStage(8, 4, raw16, options)
+    for frame in frames[:4]:
+        keogram.process(frame)
+    assert keogram.get_frames_per_column() == 2
+    assert np.array_equal(_image(keogram), _expected([[0, 1], [2, 3]]))
+
+    with tempfile.TemporaryDirectory() as tmp:
+        options.max_columns = 4
+        options.checkpoint = Path(tmp) / "keogram.bin"
+        options.checkpoint_interval = 5
+        keogram = camera_zwo_asi.KeogramStage(8, 4, raw16, options)
+        for frame in frames[:7]:
+            keogram.process(frame)
+        del keogram
+        # resumed from the checkpoint of the 5th frame
+        keogram = camera_zwo_asi.KeogramStage(8, 4, raw16, options)
+        assert keogram.get_nb_frames() == 5
+        for frame in frames[5:]:
+            keogram.process(frame)
+        assert np.array_equal(_image(keogram), _expected(groups))
+
+        # columns without frames are rejected
+        data = bytearray(options.checkpoint.read_bytes())
+        header_size = 5 + 8 * 8
+        data[header_size : header_size + 4] = bytes(4)
+        invalid = Path(tmp) / "invalid.bin"
+        invalid.write_bytes(bytes(data))
+        with pytest.raises(Exception):
+            keogram.load(invalid)
+        assert keogram.get_nb_frames() == nb_frames
+        options.strip_width = 1
+        with pytest.raises(Exception):
+            camera_zwo_asi.KeogramStage(8, 4, raw16, options)
+
+
+def test_startrails():
+    """
+    Check startrails are the maximum of the frames of mean in range,
+    and are resumed from their checkpoint
+    """
+    raw16 = camera_zwo_asi.ImageType.raw16
+    rng = np.random.default_rng(3)
+    valid = [
+        rng.integers(17000, 22000, size=(4, 8), dtype=np.uint16) for _ in range(4)
+    ]
+    dark = np.full((4, 8), 3000, dtype=np.uint16)
+    bright = np.full((4, 8), 60000, dtype=np.uint16)
+    sequence = [valid[0], dark, valid[1], bright, valid[2], valid[3]]
+    frames = [_frame(values, 1000, index=i) for i, values in enumerate(sequence)]
+    expected = np.max(valid, axis=0)
+
+    def _image(startrails):
+        return startrails.get_image().get_data().view(np.uint16).reshape(4, 8)
+
+    options = camera_zwo_asi.StartrailOptions()
+    options.min_mean = 0.1
+    options.max_mean = 0.5
+    startrails = camera_zwo_asi.StartrailStage(8, 4, raw16, options)
+    for frame in frames:
+        startrails.process(frame)
+    assert startrails.get_nb_frames() == 4
+    assert startrails.get_nb_skipped() == 2
+    assert np.array_equal(_image(startrails), expected)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        options.checkpoint = Path(tmp) / "startrails.bin"
+        options.checkpoint_interval = 2
+        startrails = camera_zwo_asi.StartrailStage(8, 4, raw16, options)
+        for frame in frames[:3]:
+            startrails.process(frame)
+        del startrails
+        startrails = camera_zwo_asi.StartrailStage(8, 4, raw16, options)
+        assert startrails.get_nb_frames() == 2
+        assert startrails.get_nb_skipped() == 1
+        for frame in frames[3:]:
+            startrails.process(frame)
+        assert startrails.get_nb_frames() == 4
+        assert startrails.get_nb_skipped() == 2
+        assert np.array_equal(_image(startrails), expected)
+
+
+def _draw_line(values, x0, y0, x1, y1, value):
+    """
+    adds value to the pixels of the segment (one pixel wide)
+    """
+    steps = max(abs(x1 - x0), abs(y1 - y0))
+    t = np.linspace(0.0, 1.0, steps + 1)
+    xs = np.round(x0 + t * (x1 - x0)).astype(int)
+    ys = np.round(y0 + t * (y1 - y0)).astype(int)
+    values[ys, xs] += value
+
+
+def test_meteor_detector():
+    """
+    Check a line appearing in a single frame over noise triggers an
+    event, recorded with its pre and post trigger frames
+    """
+    rng = np.random.default_rng(4)
+    nb_frames, trigger = 30, 20
+    frames = []
+    for index in range(nb_frames):
+        values = rng.normal(1000, 20, size=(64, 96))
+        if index == trigger:
+            _draw_line(values, 10, 8, 85, 55, 600)
+        frames.append(_frame(values.round(), 1000, index=index))
+
+    with tempfile.TemporaryDirectory() as tmp:
+        options = camera_zwo_asi.MeteorOptions()
+        options.binning = 2
+        # the line changes a few percents of the (binned) pixels
+        options.max_changed_fraction = 0.1
+        options.pre_trigger_frames = 5
+        options.post_trigger_frames = 4
+        options.folder = Path(tmp)
+        detector = camera_zwo_asi.MeteorDetector(
+            96, 64, camera_zwo_asi.ImageType.raw16, options
+        )
+        for frame in frames:
+            detector.process(frame)
+        detector.flush()
+
+        assert detector.get_nb_frames() == nb_frames
+        assert detector.get_nb_dropped() == 0
+        assert detector.get_last_error() == ""
+        events = detector.get_events()
+        assert len(events) == 1
+        event = events[0]
+        assert event.trigger_index == trigger
+        assert event.first_index == trigger - 5
+        assert event.last_index == trigger + 4
+        # along the line (the segments may not cover all of it)
+        assert event.segments
+        length = np.hypot(75, 47)
+        for segment in event.segments:
+            for x, y in ((segment.x0, segment.y0), (segment.x1, segment.y1)):
+                assert abs(75 * (y - 8) - 47 * (x - 10)) / length <= 3
+                assert 6 <= x <= 89
+        assert max(segment.length() for segment in event.segments) > 0.5 * length
+
+        # the frames of the event, as written
+        assert event.folder == Path(tmp) / f"meteor_{trigger}"
+        assert (event.folder / "event.txt").is_file()
+        source = camera_zwo_asi.RawSource(
+            event.folder, 96, 64, camera_zwo_asi.ImageType.raw16
+        )
+        read = _read_all(source, (64, 96), np.uint16)
+        assert [index for index, _ in read] == list(range(trigger - 5, trigger + 5))
+        for index, values in read:
+            assert np.array_equal(
+                values, frames[index].get_data().view(np.uint16).reshape(64, 96)
+            )
+
+
+def test_integrator_trails():
+    """
+    Check a satellite trail of a frame is masked, and the sums of the
+    masked values scaled to the K frames
+    """
+    rng = np.random.default_rng(5)
+    nb_frames, width, height = 6, 192, 128
+    values = rng.normal(1000, 20, size=(nb_frames, height, width)).round()
+    trail = np.zeros((height, width))
+    _draw_line(trail, 20, 20, 150, 100, 3000)
+    values[3] += trail
+
+    options = camera_zwo_asi.IntegratorOptions()
+    options.nb_frames = nb_frames
+    options.trail_sigma = 5
+    options.trail_binning = 4
+    options.trail_width = 4
+    options.trail_hough.threshold = 8
+    options.trail_hough.min_length = 8
+    integrator = camera_zwo_asi.VideoIntegrator(
+        width, height, camera_zwo_asi.ImageType.raw16, options
+    )
+    for index in range(nb_frames):
+        completed = integrator.add(_frame(values[index], 1000, index=index))
+    assert completed
+    integrated = integrator.get_frame()
+    data = integrated.get_data().reshape(height, width).astype(float)
+    assert integrated.nb_trails >= 1
+    on_trail = trail > 0
+    assert on_trail.sum() <= integrated.nb_masked < 0.1 * width * height
+
+    # the trail is not integrated: the sum of the other frames is scaled
+    others = values.sum(axis=0) - values[3]
+    assert np.all(np.abs(data[on_trail] - others[on_trail] * 6 / 5) <= 1)
+
+    # far from the trail, the sums are exact
+    total = values.sum(axis=0)
+    changed = data != total
+    assert changed.sum() <= integrated.nb_masked
+    ys, xs = np.mgrid[:height, :width]
+    t = np.clip(((xs - 20) * 130 + (ys - 20) * 80) / (130**2 + 80**2), 0, 1)
+    distance = np.hypot(xs - 20 - t * 130, ys - 20 - t * 80)
+    assert not np.any(changed & (distance > 12))
+    assert integrated.exposure_us == nb_frames * 1000
+
+    # unmasked sums above 2**24 (not exact as float) are kept exact
+    options.nb_frames = 257
+    integrator = camera_zwo_asi.VideoIntegrator(
+        32, 32, camera_zwo_asi.ImageType.raw16, options
+    )
+    saturated = np.full((32, 32), 65535)
+    for index in range(options.nb_frames):
+        completed = integrator.add(_frame(saturated, 1000, index=index))
+    assert completed
+    assert np.all(integrator.get_frame().get_data() == 257 * 65535)
+
+
+def test_trace_replay(use_sdk):
+    """
+    Check a session recorded on the simulated SDK is replayed
+    with the same frames, without the simulated SDK
+    """
+
+    def session():
+        camera = camera_zwo_asi.Camera(0)
+        camera.set_control("Exposure", 1000)
+        roi = camera.get_roi()
+        frame = camera_zwo_asi.Frame(roi.width, roi.height, roi.type)
+        camera.capture_frame(frame)
+        data = bytes(frame.get_data())
+        del camera
+        return data
+
+    with tempfile.TemporaryDirectory() as tmp:
+        path = Path(tmp) / "session.trace"
+        recorder = use_sdk(
+            camera_zwo_asi.RecordingSdk(
+                camera_zwo_asi.SimulatedSdk(
+                    nb_cameras=1, max_width=320, max_height=240
+                ),
+                path,
+                data=camera_zwo_asi.TraceData.full,
+            )
+        )
+        recorded = session()
+        recorder.flush()
+
+        replay = use_sdk(camera_zwo_asi.ReplaySdk(path, speed=0.0))
+        replayed = session()
+        assert replayed == recorded
+        assert replay.get_nb_unmatched() == 0
+        assert replay.get_nb_replayed() == recorder.get_nb_records()